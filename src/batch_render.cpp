@@ -0,0 +1,1189 @@
+#include "batch_render.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    include <winsock2.h>
+#    include <ws2tcpip.h>
+#    include <direct.h>
+#    include <process.h>
+#    define MSG_NOSIGNAL 0
+#else
+#    include <arpa/inet.h>
+#    include <netdb.h>
+#    include <netinet/in.h>
+#    include <netinet/tcp.h>
+#    include <poll.h>
+#    include <signal.h>
+#    include <spawn.h>
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/types.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+#    if !defined(MSG_NOSIGNAL)
+#        define MSG_NOSIGNAL 0
+#    endif
+extern char** environ;
+#endif
+
+#if defined(_WIN32)
+static const BatchSocket kInvalidSocket = BatchSocket(INVALID_SOCKET);
+#else
+static const BatchSocket kInvalidSocket = -1;
+#endif
+
+// How long connect() keeps retrying, in attempts of kConnectRetryMs.
+static const uint32_t kConnectAttempts = 50;
+static const uint32_t kConnectRetryMs  = 200;
+
+// Time the coordinator gets to answer HELLO.
+static const int kSetupTimeoutMs = 30000;
+
+// Granularity of the coordinator's timeouts and process checks.
+static const int kPollIntervalMs = 100;
+
+// Seconds between progress messages of the coordinator.
+static const double kProgressInterval = 5.0;
+
+// Seconds spawned workers get to exit once told that there is nothing left.
+static const double kWorkerExitTimeout = 10.0;
+
+// Larger payloads are treated as a protocol error rather than buffered.
+static const size_t kMaxPayloadSize = 1024 * 1024 * 1024;
+
+static const char* kJournalName = "journal.txt";
+static const char* kTimingsName = "timings.csv";
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool initialize_sockets()
+{
+#if defined(_WIN32)
+    struct WinsockInit
+    {
+        bool initialized = false;
+
+        WinsockInit()
+        {
+            WSADATA data;
+            initialized = WSAStartup(MAKEWORD(2, 2), &data) == 0;
+        }
+
+        ~WinsockInit()
+        {
+            if (initialized)
+                WSACleanup();
+        }
+    };
+
+    static WinsockInit init;
+
+    return init.initialized;
+#else
+    return true;
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void close_socket(BatchSocket socket)
+{
+#if defined(_WIN32)
+    closesocket(SOCKET(socket));
+#else
+    close(socket);
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static int poll_sockets(pollfd* fds, size_t count, int timeout_ms)
+{
+#if defined(_WIN32)
+    return WSAPoll(fds, ULONG(count), timeout_ms);
+#else
+    return poll(fds, nfds_t(count), timeout_ms);
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool send_all(BatchSocket socket, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        const int sent = int(::send(socket, data, int(std::min(size, size_t(1 << 20))), MSG_NOSIGNAL));
+
+        if (sent <= 0)
+            return false;
+
+        data += sent;
+        size -= size_t(sent);
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Appends whatever arrived to 'buffer'. Returns false once the connection is closed or failed.
+static bool receive_some(BatchSocket socket, std::string& buffer)
+{
+    char      data[65536];
+    const int received = int(recv(socket, data, int(sizeof(data)), 0));
+
+    if (received <= 0)
+        return false;
+
+    buffer.append(data, size_t(received));
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Returns 1 when 'socket' has data or was closed, 0 on timeout and -1 on error.
+static int wait_readable(BatchSocket socket, int timeout_ms)
+{
+    pollfd fd;
+
+    fd.fd      = socket;
+    fd.events  = POLLIN;
+    fd.revents = 0;
+
+    const int result = poll_sockets(&fd, 1, timeout_ms);
+
+    return result < 0 ? -1 : (result == 0 ? 0 : 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::vector<std::string> split_fields(const std::string& line)
+{
+    std::vector<std::string> fields;
+    std::istringstream       stream(line);
+    std::string              field;
+
+    while (stream >> field)
+        fields.push_back(field);
+
+    return fields;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double seconds_since(const std::chrono::steady_clock::time_point& start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool file_exists(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (!file)
+        return false;
+
+    fclose(file);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool read_file(const std::string& path, std::vector<uint8_t>& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (!file)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data.resize(size > 0 ? size_t(size) : 0);
+
+    const bool ok = size >= 0 && fread(data.data(), 1, data.size(), file) == data.size();
+
+    fclose(file);
+
+    return ok;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool write_file(const std::string& path, const std::string& data)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+
+    if (!file)
+        return false;
+
+    const bool ok = fwrite(data.data(), 1, data.size(), file) == data.size();
+
+    return fclose(file) == 0 && ok;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void make_directory(const std::string& path)
+{
+#if defined(_WIN32)
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Extensions come from the workers and end up in file names.
+static bool is_valid_extension(const std::string& extension)
+{
+    if (extension.empty() || extension.size() > 8)
+        return false;
+
+    for (char c : extension)
+    {
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')))
+            return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string batch_frame_name(uint32_t frame, const std::string& extension)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%06u", frame);
+
+    return std::string(name) + "." + extension;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string batch_worker_name(const std::string& renderer)
+{
+    char host[256] = "localhost";
+
+    initialize_sockets();
+    gethostname(host, sizeof(host) - 1);
+
+#if defined(_WIN32)
+    const int pid = _getpid();
+#else
+    const int pid = int(getpid());
+#endif
+
+    std::string name = renderer + "-" + host + "-" + std::to_string(pid);
+
+    // Names are a single field of the protocol.
+    std::replace(name.begin(), name.end(), ' ', '_');
+
+    return name;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BatchWorkerClient::BatchWorkerClient() :
+    m_socket(kInvalidSocket)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BatchWorkerClient::~BatchWorkerClient()
+{
+    disconnect();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::connect(const std::string& address, const std::string& name)
+{
+    disconnect();
+
+    if (!initialize_sockets())
+        return fail("Failed to initialize sockets");
+
+    const size_t colon = address.rfind(':');
+
+    if (colon == std::string::npos)
+        return fail("Expected host:port, got " + address);
+
+    const std::string host = address.substr(0, colon);
+    const std::string port = address.substr(colon + 1);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo* info = nullptr;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &info) != 0 || !info)
+        return fail("Failed to resolve " + address);
+
+    for (uint32_t attempt = 0; attempt < kConnectAttempts && m_socket == kInvalidSocket; attempt++)
+    {
+        if (attempt > 0)
+            std::this_thread::sleep_for(std::chrono::milliseconds(kConnectRetryMs));
+
+        const BatchSocket socket = BatchSocket(::socket(info->ai_family, info->ai_socktype, info->ai_protocol));
+
+        if (socket == kInvalidSocket)
+            continue;
+
+        if (::connect(socket, info->ai_addr, int(info->ai_addrlen)) == 0)
+            m_socket = socket;
+        else
+            close_socket(socket);
+    }
+
+    freeaddrinfo(info);
+
+    if (m_socket == kInvalidSocket)
+        return fail("Failed to connect to " + address);
+
+    // Lines are small and answered one at a time.
+    int no_delay = 1;
+    setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+    m_connected = true;
+    m_received.clear();
+
+    // Names are a single field of the protocol.
+    std::string worker_name = name.empty() ? "worker" : name;
+    std::replace(worker_name.begin(), worker_name.end(), ' ', '_');
+
+    const std::string hello = "HELLO " + worker_name + "\n";
+
+    if (!send_all(m_socket, hello.data(), hello.size()))
+        return fail("Failed to send HELLO");
+
+    std::string line;
+
+    if (!read_line(line, kSetupTimeoutMs))
+        return fail(m_connected ? "No setup from the coordinator" : m_error);
+
+    const std::vector<std::string> fields = split_fields(line);
+
+    if (fields.size() != 6 || fields[0] != "SETUP")
+        return fail("Unexpected message: " + line);
+
+    m_setup.width         = uint32_t(strtoul(fields[1].c_str(), nullptr, 10));
+    m_setup.height        = uint32_t(strtoul(fields[2].c_str(), nullptr, 10));
+    m_setup.fps           = float(atof(fields[3].c_str()));
+    m_setup.warmup_frames = uint32_t(strtoul(fields[4].c_str(), nullptr, 10));
+
+    std::string path;
+
+    if (!read_payload(path, size_t(strtoull(fields[5].c_str(), nullptr, 10))))
+        return fail("Failed to receive the camera path");
+
+    if (!m_setup.path.parse(path))
+        return fail("Invalid camera path");
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchWorkerClient::disconnect()
+{
+    if (m_socket != kInvalidSocket)
+        close_socket(m_socket);
+
+    m_socket    = kInvalidSocket;
+    m_connected = false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::request_job()
+{
+    static const char kReady[] = "READY\n";
+
+    if (!m_connected)
+        return false;
+
+    if (!send_all(m_socket, kReady, sizeof(kReady) - 1))
+        return fail("Failed to send READY");
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BatchMessage BatchWorkerClient::poll(BatchJob& job, int timeout_ms)
+{
+    std::string line;
+
+    if (!m_connected)
+        return BATCH_MESSAGE_ERROR;
+
+    if (!read_line(line, timeout_ms))
+        return m_connected ? BATCH_MESSAGE_NONE : BATCH_MESSAGE_ERROR;
+
+    const std::vector<std::string> fields = split_fields(line);
+
+    if (fields.size() == 3 && fields[0] == "JOB")
+    {
+        job.first_frame = uint32_t(strtoul(fields[1].c_str(), nullptr, 10));
+        job.frame_count = uint32_t(strtoul(fields[2].c_str(), nullptr, 10));
+
+        return BATCH_MESSAGE_JOB;
+    }
+
+    if (fields.size() == 1 && fields[0] == "DONE")
+        return BATCH_MESSAGE_DONE;
+
+    fail("Unexpected message: " + line);
+
+    return BATCH_MESSAGE_ERROR;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::send_frame(uint32_t frame, float cpu_ms, float gpu_ms, const std::string& extension, const std::vector<uint8_t>& data)
+{
+    if (!m_connected)
+        return false;
+
+    char header[128];
+    snprintf(header, sizeof(header), "FRAME %u %.4f %.4f %s %llu\n", frame, cpu_ms, gpu_ms, extension.c_str(), (unsigned long long)data.size());
+
+    if (!send_all(m_socket, header, strlen(header)) || !send_all(m_socket, (const char*)data.data(), data.size()))
+        return fail("Failed to send frame " + std::to_string(frame));
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::send_frame_file(uint32_t frame, float cpu_ms, float gpu_ms, const std::string& path)
+{
+    std::vector<uint8_t> data;
+
+    const size_t dot = path.rfind('.');
+
+    if (dot == std::string::npos || !read_file(path, data))
+        return fail("Failed to read " + path);
+
+    return send_frame(frame, cpu_ms, gpu_ms, path.substr(dot + 1), data);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::read_line(std::string& line, int timeout_ms)
+{
+    size_t end = m_received.find('\n');
+
+    while (end == std::string::npos)
+    {
+        const int ready = wait_readable(m_socket, timeout_ms);
+
+        if (ready == 0)
+            return false;
+
+        if (ready < 0 || !receive_some(m_socket, m_received))
+            return fail("Connection to the coordinator lost");
+
+        end = m_received.find('\n');
+    }
+
+    line = m_received.substr(0, end);
+    m_received.erase(0, end + 1);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::read_payload(std::string& payload, size_t size)
+{
+    if (size > kMaxPayloadSize)
+        return fail("Payload too large");
+
+    while (m_received.size() < size)
+    {
+        if (!receive_some(m_socket, m_received))
+            return fail("Connection to the coordinator lost");
+    }
+
+    payload = m_received.substr(0, size);
+    m_received.erase(0, size);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchWorkerClient::fail(const std::string& error)
+{
+    m_error = error;
+
+    disconnect();
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BatchCoordinator::BatchCoordinator() :
+    m_listen_socket(kInvalidSocket)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+BatchCoordinator::~BatchCoordinator()
+{
+    for (auto& connection : m_connections)
+        close_socket(connection.socket);
+
+    if (m_listen_socket != kInvalidSocket)
+        close_socket(m_listen_socket);
+
+    if (m_journal)
+        fclose(m_journal);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::start(const BatchSetup& setup, const BatchSettings& settings)
+{
+    m_setup    = setup;
+    m_settings = settings;
+
+    m_settings.job_frames = std::max(m_settings.job_frames, 1u);
+
+    const uint32_t path_frames = m_setup.path.frame_count(m_setup.fps);
+
+    if (m_settings.first_frame >= path_frames)
+    {
+        m_error = "The camera path has " + std::to_string(path_frames) + " frames, nothing to render from frame " + std::to_string(m_settings.first_frame);
+        return false;
+    }
+
+    m_frame_states.assign(std::min(m_settings.frame_count, path_frames - m_settings.first_frame), FRAME_PENDING);
+
+    make_directory(m_settings.output_dir);
+    load_journal();
+
+    m_journal = fopen((m_settings.output_dir + "/" + kJournalName).c_str(), "a");
+
+    if (!m_journal)
+    {
+        m_error = "Failed to open the journal in " + m_settings.output_dir;
+        return false;
+    }
+
+    if (!initialize_sockets())
+    {
+        m_error = "Failed to initialize sockets";
+        return false;
+    }
+
+    m_listen_socket = BatchSocket(socket(AF_INET, SOCK_STREAM, IPPROTO_TCP));
+
+    if (m_listen_socket == kInvalidSocket)
+    {
+        m_error = "Failed to create the listening socket";
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(m_listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+    // Every interface, so that workers on other machines can connect.
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(m_settings.port);
+
+    if (bind(m_listen_socket, (const sockaddr*)&address, sizeof(address)) != 0 || listen(m_listen_socket, 64) != 0)
+    {
+        m_error = "Failed to listen on port " + std::to_string(m_settings.port);
+        return false;
+    }
+
+    socklen_t address_size = sizeof(address);
+    getsockname(m_listen_socket, (sockaddr*)&address, &address_size);
+
+    m_port = ntohs(address.sin_port);
+
+    printf("Listening on port %u: %u frames, %u already rendered\n", m_port, frames_total(), m_frames_resumed);
+
+    m_spawned.resize(m_settings.spawn_workers);
+
+    for (auto& worker : m_spawned)
+    {
+        if (!spawn_worker(worker))
+            break;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::run()
+{
+    const auto start         = std::chrono::steady_clock::now();
+    auto       idle_since    = start;
+    auto       last_progress = start;
+    uint32_t   last_done     = m_frames_done;
+    bool       gave_up       = false;
+
+    while (m_frames_done < frames_total())
+    {
+        std::vector<pollfd> fds(m_connections.size() + 1);
+
+        fds[0].fd     = m_listen_socket;
+        fds[0].events = POLLIN;
+
+        for (size_t i = 0; i < m_connections.size(); i++)
+        {
+            fds[i + 1].fd     = m_connections[i].socket;
+            fds[i + 1].events = POLLIN;
+        }
+
+        poll_sockets(fds.data(), fds.size(), kPollIntervalMs);
+
+        // In reverse so that dropping a connection doesn't move the ones still to be visited.
+        for (size_t i = fds.size() - 1; i > 0; i--)
+        {
+            std::string error;
+
+            if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && !receive(m_connections[i - 1], error))
+                drop_connection(i - 1, error);
+        }
+
+        if (fds[0].revents & POLLIN)
+            accept_connections();
+
+        check_timeouts();
+        check_spawned_workers();
+        assign_jobs();
+
+        if (!m_connections.empty())
+            idle_since = std::chrono::steady_clock::now();
+        else if (m_settings.idle_timeout > 0.0f && seconds_since(idle_since) > m_settings.idle_timeout)
+        {
+            m_error = "No workers for " + std::to_string(int(m_settings.idle_timeout)) + " seconds, run again to resume";
+            gave_up = true;
+            break;
+        }
+
+        if (m_frames_done != last_done && seconds_since(last_progress) > kProgressInterval)
+        {
+            printf("%u / %u frames, %u workers\n", m_frames_done, frames_total(), uint32_t(m_connections.size()));
+
+            last_progress = std::chrono::steady_clock::now();
+            last_done     = m_frames_done;
+        }
+    }
+
+    // Workers still waiting for a job are released, the others find out when they ask for one.
+    for (auto& connection : m_connections)
+    {
+        send(connection.socket, "DONE\n");
+        close_socket(connection.socket);
+    }
+
+    m_connections.clear();
+
+    for (auto& worker : m_workers)
+        worker.connected = false;
+
+    stop_spawned_workers();
+    write_report(seconds_since(start));
+
+    return !gave_up;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::load_journal()
+{
+    FILE* file = fopen((m_settings.output_dir + "/" + kJournalName).c_str(), "r");
+
+    if (!file)
+        return;
+
+    char line[512];
+
+    while (fgets(line, sizeof(line), file))
+    {
+        uint32_t frame  = 0;
+        float    cpu_ms = 0.0f;
+        float    gpu_ms = 0.0f;
+        char     extension[16];
+
+        if (sscanf(line, "%u %f %f %15s", &frame, &cpu_ms, &gpu_ms, extension) != 4 || frame < m_settings.first_frame)
+            continue;
+
+        const uint32_t idx = frame - m_settings.first_frame;
+
+        // The journal is written after the image, but the image may have been deleted since.
+        if (idx >= frames_total() || m_frame_states[idx] == FRAME_DONE || !file_exists(m_settings.output_dir + "/" + batch_frame_name(frame, extension)))
+            continue;
+
+        m_frame_states[idx] = FRAME_DONE;
+        m_frames_done++;
+        m_frames_resumed++;
+
+        m_timings.record(frame, "cpu_ms", cpu_ms);
+
+        if (gpu_ms > 0.0f)
+            m_timings.record(frame, "gpu_ms", gpu_ms);
+    }
+
+    fclose(file);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::accept_connections()
+{
+    const BatchSocket socket = BatchSocket(accept(m_listen_socket, nullptr, nullptr));
+
+    if (socket == kInvalidSocket)
+        return;
+
+    int no_delay = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&no_delay, sizeof(no_delay));
+
+    Connection connection;
+
+    connection.socket       = socket;
+    connection.last_message = std::chrono::steady_clock::now();
+
+    m_connections.push_back(connection);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::receive(Connection& connection, std::string& error)
+{
+    if (!receive_some(connection.socket, connection.received))
+    {
+        error = "connection closed";
+        return false;
+    }
+
+    connection.last_message = std::chrono::steady_clock::now();
+
+    while (true)
+    {
+        const size_t end = connection.received.find('\n');
+
+        if (end == std::string::npos)
+            return true;
+
+        const std::vector<std::string> fields = split_fields(connection.received.substr(0, end));
+
+        if (fields.empty())
+        {
+            connection.received.erase(0, end + 1);
+            continue;
+        }
+
+        if (fields[0] == "FRAME")
+        {
+            const size_t size = fields.size() == 6 ? size_t(strtoull(fields[5].c_str(), nullptr, 10)) : 0;
+
+            if (fields.size() != 6 || size > kMaxPayloadSize)
+            {
+                error = "invalid FRAME message";
+                return false;
+            }
+
+            // Wait for the rest of the image.
+            if (connection.received.size() < end + 1 + size)
+                return true;
+
+            const std::string payload = connection.received.substr(end + 1, size);
+
+            connection.received.erase(0, end + 1 + size);
+
+            if (!receive_frame(connection, fields, payload, error))
+                return false;
+
+            continue;
+        }
+
+        connection.received.erase(0, end + 1);
+
+        if (fields[0] == "HELLO" && fields.size() == 2 && !connection.identified)
+        {
+            // A restarted worker carries on with the statistics of its previous connection.
+            size_t worker = 0;
+
+            while (worker < m_workers.size() && (m_workers[worker].name != fields[1] || m_workers[worker].connected))
+                worker++;
+
+            if (worker == m_workers.size())
+            {
+                m_workers.push_back(BatchWorkerInfo());
+                m_workers.back().name = fields[1];
+            }
+
+            m_workers[worker].connected = true;
+            connection.worker           = uint32_t(worker);
+            connection.identified       = true;
+
+            const std::string path = m_setup.path.serialize();
+
+            char setup[128];
+            snprintf(setup, sizeof(setup), "SETUP %u %u %.9g %u %llu\n", m_setup.width, m_setup.height, m_setup.fps, m_setup.warmup_frames, (unsigned long long)path.size());
+
+            if (!send(connection.socket, setup + path))
+            {
+                error = "failed to send SETUP";
+                return false;
+            }
+
+            printf("Worker %s connected\n", fields[1].c_str());
+        }
+        else if (fields[0] == "READY" && connection.identified)
+            connection.waiting = true;
+        else
+        {
+            error = "unexpected message " + fields[0];
+            return false;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::receive_frame(Connection& connection, const std::vector<std::string>& fields, const std::string& payload, std::string& error)
+{
+    const uint32_t    frame     = uint32_t(strtoul(fields[1].c_str(), nullptr, 10));
+    const float       cpu_ms    = float(atof(fields[2].c_str()));
+    const float       gpu_ms    = float(atof(fields[3].c_str()));
+    const std::string extension = fields[4];
+
+    auto assigned = std::find(connection.frames.begin(), connection.frames.end(), frame);
+
+    if (assigned == connection.frames.end() || !is_valid_extension(extension))
+    {
+        error = "unexpected frame " + fields[1];
+        return false;
+    }
+
+    connection.frames.erase(assigned);
+
+    // Written under a temporary name first, so that a crash never leaves a truncated frame behind a journal
+    // entry.
+    const std::string path      = m_settings.output_dir + "/" + batch_frame_name(frame, extension);
+    const std::string temp_path = path + ".tmp";
+
+    remove(path.c_str());
+
+    if (!write_file(temp_path, payload) || rename(temp_path.c_str(), path.c_str()) != 0)
+    {
+        // Nothing the worker did wrong, give the frame to the next job.
+        printf("Failed to write %s\n", path.c_str());
+        m_frame_states[frame - m_settings.first_frame] = FRAME_PENDING;
+        return true;
+    }
+
+    const BatchWorkerInfo& worker = m_workers[connection.worker];
+
+    fprintf(m_journal, "%u %.4f %.4f %s %s\n", frame, cpu_ms, gpu_ms, extension.c_str(), worker.name.c_str());
+    fflush(m_journal);
+
+    m_frame_states[frame - m_settings.first_frame] = FRAME_DONE;
+    m_frames_done++;
+    m_workers[connection.worker].frames++;
+
+    m_timings.record(frame, "cpu_ms", cpu_ms);
+
+    if (gpu_ms > 0.0f)
+        m_timings.record(frame, "gpu_ms", gpu_ms);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::assign_jobs()
+{
+    for (auto& connection : m_connections)
+    {
+        BatchJob job;
+
+        if (!connection.waiting || !next_job(connection, job))
+            continue;
+
+        for (uint32_t i = 0; i < job.frame_count; i++)
+        {
+            m_frame_states[job.first_frame - m_settings.first_frame + i] = FRAME_ASSIGNED;
+            connection.frames.push_back(job.first_frame + i);
+        }
+
+        connection.waiting      = false;
+        connection.next_frame   = job.first_frame + job.frame_count;
+        connection.last_message = std::chrono::steady_clock::now();
+
+        m_workers[connection.worker].jobs++;
+
+        send(connection.socket, "JOB " + std::to_string(job.first_frame) + " " + std::to_string(job.frame_count) + "\n");
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::next_job(const Connection& connection, BatchJob& job) const
+{
+    const uint32_t count = frames_total();
+    uint32_t       start = UINT32_MAX;
+
+    // Continue the worker's last job if nobody took the frames after it.
+    if (connection.next_frame != UINT32_MAX)
+    {
+        const uint32_t idx = connection.next_frame - m_settings.first_frame;
+
+        if (idx < count && m_frame_states[idx] == FRAME_PENDING)
+            start = idx;
+    }
+
+    if (start == UINT32_MAX)
+    {
+        uint32_t run_start  = 0;
+        uint32_t run_length = 0;
+
+        for (uint32_t i = 0; i < count;)
+        {
+            if (m_frame_states[i] != FRAME_PENDING)
+            {
+                i++;
+                continue;
+            }
+
+            uint32_t length = 0;
+
+            while (i + length < count && m_frame_states[i + length] == FRAME_PENDING)
+                length++;
+
+            if (length > run_length)
+            {
+                run_start  = i;
+                run_length = length;
+            }
+
+            i += length;
+        }
+
+        if (run_length == 0)
+            return false;
+
+        start = run_start;
+
+        // Whoever has the frames before the run will carry on into it, so take its second half. Splitting the
+        // longest run every time keeps the stretches each worker renders without interruption long.
+        if (run_start > 0 && m_frame_states[run_start - 1] == FRAME_ASSIGNED && run_length >= 2 * m_settings.job_frames)
+            start = run_start + run_length / 2;
+    }
+
+    uint32_t length = 0;
+
+    while (start + length < count && length < m_settings.job_frames && m_frame_states[start + length] == FRAME_PENDING)
+        length++;
+
+    job.first_frame = m_settings.first_frame + start;
+    job.frame_count = length;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::drop_connection(size_t idx, const std::string& reason)
+{
+    Connection& connection = m_connections[idx];
+
+    for (uint32_t frame : connection.frames)
+        m_frame_states[frame - m_settings.first_frame] = FRAME_PENDING;
+
+    if (connection.identified)
+    {
+        BatchWorkerInfo& worker = m_workers[connection.worker];
+
+        worker.connected = false;
+
+        if (!connection.frames.empty())
+            worker.lost_jobs++;
+
+        printf("Worker %s lost (%s), %u frames back in the queue\n", worker.name.c_str(), reason.c_str(), uint32_t(connection.frames.size()));
+    }
+
+    close_socket(connection.socket);
+
+    m_connections.erase(m_connections.begin() + idx);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::check_timeouts()
+{
+    for (size_t i = m_connections.size(); i-- > 0;)
+    {
+        const Connection& connection = m_connections[i];
+
+        // Workers without a job are allowed to wait for one indefinitely.
+        const bool busy = !connection.frames.empty() || !connection.identified;
+
+        if (busy && seconds_since(connection.last_message) > m_settings.worker_timeout)
+            drop_connection(i, "timed out");
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::check_spawned_workers()
+{
+#if !defined(_WIN32)
+    for (auto& worker : m_spawned)
+    {
+        int status = 0;
+
+        if (!worker.running || waitpid(pid_t(worker.process), &status, WNOHANG) != pid_t(worker.process))
+            continue;
+
+        worker.running = false;
+
+        if (m_frames_done == frames_total())
+            continue;
+
+        if (WIFSIGNALED(status))
+            printf("Worker process %lld killed by signal %d\n", (long long)worker.process, WTERMSIG(status));
+        else
+            printf("Worker process %lld exited with code %d\n", (long long)worker.process, WEXITSTATUS(status));
+
+        if (worker.restarts < m_settings.max_restarts)
+        {
+            worker.restarts++;
+            spawn_worker(worker);
+        }
+    }
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::spawn_worker(SpawnedWorker& worker)
+{
+#if defined(_WIN32)
+    (void)worker;
+    printf("Spawning workers is not supported on this platform, start them with --batch-worker <host>:%u\n", m_port);
+    return false;
+#else
+    std::vector<std::string> args;
+
+    args.push_back(m_settings.worker_command);
+    args.insert(args.end(), m_settings.worker_args.begin(), m_settings.worker_args.end());
+    args.push_back("--batch-worker");
+    args.push_back("127.0.0.1:" + std::to_string(m_port));
+
+    std::vector<char*> argv;
+
+    for (auto& arg : args)
+        argv.push_back(&arg[0]);
+
+    argv.push_back(nullptr);
+
+    pid_t pid = 0;
+
+    if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+    {
+        printf("Failed to start worker %s\n", m_settings.worker_command.c_str());
+        return false;
+    }
+
+    worker.process = int64_t(pid);
+    worker.running = true;
+
+    return true;
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::stop_spawned_workers()
+{
+#if !defined(_WIN32)
+    const auto start = std::chrono::steady_clock::now();
+
+    for (auto& worker : m_spawned)
+    {
+        int status = 0;
+
+        // Workers that were between jobs exit on DONE, the others when they find the connection closed.
+        while (worker.running && waitpid(pid_t(worker.process), &status, WNOHANG) == 0)
+        {
+            if (seconds_since(start) > kWorkerExitTimeout)
+            {
+                kill(pid_t(worker.process), SIGTERM);
+                waitpid(pid_t(worker.process), &status, 0);
+                break;
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(kPollIntervalMs));
+        }
+
+        worker.running = false;
+    }
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BatchCoordinator::write_report(double elapsed_s)
+{
+    const std::string timings_path = m_settings.output_dir + "/" + kTimingsName;
+
+    if (!m_timings.write_csv(timings_path))
+        printf("Failed to write %s\n", timings_path.c_str());
+
+    const uint32_t rendered = m_frames_done - m_frames_resumed;
+
+    printf("Rendered %u frames in %.1f s (%.2f frames/s), %u of %u done\n", rendered, elapsed_s, elapsed_s > 0.0 ? double(rendered) / elapsed_s : 0.0, m_frames_done, frames_total());
+
+    for (const auto& worker : m_workers)
+        printf("  %s: %u frames in %u jobs, %u jobs lost\n", worker.name.c_str(), worker.frames, worker.jobs, worker.lost_jobs);
+
+    const TimingStatistics cpu = compute_timing_statistics(m_timings.column_values("cpu_ms"));
+    const TimingStatistics gpu = compute_timing_statistics(m_timings.column_values("gpu_ms"));
+
+    printf("  CPU per frame: %.3f ms mean, %.3f ms p95\n", cpu.mean, cpu.p95);
+
+    if (gpu.count > 0)
+        printf("  GPU per frame: %.3f ms mean, %.3f ms p95\n", gpu.mean, gpu.p95);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BatchCoordinator::send(BatchSocket socket, const std::string& data)
+{
+    return send_all(socket, data.data(), data.size());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,205 @@
+#pragma once
+
+#include "camera_path.h"
+#include "timing_report.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// Distributed rendering of camera paths. A coordinator hands out runs of consecutive frames to worker processes
+// over TCP, and the workers send back every frame as an encoded image along with its timings. Workers pull a new
+// job whenever they run out, so faster machines simply take more of them, and a worker is given the frames that
+// continue its last job whenever they are still free so that temporal effects carry over without a warmup.
+//
+// Protocol: text lines, where the last field of SETUP and FRAME is the size of a payload following the line.
+//   Worker:      HELLO <name>
+//   Coordinator: SETUP <width> <height> <fps> <warmup frames> <size>     payload: camera path text
+//   Worker:      READY                                                   wants another job
+//   Coordinator: JOB <first frame> <frame count>                         or DONE once every frame is rendered
+//   Worker:      FRAME <frame> <cpu ms> <gpu ms> <extension> <size>      payload: encoded image
+//
+// A worker may send READY before it sent the frames of its current job, so that its next job arrives before it
+// runs out of work. The coordinator only answers once it has a job: while the last frames are rendered elsewhere
+// an idle worker waits, since they come back to the queue if their worker is lost.
+
+#if defined(_WIN32)
+typedef uintptr_t BatchSocket;
+#else
+typedef int BatchSocket;
+#endif
+
+struct BatchSetup
+{
+    uint32_t   width         = 1920;
+    uint32_t   height        = 1080;
+    float      fps           = 30.0f;
+    uint32_t   warmup_frames = 8; // Rendered, but not sent, before a job that doesn't continue the previous one.
+    CameraPath path;
+};
+
+struct BatchJob
+{
+    uint32_t first_frame = 0;
+    uint32_t frame_count = 0;
+};
+
+enum BatchMessage
+{
+    BATCH_MESSAGE_NONE, // Nothing arrived before the timeout.
+    BATCH_MESSAGE_JOB,
+    BATCH_MESSAGE_DONE,
+    BATCH_MESSAGE_ERROR // Connection lost or protocol error, the worker should exit.
+};
+
+// Worker side of the protocol. Blocking, meant to be driven from a single thread.
+class BatchWorkerClient
+{
+public:
+    BatchWorkerClient();
+    ~BatchWorkerClient();
+
+    // Connects to "host:port" and waits for the setup. Retries for a while, so that workers may be started
+    // before the coordinator.
+    bool connect(const std::string& address, const std::string& name);
+    void disconnect();
+
+    // Asks for the next job, whose answer is picked up by poll().
+    bool request_job();
+
+    // Waits up to 'timeout_ms' for the answer to request_job(), -1 waits forever.
+    BatchMessage poll(BatchJob& job, int timeout_ms);
+
+    bool send_frame(uint32_t frame, float cpu_ms, float gpu_ms, const std::string& extension, const std::vector<uint8_t>& data);
+
+    // Sends the contents of an encoded image file, whose extension is taken from its path.
+    bool send_frame_file(uint32_t frame, float cpu_ms, float gpu_ms, const std::string& path);
+
+    inline bool               is_connected() const { return m_connected; }
+    inline const BatchSetup&  setup() const { return m_setup; }
+    inline const std::string& error() const { return m_error; }
+
+private:
+    bool read_line(std::string& line, int timeout_ms);
+    bool read_payload(std::string& payload, size_t size);
+    bool fail(const std::string& error);
+
+private:
+    BatchSocket m_socket;
+    bool        m_connected = false;
+    std::string m_received; // Bytes read past the last line or payload.
+    BatchSetup  m_setup;
+    std::string m_error;
+};
+
+struct BatchSettings
+{
+    std::string              output_dir     = "batch";
+    uint16_t                 port           = 0;          // 0 picks any free port.
+    uint32_t                 first_frame    = 0;
+    uint32_t                 frame_count    = UINT32_MAX; // Clamped to the end of the path.
+    uint32_t                 job_frames     = 8;
+    float                    worker_timeout = 120.0f; // Seconds a worker with a job may stay silent before it's dropped.
+    float                    idle_timeout   = 60.0f;  // Seconds without any worker before giving up, 0 waits forever.
+    uint32_t                 spawn_workers  = 0;      // Local workers started, and restarted, by the coordinator.
+    uint32_t                 max_restarts   = 3;      // Per spawned worker.
+    std::string              worker_command;          // Executable of spawned workers, given "--batch-worker 127.0.0.1:<port>".
+    std::vector<std::string> worker_args;
+};
+
+struct BatchWorkerInfo
+{
+    std::string name;
+    uint32_t    frames    = 0;
+    uint32_t    jobs      = 0;
+    uint32_t    lost_jobs = 0; // Frames of these went back to the queue.
+    bool        connected = false;
+};
+
+// Coordinator side. Frames already in the output directory's journal are skipped, so an interrupted run is
+// resumed by starting the coordinator again with the same settings.
+class BatchCoordinator
+{
+public:
+    BatchCoordinator();
+    ~BatchCoordinator();
+
+    // Loads the journal, starts listening and spawns the local workers.
+    bool start(const BatchSetup& setup, const BatchSettings& settings);
+
+    // Serves workers until every frame is in the output directory, then writes the timings. Returns false if it
+    // gave up waiting for workers, in which case starting again resumes where it stopped.
+    bool run();
+
+    inline uint16_t                            port() const { return m_port; }
+    inline uint32_t                            frames_total() const { return uint32_t(m_frame_states.size()); }
+    inline uint32_t                            frames_done() const { return m_frames_done; }
+    inline uint32_t                            frames_resumed() const { return m_frames_resumed; }
+    inline const std::vector<BatchWorkerInfo>& workers() const { return m_workers; }
+    inline const FrameTimingLog&               timings() const { return m_timings; }
+    inline const std::string&                  error() const { return m_error; }
+
+private:
+    enum FrameState
+    {
+        FRAME_PENDING,
+        FRAME_ASSIGNED,
+        FRAME_DONE
+    };
+
+    struct Connection
+    {
+        BatchSocket                           socket;
+        uint32_t                              worker     = 0; // Index into m_workers once HELLO arrived.
+        bool                                  identified = false;
+        bool                                  waiting    = false; // Sent READY, not answered yet.
+        std::string                           received;
+        std::vector<uint32_t>                 frames;                  // Assigned and not received yet.
+        uint32_t                              next_frame = UINT32_MAX; // Frame after its last job.
+        std::chrono::steady_clock::time_point last_message;
+    };
+
+    struct SpawnedWorker
+    {
+        int64_t  process  = 0;
+        uint32_t restarts = 0;
+        bool     running  = false;
+    };
+
+    void load_journal();
+    void accept_connections();
+    bool receive(Connection& connection, std::string& error);
+    bool receive_frame(Connection& connection, const std::vector<std::string>& fields, const std::string& payload, std::string& error);
+    void assign_jobs();
+    bool next_job(const Connection& connection, BatchJob& job) const;
+    void drop_connection(size_t idx, const std::string& reason);
+    void check_timeouts();
+    void check_spawned_workers();
+    bool spawn_worker(SpawnedWorker& worker);
+    void stop_spawned_workers();
+    void write_report(double elapsed_s);
+    bool send(BatchSocket socket, const std::string& data);
+
+private:
+    BatchSetup                   m_setup;
+    BatchSettings                m_settings;
+    BatchSocket                  m_listen_socket;
+    uint16_t                     m_port = 0;
+    std::vector<Connection>      m_connections;
+    std::vector<BatchWorkerInfo> m_workers;
+    std::vector<SpawnedWorker>   m_spawned;
+    std::vector<uint8_t>         m_frame_states; // FrameState of every frame, from the first one of the settings.
+    FrameTimingLog               m_timings;
+    FILE*                        m_journal        = nullptr;
+    uint32_t                     m_frames_done    = 0;
+    uint32_t                     m_frames_resumed = 0;
+    std::string                  m_error;
+};
+
+// File name of a frame in the output directory.
+std::string batch_frame_name(uint32_t frame, const std::string& extension);
+
+// "<renderer>-<host>-<process id>", unique across the machines of a farm.
+std::string batch_worker_name(const std::string& renderer);
@@ -0,0 +1,366 @@
+#include "batch_render.h"
+#include "cpu_frame_renderer.h"
+#include "frame_capture.h"
+#include "thread_pool.h"
+
+#if defined(HYBRID_RENDERING_BATCH_ASSIMP)
+#    include <assimp/scene.h>
+#    include <assimp/Importer.hpp>
+#    include <assimp/postprocess.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Coordinator and CPU worker of the distributed batch renderer, see batch_render.h. GPU workers are instances
+// of HybridRendering started with --batch-worker.
+//
+// Coordinator: BatchRender --coordinator (--path FILE | --turntable CX CY CZ RADIUS HEIGHT SECONDS)
+//                          [--fps N] [--size WIDTH HEIGHT] [--first N] [--frames N] [--job-frames N] [--warmup N]
+//                          [--output DIR] [--port N] [--worker-timeout SECONDS] [--idle-timeout SECONDS]
+//                          [--spawn N] [--max-restarts N] [--worker-command EXE] [-- WORKER ARGUMENTS...]
+//
+// Worker:      BatchRender --batch-worker HOST:PORT [--scene synthetic|FILE] [--threads N] [--name NAME]
+//                          [--exit-after N]
+//
+// Spawned workers run this executable as a CPU worker unless --worker-command names another one, and get
+// everything after "--" followed by --batch-worker. Running the coordinator again with the same output directory
+// resumes an interrupted run, and --exit-after makes a worker die mid-job to exercise the recovery.
+
+// Scene of the renderer, relative to the working directory.
+static const char* kSceneMeshPath = "mesh/sponza.obj";
+
+// Synthetic scene: a floor with a grid of boxes, about the size of Sponza.
+static const uint32_t kSyntheticGridSize = 12;
+static const float    kSyntheticSpacing  = 200.0f;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float next_random(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / 16777216.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void add_box(CpuScene& scene, const glm::vec3& min_extents, const glm::vec3& max_extents, const glm::vec3& albedo)
+{
+    static const uint32_t kFaces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+
+    const uint32_t base = uint32_t(scene.positions.size());
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        scene.positions.push_back(glm::vec3(i & 1 ? max_extents.x : min_extents.x,
+                                            i & 2 ? max_extents.y : min_extents.y,
+                                            i & 4 ? max_extents.z : min_extents.z));
+    }
+
+    for (uint32_t i = 0; i < 36; i++)
+        scene.indices.push_back(base + kFaces[i]);
+
+    for (uint32_t i = 0; i < 12; i++)
+        scene.albedo.push_back(albedo);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static CpuScene synthetic_scene()
+{
+    CpuScene scene;
+    uint32_t seed = 1337;
+
+    const float half = kSyntheticSpacing * float(kSyntheticGridSize) * 0.5f;
+
+    add_box(scene, glm::vec3(-half, -10.0f, -half), glm::vec3(half, 0.0f, half), glm::vec3(0.6f));
+
+    for (uint32_t z = 0; z < kSyntheticGridSize; z++)
+    {
+        for (uint32_t x = 0; x < kSyntheticGridSize; x++)
+        {
+            const glm::vec3 corner = glm::vec3(float(x) * kSyntheticSpacing - half + 50.0f, 0.0f, float(z) * kSyntheticSpacing - half + 50.0f);
+            const glm::vec3 size   = glm::vec3(40.0f + 60.0f * next_random(seed), 20.0f + 300.0f * next_random(seed), 40.0f + 60.0f * next_random(seed));
+            const glm::vec3 albedo = glm::vec3(0.2f + 0.6f * next_random(seed), 0.2f + 0.6f * next_random(seed), 0.2f + 0.6f * next_random(seed));
+
+            add_box(scene, corner, corner + size, albedo);
+        }
+    }
+
+    return scene;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(HYBRID_RENDERING_BATCH_ASSIMP)
+
+static bool import_scene(const std::string& path, CpuScene& scene)
+{
+    Assimp::Importer importer;
+
+    const aiScene* imported = importer.ReadFile(path, aiProcess_Triangulate);
+
+    if (!imported)
+        return false;
+
+    for (uint32_t i = 0; i < imported->mNumMeshes; i++)
+    {
+        const aiMesh*  mesh = imported->mMeshes[i];
+        const uint32_t base = uint32_t(scene.positions.size());
+
+        aiColor4D diffuse(0.7f, 0.7f, 0.7f, 1.0f);
+
+        if (mesh->mMaterialIndex < imported->mNumMaterials)
+            aiGetMaterialColor(imported->mMaterials[mesh->mMaterialIndex], AI_MATKEY_COLOR_DIFFUSE, &diffuse);
+
+        for (uint32_t j = 0; j < mesh->mNumVertices; j++)
+            scene.positions.push_back(glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z));
+
+        for (uint32_t j = 0; j < mesh->mNumFaces; j++)
+        {
+            if (mesh->mFaces[j].mNumIndices != 3)
+                continue;
+
+            for (uint32_t k = 0; k < 3; k++)
+                scene.indices.push_back(base + mesh->mFaces[j].mIndices[k]);
+
+            scene.albedo.push_back(glm::vec3(diffuse.r, diffuse.g, diffuse.b));
+        }
+    }
+
+    return true;
+}
+
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static int run_worker(int argc, char* argv[])
+{
+    std::string address;
+    std::string scene_path = kSceneMeshPath;
+    std::string name       = batch_worker_name("cpu");
+    uint32_t    threads    = 0;
+    uint32_t    exit_after = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--batch-worker") == 0 && i + 1 < argc)
+            address = argv[++i];
+        else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+            scene_path = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+            name = argv[++i];
+        else if (strcmp(argv[i], "--exit-after") == 0 && i + 1 < argc)
+            exit_after = uint32_t(atoi(argv[++i]));
+    }
+
+    CpuScene scene;
+
+#if defined(HYBRID_RENDERING_BATCH_ASSIMP)
+    if (scene_path != "synthetic" && !import_scene(scene_path, scene))
+    {
+        fprintf(stderr, "%s: failed to import %s\n", name.c_str(), scene_path.c_str());
+        return 1;
+    }
+#endif
+
+    if (scene.indices.empty())
+        scene = synthetic_scene();
+
+    ThreadPool       pool(threads);
+    CpuFrameRenderer renderer(&pool);
+
+    renderer.set_scene(scene);
+
+    BatchWorkerClient client;
+
+    if (!client.connect(address, name))
+    {
+        fprintf(stderr, "%s: %s\n", name.c_str(), client.error().c_str());
+        return 1;
+    }
+
+    const BatchSetup& setup = client.setup();
+
+    CpuRenderSettings settings;
+
+    settings.width  = setup.width;
+    settings.height = setup.height;
+
+    // write_png() only writes files, so every frame goes through a scratch file.
+    const std::string scratch_path = name + "_scratch.png";
+
+    std::vector<uint8_t> pixels;
+    uint32_t             rendered = 0;
+
+    client.request_job();
+
+    while (true)
+    {
+        BatchJob job;
+
+        const BatchMessage message = client.poll(job, -1);
+
+        if (message == BATCH_MESSAGE_DONE)
+            break;
+
+        if (message != BATCH_MESSAGE_JOB)
+        {
+            fprintf(stderr, "%s: %s\n", name.c_str(), client.error().c_str());
+            return 1;
+        }
+
+        for (uint32_t i = 0; i < job.frame_count; i++)
+        {
+            const uint32_t frame = job.first_frame + i;
+
+            // The next job is on its way while the last frame renders.
+            if (i + 1 == job.frame_count && !client.request_job())
+                break;
+
+            const Clock::time_point start = Clock::now();
+
+            renderer.render(setup.path.evaluate(float(frame) / setup.fps), settings, pixels);
+
+            if (write_png(scratch_path, settings.width, settings.height, 4, pixels.data(), false) == 0)
+            {
+                fprintf(stderr, "%s: failed to write %s\n", name.c_str(), scratch_path.c_str());
+                return 1;
+            }
+
+            const float cpu_ms = std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+
+            if (!client.send_frame_file(frame, cpu_ms, 0.0f, scratch_path))
+                break;
+
+            if (exit_after > 0 && ++rendered == exit_after)
+            {
+                fprintf(stderr, "%s: exiting after %u frames as requested\n", name.c_str(), rendered);
+                _Exit(3);
+            }
+        }
+    }
+
+    remove(scratch_path.c_str());
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static int run_coordinator(int argc, char* argv[])
+{
+    BatchSetup    setup;
+    BatchSettings settings;
+    bool          has_path = false;
+
+    settings.worker_command = argv[0];
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--path") == 0 && i + 1 < argc)
+        {
+            if (!setup.path.load(argv[++i]))
+            {
+                fprintf(stderr, "Failed to load camera path %s\n", argv[i]);
+                return 1;
+            }
+
+            has_path = true;
+        }
+        else if (strcmp(argv[i], "--turntable") == 0 && i + 6 < argc)
+        {
+            const glm::vec3 centre = glm::vec3(float(atof(argv[i + 1])), float(atof(argv[i + 2])), float(atof(argv[i + 3])));
+
+            setup.path.make_turntable(centre, float(atof(argv[i + 4])), float(atof(argv[i + 5])), float(atof(argv[i + 6])));
+
+            has_path = true;
+            i += 6;
+        }
+        else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+            setup.fps = float(atof(argv[++i]));
+        else if (strcmp(argv[i], "--size") == 0 && i + 2 < argc)
+        {
+            setup.width  = uint32_t(atoi(argv[++i]));
+            setup.height = uint32_t(atoi(argv[++i]));
+        }
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            setup.warmup_frames = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--first") == 0 && i + 1 < argc)
+            settings.first_frame = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            settings.frame_count = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--job-frames") == 0 && i + 1 < argc)
+            settings.job_frames = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            settings.output_dir = argv[++i];
+        else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc)
+            settings.port = uint16_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--worker-timeout") == 0 && i + 1 < argc)
+            settings.worker_timeout = float(atof(argv[++i]));
+        else if (strcmp(argv[i], "--idle-timeout") == 0 && i + 1 < argc)
+            settings.idle_timeout = float(atof(argv[++i]));
+        else if (strcmp(argv[i], "--spawn") == 0 && i + 1 < argc)
+            settings.spawn_workers = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--max-restarts") == 0 && i + 1 < argc)
+            settings.max_restarts = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--worker-command") == 0 && i + 1 < argc)
+            settings.worker_command = argv[++i];
+        else if (strcmp(argv[i], "--") == 0)
+        {
+            settings.worker_args.assign(argv + i + 1, argv + argc);
+            break;
+        }
+    }
+
+    if (!has_path || setup.fps <= 0.0f || setup.width == 0 || setup.height == 0)
+    {
+        fprintf(stderr, "A camera path (--path or --turntable), a frame rate and an image size are required\n");
+        return 1;
+    }
+
+    BatchCoordinator coordinator;
+
+    if (!coordinator.start(setup, settings))
+    {
+        fprintf(stderr, "%s\n", coordinator.error().c_str());
+        return 1;
+    }
+
+    if (!coordinator.run())
+    {
+        fprintf(stderr, "%s\n", coordinator.error().c_str());
+        return 2;
+    }
+
+    return 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--coordinator") == 0)
+            return run_coordinator(argc, argv);
+        else if (strcmp(argv[i], "--batch-worker") == 0)
+            return run_worker(argc, argv);
+        else if (strcmp(argv[i], "--") == 0)
+            break;
+    }
+
+    fprintf(stderr, "Usage: %s --coordinator ... or %s --batch-worker HOST:PORT ..., see batch_render_tool.cpp\n", argv[0], argv[0]);
+
+    return 1;
+}
@@ -0,0 +1,154 @@
+#include "camera_path.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdio.h>
+
+// Keys of a turntable. Enough for the spline to stay within a hundredth of a percent of the circle.
+static const uint32_t kTurntableKeys = 64;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 catmull_rom(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec3& p3, float t)
+{
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+
+    return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool CameraPath::parse(const std::string& text)
+{
+    std::vector<CameraKey> keys;
+    std::istringstream     stream(text);
+    std::string            line;
+
+    while (std::getline(stream, line))
+    {
+        const size_t comment = line.find('#');
+
+        if (comment != std::string::npos)
+            line.resize(comment);
+
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+
+        CameraKey key;
+
+        if (sscanf(line.c_str(), "%f %f %f %f %f %f %f", &key.time, &key.pose.position.x, &key.pose.position.y, &key.pose.position.z, &key.pose.target.x, &key.pose.target.y, &key.pose.target.z) != 7)
+            return false;
+
+        if (!keys.empty() && key.time <= keys.back().time)
+            return false;
+
+        keys.push_back(key);
+    }
+
+    if (keys.empty())
+        return false;
+
+    m_keys = keys;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool CameraPath::load(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (!file)
+        return false;
+
+    std::string text;
+    char        buffer[4096];
+    size_t      read = 0;
+
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, read);
+
+    fclose(file);
+
+    return parse(text);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string CameraPath::serialize() const
+{
+    std::string text = "# time px py pz tx ty tz\n";
+    char        line[256];
+
+    // Round trips every float exactly, workers must evaluate the same poses as the coordinator.
+    for (const auto& key : m_keys)
+    {
+        snprintf(line, sizeof(line), "%.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", key.time, key.pose.position.x, key.pose.position.y, key.pose.position.z, key.pose.target.x, key.pose.target.y, key.pose.target.z);
+        text += line;
+    }
+
+    return text;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CameraPath::make_turntable(const glm::vec3& centre, float radius, float height, float duration)
+{
+    m_keys.resize(kTurntableKeys + 1);
+
+    for (uint32_t i = 0; i <= kTurntableKeys; i++)
+    {
+        const float angle = float(i) / float(kTurntableKeys) * 6.28318531f;
+
+        m_keys[i].time          = duration * float(i) / float(kTurntableKeys);
+        m_keys[i].pose.position = centre + glm::vec3(std::sin(angle) * radius, height, std::cos(angle) * radius);
+        m_keys[i].pose.target   = centre;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CameraPose CameraPath::evaluate(float time) const
+{
+    if (m_keys.empty())
+        return CameraPose();
+
+    if (time <= m_keys.front().time)
+        return m_keys.front().pose;
+
+    if (time >= m_keys.back().time)
+        return m_keys.back().pose;
+
+    // First key after 'time', the segment is [i - 1, i].
+    const size_t i = std::upper_bound(m_keys.begin(), m_keys.end(), time, [](float t, const CameraKey& key) { return t < key.time; }) - m_keys.begin();
+
+    const CameraKey& k0 = m_keys[i > 1 ? i - 2 : 0];
+    const CameraKey& k1 = m_keys[i - 1];
+    const CameraKey& k2 = m_keys[i];
+    const CameraKey& k3 = m_keys[std::min(i + 1, m_keys.size() - 1)];
+
+    const float t = (time - k1.time) / (k2.time - k1.time);
+
+    CameraPose pose;
+
+    pose.position = catmull_rom(k0.pose.position, k1.pose.position, k2.pose.position, k3.pose.position, t);
+    pose.target   = catmull_rom(k0.pose.target, k1.pose.target, k2.pose.target, k3.pose.target, t);
+
+    return pose;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t CameraPath::frame_count(float fps) const
+{
+    if (m_keys.empty() || fps <= 0.0f)
+        return 0;
+
+    // Tolerates the rounding of durations that are a whole number of frames.
+    return uint32_t(std::floor(duration() * fps + 1e-3f)) + 1;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
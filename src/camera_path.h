@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct CameraPose
+{
+    glm::vec3 position;
+    glm::vec3 target;
+};
+
+struct CameraKey
+{
+    float      time; // Seconds from the start of the path.
+    CameraPose pose;
+};
+
+// Camera animation for offline rendering. The pose of a frame depends on nothing but its time, so the frames of a
+// path can be rendered in any order and split between any number of processes. Positions and targets follow
+// Catmull-Rom splines through the keys.
+class CameraPath
+{
+public:
+    // One key per line: "time px py pz tx ty tz", in increasing time order. '#' starts a comment.
+    bool        parse(const std::string& text);
+    bool        load(const std::string& path);
+    std::string serialize() const;
+
+    // A full turn around 'centre' in 'duration' seconds, 'height' above it and always looking at it.
+    void make_turntable(const glm::vec3& centre, float radius, float height, float duration);
+
+    CameraPose evaluate(float time) const;
+
+    // Frames at 'fps' from time zero up to and including the last key.
+    uint32_t frame_count(float fps) const;
+
+    inline bool                          empty() const { return m_keys.empty(); }
+    inline float                         duration() const { return m_keys.empty() ? 0.0f : m_keys.back().time; }
+    inline const std::vector<CameraKey>& keys() const { return m_keys; }
+
+private:
+    std::vector<CameraKey> m_keys;
+};
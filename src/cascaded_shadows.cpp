@@ -0,0 +1,141 @@
+#include "cascaded_shadows.h"
+
+#include <algorithm>
+#include <cmath>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Right handed look-at matrix, the light looks down its negative Z axis.
+static glm::mat4 look_at(const glm::vec3& eye, const glm::vec3& right, const glm::vec3& up, const glm::vec3& forward)
+{
+    glm::mat4 m(1.0f);
+
+    m[0][0] = right.x;
+    m[1][0] = right.y;
+    m[2][0] = right.z;
+    m[0][1] = up.x;
+    m[1][1] = up.y;
+    m[2][1] = up.z;
+    m[0][2] = -forward.x;
+    m[1][2] = -forward.y;
+    m[2][2] = -forward.z;
+    m[3][0] = -glm::dot(right, eye);
+    m[3][1] = -glm::dot(up, eye);
+    m[3][2] = glm::dot(forward, eye);
+
+    return m;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Orthographic projection with a [0, 1] depth range regardless of how GLM is configured.
+static glm::mat4 ortho_zero_to_one(float half_extent, float near_plane, float far_plane)
+{
+    glm::mat4 m(1.0f);
+
+    m[0][0] = 1.0f / half_extent;
+    m[1][1] = 1.0f / half_extent;
+    m[2][2] = -1.0f / (far_plane - near_plane);
+    m[3][2] = -near_plane / (far_plane - near_plane);
+
+    return m;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void compute_cascade_splits(float near_plane, float far_plane, float lambda, float* splits)
+{
+    for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+    {
+        const float p           = float(i + 1) / float(kShadowCascadeCount);
+        const float logarithmic = near_plane * std::pow(far_plane / near_plane, p);
+        const float uniform     = near_plane + (far_plane - near_plane) * p;
+
+        splits[i] = lambda * logarithmic + (1.0f - lambda) * uniform;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void fit_shadow_cascades(const glm::vec3&              camera_pos,
+                         const glm::vec3&              camera_forward,
+                         const glm::vec3&              camera_right,
+                         float                         fov_y,
+                         float                         aspect,
+                         float                         near_plane,
+                         const glm::vec3&              light_dir,
+                         const CascadedShadowSettings& settings,
+                         ShadowCascade*                cascades)
+{
+    float splits[kShadowCascadeCount];
+
+    compute_cascade_splits(near_plane, settings.shadow_distance, settings.split_lambda, splits);
+
+    const glm::vec3 camera_up   = glm::normalize(glm::cross(camera_right, camera_forward));
+    const float     tan_half_fy = std::tan(glm::radians(fov_y) * 0.5f);
+
+    // Light space basis.
+    const glm::vec3 light_forward = -light_dir;
+    const glm::vec3 reference_up  = std::abs(light_forward.y) < 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 light_right   = glm::normalize(glm::cross(light_forward, reference_up));
+    const glm::vec3 light_up      = glm::cross(light_right, light_forward);
+
+    float slice_near = near_plane;
+
+    for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+    {
+        const float slice_far = splits[i];
+
+        // Bounding sphere of the eight corners of the frustum slice.
+        glm::vec3 corners[8];
+
+        for (uint32_t j = 0; j < 2; j++)
+        {
+            const float     d      = j == 0 ? slice_near : slice_far;
+            const float     h      = d * tan_half_fy;
+            const float     w      = h * aspect;
+            const glm::vec3 centre = camera_pos + camera_forward * d;
+
+            corners[j * 4 + 0] = centre - camera_right * w - camera_up * h;
+            corners[j * 4 + 1] = centre + camera_right * w - camera_up * h;
+            corners[j * 4 + 2] = centre + camera_right * w + camera_up * h;
+            corners[j * 4 + 3] = centre - camera_right * w + camera_up * h;
+        }
+
+        glm::vec3 centre = glm::vec3(0.0f);
+
+        for (uint32_t j = 0; j < 8; j++)
+            centre += corners[j];
+
+        centre /= 8.0f;
+
+        float radius = 0.0f;
+
+        for (uint32_t j = 0; j < 8; j++)
+            radius = std::max(radius, glm::length(corners[j] - centre));
+
+        // Quantize the radius so that floating point noise doesn't change the texel size every frame.
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        const float texel_size = 2.0f * radius / float(settings.resolution);
+
+        // Move the centre in whole texel steps across the light's image plane.
+        const float x = glm::dot(centre, light_right);
+        const float y = glm::dot(centre, light_up);
+
+        centre += light_right * (std::floor(x / texel_size) * texel_size - x);
+        centre += light_up * (std::floor(y / texel_size) * texel_size - y);
+
+        const float     depth_range = 2.0f * radius + settings.caster_extension;
+        const glm::vec3 eye         = centre + light_dir * (radius + settings.caster_extension);
+
+        cascades[i].view_proj   = ortho_zero_to_one(radius, 0.0f, depth_range) * look_at(eye, light_right, light_up, light_forward);
+        cascades[i].split_far   = slice_far;
+        cascades[i].texel_size  = texel_size;
+        cascades[i].depth_range = depth_range;
+
+        slice_near = slice_far;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
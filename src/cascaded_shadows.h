@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+
+// Number of cascades of the directional light's shadow map. Must match SHADOW_CASCADE_COUNT in shadow.rgen.
+static const uint32_t kShadowCascadeCount = 4;
+
+struct CascadedShadowSettings
+{
+    uint32_t resolution       = 2048;    // Size of every cascade in texels.
+    float    split_lambda     = 0.8f;    // Blend between uniform (0) and logarithmic (1) split distances.
+    float    shadow_distance  = 2500.0f; // View space distance covered by the last cascade.
+    float    caster_extension = 2000.0f; // Extra depth towards the light so that off-screen casters are captured.
+};
+
+struct ShadowCascade
+{
+    glm::mat4 view_proj;   // World space to shadow map clip space, depth in [0, 1].
+    float     split_far;   // View space distance where this cascade ends.
+    float     texel_size;  // World space size of a shadow map texel.
+    float     depth_range; // World space distance between the near and far planes.
+};
+
+// Practical split scheme: a 'lambda' weighted mix of logarithmic and uniform split distances. Writes
+// kShadowCascadeCount far distances.
+void compute_cascade_splits(float near_plane, float far_plane, float lambda, float* splits);
+
+// Fits an orthographic projection around the bounding sphere of every cascade's slice of the view frustum.
+// Spheres keep the projection size constant while the camera rotates, and snapping the sphere centre to
+// whole texels keeps the shadow edges from shimmering while it moves. 'light_dir' points towards the light.
+void fit_shadow_cascades(const glm::vec3&              camera_pos,
+                         const glm::vec3&              camera_forward,
+                         const glm::vec3&              camera_right,
+                         float                         fov_y,
+                         float                         aspect,
+                         float                         near_plane,
+                         const glm::vec3&              light_dir,
+                         const CascadedShadowSettings& settings,
+                         ShadowCascade*                cascades);
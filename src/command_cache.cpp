@@ -0,0 +1,147 @@
+#include "command_cache.h"
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t hash_combine(uint64_t hash, uint64_t value)
+{
+    return hash_bytes(&value, sizeof(value), hash);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t hash)
+{
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SecondaryCommandCache::SecondaryCommandCache(dw::vk::Backend::Ptr backend, uint32_t variant_count) :
+    m_device(backend->device())
+{
+    VkCommandPoolCreateInfo pool_info;
+    DW_ZERO_MEMORY(pool_info);
+
+    pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+    pool_info.queueFamilyIndex = backend->queue_infos().graphics_queue_index;
+
+    if (vkCreateCommandPool(m_device, &pool_info, nullptr, &m_pool) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("Failed to create secondary command pool");
+        return;
+    }
+
+    m_variants.resize(variant_count);
+
+    std::vector<VkCommandBuffer> cmd_bufs(variant_count);
+
+    VkCommandBufferAllocateInfo alloc_info;
+    DW_ZERO_MEMORY(alloc_info);
+
+    alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool        = m_pool;
+    alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    alloc_info.commandBufferCount = variant_count;
+
+    if (vkAllocateCommandBuffers(m_device, &alloc_info, cmd_bufs.data()) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("Failed to allocate secondary command buffers");
+        return;
+    }
+
+    for (uint32_t i = 0; i < variant_count; i++)
+        m_variants[i].cmd_buf = cmd_bufs[i];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SecondaryCommandCache::~SecondaryCommandCache()
+{
+    // Freed along with the pool.
+    if (m_pool != VK_NULL_HANDLE)
+        vkDestroyCommandPool(m_device, m_pool, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VkCommandBuffer SecondaryCommandCache::find(uint32_t variant, uint64_t key)
+{
+    Variant& v = m_variants[variant];
+
+    if (!v.valid || v.key != key)
+        return VK_NULL_HANDLE;
+
+    m_stats.hits++;
+    m_stats.saved_ms += v.record_ms;
+
+    return v.cmd_buf;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VkCommandBuffer SecondaryCommandCache::begin(uint32_t variant, VkRenderPass render_pass, VkFramebuffer framebuffer)
+{
+    Variant& v = m_variants[variant];
+
+    v.valid        = false;
+    v.record_start = std::chrono::high_resolution_clock::now();
+
+    VkCommandBufferInheritanceInfo inheritance_info;
+    DW_ZERO_MEMORY(inheritance_info);
+
+    inheritance_info.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass  = render_pass;
+    inheritance_info.subpass     = 0;
+    inheritance_info.framebuffer = framebuffer;
+
+    VkCommandBufferBeginInfo begin_info;
+    DW_ZERO_MEMORY(begin_info);
+
+    // Neither one time nor simultaneous use: a variant is re-executed every time its frame slot comes around.
+    begin_info.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags            = render_pass != VK_NULL_HANDLE ? VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT : 0;
+    begin_info.pInheritanceInfo = &inheritance_info;
+
+    vkBeginCommandBuffer(v.cmd_buf, &begin_info);
+
+    return v.cmd_buf;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SecondaryCommandCache::end(uint32_t variant, uint64_t key)
+{
+    Variant& v = m_variants[variant];
+
+    vkEndCommandBuffer(v.cmd_buf);
+
+    v.key       = key;
+    v.valid     = true;
+    v.record_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - v.record_start).count();
+
+    m_stats.misses++;
+    m_stats.recorded_ms += v.record_ms;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CommandCacheStats SecondaryCommandCache::take_stats()
+{
+    CommandCacheStats stats = m_stats;
+
+    m_stats = CommandCacheStats();
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vk.h>
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+struct CommandCacheStats
+{
+    uint32_t hits        = 0;
+    uint32_t misses      = 0;
+    float    recorded_ms = 0.0f; // Spent recording the misses.
+    float    saved_ms    = 0.0f; // What recording the hits took the last time they were recorded.
+};
+
+// Secondary command buffers that are recorded once per variant and replayed until the state they were recorded
+// from changes. A variant is typically a frame-in-flight slot, so that a recording is only ever reused after the
+// fence of the frame that last executed it, and the key hashes everything else the commands depend on.
+class SecondaryCommandCache
+{
+public:
+    SecondaryCommandCache(dw::vk::Backend::Ptr backend, uint32_t variant_count);
+    ~SecondaryCommandCache();
+
+    // Returns the recording of 'variant' if it was made with the same key, VK_NULL_HANDLE otherwise.
+    VkCommandBuffer find(uint32_t variant, uint64_t key);
+
+    // Starts recording 'variant' from scratch. Commands that go inside a render pass need the render pass and
+    // framebuffer they are executed in.
+    VkCommandBuffer begin(uint32_t variant, VkRenderPass render_pass, VkFramebuffer framebuffer);
+    void            end(uint32_t variant, uint64_t key);
+
+    // Returns and resets the statistics gathered since the last call.
+    CommandCacheStats take_stats();
+
+private:
+    struct Variant
+    {
+        VkCommandBuffer                                cmd_buf   = VK_NULL_HANDLE;
+        uint64_t                                       key       = 0;
+        bool                                           valid     = false;
+        float                                          record_ms = 0.0f;
+        std::chrono::high_resolution_clock::time_point record_start;
+    };
+
+    VkDevice             m_device;
+    VkCommandPool        m_pool = VK_NULL_HANDLE;
+    std::vector<Variant> m_variants;
+    CommandCacheStats    m_stats;
+};
+
+uint64_t hash_combine(uint64_t hash, uint64_t value);
+uint64_t hash_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull);
@@ -0,0 +1,1412 @@
+#include "cascaded_shadows.h"
+#include "cpu_ray_tracer.h"
+#include "dynamic_resolution.h"
+#include "light_sampling.h"
+#include "occlusion_culling.h"
+#include "opacity_baker.h"
+#include "ray_cones.h"
+#include "ray_stats.h"
+#include "thread_pool.h"
+#include "transforms.h"
+#include "virtual_texturing.h"
+
+#if defined(HYBRID_RENDERING_BENCHMARK_ASSIMP)
+#    include <assimp/scene.h>
+#    include <assimp/Importer.hpp>
+#    include <assimp/postprocess.h>
+#endif
+
+#include <gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Benchmarks of the CPU work of a frame and of scene loading, on fixed synthetic inputs so that they run without
+// a window, a GPU or the scene's assets, and so that runs on different machines measure the same work. Results
+// are written as JSON for regression tracking: per benchmark the iteration timings, the items processed per
+// second and a checksum of the output, which changes when the work itself changes rather than its speed.
+//
+// The checks run first: CPU models compared against the values the shaders and the renderer's controllers are
+// expected to produce, and the ray counter model against counts worked out from a scene's geometry. A failed
+// check makes the run exit with 1, --checks-only skips the benchmarks.
+//
+// Usage: CpuBenchmark [--iterations N] [--warmup N] [--threads N] [--filter SUBSTRING] [--json PATH]
+//                     [--checks-only] [--timing-trace PATH]
+//
+// --timing-trace replays a trace written by the renderer's --resolution-trace through the dynamic resolution
+// controller in place of the synthetic one. Without --json the results go to stdout and the progress to stderr.
+
+// Synthetic mesh: a grid of quads per submesh.
+static const uint32_t kMeshSubmeshes = 16;
+static const uint32_t kMeshGridSize  = 64;
+
+// Synthetic interior for culling and ray tracing: boxes on a grid.
+static const uint32_t kBoxGridSize = 24;
+static const float    kBoxSpacing  = 100.0f;
+
+static const uint32_t kCullingViews  = 16;
+static const uint32_t kRayCount      = 1 << 16;
+static const uint32_t kLightCount    = 4096;
+static const uint32_t kLightSamples  = 1 << 14;
+static const uint32_t kUniformFrames = 1024;
+
+// Opacity baking: one alpha map shared by a submesh of random small triangles.
+static const uint32_t kOpacityTextureSize = 1024;
+static const uint32_t kOpacityTriangles   = 1 << 16;
+
+// Virtual texturing: a page cache too small for the textures the camera sweeps over, so that it evicts.
+static const uint32_t kVtCacheSlots = 256;
+static const uint32_t kVtFrames     = 300;
+
+// Dynamic uniform buffer offsets are aligned to this on most devices.
+static const size_t kUniformAlignment = 256;
+
+// Frames in flight of the renderer, whose uniform ring is emulated.
+static const uint32_t kFramesInFlight = 2;
+
+// Dynamic resolution: frames of the synthetic trace spent overloaded, then as many spent idle.
+static const uint32_t kResolutionPhaseFrames = 90;
+
+// Ray counters: a camera looking straight down at a floor with a quad floating above it.
+static const uint32_t kRayStatsImageSize     = 64;
+static const float    kRayStatsFloorSize     = 80.0f;
+static const float    kRayStatsBlockerMin    = 30.0f;
+static const float    kRayStatsBlockerMax    = 50.0f;
+static const float    kRayStatsBlockerHeight = 5.0f;
+static const float    kRayStatsCameraHeight  = 100.0f;
+static const float    kRayStatsFov           = 30.0f; // Degrees
+
+// Ray cones: random inputs the CPU functions and ray_cones.glsl are compared on, and the relative error allowed
+// between the float math of the one and the double math the shader compiles to here.
+static const uint32_t kRayConeCases     = 1024;
+static const float    kRayConeTolerance = 1e-4f;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+struct BenchmarkResult
+{
+    std::string         name;
+    std::vector<double> iteration_ms;
+    uint64_t            items    = 0; // Processed per iteration.
+    uint64_t            checksum = 0;
+};
+
+struct BenchmarkOptions
+{
+    uint32_t    iterations  = 10;
+    uint32_t    warmup      = 2;
+    uint32_t    threads     = 0;
+    bool        checks_only = false;
+    std::string filter;
+    std::string json_path;
+    std::string timing_trace_path;
+};
+
+// A benchmark runs its work once per call and returns a checksum of the output.
+struct Benchmark
+{
+    const char*               name;
+    uint64_t                  items;
+    std::function<uint64_t()> run;
+};
+
+// A check runs once and returns why it failed, empty when it passed.
+struct Check
+{
+    const char*                  name;
+    std::function<std::string()> run;
+};
+
+// ray_cones.glsl compiled as C++, so that the ray_cones check compares the CPU functions with the shader's code
+// rather than with another copy of it. The builtins it calls are mapped onto <cmath>.
+namespace glsl
+{
+using glm::cross;
+using glm::dot;
+using glm::length;
+using glm::mat4;
+using glm::vec2;
+using glm::vec3;
+
+inline double abs(double x) { return std::abs(x); }
+inline double atan(double x) { return std::atan(x); }
+inline double log2(double x) { return std::log2(x); }
+inline double max(double a, double b) { return std::max(a, b); }
+inline double sqrt(double x) { return std::sqrt(x); }
+
+#include "shaders/ray_cones.glsl"
+} // namespace glsl
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double elapsed_ms(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float next_random(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / 16777216.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint64_t checksum_bytes(const void* data, size_t size, uint64_t hash = 14695981039346656037ull)
+{
+    // FNV-1a
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint64_t checksum_float(uint64_t hash, float value)
+{
+    // Quantized so that the last bits of a result don't make the checksum differ between compilers.
+    const int64_t quantized = int64_t(std::floor(double(value) * 1024.0 + 0.5));
+
+    return checksum_bytes(&quantized, sizeof(quantized), hash);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(HYBRID_RENDERING_BENCHMARK_ASSIMP)
+
+// Wavefront OBJ text of a grid of quads per submesh, with texture coordinates and normals, as a content tool
+// would export it.
+static std::string generate_obj()
+{
+    std::string obj;
+
+    obj.reserve(kMeshSubmeshes * (kMeshGridSize + 1) * (kMeshGridSize + 1) * 96);
+
+    char     line[256];
+    uint32_t base = 1;
+
+    for (uint32_t s = 0; s < kMeshSubmeshes; s++)
+    {
+        snprintf(line, sizeof(line), "o submesh_%u\nusemtl material_%u\n", s, s % 4);
+        obj += line;
+
+        for (uint32_t y = 0; y <= kMeshGridSize; y++)
+        {
+            for (uint32_t x = 0; x <= kMeshGridSize; x++)
+            {
+                const float u = float(x) / float(kMeshGridSize);
+                const float v = float(y) / float(kMeshGridSize);
+
+                snprintf(line, sizeof(line), "v %.4f %.4f %.4f\nvt %.4f %.4f\nvn 0 1 0\n", float(s) * 110.0f + u * 100.0f, std::sin(u * 6.0f) * 4.0f, v * 100.0f, u * 4.0f, v * 4.0f);
+                obj += line;
+            }
+        }
+
+        for (uint32_t y = 0; y < kMeshGridSize; y++)
+        {
+            for (uint32_t x = 0; x < kMeshGridSize; x++)
+            {
+                const uint32_t i0 = base + y * (kMeshGridSize + 1) + x;
+                const uint32_t i1 = i0 + 1;
+                const uint32_t i2 = i0 + kMeshGridSize + 1;
+                const uint32_t i3 = i2 + 1;
+
+                snprintf(line, sizeof(line), "f %u/%u/%u %u/%u/%u %u/%u/%u %u/%u/%u\n", i0, i0, i0, i1, i1, i1, i3, i3, i3, i2, i2, i2);
+                obj += line;
+            }
+        }
+
+        base += (kMeshGridSize + 1) * (kMeshGridSize + 1);
+    }
+
+    return obj;
+}
+
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The same grid as generate_obj(), built directly, for vertex packing when Assimp isn't available.
+static void generate_grid_submesh(uint32_t s, std::vector<glm::vec3>& positions, std::vector<glm::vec2>& tex_coords, std::vector<glm::vec3>& normals, std::vector<uint32_t>& indices)
+{
+    for (uint32_t y = 0; y <= kMeshGridSize; y++)
+    {
+        for (uint32_t x = 0; x <= kMeshGridSize; x++)
+        {
+            const float u = float(x) / float(kMeshGridSize);
+            const float v = float(y) / float(kMeshGridSize);
+
+            positions.push_back(glm::vec3(float(s) * 110.0f + u * 100.0f, std::sin(u * 6.0f) * 4.0f, v * 100.0f));
+            tex_coords.push_back(glm::vec2(u * 4.0f, 1.0f - v * 4.0f));
+            normals.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+        }
+    }
+
+    for (uint32_t y = 0; y < kMeshGridSize; y++)
+    {
+        for (uint32_t x = 0; x < kMeshGridSize; x++)
+        {
+            const uint32_t i0 = y * (kMeshGridSize + 1) + x;
+            const uint32_t i2 = i0 + kMeshGridSize + 1;
+
+            const uint32_t quad[6] = { i0, i0 + 1, i2 + 1, i0, i2 + 1, i2 };
+
+            indices.insert(indices.end(), quad, quad + 6);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Vertex layout of the framework's vertex buffer, see Vertex in common.glsl. The submesh index goes in the
+// position's w.
+struct PackedVertex
+{
+    glm::vec4 position;
+    glm::vec4 tex_coord;
+    glm::vec4 normal;
+    glm::vec4 tangent;
+    glm::vec4 bitangent;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Packs a submesh into the vertex layout and appends its indices, with tangents accumulated per triangle from
+// the UV derivatives like the framework's loader asks Assimp to.
+static void pack_vertices(uint32_t submesh, const std::vector<glm::vec3>& positions, const std::vector<glm::vec2>& tex_coords, const std::vector<glm::vec3>& normals, const std::vector<uint32_t>& indices, std::vector<PackedVertex>& vertices, std::vector<uint32_t>& packed_indices)
+{
+    const uint32_t base_vertex = uint32_t(vertices.size());
+
+    vertices.resize(base_vertex + positions.size());
+
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        PackedVertex& vertex = vertices[base_vertex + i];
+
+        vertex.position  = glm::vec4(positions[i], float(submesh));
+        vertex.tex_coord = glm::vec4(tex_coords[i].x, tex_coords[i].y, 0.0f, 0.0f);
+        vertex.normal    = glm::vec4(normals[i], 0.0f);
+        vertex.tangent   = glm::vec4(0.0f);
+        vertex.bitangent = glm::vec4(0.0f);
+    }
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const uint32_t i0 = indices[i];
+        const uint32_t i1 = indices[i + 1];
+        const uint32_t i2 = indices[i + 2];
+
+        const glm::vec3 e1  = positions[i1] - positions[i0];
+        const glm::vec3 e2  = positions[i2] - positions[i0];
+        const glm::vec2 du1 = tex_coords[i1] - tex_coords[i0];
+        const glm::vec2 du2 = tex_coords[i2] - tex_coords[i0];
+
+        const float det = du1.x * du2.y - du2.x * du1.y;
+        const float r   = std::abs(det) > 1e-12f ? 1.0f / det : 0.0f;
+
+        const glm::vec4 tangent   = glm::vec4((e1 * du2.y - e2 * du1.y) * r, 0.0f);
+        const glm::vec4 bitangent = glm::vec4((e2 * du1.x - e1 * du2.x) * r, 0.0f);
+
+        for (uint32_t j = 0; j < 3; j++)
+        {
+            vertices[base_vertex + indices[i + j]].tangent += tangent;
+            vertices[base_vertex + indices[i + j]].bitangent += bitangent;
+        }
+    }
+
+    for (uint32_t index : indices)
+        packed_indices.push_back(base_vertex + index);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static SubmeshGeometry make_box(const glm::vec3& min_extents, const glm::vec3& max_extents)
+{
+    static const uint32_t kFaces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+
+    SubmeshGeometry box;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        box.positions.push_back(glm::vec3(i & 1 ? max_extents.x : min_extents.x,
+                                          i & 2 ? max_extents.y : min_extents.y,
+                                          i & 4 ? max_extents.z : min_extents.z));
+    }
+
+    box.indices.assign(kFaces, kFaces + 36);
+
+    box.bounds.min_extents = min_extents;
+    box.bounds.max_extents = max_extents;
+
+    return box;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A floor with a grid of boxes of random heights, every few of them a long wall that can occlude the rest.
+static void generate_boxes(std::vector<SubmeshGeometry>& submeshes, std::vector<uint32_t>& occluder_candidates)
+{
+    uint32_t seed = 1337;
+
+    const float extent = kBoxSpacing * float(kBoxGridSize);
+
+    submeshes.push_back(make_box(glm::vec3(0.0f, -10.0f, 0.0f), glm::vec3(extent, 0.0f, extent)));
+    occluder_candidates.push_back(0);
+
+    for (uint32_t z = 0; z < kBoxGridSize; z++)
+    {
+        for (uint32_t x = 0; x < kBoxGridSize; x++)
+        {
+            const glm::vec3 corner = glm::vec3(float(x) * kBoxSpacing, 0.0f, float(z) * kBoxSpacing);
+
+            if (x % 6 == 3)
+            {
+                occluder_candidates.push_back(uint32_t(submeshes.size()));
+                submeshes.push_back(make_box(corner, corner + glm::vec3(10.0f, 250.0f, kBoxSpacing)));
+            }
+            else
+            {
+                const glm::vec3 size = glm::vec3(20.0f + 40.0f * next_random(seed), 10.0f + 120.0f * next_random(seed), 20.0f + 40.0f * next_random(seed));
+
+                submeshes.push_back(make_box(corner + glm::vec3(10.0f, 0.0f, 10.0f), corner + glm::vec3(10.0f, 0.0f, 10.0f) + size));
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Camera of view 'i' of 'count', walking a circle over the boxes and turning faster than it walks.
+static void benchmark_view(uint32_t i, uint32_t count, glm::vec3& eye, glm::vec3& forward)
+{
+    const float t      = float(i) / float(count) * 6.2831853f;
+    const float centre = kBoxSpacing * float(kBoxGridSize) * 0.5f;
+
+    eye     = glm::vec3(centre + std::cos(t) * centre * 0.6f, 150.0f, centre + std::sin(t) * centre * 0.6f);
+    forward = glm::normalize(glm::vec3(std::cos(t * 3.0f), -0.2f, std::sin(t * 3.0f)));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The rules the controller's scale sequence follows whatever the timings: within the bounds, on the quantization
+// grid, at most max_scale_delta per change and no change during the cooldown after one.
+static std::string check_scale_sequence(const DynamicResolutionSettings& settings, const std::vector<float>& scales)
+{
+    char     error[256];
+    float    previous    = settings.max_scale;
+    uint32_t last_change = 0;
+    bool     changed     = false;
+
+    for (uint32_t i = 0; i < scales.size(); i++)
+    {
+        const float scale = scales[i];
+        const float steps = scale / settings.scale_step;
+
+        if (scale < settings.min_scale || scale > settings.max_scale || std::fabs(steps - std::round(steps)) > 1e-3f)
+            snprintf(error, sizeof(error), "frame %u: scale %.4f is off the grid", i, scale);
+        else if (std::fabs(scale - previous) > settings.max_scale_delta + 1e-4f)
+            snprintf(error, sizeof(error), "frame %u: scale jumped from %.4f to %.4f", i, previous, scale);
+        else if (scale != previous && changed && i - last_change <= settings.cooldown_frames)
+            snprintf(error, sizeof(error), "frame %u: scale changed %u frames after the last change", i, i - last_change);
+        else
+        {
+            if (scale != previous)
+            {
+                last_change = i;
+                changed     = true;
+            }
+
+            previous = scale;
+            continue;
+        }
+
+        return error;
+    }
+
+    return std::string();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Two triangles at 'height' covering [min_extent, max_extent] in X and Z.
+static void add_quad(float min_extent, float max_extent, float height, std::vector<glm::vec3>& positions, std::vector<uint32_t>& indices)
+{
+    const uint32_t base    = uint32_t(positions.size());
+    const uint32_t quad[6] = { 0, 2, 1, 0, 3, 2 };
+
+    positions.push_back(glm::vec3(min_extent, height, min_extent));
+    positions.push_back(glm::vec3(max_extent, height, min_extent));
+    positions.push_back(glm::vec3(max_extent, height, max_extent));
+    positions.push_back(glm::vec3(min_extent, height, max_extent));
+
+    for (uint32_t i : quad)
+        indices.push_back(base + i);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The G-Buffer of the ray counter scene, traced rather than rasterized. The left half of the image is a mirror
+// shaped like a bowl, its normals lean towards the centre so that reflections reach the blocker.
+static RayTracingFrame ray_stats_frame(const CpuRayTracer& tracer)
+{
+    RayTracingFrame frame;
+
+    frame.width      = kRayStatsImageSize;
+    frame.height     = kRayStatsImageSize;
+    frame.camera_pos = glm::vec3(kRayStatsFloorSize * 0.5f, kRayStatsCameraHeight, kRayStatsFloorSize * 0.5f);
+    frame.view       = glm::lookAt(frame.camera_pos, frame.camera_pos - glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+    frame.projection = glm::perspective(glm::radians(kRayStatsFov), 1.0f, 0.1f, 1000.0f);
+    frame.light_dir  = glm::normalize(glm::vec3(1.0f, 1.0f, 0.5f));
+    frame.frame      = 7;
+
+    const glm::mat4 inverse_view_proj = glm::inverse(frame.projection * frame.view);
+
+    for (uint32_t y = 0; y < frame.height; y++)
+    {
+        for (uint32_t x = 0; x < frame.width; x++)
+        {
+            const glm::vec2 ndc = glm::vec2((float(x) + 0.5f) / float(frame.width), (float(y) + 0.5f) / float(frame.height)) * 2.0f - 1.0f;
+            const glm::vec4 far = inverse_view_proj * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+            const glm::vec3 dir = glm::normalize(glm::vec3(far) / far.w - frame.camera_pos);
+
+            GBufferSample     sample = { glm::vec3(0.0f), glm::vec3(0.0f), 1.0f };
+            CpuRayTracer::Hit hit;
+
+            if (tracer.intersect(frame.camera_pos, dir, 0.0f, 10000.0f, hit))
+            {
+                sample.position  = frame.camera_pos + dir * hit.t;
+                sample.normal    = glm::vec3(0.0f, 1.0f, 0.0f);
+                sample.roughness = x < frame.width / 2 ? 0.0f : 0.5f;
+
+                if (sample.roughness == 0.0f)
+                    sample.normal = glm::normalize(glm::vec3(frame.camera_pos.x - sample.position.x, kRayStatsFloorSize * 0.5f, frame.camera_pos.z - sample.position.z));
+            }
+
+            frame.g_buffer.push_back(sample);
+        }
+    }
+
+    return frame;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Whether a ray from 'origin' towards 'target' crosses the blocker quad before reaching it.
+static bool crosses_blocker(const glm::vec3& origin, const glm::vec3& target)
+{
+    // Rays leaving the blocker start on its plane, within the tracer's minimum distance of it.
+    if (origin.y > kRayStatsBlockerHeight - 0.01f || target.y <= kRayStatsBlockerHeight)
+        return false;
+
+    const glm::vec3 p = origin + (target - origin) * ((kRayStatsBlockerHeight - origin.y) / (target.y - origin.y));
+
+    return p.x > kRayStatsBlockerMin && p.x < kRayStatsBlockerMax && p.z > kRayStatsBlockerMin && p.z < kRayStatsBlockerMax;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The counters the ray counter scene should produce with hard shadows, worked out from the geometry alone.
+static RayStats expected_ray_stats(const RayTracingFrame& frame)
+{
+    RayStats stats;
+
+    auto count = [](PassRayStats& pass, bool hit) {
+        pass.rays++;
+
+        if (hit)
+            pass.hits++;
+        else
+            pass.misses++;
+    };
+
+    auto reflection = [&](uint32_t x, uint32_t y) {
+        const GBufferSample& sample = frame.g_buffer[size_t(y) * frame.width + x];
+
+        if (sample.roughness == 0.0f)
+            count(stats.reflection, crosses_blocker(sample.position, sample.position + glm::reflect(glm::normalize(sample.position - frame.camera_pos), sample.normal) * kRayStatsCameraHeight));
+    };
+
+    for (uint32_t y = 0; y < frame.height; y++)
+    {
+        for (uint32_t x = 0; x < frame.width; x++)
+        {
+            const GBufferSample& sample = frame.g_buffer[size_t(y) * frame.width + x];
+
+            stats.shadow_traced_pixels++;
+
+            count(stats.shadow, crosses_blocker(sample.position + frame.light_dir * 0.1f, sample.position + frame.light_dir * kRayStatsCameraHeight));
+
+            if (!frame.ssr)
+                reflection(x, y);
+            else if (sample.roughness == 0.0f)
+                stats.ssr_pixels++;
+
+            if (!frame.reservoirs.empty())
+                count(stats.light, crosses_blocker(sample.position + sample.normal * 0.1f, glm::vec3(frame.lights[0].position_range)));
+        }
+    }
+
+    if (frame.ssr)
+    {
+        stats.ssr_hits = stats.ssr_pixels - frame.reflection_ray_list.size();
+
+        for (uint32_t pixel : frame.reflection_ray_list)
+            reflection(pixel & 0xffff, pixel >> 16);
+    }
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Pixels within 'radius' of a pixel on the other side of the hard shadow's edge, the only ones a penumbra or an
+// ambiguous shadow map lookup can reach in the ray counter scene.
+static uint64_t shadow_edge_pixels(const RayTracingFrame& frame, int32_t radius)
+{
+    const int32_t size = int32_t(kRayStatsImageSize);
+
+    auto shadowed = [&](int32_t x, int32_t y) {
+        const GBufferSample& sample = frame.g_buffer[size_t(glm::clamp(y, 0, size - 1)) * size + glm::clamp(x, 0, size - 1)];
+
+        return crosses_blocker(sample.position + frame.light_dir * 0.1f, sample.position + frame.light_dir * kRayStatsCameraHeight);
+    };
+
+    uint64_t count = 0;
+
+    for (int32_t y = 0; y < size; y++)
+    {
+        for (int32_t x = 0; x < size; x++)
+        {
+            bool edge = false;
+
+            for (int32_t dy = -radius; dy <= radius && !edge; dy++)
+            {
+                for (int32_t dx = -radius; dx <= radius && !edge; dx++)
+                    edge = shadowed(x + dx, y + dy) != shadowed(x, y);
+            }
+
+            count += edge ? 1 : 0;
+        }
+    }
+
+    return count;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 random_vec3(uint32_t& seed, float scale)
+{
+    const float x = next_random(seed);
+    const float y = next_random(seed);
+    const float z = next_random(seed);
+
+    return (glm::vec3(x, y, z) * 2.0f - 1.0f) * scale;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Returns why 'actual' isn't 'expected' within the ray cone tolerance, empty when it is.
+static std::string compare_ray_cone_value(const char* name, float expected, float actual)
+{
+    if (std::abs(actual - expected) <= kRayConeTolerance * std::max(1.0f, std::abs(expected)))
+        return std::string();
+
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer), "%s is %g, expected %g", name, actual, expected);
+
+    return buffer;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double percentile(std::vector<double> values, double p)
+{
+    if (values.empty())
+        return 0.0;
+
+    std::sort(values.begin(), values.end());
+
+    const size_t idx = std::min(values.size() - 1, size_t(p * double(values.size() - 1) + 0.5));
+
+    return values[idx];
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static BenchmarkResult run_benchmark(const Benchmark& benchmark, const BenchmarkOptions& options)
+{
+    BenchmarkResult result;
+
+    result.name  = benchmark.name;
+    result.items = benchmark.items;
+
+    for (uint32_t i = 0; i < options.warmup; i++)
+        benchmark.run();
+
+    for (uint32_t i = 0; i < options.iterations; i++)
+    {
+        const Clock::time_point start = Clock::now();
+
+        // Every iteration does the same work, so any of them gives the checksum.
+        result.checksum = benchmark.run();
+
+        result.iteration_ms.push_back(elapsed_ms(start));
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void write_json(FILE* file, const std::vector<BenchmarkResult>& results, const BenchmarkOptions& options, uint32_t thread_count)
+{
+    fprintf(file, "{\n");
+#if defined(__AVX2__)
+    fprintf(file, "  \"avx2\": true,\n");
+#else
+    fprintf(file, "  \"avx2\": false,\n");
+#endif
+    fprintf(file, "  \"threads\": %u,\n", thread_count);
+    fprintf(file, "  \"iterations\": %u,\n", options.iterations);
+    fprintf(file, "  \"warmup\": %u,\n", options.warmup);
+    fprintf(file, "  \"benchmarks\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchmarkResult& result = results[i];
+
+        double sum = 0.0;
+
+        for (double ms : result.iteration_ms)
+            sum += ms;
+
+        const double mean   = result.iteration_ms.empty() ? 0.0 : sum / double(result.iteration_ms.size());
+        const double median = percentile(result.iteration_ms, 0.5);
+
+        fprintf(file, "    { \"name\": \"%s\", \"items\": %llu, \"mean_ms\": %.4f, \"min_ms\": %.4f, \"median_ms\": %.4f, \"p95_ms\": %.4f, \"max_ms\": %.4f, \"items_per_second\": %.1f, \"checksum\": \"%016llx\" }%s\n",
+                result.name.c_str(),
+                (unsigned long long)result.items,
+                mean,
+                percentile(result.iteration_ms, 0.0),
+                median,
+                percentile(result.iteration_ms, 0.95),
+                percentile(result.iteration_ms, 1.0),
+                median > 0.0 ? double(result.items) * 1000.0 / median : 0.0,
+                (unsigned long long)result.checksum,
+                i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions options;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+            options.iterations = std::max(uint32_t(atoi(argv[++i])), 1u);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            options.warmup = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            options.threads = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            options.filter = argv[++i];
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            options.json_path = argv[++i];
+        else if (strcmp(argv[i], "--checks-only") == 0)
+            options.checks_only = true;
+        else if (strcmp(argv[i], "--timing-trace") == 0 && i + 1 < argc)
+            options.timing_trace_path = argv[++i];
+    }
+
+    ThreadPool pool(options.threads);
+
+    // ---------------------------------------------------------------------------
+    // Inputs
+    // ---------------------------------------------------------------------------
+
+#if defined(HYBRID_RENDERING_BENCHMARK_ASSIMP)
+    const std::string obj = generate_obj();
+#endif
+
+    std::vector<std::vector<glm::vec3>> grid_positions(kMeshSubmeshes);
+    std::vector<std::vector<glm::vec2>> grid_tex_coords(kMeshSubmeshes);
+    std::vector<std::vector<glm::vec3>> grid_normals(kMeshSubmeshes);
+    std::vector<std::vector<uint32_t>>  grid_indices(kMeshSubmeshes);
+
+    for (uint32_t s = 0; s < kMeshSubmeshes; s++)
+        generate_grid_submesh(s, grid_positions[s], grid_tex_coords[s], grid_normals[s], grid_indices[s]);
+
+    const uint64_t mesh_triangles = uint64_t(kMeshSubmeshes) * kMeshGridSize * kMeshGridSize * 2;
+
+    std::vector<SubmeshGeometry> submeshes;
+    std::vector<uint32_t>        occluder_candidates;
+
+    generate_boxes(submeshes, occluder_candidates);
+
+    std::vector<Aabb>      boxes;
+    std::vector<glm::vec3> scene_positions;
+    std::vector<uint32_t>  scene_indices;
+
+    for (const auto& submesh : submeshes)
+    {
+        const uint32_t base_vertex = uint32_t(scene_positions.size());
+
+        boxes.push_back(submesh.bounds);
+        scene_positions.insert(scene_positions.end(), submesh.positions.begin(), submesh.positions.end());
+
+        for (uint32_t index : submesh.indices)
+            scene_indices.push_back(base_vertex + index);
+    }
+
+    OcclusionCullingSettings culling_settings;
+
+    culling_settings.max_occluders = 256;
+
+    OcclusionCuller culler(&pool, culling_settings);
+
+    culler.set_occluders(submeshes, select_occluders(submeshes, occluder_candidates, culling_settings.max_occluders, culling_settings.max_occluder_triangles));
+
+    CpuRayTracer ray_tracer;
+
+    ray_tracer.build(scene_positions, scene_indices);
+
+    std::vector<glm::vec3> ray_origins(kRayCount);
+    std::vector<glm::vec3> ray_directions(kRayCount);
+
+    {
+        uint32_t seed = 7;
+
+        for (uint32_t i = 0; i < kRayCount; i++)
+        {
+            glm::vec3 eye;
+            glm::vec3 forward;
+
+            benchmark_view(i % kCullingViews, kCullingViews, eye, forward);
+
+            ray_origins[i]    = eye;
+            ray_directions[i] = glm::normalize(forward + glm::vec3(next_random(seed) - 0.5f, next_random(seed) - 0.5f, next_random(seed) - 0.5f) * 0.8f);
+        }
+    }
+
+    const float              light_extent = kBoxSpacing * float(kBoxGridSize);
+    const std::vector<Light> rest_lights  = generate_lights(kLightCount, glm::vec3(0.0f, 10.0f, 0.0f), glm::vec3(light_extent, 300.0f, light_extent), 1337);
+    std::vector<Light>       lights       = rest_lights;
+
+    std::vector<OpacityTexture> opacity_textures(1);
+    std::vector<OpacitySubmesh> opacity_submeshes(1);
+
+    {
+        OpacityTexture& texture = opacity_textures[0];
+
+        texture.width  = kOpacityTextureSize;
+        texture.height = kOpacityTextureSize;
+        texture.alpha.resize(size_t(kOpacityTextureSize) * kOpacityTextureSize);
+
+        // Leaves: opaque discs on a transparent background, so that every class of triangle shows up.
+        for (uint32_t y = 0; y < kOpacityTextureSize; y++)
+        {
+            for (uint32_t x = 0; x < kOpacityTextureSize; x++)
+            {
+                const float dx = float(x % 128) - 64.0f;
+                const float dy = float(y % 128) - 64.0f;
+
+                texture.alpha[y * kOpacityTextureSize + x] = dx * dx + dy * dy < 40.0f * 40.0f ? 255 : 0;
+            }
+        }
+
+        analyze_opacity_texture(texture, opacity_cutoff(0.1f));
+
+        OpacitySubmesh& submesh = opacity_submeshes[0];
+        uint32_t        seed    = 42;
+
+        submesh.texture = 0;
+
+        for (uint32_t i = 0; i < kOpacityTriangles; i++)
+        {
+            const glm::vec2 uv = glm::vec2(next_random(seed), next_random(seed));
+
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                submesh.indices.push_back(uint32_t(submesh.tex_coords.size()));
+                submesh.tex_coords.push_back(uv + glm::vec2(next_random(seed), next_random(seed)) * 0.03f);
+            }
+        }
+    }
+
+    std::vector<uint8_t> opacity(kOpacityTriangles);
+
+    std::vector<uint8_t> uniform_ring(kUniformAlignment * ((sizeof(Transforms) + kUniformAlignment - 1) / kUniformAlignment) * kFramesInFlight);
+    std::vector<uint8_t> light_ring(sizeof(Light) * kLightCount * kFramesInFlight);
+
+    // ---------------------------------------------------------------------------
+    // Benchmarks
+    // ---------------------------------------------------------------------------
+
+    std::vector<Benchmark> benchmarks;
+
+#if defined(HYBRID_RENDERING_BENCHMARK_ASSIMP)
+    benchmarks.push_back({ "mesh_import", mesh_triangles, [&]() {
+                              // The same flags as the renderer's own imports of the scene.
+                              Assimp::Importer importer;
+
+                              const aiScene* scene = importer.ReadFileFromMemory(obj.data(), obj.size(), aiProcess_Triangulate | aiProcess_FlipUVs, "obj");
+
+                              if (!scene)
+                                  return uint64_t(0);
+
+                              std::vector<PackedVertex> vertices;
+                              std::vector<uint32_t>     indices;
+
+                              for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+                              {
+                                  const aiMesh* mesh = scene->mMeshes[i];
+
+                                  std::vector<glm::vec3> positions(mesh->mNumVertices);
+                                  std::vector<glm::vec2> tex_coords(mesh->mNumVertices);
+                                  std::vector<glm::vec3> normals(mesh->mNumVertices);
+                                  std::vector<uint32_t>  submesh_indices;
+
+                                  for (uint32_t j = 0; j < mesh->mNumVertices; j++)
+                                  {
+                                      positions[j]  = glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z);
+                                      tex_coords[j] = mesh->HasTextureCoords(0) ? glm::vec2(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y) : glm::vec2(0.0f);
+                                      normals[j]    = mesh->HasNormals() ? glm::vec3(mesh->mNormals[j].x, mesh->mNormals[j].y, mesh->mNormals[j].z) : glm::vec3(0.0f);
+                                  }
+
+                                  for (uint32_t j = 0; j < mesh->mNumFaces; j++)
+                                  {
+                                      if (mesh->mFaces[j].mNumIndices == 3)
+                                          submesh_indices.insert(submesh_indices.end(), mesh->mFaces[j].mIndices, mesh->mFaces[j].mIndices + 3);
+                                  }
+
+                                  pack_vertices(i, positions, tex_coords, normals, submesh_indices, vertices, indices);
+                              }
+
+                              return checksum_bytes(indices.data(), indices.size() * sizeof(uint32_t), vertices.size());
+                          } });
+#endif
+
+    benchmarks.push_back({ "vertex_packing", mesh_triangles, [&]() {
+                              std::vector<PackedVertex> vertices;
+                              std::vector<uint32_t>     indices;
+
+                              for (uint32_t s = 0; s < kMeshSubmeshes; s++)
+                                  pack_vertices(s, grid_positions[s], grid_tex_coords[s], grid_normals[s], grid_indices[s], vertices, indices);
+
+                              uint64_t hash = checksum_bytes(indices.data(), indices.size() * sizeof(uint32_t));
+
+                              for (size_t i = 0; i < vertices.size(); i += 97)
+                                  hash = checksum_float(checksum_float(hash, vertices[i].tangent.x), vertices[i].bitangent.z);
+
+                              return hash;
+                          } });
+
+    benchmarks.push_back({ "transforms_update", kUniformFrames, [&]() {
+                              // What the simulation stage computes per frame: camera matrices and the shadow cascades.
+                              const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 10000.0f);
+                              const glm::vec3 light_dir  = glm::normalize(glm::vec3(0.2f, 0.9770f, 0.2f));
+
+                              CascadedShadowSettings settings;
+                              Transforms             transforms;
+                              uint64_t               hash = 0;
+
+                              for (uint32_t i = 0; i < kUniformFrames; i++)
+                              {
+                                  glm::vec3 eye;
+                                  glm::vec3 forward;
+
+                                  benchmark_view(i, kUniformFrames, eye, forward);
+
+                                  const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+                                  const glm::mat4 view  = glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f));
+
+                                  transforms.proj_inverse = glm::inverse(projection);
+                                  transforms.view_inverse = glm::inverse(view);
+                                  transforms.proj         = projection;
+                                  transforms.view         = view;
+                                  transforms.model        = glm::mat4(1.0f);
+                                  transforms.cam_pos      = glm::vec4(eye, 0.0f);
+                                  transforms.light_dir    = glm::vec4(light_dir, 0.0f);
+
+                                  ShadowCascade cascades[kShadowCascadeCount];
+
+                                  fit_shadow_cascades(eye, forward, right, 60.0f, 16.0f / 9.0f, 0.1f, light_dir, settings, cascades);
+
+                                  for (uint32_t j = 0; j < kShadowCascadeCount; j++)
+                                  {
+                                      transforms.cascade_view_proj[j]    = cascades[j].view_proj;
+                                      transforms.cascade_splits[j]       = cascades[j].split_far;
+                                      transforms.cascade_texel_sizes[j]  = cascades[j].texel_size;
+                                      transforms.cascade_depth_ranges[j] = cascades[j].depth_range;
+                                  }
+
+                                  hash = checksum_float(hash, transforms.cascade_view_proj[kShadowCascadeCount - 1][3][0] + transforms.view_inverse[3][2]);
+                              }
+
+                              return hash;
+                          } });
+
+    benchmarks.push_back({ "uniform_packing", kUniformFrames, [&]() {
+                              // What recording a frame writes to the mapped per-frame buffers: the animated lights and the
+                              // uniform block, each into the slot of its frame in flight.
+                              const size_t slot_size = uniform_ring.size() / kFramesInFlight;
+
+                              Transforms transforms;
+                              uint64_t   hash = 0;
+
+                              for (uint32_t i = 0; i < kUniformFrames; i++)
+                              {
+                                  const uint32_t frame_idx = i % kFramesInFlight;
+
+                                  animate_lights(rest_lights, lights, float(i) * 0.016f);
+
+                                  transforms.light_params = glm::uvec4(kLightCount, kLightCount * frame_idx, 32, 3);
+                                  transforms.csm_params   = glm::vec4(1.0f, 0.1f, 1.5f, float(i));
+
+                                  memcpy(light_ring.data() + sizeof(Light) * kLightCount * frame_idx, lights.data(), sizeof(Light) * lights.size());
+                                  memcpy(uniform_ring.data() + slot_size * frame_idx, &transforms, sizeof(Transforms));
+
+                                  hash = checksum_float(hash, lights[i % kLightCount].position_range.x);
+                              }
+
+                              return hash;
+                          } });
+
+    benchmarks.push_back({ "occlusion_culling", uint64_t(kCullingViews) * boxes.size(), [&]() {
+                              const uint32_t  width      = culler.settings().width;
+                              const uint32_t  height     = culler.settings().height;
+                              const glm::mat4 projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 1.0f, 10000.0f);
+
+                              std::vector<uint8_t> visible;
+                              uint64_t             hash = 0;
+
+                              for (uint32_t v = 0; v < kCullingViews; v++)
+                              {
+                                  glm::vec3 eye;
+                                  glm::vec3 forward;
+
+                                  benchmark_view(v, kCullingViews, eye, forward);
+
+                                  culler.render(projection * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+                                  culler.cull(boxes, visible);
+
+                                  hash = checksum_bytes(visible.data(), visible.size(), hash);
+                              }
+
+                              return hash;
+                          } });
+
+    benchmarks.push_back({ "bvh_build", scene_indices.size() / 3, [&]() {
+                              CpuRayTracer tracer;
+
+                              tracer.build(scene_positions, scene_indices);
+
+                              return uint64_t(tracer.node_count());
+                          } });
+
+    benchmarks.push_back({ "bvh_closest_hit", kRayCount, [&]() {
+                              uint64_t hash = 0;
+
+                              for (uint32_t i = 0; i < kRayCount; i++)
+                              {
+                                  CpuRayTracer::Hit hit;
+
+                                  if (ray_tracer.intersect(ray_origins[i], ray_directions[i], 0.001f, 100000.0f, hit))
+                                      hash = checksum_bytes(&hit.primitive, sizeof(hit.primitive), hash);
+                              }
+
+                              return hash;
+                          } });
+
+    benchmarks.push_back({ "bvh_any_hit", kRayCount, [&]() {
+                              uint64_t occluded = 0;
+
+                              for (uint32_t i = 0; i < kRayCount; i++)
+                                  occluded += ray_tracer.occluded(ray_origins[i], ray_directions[i], 0.001f, 500.0f);
+
+                              return occluded;
+                          } });
+
+    benchmarks.push_back({ "light_sampling_ris", kLightSamples, [&]() {
+                              // The CPU reference of the many lights pass' initial resampling, 32 candidates per pixel.
+                              uint32_t seed = 99;
+                              uint64_t hash = 0;
+
+                              for (uint32_t i = 0; i < kLightSamples; i++)
+                              {
+                                  const glm::vec3 position = glm::vec3(next_random(seed) * light_extent, 0.0f, next_random(seed) * light_extent);
+
+                                  const LightReservoir reservoir = sample_lights_ris(rest_lights, position, glm::vec3(0.0f, 1.0f, 0.0f), 32, seed);
+
+                                  hash = checksum_bytes(&reservoir.light_idx, sizeof(reservoir.light_idx), hash);
+                              }
+
+                              return hash;
+                          } });
+
+    benchmarks.push_back({ "opacity_bake", kOpacityTriangles, [&]() {
+                              const OpacityBakeStats stats = bake_triangle_opacity(&pool, opacity_submeshes, opacity_textures, opacity_cutoff(0.1f), opacity);
+
+                              return checksum_bytes(opacity.data(), opacity.size(), stats.mixed);
+                          } });
+
+    VtSimulationSettings vt_settings;
+
+    vt_settings.slots  = kVtCacheSlots;
+    vt_settings.frames = kVtFrames;
+
+    benchmarks.push_back({ "virtual_texture_feedback", uint64_t(kVtFrames) * vt_settings.feedback_width * vt_settings.feedback_height, [&]() {
+                              // The streamer's analysis and eviction loop, the checksum changes with what it makes resident.
+                              const VtSimulationStats stats = simulate_virtual_texturing(vt_settings);
+
+                              const uint64_t counters[] = { stats.exact, stats.mip_error, stats.uploads, stats.evictions, stats.refetches, stats.deferred };
+
+                              return checksum_bytes(&counters[0], sizeof(counters));
+                          } });
+
+    // ---------------------------------------------------------------------------
+    // Checks
+    // ---------------------------------------------------------------------------
+
+    std::vector<Check> checks;
+
+    checks.push_back({ "dynamic_resolution_replay", [&]() {
+                          const DynamicResolutionSettings settings;
+
+                          std::vector<GpuFrameTiming> trace;
+                          bool                        recorded = !options.timing_trace_path.empty();
+
+                          if (recorded && !load_timing_trace(options.timing_trace_path, trace))
+                              return "failed to load " + options.timing_trace_path;
+
+                          // Timings that ignore the scale, as if the scene got heavier then lighter faster than the
+                          // controller reacts: it has to walk down to the lowest scale, then back up to the highest.
+                          if (!recorded)
+                          {
+                              uint32_t seed = 5;
+
+                              for (uint32_t i = 0; i < 2 * kResolutionPhaseFrames; i++)
+                              {
+                                  GpuFrameTiming timing;
+
+                                  timing.scaled_ms = (i < kResolutionPhaseFrames ? 24.0f : 6.0f) + next_random(seed) - 0.5f;
+                                  timing.fixed_ms  = 2.0f;
+
+                                  trace.push_back(timing);
+                              }
+                          }
+
+                          DynamicResolutionController controller(settings);
+                          DynamicResolutionController replay(settings);
+
+                          const std::vector<float> scales = replay_timing_trace(controller, trace);
+
+                          if (replay_timing_trace(replay, trace) != scales)
+                              return std::string("two replays of the same trace picked different scales");
+
+                          const std::string error = check_scale_sequence(settings, scales);
+
+                          if (!error.empty() || recorded)
+                              return error;
+
+                          for (uint32_t i = 1; i < scales.size(); i++)
+                          {
+                              if (i < kResolutionPhaseFrames ? scales[i] > scales[i - 1] : scales[i] < scales[i - 1])
+                                  return "frame " + std::to_string(i) + ": scale moved against the load";
+                          }
+
+                          if (scales[kResolutionPhaseFrames - 1] != settings.min_scale || scales.back() != settings.max_scale)
+                              return std::string("the scale didn't reach its bounds");
+
+                          return std::string();
+                      } });
+
+    checks.push_back({ "ray_cones", [&]() {
+                          std::string error;
+                          uint32_t    seed = 11;
+
+                          // The shader's functions on random inputs, including concave surfaces and grazing hits.
+                          for (uint32_t i = 0; i < kRayConeCases && error.empty(); i++)
+                          {
+                              const glm::vec3 dp_dx = random_vec3(seed, 1.0f);
+                              const glm::vec3 dp_dy = random_vec3(seed, 1.0f);
+                              const glm::vec3 dn_dx = random_vec3(seed, 0.1f);
+                              const glm::vec3 dn_dy = random_vec3(seed, 0.1f);
+                              const glm::vec3 p0    = random_vec3(seed, 10.0f);
+                              const glm::vec3 p1    = random_vec3(seed, 10.0f);
+                              const glm::vec3 p2    = random_vec3(seed, 10.0f);
+                              const glm::vec2 uv0   = glm::vec2(next_random(seed), next_random(seed));
+                              const glm::vec2 uv1   = glm::vec2(next_random(seed), next_random(seed));
+                              const glm::vec2 uv2   = glm::vec2(next_random(seed), next_random(seed));
+                              const glm::vec2 size  = glm::vec2(float(64 << (i % 6)), float(64 << (i / 6 % 6)));
+                              const float     width = next_random(seed) * 0.1f;
+                              const float     t     = next_random(seed) * 100.0f;
+                              const float     cos_i = next_random(seed) * 2.0f - 1.0f;
+
+                              const float spread   = surface_spread_angle(dp_dx, dp_dy, dn_dx, dn_dy);
+                              const float constant = triangle_lod_constant(p0, p1, p2, uv0, uv1, uv2);
+
+                              error = compare_ray_cone_value("surface_spread_angle", glsl::surface_spread_angle(dp_dx, dp_dy, dn_dx, dn_dy), spread);
+
+                              if (error.empty())
+                                  error = compare_ray_cone_value("ray_cone_width", glsl::ray_cone_width(width, spread, t), ray_cone_width(width, spread, t));
+
+                              if (error.empty())
+                                  error = compare_ray_cone_value("triangle_lod_constant", glsl::triangle_lod_constant(p0, p1, p2, uv0, uv1, uv2), constant);
+
+                              if (error.empty())
+                                  error = compare_ray_cone_value("ray_cone_lod", glsl::ray_cone_lod(constant, size, width, cos_i), ray_cone_lod(constant, size, width, cos_i));
+                          }
+
+                          if (!error.empty())
+                              return error;
+
+                          // A camera 'distance' in front of a flat mirror, reflecting onto a square 'side' wide with a
+                          // 'texels' wide texture across it: the cone has to cover a texel where it lands at mip 0.
+                          const float     fov      = glm::radians(60.0f);
+                          const float     height   = 1080.0f;
+                          const float     distance = 2.0f;
+                          const float     side     = 8.0f;
+                          const float     texels   = 1024.0f;
+                          const glm::mat4 proj_inv = glm::inverse(glm::perspective(fov, 16.0f / 9.0f, 0.1f, 1000.0f));
+                          const float     angle    = pixel_spread_angle(proj_inv, height);
+
+                          error = compare_ray_cone_value("pixel_spread_angle", std::atan(2.0f * std::tan(0.5f * fov) / height), angle);
+
+                          if (error.empty())
+                              error = compare_ray_cone_value("mirror spread", 0.0f, surface_spread_angle(glm::vec3(1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0.0f), glm::vec3(0.0f)));
+
+                          const glm::vec3 p0       = glm::vec3(0.0f);
+                          const glm::vec3 p1       = glm::vec3(side, 0.0f, 0.0f);
+                          const glm::vec3 p2       = glm::vec3(0.0f, side, 0.0f);
+                          const float     constant = triangle_lod_constant(p0, p1, p2, glm::vec2(0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f));
+                          const float     t        = side / (texels * angle) - distance;
+                          const float     width    = ray_cone_width(ray_cone_width(0.0f, angle, distance), angle, t);
+
+                          if (error.empty())
+                              error = compare_ray_cone_value("triangle_lod_constant", -std::log2(side), constant);
+
+                          if (error.empty())
+                              error = compare_ray_cone_value("ray_cone_lod", 0.0f, ray_cone_lod(constant, glm::vec2(texels), width, 1.0f));
+
+                          if (error.empty())
+                              error = compare_ray_cone_value("grazing ray_cone_lod", 1.0f, ray_cone_lod(constant, glm::vec2(texels), width, 0.5f));
+
+                          // On a sphere a step along the surface turns the normal by step / radius, outwards on the
+                          // convex side and inwards on the concave one.
+                          const float     radius = 4.0f;
+                          const glm::vec3 dp_dx  = glm::vec3(0.01f, 0.0f, 0.0f);
+                          const glm::vec3 dp_dy  = glm::vec3(0.0f, 0.01f, 0.0f);
+                          const float     curve  = 2.0f * std::sqrt(2.0f) * 0.01f / radius;
+
+                          if (error.empty())
+                              error = compare_ray_cone_value("convex spread", curve, surface_spread_angle(dp_dx, dp_dy, dp_dx / radius, dp_dy / radius));
+
+                          if (error.empty())
+                              error = compare_ray_cone_value("concave spread", -curve, surface_spread_angle(dp_dx, dp_dy, -dp_dx / radius, -dp_dy / radius));
+
+                          return error;
+                      } });
+
+    checks.push_back({ "ray_stats", [&]() {
+                          std::vector<glm::vec3> positions;
+                          std::vector<uint32_t>  indices;
+
+                          add_quad(0.0f, kRayStatsFloorSize, 0.0f, positions, indices);
+                          add_quad(kRayStatsBlockerMin, kRayStatsBlockerMax, kRayStatsBlockerHeight, positions, indices);
+
+                          CpuRayTracer tracer;
+
+                          tracer.build(positions, indices);
+
+                          RayTracingFrame frame  = ray_stats_frame(tracer);
+                          const uint64_t  pixels = frame.g_buffer.size();
+
+                          // One point light above the blocker that every reservoir picked, with spatial reuse on so
+                          // that its random numbers are replayed.
+                          Light light;
+
+                          light.position_range   = glm::vec4(kRayStatsFloorSize * 0.5f, 4.0f * kRayStatsBlockerHeight, kRayStatsFloorSize * 0.5f, 200.0f);
+                          light.color_type       = glm::vec4(1.0f, 1.0f, 1.0f, float(LIGHT_TYPE_POINT));
+                          light.direction_radius = glm::vec4(0.0f);
+                          light.spot_params      = glm::vec4(0.0f);
+
+                          LightReservoir reservoir;
+
+                          reservoir.light_idx = 0;
+                          reservoir.w_sum     = 1.0f;
+                          reservoir.m         = 1.0f;
+                          reservoir.w         = 1.0f;
+
+                          frame.lights.push_back(light);
+                          frame.reservoirs.assign(pixels, reservoir);
+                          frame.spatial_neighbours = 3;
+                          frame.spatial_radius     = 4.0f;
+
+                          std::string error = compare_ray_stats(expected_ray_stats(frame), trace_frame_rays_cpu(tracer, frame), 0.0);
+
+                          if (!error.empty())
+                              return "hard shadows: " + error;
+
+                          // Every other mirror pixel left to the ray traced reflections.
+                          frame.ssr = true;
+
+                          for (uint32_t y = 0; y < frame.height; y++)
+                          {
+                              for (uint32_t x = 0; x < frame.width; x++)
+                              {
+                                  if (frame.g_buffer[size_t(y) * frame.width + x].roughness == 0.0f && (x + y) % 2 == 0)
+                                      frame.reflection_ray_list.push_back(x | (y << 16));
+                              }
+                          }
+
+                          error = compare_ray_stats(expected_ray_stats(frame), trace_frame_rays_cpu(tracer, frame), 0.0);
+
+                          if (!error.empty())
+                              return "screen space reflections: " + error;
+
+                          // Soft shadows: only pixels near the edge may refine, each with the same number of rays.
+                          frame.light_angular_radius        = glm::radians(2.0f);
+                          frame.penumbra_variance_threshold = 0.01f;
+                          frame.max_penumbra_radius         = 8;
+                          frame.penumbra_rays               = 4;
+
+                          const RayStats soft = trace_frame_rays_cpu(tracer, frame);
+
+                          if (!compare_ray_stats(soft, trace_frame_rays_cpu(tracer, frame), 0.0).empty())
+                              return std::string("soft shadows: two traces of the same frame differ");
+
+                          if (soft.shadow.rays != soft.shadow_traced_pixels + soft.shadow_penumbra_pixels * frame.penumbra_rays || soft.shadow.hits + soft.shadow.misses != soft.shadow.rays)
+                              return std::string("soft shadows: ray counts don't add up");
+
+                          if (soft.shadow_penumbra_pixels == 0 || soft.shadow_penumbra_pixels > shadow_edge_pixels(frame, int32_t(frame.max_penumbra_radius) + 1))
+                              return "soft shadows: " + std::to_string(soft.shadow_penumbra_pixels) + " penumbra pixels";
+
+                          // Hybrid shadows: the cascades are rendered by tracing a ray per texel towards the floor.
+                          frame.light_angular_radius       = 0.0f;
+                          frame.hybrid_shadows             = true;
+                          frame.shadow_map_resolution      = 512;
+                          frame.cascade_boundary_band      = 0.1f;
+                          frame.depth_ambiguity_texels     = 1.0f;
+                          frame.contact_hardening_distance = 1.0f;
+
+                          CascadedShadowSettings csm_settings;
+
+                          csm_settings.resolution      = frame.shadow_map_resolution;
+                          csm_settings.shadow_distance = 500.0f;
+
+                          fit_shadow_cascades(frame.camera_pos, glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), kRayStatsFov, 1.0f, 0.1f, frame.light_dir, csm_settings, frame.cascades);
+
+                          const uint32_t resolution = frame.shadow_map_resolution;
+
+                          frame.shadow_map.resize(size_t(kShadowCascadeCount) * resolution * resolution);
+
+                          for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+                          {
+                              const glm::mat4 inverse_view_proj = glm::inverse(frame.cascades[i].view_proj);
+
+                              for (uint32_t y = 0; y < resolution; y++)
+                              {
+                                  for (uint32_t x = 0; x < resolution; x++)
+                                  {
+                                      const glm::vec2 ndc    = glm::vec2((float(x) + 0.5f) / float(resolution), (float(y) + 0.5f) / float(resolution)) * 2.0f - 1.0f;
+                                      const glm::vec4 origin = inverse_view_proj * glm::vec4(ndc.x, ndc.y, 0.0f, 1.0f);
+                                      float&          depth  = frame.shadow_map[(size_t(i) * resolution + y) * resolution + x];
+
+                                      CpuRayTracer::Hit hit;
+
+                                      depth = 1.0f;
+
+                                      if (tracer.intersect(glm::vec3(origin) / origin.w, -frame.light_dir, 0.0f, frame.cascades[i].depth_range, hit))
+                                          depth = hit.t / frame.cascades[i].depth_range;
+                                  }
+                              }
+                          }
+
+                          const RayStats hybrid = trace_frame_rays_cpu(tracer, frame);
+
+                          if (hybrid.shadow.rays != hybrid.shadow_traced_pixels || hybrid.shadow.hits + hybrid.shadow.misses != hybrid.shadow.rays)
+                              return std::string("hybrid shadows: ray counts don't add up");
+
+                          if (hybrid.shadow_traced_pixels == 0 || hybrid.shadow_traced_pixels > shadow_edge_pixels(frame, 2))
+                              return "hybrid shadows: " + std::to_string(hybrid.shadow_traced_pixels) + " of " + std::to_string(pixels) + " pixels traced";
+
+                          return std::string();
+                      } });
+
+    // ---------------------------------------------------------------------------
+    // Run
+    // ---------------------------------------------------------------------------
+
+    uint32_t failed_checks = 0;
+
+    for (const Check& check : checks)
+    {
+        if (!options.filter.empty() && std::string(check.name).find(options.filter) == std::string::npos)
+            continue;
+
+        const std::string error = check.run();
+
+        if (error.empty())
+            fprintf(stderr, "%-20s: passed\n", check.name);
+        else
+        {
+            fprintf(stderr, "%-20s: FAILED, %s\n", check.name, error.c_str());
+            failed_checks++;
+        }
+    }
+
+    if (options.checks_only)
+        return failed_checks > 0 ? 1 : 0;
+
+    std::vector<BenchmarkResult> results;
+
+    for (const Benchmark& benchmark : benchmarks)
+    {
+        if (!options.filter.empty() && std::string(benchmark.name).find(options.filter) == std::string::npos)
+            continue;
+
+        results.push_back(run_benchmark(benchmark, options));
+
+        fprintf(stderr, "%-20s: %.3f ms median\n", benchmark.name, percentile(results.back().iteration_ms, 0.5));
+    }
+
+    if (options.json_path.empty())
+        write_json(stdout, results, options, pool.thread_count());
+    else
+    {
+        FILE* file = fopen(options.json_path.c_str(), "w");
+
+        if (!file)
+        {
+            fprintf(stderr, "Failed to open %s\n", options.json_path.c_str());
+            return 1;
+        }
+
+        write_json(file, results, options, pool.thread_count());
+        fclose(file);
+    }
+
+    return failed_checks > 0 ? 1 : 0;
+}
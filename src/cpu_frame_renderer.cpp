@@ -0,0 +1,101 @@
+#include "cpu_frame_renderer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float     kMaxDistance = 100000.0f;
+static const glm::vec3 kSunColor    = glm::vec3(3.0f, 2.85f, 2.6f);
+static const glm::vec3 kSkyColor    = glm::vec3(0.45f, 0.6f, 0.85f);
+static const glm::vec3 kGroundColor = glm::vec3(0.2f, 0.18f, 0.15f);
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint8_t to_display(float value)
+{
+    // Reinhard and gamma 2.2, all the preview needs.
+    const float mapped = std::pow(value / (1.0f + value), 1.0f / 2.2f);
+
+    return uint8_t(std::min(std::max(mapped, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CpuFrameRenderer::CpuFrameRenderer(ThreadPool* pool) :
+    m_pool(pool)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuFrameRenderer::set_scene(const CpuScene& scene)
+{
+    m_scene = scene;
+    m_ray_tracer.build(m_scene.positions, m_scene.indices);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuFrameRenderer::render(const CameraPose& pose, const CpuRenderSettings& settings, std::vector<uint8_t>& pixels) const
+{
+    pixels.resize(size_t(settings.width) * settings.height * 4);
+
+    const glm::vec3 forward   = glm::normalize(pose.target - pose.position);
+    const glm::vec3 right     = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    const glm::vec3 up        = glm::cross(right, forward);
+    const glm::vec3 light_dir = glm::normalize(settings.light_dir);
+    const float     tan_half  = std::tan(glm::radians(settings.fov_y) * 0.5f);
+    const float     aspect    = float(settings.width) / float(settings.height);
+
+    m_pool->parallel_for(settings.height, [&](uint32_t y) {
+        uint8_t* row = &pixels[size_t(y) * settings.width * 4];
+
+        for (uint32_t x = 0; x < settings.width; x++)
+        {
+            const float ndc_x = (float(x) + 0.5f) / float(settings.width) * 2.0f - 1.0f;
+            const float ndc_y = 1.0f - (float(y) + 0.5f) / float(settings.height) * 2.0f;
+
+            const glm::vec3 direction = glm::normalize(forward + right * (ndc_x * tan_half * aspect) + up * (ndc_y * tan_half));
+            const glm::vec3 color     = shade(pose.position, direction, light_dir);
+
+            row[x * 4 + 0] = to_display(color.x);
+            row[x * 4 + 1] = to_display(color.y);
+            row[x * 4 + 2] = to_display(color.z);
+            row[x * 4 + 3] = 255;
+        }
+    });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 CpuFrameRenderer::shade(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& light_dir) const
+{
+    CpuRayTracer::Hit hit;
+
+    if (!m_ray_tracer.intersect(origin, direction, 0.0f, kMaxDistance, hit))
+        return kSkyColor;
+
+    const uint32_t  i0 = m_scene.indices[hit.primitive * 3];
+    const glm::vec3 p0 = m_scene.positions[i0];
+    const glm::vec3 p1 = m_scene.positions[m_scene.indices[hit.primitive * 3 + 1]];
+    const glm::vec3 p2 = m_scene.positions[m_scene.indices[hit.primitive * 3 + 2]];
+
+    glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+
+    if (glm::dot(normal, direction) > 0.0f)
+        normal = -normal;
+
+    // Offset along the normal, scaled with the distance the hit point's precision depends on.
+    const glm::vec3 position = origin + direction * hit.t + normal * (1e-3f * (1.0f + hit.t));
+
+    const float n_dot_l = std::max(glm::dot(normal, light_dir), 0.0f);
+    const float shadow  = n_dot_l > 0.0f && !m_ray_tracer.occluded(position, light_dir, 0.0f, kMaxDistance) ? 1.0f : 0.0f;
+
+    const float     sky_weight = normal.y * 0.5f + 0.5f;
+    const glm::vec3 ambient    = (kSkyColor * sky_weight + kGroundColor * (1.0f - sky_weight)) * 0.3f;
+    const glm::vec3 albedo     = hit.primitive < m_scene.albedo.size() ? m_scene.albedo[hit.primitive] : glm::vec3(0.7f);
+
+    return albedo * (kSunColor * (n_dot_l * shadow) + ambient);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
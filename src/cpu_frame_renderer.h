@@ -0,0 +1,50 @@
+#pragma once
+
+#include "camera_path.h"
+#include "cpu_ray_tracer.h"
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+class ThreadPool;
+
+// Indexed triangle list with a colour per triangle.
+struct CpuScene
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t>  indices;
+    std::vector<glm::vec3> albedo;
+};
+
+struct CpuRenderSettings
+{
+    uint32_t  width     = 1920;
+    uint32_t  height    = 1080;
+    float     fov_y     = 60.0f; // Degrees, the same as the camera of the GPU renderer.
+    glm::vec3 light_dir = glm::vec3(0.2f, 0.9770f, 0.2f); // Towards the light.
+};
+
+// Fallback of the batch workers on machines without ray tracing hardware: primary rays through CpuRayTracer,
+// a shadow ray towards the sun and a sky ambient term. Not meant to match the GPU renderer's image, only to
+// keep a farm of CPU machines useful for previews and for testing the batch pipeline.
+class CpuFrameRenderer
+{
+public:
+    CpuFrameRenderer(ThreadPool* pool);
+
+    void set_scene(const CpuScene& scene);
+
+    // Tightly packed RGBA8, top row first.
+    void render(const CameraPose& pose, const CpuRenderSettings& settings, std::vector<uint8_t>& pixels) const;
+
+    inline size_t triangle_count() const { return m_ray_tracer.triangle_count(); }
+
+private:
+    glm::vec3 shade(const glm::vec3& origin, const glm::vec3& direction, const glm::vec3& light_dir) const;
+
+private:
+    ThreadPool*  m_pool;
+    CpuScene     m_scene;
+    CpuRayTracer m_ray_tracer;
+};
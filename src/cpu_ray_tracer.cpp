@@ -0,0 +1,240 @@
+#include "cpu_ray_tracer.h"
+
+#include <algorithm>
+#include <float.h>
+
+static const uint32_t kMaxLeafTriangles = 4;
+
+// Traversal leaves at most one node per level on the stack, deeper trees than this traverse with a heap stack.
+static const uint32_t kTraversalStackSize = 64;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool intersect_aabb(const glm::vec3& origin, const glm::vec3& inv_direction, const glm::vec3& min_extents, const glm::vec3& max_extents, float tmin, float tmax)
+{
+    for (int i = 0; i < 3; i++)
+    {
+        float t0 = (min_extents[i] - origin[i]) * inv_direction[i];
+        float t1 = (max_extents[i] - origin[i]) * inv_direction[i];
+
+        if (t0 > t1)
+            std::swap(t0, t1);
+
+        tmin = std::max(tmin, t0);
+        tmax = std::min(tmax, t1);
+
+        if (tmax < tmin)
+            return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuRayTracer::build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices)
+{
+    const uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+    m_triangles.resize(triangle_count);
+    m_nodes.clear();
+    m_depth = 0;
+
+    if (triangle_count == 0)
+        return;
+
+    m_nodes.reserve(triangle_count * 2);
+
+    std::vector<glm::vec3> centroids(triangle_count);
+
+    for (uint32_t i = 0; i < triangle_count; i++)
+    {
+        const glm::vec3& v0 = positions[indices[3 * i]];
+        const glm::vec3& v1 = positions[indices[3 * i + 1]];
+        const glm::vec3& v2 = positions[indices[3 * i + 2]];
+
+        m_triangles[i].v0        = v0;
+        m_triangles[i].e1        = v1 - v0;
+        m_triangles[i].e2        = v2 - v0;
+        m_triangles[i].primitive = i;
+
+        centroids[i] = (v0 + v1 + v2) / 3.0f;
+    }
+
+    build_node(centroids, 0, triangle_count, 0);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t CpuRayTracer::build_node(std::vector<glm::vec3>& centroids, uint32_t first, uint32_t count, uint32_t depth)
+{
+    m_depth = std::max(m_depth, depth);
+
+    const uint32_t node_idx = uint32_t(m_nodes.size());
+    m_nodes.push_back(Node());
+
+    glm::vec3 min_extents(FLT_MAX);
+    glm::vec3 max_extents(-FLT_MAX);
+    glm::vec3 centroid_min(FLT_MAX);
+    glm::vec3 centroid_max(-FLT_MAX);
+
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const Triangle& tri = m_triangles[i];
+
+        min_extents = glm::min(min_extents, glm::min(tri.v0, glm::min(tri.v0 + tri.e1, tri.v0 + tri.e2)));
+        max_extents = glm::max(max_extents, glm::max(tri.v0, glm::max(tri.v0 + tri.e1, tri.v0 + tri.e2)));
+
+        centroid_min = glm::min(centroid_min, centroids[i]);
+        centroid_max = glm::max(centroid_max, centroids[i]);
+    }
+
+    m_nodes[node_idx].min_extents = min_extents;
+    m_nodes[node_idx].max_extents = max_extents;
+
+    if (count <= kMaxLeafTriangles)
+    {
+        m_nodes[node_idx].first = first;
+        m_nodes[node_idx].count = count;
+
+        return node_idx;
+    }
+
+    // Median split along the longest axis of the centroid bounds.
+    const glm::vec3 extent = centroid_max - centroid_min;
+    int             axis   = 0;
+
+    if (extent.y > extent[axis])
+        axis = 1;
+    if (extent.z > extent[axis])
+        axis = 2;
+
+    const uint32_t        mid = count / 2;
+    std::vector<uint32_t> order(count);
+
+    for (uint32_t i = 0; i < count; i++)
+        order[i] = first + i;
+
+    std::nth_element(order.begin(), order.begin() + mid, order.end(), [&](uint32_t a, uint32_t b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    std::vector<Triangle>  sorted_triangles(count);
+    std::vector<glm::vec3> sorted_centroids(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        sorted_triangles[i] = m_triangles[order[i]];
+        sorted_centroids[i] = centroids[order[i]];
+    }
+
+    std::copy(sorted_triangles.begin(), sorted_triangles.end(), m_triangles.begin() + first);
+    std::copy(sorted_centroids.begin(), sorted_centroids.end(), centroids.begin() + first);
+
+    build_node(centroids, first, mid, depth + 1);
+
+    const uint32_t right = build_node(centroids, first + mid, count - mid, depth + 1);
+
+    m_nodes[node_idx].first = right;
+    m_nodes[node_idx].count = 0;
+
+    return node_idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool CpuRayTracer::intersect(const glm::vec3& origin, const glm::vec3& direction, float tmin, float tmax, Hit& hit) const
+{
+    return traverse(origin, direction, tmin, tmax, false, hit);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool CpuRayTracer::occluded(const glm::vec3& origin, const glm::vec3& direction, float tmin, float tmax) const
+{
+    Hit hit;
+    return traverse(origin, direction, tmin, tmax, true, hit);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool CpuRayTracer::traverse(const glm::vec3& origin, const glm::vec3& direction, float tmin, float tmax, bool any_hit, Hit& hit) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    const glm::vec3 inv_direction = glm::vec3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+    // Popping a node and pushing its children grows the stack by one per level, so depth + 1 entries never
+    // overflow and no subtree is ever skipped.
+    uint32_t              local_stack[kTraversalStackSize];
+    std::vector<uint32_t> heap_stack;
+    uint32_t*             stack = local_stack;
+
+    if (m_depth + 1 > kTraversalStackSize)
+    {
+        heap_stack.resize(m_depth + 1);
+        stack = heap_stack.data();
+    }
+
+    uint32_t stack_size = 0;
+    bool     found      = false;
+
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        const Node& node = m_nodes[stack[--stack_size]];
+
+        if (!intersect_aabb(origin, inv_direction, node.min_extents, node.max_extents, tmin, tmax))
+            continue;
+
+        if (node.count == 0)
+        {
+            stack[stack_size++] = node.first;
+            stack[stack_size++] = uint32_t(&node - &m_nodes[0]) + 1;
+            continue;
+        }
+
+        for (uint32_t i = node.first; i < node.first + node.count; i++)
+        {
+            // Moller-Trumbore
+            const Triangle& tri = m_triangles[i];
+            const glm::vec3 p   = glm::cross(direction, tri.e2);
+            const float     det = glm::dot(tri.e1, p);
+
+            if (std::abs(det) < 1e-8f)
+                continue;
+
+            const float     inv_det = 1.0f / det;
+            const glm::vec3 s       = origin - tri.v0;
+            const float     u       = glm::dot(s, p) * inv_det;
+
+            if (u < 0.0f || u > 1.0f)
+                continue;
+
+            const glm::vec3 q = glm::cross(s, tri.e1);
+            const float     v = glm::dot(direction, q) * inv_det;
+
+            if (v < 0.0f || u + v > 1.0f)
+                continue;
+
+            const float t = glm::dot(tri.e2, q) * inv_det;
+
+            if (t < tmin || t > tmax)
+                continue;
+
+            hit.t         = t;
+            hit.primitive = tri.primitive;
+            hit.u         = u;
+            hit.v         = v;
+            tmax          = t;
+            found         = true;
+
+            if (any_hit)
+                return true;
+        }
+    }
+
+    return found;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
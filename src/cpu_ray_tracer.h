@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// Minimal BVH ray tracer over a triangle soup. Used as a reference for the GPU ray tracing passes
+// on machines without ray tracing hardware.
+class CpuRayTracer
+{
+public:
+    struct Hit
+    {
+        float    t;
+        uint32_t primitive;
+        float    u;
+        float    v;
+    };
+
+    // Builds the BVH from an indexed triangle list.
+    void build(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices);
+
+    // Finds the closest intersection in [tmin, tmax].
+    bool intersect(const glm::vec3& origin, const glm::vec3& direction, float tmin, float tmax, Hit& hit) const;
+
+    // Returns true as soon as any intersection in [tmin, tmax] is found.
+    bool occluded(const glm::vec3& origin, const glm::vec3& direction, float tmin, float tmax) const;
+
+    inline size_t   triangle_count() const { return m_triangles.size(); }
+    inline size_t   node_count() const { return m_nodes.size(); }
+    inline uint32_t depth() const { return m_depth; }
+
+private:
+    struct Triangle
+    {
+        glm::vec3 v0;
+        glm::vec3 e1;
+        glm::vec3 e2;
+        uint32_t  primitive;
+    };
+
+    struct Node
+    {
+        glm::vec3 min_extents;
+        glm::vec3 max_extents;
+        uint32_t  first; // First triangle for leaves, right child for interior nodes.
+        uint32_t  count; // Zero for interior nodes, the left child immediately follows its parent.
+    };
+
+    uint32_t build_node(std::vector<glm::vec3>& centroids, uint32_t first, uint32_t count, uint32_t depth);
+    bool     traverse(const glm::vec3& origin, const glm::vec3& direction, float tmin, float tmax, bool any_hit, Hit& hit) const;
+
+private:
+    std::vector<Triangle> m_triangles;
+    std::vector<Node>     m_nodes;
+    uint32_t              m_depth = 0; // Of the deepest leaf, the root being at 0.
+};
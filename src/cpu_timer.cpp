@@ -0,0 +1,74 @@
+#include "cpu_timer.h"
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+CpuTimer::CpuTimer() :
+    m_epoch(Clock::now())
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuTimer::begin_frame()
+{
+    m_current.clear();
+    m_open_scopes.clear();
+    m_frame++;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuTimer::end_frame()
+{
+    m_results.swap(m_current);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuTimer::begin_scope(const std::string& name)
+{
+    Result result;
+
+    result.name       = name;
+    result.depth      = uint32_t(m_open_scopes.size());
+    result.start_ms   = now_ms();
+    result.elapsed_ms = 0.0f;
+
+    m_open_scopes.push_back(uint32_t(m_current.size()));
+    m_current.push_back(result);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void CpuTimer::end_scope()
+{
+    if (m_open_scopes.empty())
+        return;
+
+    Result& result = m_current[m_open_scopes.back()];
+    m_open_scopes.pop_back();
+
+    result.elapsed_ms = float(now_ms() - result.start_ms);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float CpuTimer::elapsed_ms(const std::string& name) const
+{
+    for (const auto& result : m_results)
+    {
+        if (result.name == name)
+            return result.elapsed_ms;
+    }
+
+    return 0.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+double CpuTimer::now_ms() const
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - m_epoch).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
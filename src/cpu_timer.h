@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Named CPU scopes recorded per frame. Mirrors GpuTimer so both can be reported side by side.
+class CpuTimer
+{
+public:
+    struct Result
+    {
+        std::string name;
+        uint32_t    depth;
+        double      start_ms; // Relative to the creation of the timer.
+        float       elapsed_ms;
+    };
+
+    CpuTimer();
+
+    // Scopes recorded between begin_frame() and end_frame() become available through results() once the frame ends.
+    void begin_frame();
+    void end_frame();
+    void begin_scope(const std::string& name);
+    void end_scope();
+
+    float  elapsed_ms(const std::string& name) const;
+    double now_ms() const;
+
+    inline const std::vector<Result>& results() const { return m_results; }
+    inline uint64_t                   frame() const { return m_frame; }
+
+private:
+    typedef std::chrono::high_resolution_clock Clock;
+
+    Clock::time_point     m_epoch;
+    std::vector<Result>   m_results;
+    std::vector<Result>   m_current;
+    std::vector<uint32_t> m_open_scopes;
+    uint64_t              m_frame = 0;
+};
+
+// Records a CPU scope for the lifetime of the object.
+class ScopedCpuTimer
+{
+public:
+    ScopedCpuTimer(CpuTimer* timer, const std::string& name) :
+        m_timer(timer)
+    {
+        m_timer->begin_scope(name);
+    }
+
+    ~ScopedCpuTimer()
+    {
+        m_timer->end_scope();
+    }
+
+private:
+    CpuTimer* m_timer;
+};
@@ -0,0 +1,148 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+DynamicResolutionController::DynamicResolutionController(const DynamicResolutionSettings& settings) :
+    m_settings(settings)
+{
+    reset();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float DynamicResolutionController::update(const GpuFrameTiming& timing)
+{
+    // Smooth out single frame spikes before reacting to them.
+    if (!m_has_history)
+    {
+        m_filtered_scaled_ms = timing.scaled_ms;
+        m_filtered_fixed_ms  = timing.fixed_ms;
+        m_has_history        = true;
+    }
+    else
+    {
+        m_filtered_scaled_ms += (timing.scaled_ms - m_filtered_scaled_ms) * m_settings.smoothing;
+        m_filtered_fixed_ms += (timing.fixed_ms - m_filtered_fixed_ms) * m_settings.smoothing;
+    }
+
+    // Give the GPU a few frames to settle after a change so that stale timings don't cause oscillation.
+    if (m_cooldown > 0)
+    {
+        m_cooldown--;
+        return m_scale;
+    }
+
+    const float budget = m_settings.target_frame_ms * m_settings.headroom;
+    const float error  = (m_filtered_scaled_ms + m_filtered_fixed_ms - budget) / budget;
+
+    if (std::fabs(error) <= m_settings.dead_band)
+        return m_scale;
+
+    const float area          = std::max(m_scale * m_scale, 1e-4f);
+    const float cost_per_area = m_filtered_scaled_ms / area;
+    const float available     = budget - m_filtered_fixed_ms;
+
+    float desired = m_settings.max_scale;
+
+    if (available <= 0.0f)
+        desired = m_settings.min_scale;
+    else if (cost_per_area > 0.0f)
+        desired = std::sqrt(available / cost_per_area);
+
+    desired = std::min(std::max(desired, m_scale - m_settings.max_scale_delta), m_scale + m_settings.max_scale_delta);
+    desired = quantize(desired);
+
+    if (desired != m_scale)
+    {
+        // Predict the cost at the new resolution so the filter doesn't have to catch up from the old one.
+        m_filtered_scaled_ms = cost_per_area * desired * desired;
+        m_scale              = desired;
+        m_cooldown           = m_settings.cooldown_frames;
+    }
+
+    return m_scale;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void DynamicResolutionController::reset()
+{
+    m_scale              = quantize(m_settings.max_scale);
+    m_filtered_scaled_ms = 0.0f;
+    m_filtered_fixed_ms  = 0.0f;
+    m_cooldown           = 0;
+    m_has_history        = false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float DynamicResolutionController::quantize(float scale) const
+{
+    if (m_settings.scale_step > 0.0f)
+        scale = std::round(scale / m_settings.scale_step) * m_settings.scale_step;
+
+    return std::min(std::max(scale, m_settings.min_scale), m_settings.max_scale);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<float> replay_timing_trace(DynamicResolutionController& controller, const std::vector<GpuFrameTiming>& trace)
+{
+    std::vector<float> scales;
+    scales.reserve(trace.size());
+
+    for (const auto& timing : trace)
+        scales.push_back(controller.update(timing));
+
+    return scales;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool load_timing_trace(const std::string& path, std::vector<GpuFrameTiming>& trace)
+{
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+
+    while (std::getline(file, line))
+    {
+        std::replace(line.begin(), line.end(), ',', ' ');
+        std::istringstream stream(line);
+
+        GpuFrameTiming timing;
+
+        if (stream >> timing.scaled_ms >> timing.fixed_ms)
+            trace.push_back(timing);
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool save_timing_trace(const std::string& path, const std::vector<GpuFrameTiming>& trace)
+{
+    std::ofstream file(path);
+
+    if (!file.is_open())
+        return false;
+
+    // Enough digits that loading the trace back replays the same decisions.
+    file.precision(9);
+
+    for (const auto& timing : trace)
+        file << timing.scaled_ms << "," << timing.fixed_ms << "\n";
+
+    return bool(file);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
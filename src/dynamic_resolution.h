@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Tunables for the dynamic resolution controller.
+struct DynamicResolutionSettings
+{
+    float    target_frame_ms = 16.666f; // GPU frame time to hold.
+    float    headroom        = 0.9f;    // Fraction of the target the controller aims for.
+    float    min_scale       = 0.5f;    // Lower bound of the per-axis render scale.
+    float    max_scale       = 1.0f;    // Upper bound of the per-axis render scale.
+    float    scale_step      = 0.05f;   // Scales are quantized to multiples of this.
+    float    max_scale_delta = 0.1f;    // Largest per-axis change applied in a single adjustment.
+    float    smoothing       = 0.25f;   // Exponential moving average factor for incoming timings.
+    float    dead_band       = 0.05f;   // Relative error tolerated before the scale is changed.
+    uint32_t cooldown_frames = 8;       // Frames to wait after a change before adjusting again.
+};
+
+// One frame of recorded GPU timings. 'scaled_ms' is the time spent in passes whose cost
+// depends on the render resolution, 'fixed_ms' is the time spent in everything else.
+struct GpuFrameTiming
+{
+    float scaled_ms = 0.0f;
+    float fixed_ms  = 0.0f;
+};
+
+// Picks the per-axis render scale that keeps the GPU frame time at the target. The cost
+// of the scaled passes is modelled as proportional to the pixel count (scale squared)
+// which makes the controller fully deterministic for a given sequence of timings.
+class DynamicResolutionController
+{
+public:
+    DynamicResolutionController(const DynamicResolutionSettings& settings = DynamicResolutionSettings());
+
+    // Feeds the timings of a completed frame and returns the scale to render the next one at.
+    float update(const GpuFrameTiming& timing);
+    void  reset();
+
+    inline float                            scale() const { return m_scale; }
+    inline float                            filtered_frame_ms() const { return m_filtered_scaled_ms + m_filtered_fixed_ms; }
+    inline const DynamicResolutionSettings& settings() const { return m_settings; }
+    inline void                             set_settings(const DynamicResolutionSettings& settings) { m_settings = settings; }
+
+private:
+    float quantize(float scale) const;
+
+private:
+    DynamicResolutionSettings m_settings;
+    float                     m_scale              = 1.0f;
+    float                     m_filtered_scaled_ms = 0.0f;
+    float                     m_filtered_fixed_ms  = 0.0f;
+    uint32_t                  m_cooldown           = 0;
+    bool                      m_has_history        = false;
+};
+
+// Runs a controller over a recorded timing trace and returns the scale chosen after every frame.
+std::vector<float> replay_timing_trace(DynamicResolutionController& controller, const std::vector<GpuFrameTiming>& trace);
+
+// Loads a timing trace stored as 'scaled_ms,fixed_ms' lines. Lines that fail to parse are skipped.
+bool load_timing_trace(const std::string& path, std::vector<GpuFrameTiming>& trace);
+bool save_timing_trace(const std::string& path, const std::vector<GpuFrameTiming>& trace);
@@ -0,0 +1,508 @@
+#include "frame_capture.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <string.h>
+
+// Largest payload of a stored deflate block.
+static const size_t kMaxStoredBlock = 65535;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+struct Crc32Table
+{
+    uint32_t entries[256];
+
+    Crc32Table()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+
+            for (uint32_t k = 0; k < 8; k++)
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+
+            entries[i] = c;
+        }
+    }
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint32_t crc32(const uint8_t* data, size_t size)
+{
+    // Built on first use, which is thread safe for function local statics.
+    static const Crc32Table table;
+
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (size_t i = 0; i < size; i++)
+        crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void put_u32_be(std::vector<uint8_t>& out, uint32_t value)
+{
+    out.push_back(uint8_t(value >> 24));
+    out.push_back(uint8_t(value >> 16));
+    out.push_back(uint8_t(value >> 8));
+    out.push_back(uint8_t(value));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+static void put_le(std::vector<uint8_t>& out, T value)
+{
+    const uint8_t* bytes = (const uint8_t*)&value;
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void put_string(std::vector<uint8_t>& out, const char* str)
+{
+    out.insert(out.end(), str, str + strlen(str) + 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void write_png_chunk(FILE* file, const char* type, const std::vector<uint8_t>& data)
+{
+    std::vector<uint8_t> chunk;
+
+    put_u32_be(chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    put_u32_be(chunk, crc32(chunk.data() + 4, chunk.size() - 4));
+
+    fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static size_t file_size(FILE* file)
+{
+    const long size = ftell(file);
+    return size > 0 ? size_t(size) : 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint8_t linear_to_srgb8(float value)
+{
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    value = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+
+    return uint8_t(value * 255.0f + 0.5f);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float half_to_float(uint16_t value)
+{
+    const uint32_t sign     = uint32_t(value & 0x8000) << 16;
+    uint32_t       exponent = (value >> 10) & 0x1F;
+    uint32_t       mantissa = value & 0x3FF;
+    uint32_t       bits;
+
+    if (exponent == 0x1F)
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    else if (exponent != 0)
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        bits = sign;
+    else
+    {
+        // Denormal, renormalize it.
+        exponent = 113;
+
+        while (!(mantissa & 0x400))
+        {
+            mantissa <<= 1;
+            exponent--;
+        }
+
+        bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+    }
+
+    float result;
+    memcpy(&result, &bits, sizeof(float));
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+size_t capture_format_size(CaptureFormat format)
+{
+    switch (format)
+    {
+        case CAPTURE_FORMAT_RGBA8:
+            return 4;
+        case CAPTURE_FORMAT_R8_SNORM:
+            return 1;
+        case CAPTURE_FORMAT_RGBA16F:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+size_t write_png(const std::string& path, uint32_t width, uint32_t height, uint32_t channels, const uint8_t* pixels, bool flip_y)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+
+    if (!file)
+        return 0;
+
+    static const uint8_t kSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    fwrite(kSignature, 1, sizeof(kSignature), file);
+
+    std::vector<uint8_t> header;
+
+    put_u32_be(header, width);
+    put_u32_be(header, height);
+    header.push_back(8);                                            // Bit depth
+    header.push_back(channels == 1 ? 0 : (channels == 3 ? 2 : 6)); // Gray, RGB or RGBA
+    header.push_back(0);                                            // Deflate
+    header.push_back(0);                                            // Adaptive filtering
+    header.push_back(0);                                            // No interlacing
+
+    write_png_chunk(file, "IHDR", header);
+
+    // Every row starts with filter type 0. The rows are stored rather than compressed, which keeps encoding
+    // cheap enough to follow a capture of every frame.
+    const size_t         row_size = size_t(width) * channels;
+    std::vector<uint8_t> raw;
+
+    raw.reserve((row_size + 1) * height);
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint32_t src_y = flip_y ? height - 1 - y : y;
+
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + src_y * row_size, pixels + (src_y + 1) * row_size);
+    }
+
+    std::vector<uint8_t> data;
+
+    data.reserve(raw.size() + raw.size() / kMaxStoredBlock * 5 + 16);
+    data.push_back(0x78);
+    data.push_back(0x01);
+
+    uint32_t adler_a = 1;
+    uint32_t adler_b = 0;
+
+    size_t offset = 0;
+
+    do
+    {
+        const size_t   size = std::min(raw.size() - offset, kMaxStoredBlock);
+        const uint16_t len  = uint16_t(size);
+
+        data.push_back(offset + size == raw.size() ? 1 : 0);
+        put_le(data, len);
+        put_le(data, uint16_t(~len));
+        data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + size);
+
+        for (size_t i = offset; i < offset + size; i++)
+        {
+            adler_a = (adler_a + raw[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+
+        offset += size;
+    } while (offset < raw.size());
+
+    put_u32_be(data, (adler_b << 16) | adler_a);
+
+    write_png_chunk(file, "IDAT", data);
+    write_png_chunk(file, "IEND", std::vector<uint8_t>());
+
+    const size_t size = file_size(file);
+
+    fclose(file);
+
+    return size;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+size_t write_exr(const std::string& path, uint32_t width, uint32_t height, bool half, const uint8_t* pixels, bool flip_y)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+
+    if (!file)
+        return 0;
+
+    const int32_t pixel_type    = half ? 1 : 2;
+    const size_t  channel_bytes = half ? 2 : 4;
+
+    std::vector<uint8_t> header;
+
+    put_le(header, uint32_t(20000630)); // Magic
+    put_le(header, uint32_t(2));        // Version 2, single part scanline
+
+    // Channels have to be listed in alphabetical order, which is also the order of their planes in a line.
+    put_string(header, "channels");
+    put_string(header, "chlist");
+    put_le(header, int32_t(4 * 18 + 1));
+
+    for (const char* channel : { "A", "B", "G", "R" })
+    {
+        put_string(header, channel);
+        put_le(header, pixel_type);
+        put_le(header, uint32_t(0)); // pLinear and reserved
+        put_le(header, int32_t(1));  // x sampling
+        put_le(header, int32_t(1));  // y sampling
+    }
+
+    header.push_back(0);
+
+    put_string(header, "compression");
+    put_string(header, "compression");
+    put_le(header, int32_t(1));
+    header.push_back(0);
+
+    for (const char* window : { "dataWindow", "displayWindow" })
+    {
+        put_string(header, window);
+        put_string(header, "box2i");
+        put_le(header, int32_t(16));
+        put_le(header, int32_t(0));
+        put_le(header, int32_t(0));
+        put_le(header, int32_t(width - 1));
+        put_le(header, int32_t(height - 1));
+    }
+
+    put_string(header, "lineOrder");
+    put_string(header, "lineOrder");
+    put_le(header, int32_t(1));
+    header.push_back(0);
+
+    put_string(header, "pixelAspectRatio");
+    put_string(header, "float");
+    put_le(header, int32_t(4));
+    put_le(header, 1.0f);
+
+    put_string(header, "screenWindowCenter");
+    put_string(header, "v2f");
+    put_le(header, int32_t(8));
+    put_le(header, 0.0f);
+    put_le(header, 0.0f);
+
+    put_string(header, "screenWindowWidth");
+    put_string(header, "float");
+    put_le(header, int32_t(4));
+    put_le(header, 1.0f);
+
+    header.push_back(0);
+
+    fwrite(header.data(), 1, header.size(), file);
+
+    // Offsets of every line, which directly follow the table.
+    const size_t line_size = 8 + size_t(width) * 4 * channel_bytes;
+
+    std::vector<uint8_t> offsets;
+
+    for (uint32_t y = 0; y < height; y++)
+        put_le(offsets, uint64_t(header.size() + size_t(height) * 8 + size_t(y) * line_size));
+
+    fwrite(offsets.data(), 1, offsets.size(), file);
+
+    std::vector<uint8_t> line;
+    line.reserve(line_size);
+
+    static const uint32_t kPlaneChannels[4] = { 3, 2, 1, 0 }; // A, B, G, R
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const uint8_t* row = pixels + size_t(flip_y ? height - 1 - y : y) * width * 4 * channel_bytes;
+
+        line.clear();
+        put_le(line, int32_t(y));
+        put_le(line, int32_t(line_size - 8));
+
+        for (uint32_t plane : kPlaneChannels)
+        {
+            for (uint32_t x = 0; x < width; x++)
+            {
+                const uint8_t* value = row + (size_t(x) * 4 + plane) * channel_bytes;
+                line.insert(line.end(), value, value + channel_bytes);
+            }
+        }
+
+        fwrite(line.data(), 1, line.size(), file);
+    }
+
+    const size_t size = file_size(file);
+
+    fclose(file);
+
+    return size;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static size_t encode(const CaptureJob& job)
+{
+    const size_t pixel_count = size_t(job.width) * job.height;
+
+    switch (job.format)
+    {
+        case CAPTURE_FORMAT_RGBA8:
+            return write_png(job.path + ".png", job.width, job.height, 4, job.pixels, job.flip_y);
+
+        case CAPTURE_FORMAT_R8_SNORM:
+        {
+            std::vector<uint8_t> gray(pixel_count);
+
+            for (size_t i = 0; i < pixel_count; i++)
+                gray[i] = uint8_t(std::max(int32_t(int8_t(job.pixels[i])), 0) * 255 / 127);
+
+            return write_png(job.path + ".png", job.width, job.height, 1, gray.data(), job.flip_y);
+        }
+
+        case CAPTURE_FORMAT_RGBA16F:
+        {
+            if (!job.display)
+                return write_exr(job.path + ".exr", job.width, job.height, true, job.pixels, job.flip_y);
+
+            const uint16_t*      halves = (const uint16_t*)job.pixels;
+            std::vector<uint8_t> rgb(pixel_count * 3);
+
+            for (size_t i = 0; i < pixel_count; i++)
+            {
+                for (size_t c = 0; c < 3; c++)
+                    rgb[i * 3 + c] = linear_to_srgb8(half_to_float(halves[i * 4 + c]));
+            }
+
+            return write_png(job.path + ".png", job.width, job.height, 3, rgb.data(), job.flip_y);
+        }
+
+        default:
+            return write_exr(job.path + ".exr", job.width, job.height, false, job.pixels, job.flip_y);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+FrameCaptureWriter::FrameCaptureWriter(uint32_t thread_count)
+{
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency() / 2, 1u);
+
+    for (uint32_t i = 0; i < thread_count; i++)
+        m_threads.push_back(std::thread(&FrameCaptureWriter::worker_thread, this));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+FrameCaptureWriter::~FrameCaptureWriter()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameCaptureWriter::submit(const CaptureJob& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(job);
+    }
+
+    m_wake.notify_one();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameCaptureWriter::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this]() { return m_queue.empty() && m_active == 0; });
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+size_t FrameCaptureWriter::pending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_queue.size() + m_active;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+FrameCaptureStats FrameCaptureWriter::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameCaptureWriter::worker_thread()
+{
+    while (true)
+    {
+        CaptureJob job;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_quit || !m_queue.empty(); });
+
+            if (m_queue.empty())
+                return;
+
+            job = m_queue.front();
+            m_queue.pop_front();
+            m_active++;
+        }
+
+        const auto   start = std::chrono::high_resolution_clock::now();
+        const size_t size  = encode(job);
+        const float  ms    = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if (job.done)
+            job.done();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (size > 0)
+            {
+                m_stats.encoded++;
+                m_stats.bytes_written += size;
+                m_stats.encode_ms = m_stats.encoded == 1 ? ms : m_stats.encode_ms + (ms - m_stats.encode_ms) * 0.1f;
+            }
+            else
+                m_stats.failed++;
+
+            m_active--;
+        }
+
+        m_idle.notify_all();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
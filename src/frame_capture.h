@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Pixel layouts of the captured targets, as copied out of their images.
+enum CaptureFormat
+{
+    CAPTURE_FORMAT_RGBA8,    // Written as an RGBA PNG.
+    CAPTURE_FORMAT_R8_SNORM, // Written as a grayscale PNG with negative values clamped to zero.
+    CAPTURE_FORMAT_RGBA16F,  // Written as a half float EXR, or as an sRGB PNG when 'display' is set.
+    CAPTURE_FORMAT_RGBA32F   // Written as a float EXR.
+};
+
+struct CaptureJob
+{
+    std::string           path; // Without extension, which is picked from the format.
+    CaptureFormat         format;
+    bool                  display = false; // Encode a float target for viewing instead of keeping its values.
+    bool                  flip_y  = false;
+    uint32_t              width   = 0;
+    uint32_t              height  = 0;
+    const uint8_t*        pixels  = nullptr; // Tightly packed rows, must stay valid until 'done' is called.
+    std::function<void()> done;              // Called on the encoding thread once 'pixels' is no longer needed.
+};
+
+struct FrameCaptureStats
+{
+    uint64_t encoded       = 0;
+    uint64_t failed        = 0;
+    uint64_t bytes_written = 0;
+    float    encode_ms     = 0.0f; // Moving average per image.
+};
+
+// Encodes captured images to PNG and EXR on a pool of threads of its own, so that neither the render loop
+// nor the simulation worker ever waits on disk or compression.
+class FrameCaptureWriter
+{
+public:
+    // 0 threads uses half the hardware threads.
+    FrameCaptureWriter(uint32_t thread_count = 0);
+    ~FrameCaptureWriter();
+
+    void submit(const CaptureJob& job);
+
+    // Blocks until every submitted job finished.
+    void wait();
+
+    size_t            pending() const;
+    FrameCaptureStats stats() const;
+
+    inline uint32_t thread_count() const { return uint32_t(m_threads.size()); }
+
+private:
+    void worker_thread();
+
+private:
+    std::vector<std::thread> m_threads;
+    mutable std::mutex       m_mutex;
+    std::condition_variable  m_wake;
+    std::condition_variable  m_idle;
+    std::deque<CaptureJob>   m_queue;
+    uint32_t                 m_active = 0;
+    bool                     m_quit   = false;
+    FrameCaptureStats        m_stats;
+};
+
+size_t capture_format_size(CaptureFormat format);
+
+// Uncompressed (stored deflate) 8-bit PNG with 1, 3 or 4 channels. Returns the file size, 0 on failure.
+size_t write_png(const std::string& path, uint32_t width, uint32_t height, uint32_t channels, const uint8_t* pixels, bool flip_y);
+
+// Uncompressed scanline EXR with RGBA half or float channels. Returns the file size, 0 on failure.
+size_t write_exr(const std::string& path, uint32_t width, uint32_t height, bool half, const uint8_t* pixels, bool flip_y);
+
+float half_to_float(uint16_t value);
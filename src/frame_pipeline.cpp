@@ -0,0 +1,121 @@
+#include "frame_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Exponential moving average factor of the metrics.
+static const float kMetricsSmoothing = 0.1f;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void smooth(float& value, float sample)
+{
+    value += (sample - value) * kMetricsSmoothing;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+FramePipeline::FramePipeline()
+{
+    m_thread = std::thread(&FramePipeline::worker_thread, this);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+FramePipeline::~FramePipeline()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FramePipeline::kick(const std::function<void()>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_job     = job;
+        m_pending = true;
+    }
+
+    m_wake.notify_one();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float FramePipeline::wait()
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return !m_pending; });
+
+    return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FramePipeline::record_frame(double frame_start_ms, float record_ms, float sim_ms, float stall_ms, float gpu_ms)
+{
+    smooth(m_metrics.record_ms, record_ms);
+    smooth(m_metrics.sim_ms, sim_ms);
+    smooth(m_metrics.stall_ms, stall_ms);
+
+    if (gpu_ms > 0.0f)
+        smooth(m_metrics.gpu_ms, gpu_ms);
+
+    if (m_last_frame_start >= 0.0)
+        smooth(m_metrics.frame_interval_ms, float(frame_start_ms - m_last_frame_start));
+
+    m_last_frame_start = frame_start_ms;
+
+    m_metrics.sim_hidden = m_metrics.sim_ms > 0.0f ? std::max(1.0f - m_metrics.stall_ms / m_metrics.sim_ms, 0.0f) : 0.0f;
+
+    // Fully serialized frames take as long as the CPU and GPU parts added up, fully overlapped ones as long as
+    // the longer of the two.
+    const float cpu_ms  = m_metrics.record_ms + m_metrics.stall_ms;
+    const float shorter = std::min(cpu_ms, m_metrics.gpu_ms);
+
+    m_metrics.cpu_gpu_overlap = shorter > 0.0f ? std::min(std::max((cpu_ms + m_metrics.gpu_ms - m_metrics.frame_interval_ms) / shorter, 0.0f), 1.0f) : 0.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FramePipeline::worker_thread()
+{
+    while (true)
+    {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this]() { return m_quit || (m_pending && m_job); });
+
+            if (m_quit)
+                return;
+
+            job = m_job;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_job     = nullptr;
+            m_pending = false;
+        }
+
+        m_done.notify_all();
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
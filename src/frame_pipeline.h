@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+
+// Smoothed timings of the pipelined frame loop.
+struct FramePipelineMetrics
+{
+    float frame_interval_ms = 0.0f; // Between the starts of two consecutive frames on the main thread.
+    float record_ms         = 0.0f; // Main thread time spent on a frame, excluding the stall.
+    float sim_ms            = 0.0f; // Simulation and culling of a frame, wherever it ran.
+    float stall_ms          = 0.0f; // Main thread time spent waiting for the simulation to finish.
+    float sim_hidden        = 0.0f; // Fraction of the simulation that didn't delay the main thread.
+    float gpu_ms            = 0.0f;
+    float cpu_gpu_overlap   = 0.0f; // Fraction of the shorter of the CPU and GPU frames hidden behind the other.
+};
+
+// Runs one job at a time on a dedicated thread, so that the CPU work of the next frame overlaps the recording
+// and submission of the current one, and measures how much the two actually overlap.
+class FramePipeline
+{
+public:
+    FramePipeline();
+    ~FramePipeline();
+
+    // Starts 'job' on the worker. The previous job must have been waited for.
+    void kick(const std::function<void()>& job);
+
+    // Blocks until the last kicked job finished and returns the time spent blocking in milliseconds. Returns
+    // immediately when nothing is in flight.
+    float wait();
+
+    // Folds a completed frame into the metrics. 'frame_start_ms' is on the caller's clock, 'gpu_ms' is ignored
+    // unless positive since GPU timings arrive a few frames late.
+    void record_frame(double frame_start_ms, float record_ms, float sim_ms, float stall_ms, float gpu_ms);
+
+    inline const FramePipelineMetrics& metrics() const { return m_metrics; }
+
+private:
+    void worker_thread();
+
+private:
+    std::thread             m_thread;
+    std::mutex              m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_done;
+    std::function<void()>   m_job;
+    bool                    m_pending          = false;
+    bool                    m_quit             = false;
+    double                  m_last_frame_start = -1.0;
+    FramePipelineMetrics    m_metrics;
+};
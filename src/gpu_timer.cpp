@@ -0,0 +1,183 @@
+#include "gpu_timer.h"
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GpuTimer::GpuTimer(dw::vk::Backend::Ptr backend, uint32_t max_scopes) :
+    m_device(backend->device()), m_max_scopes(max_scopes)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(backend->physical_device(), &properties);
+
+    m_timestamp_period = properties.limits.timestampPeriod;
+
+    VkQueryPoolCreateInfo info;
+    DW_ZERO_MEMORY(info);
+
+    info.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.queryType  = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = m_max_scopes * 2 * dw::vk::Backend::kMaxFramesInFlight + 1; // The last one calibrates.
+
+    if (vkCreateQueryPool(m_device, &info, nullptr, &m_query_pool) != VK_SUCCESS)
+        DW_LOG_ERROR("Failed to create timestamp query pool");
+
+    m_slots.resize(dw::vk::Backend::kMaxFramesInFlight);
+    m_timestamps.resize(m_max_scopes * 2);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+GpuTimer::~GpuTimer()
+{
+    if (m_query_pool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(m_device, m_query_pool, nullptr);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GpuTimer::calibrate(dw::vk::Backend::Ptr backend, const CpuTimer& cpu_timer)
+{
+    const uint32_t query = m_max_scopes * 2 * dw::vk::Backend::kMaxFramesInFlight;
+
+    dw::vk::CommandBuffer::Ptr cmd_buf = backend->allocate_graphics_command_buffer();
+
+    VkCommandBufferBeginInfo begin_info;
+    DW_ZERO_MEMORY(begin_info);
+
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+    vkCmdResetQueryPool(cmd_buf->handle(), m_query_pool, query, 1);
+    vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_query_pool, query);
+
+    vkEndCommandBuffer(cmd_buf->handle());
+
+    const double submit_ms = cpu_timer.now_ms();
+
+    backend->flush_graphics({ cmd_buf });
+
+    const double done_ms = cpu_timer.now_ms();
+
+    uint64_t timestamp = 0;
+
+    if (vkGetQueryPoolResults(m_device, m_query_pool, query, 1, sizeof(uint64_t), &timestamp, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+    {
+        DW_LOG_ERROR("Failed to calibrate GPU timestamps, GPU scopes start at the first frame");
+        return;
+    }
+
+    m_base_timestamp = timestamp;
+    m_base_ms        = 0.5 * (submit_ms + done_ms);
+    m_has_base       = true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool GpuTimer::begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t frame_idx)
+{
+    m_current_slot = frame_idx;
+    m_open_scopes.clear();
+
+    FrameSlot&     slot        = m_slots[m_current_slot];
+    const uint32_t first_query = m_current_slot * m_max_scopes * 2;
+    bool           resolved    = false;
+
+    if (slot.recorded && !slot.names.empty())
+    {
+        const uint32_t query_count = uint32_t(slot.names.size()) * 2;
+
+        // Don't wait: if the GPU hasn't finished the frame yet, this slot's timings are simply dropped.
+        VkResult result = vkGetQueryPoolResults(m_device,
+                                                m_query_pool,
+                                                first_query,
+                                                query_count,
+                                                sizeof(uint64_t) * query_count,
+                                                m_timestamps.data(),
+                                                sizeof(uint64_t),
+                                                VK_QUERY_RESULT_64_BIT);
+
+        if (result == VK_SUCCESS)
+        {
+            if (!m_has_base)
+            {
+                m_base_timestamp = m_timestamps[0];
+                m_has_base       = true;
+            }
+
+            m_results.resize(slot.names.size());
+
+            for (uint32_t i = 0; i < slot.names.size(); i++)
+            {
+                const uint64_t ticks = m_timestamps[2 * i + 1] - m_timestamps[2 * i];
+
+                m_results[i].name       = slot.names[i];
+                m_results[i].depth      = slot.depths[i];
+                m_results[i].start_ms   = m_base_ms + double(int64_t(m_timestamps[2 * i] - m_base_timestamp)) * double(m_timestamp_period) * 1e-6;
+                m_results[i].elapsed_ms = float(double(ticks) * double(m_timestamp_period) * 1e-6);
+            }
+
+            m_resolved_frame = slot.frame;
+            resolved         = true;
+        }
+    }
+
+    slot.names.clear();
+    slot.depths.clear();
+    slot.frame    = m_frame++;
+    slot.recorded = true;
+
+    vkCmdResetQueryPool(cmd_buf->handle(), m_query_pool, first_query, m_max_scopes * 2);
+
+    return resolved;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GpuTimer::begin_scope(dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name)
+{
+    FrameSlot& slot = m_slots[m_current_slot];
+
+    if (slot.names.size() == m_max_scopes)
+    {
+        // Out of queries: keep the stack balanced but don't record anything.
+        m_open_scopes.push_back(UINT32_MAX);
+        return;
+    }
+
+    const uint32_t scope = uint32_t(slot.names.size());
+
+    slot.names.push_back(name);
+    slot.depths.push_back(uint32_t(m_open_scopes.size()));
+    m_open_scopes.push_back(scope);
+
+    vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_query_pool, (m_current_slot * m_max_scopes + scope) * 2);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void GpuTimer::end_scope(dw::vk::CommandBuffer::Ptr cmd_buf)
+{
+    if (m_open_scopes.empty())
+        return;
+
+    const uint32_t scope = m_open_scopes.back();
+    m_open_scopes.pop_back();
+
+    if (scope != UINT32_MAX)
+        vkCmdWriteTimestamp(cmd_buf->handle(), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_query_pool, (m_current_slot * m_max_scopes + scope) * 2 + 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float GpuTimer::elapsed_ms(const std::string& name) const
+{
+    for (const auto& result : m_results)
+    {
+        if (result.name == name)
+            return result.elapsed_ms;
+    }
+
+    return 0.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "cpu_timer.h"
+
+#include <vk.h>
+#include <string>
+#include <vector>
+
+// Named GPU timestamp scopes, one query range per frame-in-flight. Results are read back
+// without waiting the next time a frame slot is recorded, so they lag by kMaxFramesInFlight frames.
+class GpuTimer
+{
+public:
+    struct Result
+    {
+        std::string name;
+        uint32_t    depth;
+        double      start_ms; // On the CpuTimer's clock once calibrated, relative to the first timestamp resolved before.
+        float       elapsed_ms;
+    };
+
+    GpuTimer(dw::vk::Backend::Ptr backend, uint32_t max_scopes = 32);
+    ~GpuTimer();
+
+    // Maps GPU timestamps onto the clock of 'cpu_timer', so that scopes of the two timers line up. Waits for a
+    // timestamp written by an otherwise empty submission; the mapping is off by at most half of that round trip.
+    void calibrate(dw::vk::Backend::Ptr backend, const CpuTimer& cpu_timer);
+
+    // Collects the results previously recorded into the current frame slot and resets its queries.
+    // Returns true if a new set of results became available.
+    bool begin_frame(dw::vk::CommandBuffer::Ptr cmd_buf, uint32_t frame_idx);
+    void begin_scope(dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name);
+    void end_scope(dw::vk::CommandBuffer::Ptr cmd_buf);
+
+    // Time of the named scope in the most recently resolved frame, or 0 if it wasn't recorded.
+    float elapsed_ms(const std::string& name) const;
+
+    inline const std::vector<Result>& results() const { return m_results; }
+    inline uint64_t                   resolved_frame() const { return m_resolved_frame; }
+    inline uint64_t                   current_frame() const { return m_frame - 1; } // Frame opened by the last begin_frame().
+
+private:
+    struct FrameSlot
+    {
+        std::vector<std::string> names;
+        std::vector<uint32_t>    depths;
+        uint64_t                 frame    = 0;
+        bool                     recorded = false;
+    };
+
+    VkDevice               m_device;
+    VkQueryPool            m_query_pool = VK_NULL_HANDLE;
+    uint32_t               m_max_scopes;
+    float                  m_timestamp_period;
+    std::vector<FrameSlot> m_slots;
+    std::vector<uint32_t>  m_open_scopes;
+    std::vector<uint64_t>  m_timestamps;
+    std::vector<Result>    m_results;
+    uint32_t               m_current_slot   = 0;
+    uint64_t               m_frame          = 0;
+    uint64_t               m_resolved_frame = 0;
+    uint64_t               m_base_timestamp = 0;
+    double                 m_base_ms        = 0.0; // CPU time of the base timestamp.
+    bool                   m_has_base       = false;
+};
+
+// Records a GPU timestamp scope for the lifetime of the object.
+class ScopedGpuTimer
+{
+public:
+    ScopedGpuTimer(GpuTimer* timer, dw::vk::CommandBuffer::Ptr cmd_buf, const std::string& name) :
+        m_timer(timer), m_cmd_buf(cmd_buf)
+    {
+        m_timer->begin_scope(m_cmd_buf, name);
+    }
+
+    ~ScopedGpuTimer()
+    {
+        m_timer->end_scope(m_cmd_buf);
+    }
+
+private:
+    GpuTimer*                  m_timer;
+    dw::vk::CommandBuffer::Ptr m_cmd_buf;
+};
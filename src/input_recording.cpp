@@ -0,0 +1,133 @@
+#include "input_recording.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char     kInputFileMagic[4] = { 'H', 'R', 'I', 'N' };
+static const uint32_t kInputFileVersion  = 1;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool InputRecorder::begin(const std::string& path, uint32_t width, uint32_t height)
+{
+    m_path   = path;
+    m_width  = width;
+    m_height = height;
+    m_frames.clear();
+
+    return !m_path.empty();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void InputRecorder::record(const CameraInputFrame& frame)
+{
+    m_frames.push_back(frame);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool InputRecorder::end()
+{
+    if (m_path.empty())
+        return false;
+
+    FILE* file = fopen(m_path.c_str(), "wb");
+
+    m_path.clear();
+
+    if (!file)
+        return false;
+
+    const uint32_t frame_count = uint32_t(m_frames.size());
+
+    fwrite(kInputFileMagic, sizeof(kInputFileMagic), 1, file);
+    fwrite(&kInputFileVersion, sizeof(uint32_t), 1, file);
+    fwrite(&m_width, sizeof(uint32_t), 1, file);
+    fwrite(&m_height, sizeof(uint32_t), 1, file);
+    fwrite(&frame_count, sizeof(uint32_t), 1, file);
+
+    // Written field by field so the file layout doesn't depend on struct padding.
+    for (const auto& frame : m_frames)
+    {
+        const uint8_t mouse_look = frame.mouse_look ? 1 : 0;
+
+        fwrite(&frame.delta, sizeof(float), 1, file);
+        fwrite(&frame.heading_speed, sizeof(float), 1, file);
+        fwrite(&frame.sideways_speed, sizeof(float), 1, file);
+        fwrite(&frame.mouse_delta_x, sizeof(float), 1, file);
+        fwrite(&frame.mouse_delta_y, sizeof(float), 1, file);
+        fwrite(&mouse_look, sizeof(uint8_t), 1, file);
+    }
+
+    const bool success = ferror(file) == 0;
+    fclose(file);
+
+    return success;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool InputReplay::load(const std::string& path)
+{
+    m_loaded   = false;
+    m_position = 0;
+    m_frames.clear();
+
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (!file)
+        return false;
+
+    char     magic[4];
+    uint32_t version     = 0;
+    uint32_t frame_count = 0;
+
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, kInputFileMagic, sizeof(magic)) == 0;
+    valid      = valid && fread(&version, sizeof(uint32_t), 1, file) == 1 && version == kInputFileVersion;
+    valid      = valid && fread(&m_width, sizeof(uint32_t), 1, file) == 1;
+    valid      = valid && fread(&m_height, sizeof(uint32_t), 1, file) == 1;
+    valid      = valid && fread(&frame_count, sizeof(uint32_t), 1, file) == 1;
+
+    if (valid)
+    {
+        m_frames.resize(frame_count);
+
+        for (auto& frame : m_frames)
+        {
+            uint8_t mouse_look = 0;
+
+            valid = valid && fread(&frame.delta, sizeof(float), 1, file) == 1;
+            valid = valid && fread(&frame.heading_speed, sizeof(float), 1, file) == 1;
+            valid = valid && fread(&frame.sideways_speed, sizeof(float), 1, file) == 1;
+            valid = valid && fread(&frame.mouse_delta_x, sizeof(float), 1, file) == 1;
+            valid = valid && fread(&frame.mouse_delta_y, sizeof(float), 1, file) == 1;
+            valid = valid && fread(&mouse_look, sizeof(uint8_t), 1, file) == 1;
+
+            frame.mouse_look = mouse_look != 0;
+        }
+    }
+
+    fclose(file);
+
+    if (!valid)
+        m_frames.clear();
+
+    m_loaded = valid;
+
+    return valid;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool InputReplay::next(CameraInputFrame& frame)
+{
+    if (is_finished())
+        return false;
+
+    frame = m_frames[m_position++];
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
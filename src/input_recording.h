@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Everything update_camera() consumes in a single frame.
+struct CameraInputFrame
+{
+    float delta          = 0.0f; // Same units as Application::m_delta.
+    float heading_speed  = 0.0f;
+    float sideways_speed = 0.0f;
+    float mouse_delta_x  = 0.0f;
+    float mouse_delta_y  = 0.0f;
+    bool  mouse_look     = false;
+};
+
+// Records camera inputs into a compact binary file: a small header followed by 21 bytes per frame.
+class InputRecorder
+{
+public:
+    bool begin(const std::string& path, uint32_t width, uint32_t height);
+    void record(const CameraInputFrame& frame);
+    bool end();
+
+    inline bool   is_recording() const { return !m_path.empty(); }
+    inline size_t frame_count() const { return m_frames.size(); }
+
+private:
+    std::string                   m_path;
+    uint32_t                      m_width  = 0;
+    uint32_t                      m_height = 0;
+    std::vector<CameraInputFrame> m_frames;
+};
+
+// Plays back a file written by InputRecorder.
+class InputReplay
+{
+public:
+    bool load(const std::string& path);
+
+    // Returns false once every recorded frame has been consumed.
+    bool next(CameraInputFrame& frame);
+
+    inline bool     is_loaded() const { return m_loaded; }
+    inline bool     is_finished() const { return m_position >= m_frames.size(); }
+    inline size_t   position() const { return m_position; }
+    inline size_t   frame_count() const { return m_frames.size(); }
+    inline uint32_t width() const { return m_width; }
+    inline uint32_t height() const { return m_height; }
+
+private:
+    bool                          m_loaded   = false;
+    size_t                        m_position = 0;
+    uint32_t                      m_width    = 0;
+    uint32_t                      m_height   = 0;
+    std::vector<CameraInputFrame> m_frames;
+};
@@ -0,0 +1,227 @@
+#include "light_sampling.h"
+
+#include <algorithm>
+#include <cmath>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same hash as pcg_hash() in common.glsl.
+static uint32_t pcg_hash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float next_random(uint32_t& seed)
+{
+    seed = pcg_hash(seed);
+    return float(seed) / 4294967296.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float luminance(const glm::vec3& color)
+{
+    return glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool LightReservoir::update(uint32_t candidate, float weight, float u)
+{
+    w_sum += weight;
+    m += 1.0f;
+
+    if (weight > 0.0f && u * w_sum < weight)
+    {
+        light_idx = candidate;
+        return true;
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<Light> generate_lights(uint32_t count, const glm::vec3& bounds_min, const glm::vec3& bounds_max, uint32_t seed)
+{
+    std::vector<Light> lights(count);
+
+    const glm::vec3 extents = bounds_max - bounds_min;
+    const float     range   = std::max(std::max(extents.x, extents.y), extents.z) * 0.1f;
+
+    for (auto& light : lights)
+    {
+        const glm::vec3 position  = bounds_min + extents * glm::vec3(next_random(seed), next_random(seed), next_random(seed));
+        const glm::vec3 color     = glm::vec3(0.25f) + 0.75f * glm::vec3(next_random(seed), next_random(seed), next_random(seed));
+        const float     intensity = range * range * (0.05f + 0.05f * next_random(seed));
+        const uint32_t  type      = pcg_hash(seed) % 3;
+
+        // Spot lights point mostly downwards.
+        const glm::vec3 direction = glm::normalize(glm::vec3(next_random(seed) - 0.5f, -1.0f, next_random(seed) - 0.5f));
+
+        light.position_range   = glm::vec4(position, range);
+        light.color_type       = glm::vec4(color * intensity, float(type));
+        light.direction_radius = glm::vec4(direction, type == LIGHT_TYPE_AREA ? range * 0.05f : 0.0f);
+        light.spot_params      = glm::vec4(std::cos(glm::radians(20.0f)), std::cos(glm::radians(35.0f)), 0.0f, 0.0f);
+    }
+
+    return lights;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void animate_lights(const std::vector<Light>& rest, std::vector<Light>& lights, float time)
+{
+    lights.resize(rest.size());
+
+    for (size_t i = 0; i < rest.size(); i++)
+    {
+        const float phase  = float(i) * 2.39996f; // Golden angle, keeps neighbouring lights out of sync.
+        const float radius = rest[i].position_range.w * 0.25f;
+
+        lights[i]                = rest[i];
+        lights[i].position_range = rest[i].position_range + glm::vec4(std::cos(time + phase) * radius, 0.0f, std::sin(time + phase) * radius, 0.0f);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+glm::vec3 light_contribution(const Light& light, const glm::vec3& position, const glm::vec3& normal)
+{
+    const glm::vec3 to_light = glm::vec3(light.position_range) - position;
+    const float     dist_sq  = glm::dot(to_light, to_light);
+    const float     range    = light.position_range.w;
+
+    if (dist_sq >= range * range)
+        return glm::vec3(0.0f);
+
+    const glm::vec3 l         = to_light / std::sqrt(dist_sq);
+    const float     n_dot_l   = std::max(glm::dot(normal, l), 0.0f);
+    const float     radius    = light.direction_radius.w;
+    const float     falloff   = dist_sq / (range * range);
+    const float     window    = std::pow(std::min(std::max(1.0f - falloff * falloff, 0.0f), 1.0f), 2.0f);
+    float           intensity = window / std::max(dist_sq, std::max(radius * radius, 1e-4f));
+
+    if (uint32_t(light.color_type.w) == LIGHT_TYPE_SPOT)
+    {
+        const float cos_angle = glm::dot(-l, glm::vec3(light.direction_radius));
+        const float t         = std::min(std::max((cos_angle - light.spot_params.y) / (light.spot_params.x - light.spot_params.y), 0.0f), 1.0f);
+
+        intensity *= t * t * (3.0f - 2.0f * t);
+    }
+
+    return glm::vec3(light.color_type) * intensity * n_dot_l;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float light_target_pdf(const Light& light, const glm::vec3& position, const glm::vec3& normal)
+{
+    return luminance(light_contribution(light, position, normal));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void finalize_reservoir(LightReservoir& reservoir, const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal)
+{
+    const float target_pdf = reservoir.light_idx < lights.size() ? light_target_pdf(lights[reservoir.light_idx], position, normal) : 0.0f;
+
+    reservoir.w = target_pdf > 0.0f ? reservoir.w_sum / (reservoir.m * target_pdf) : 0.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+LightReservoir sample_lights_ris(const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, uint32_t candidates, uint32_t& seed)
+{
+    LightReservoir reservoir;
+
+    if (lights.empty())
+        return reservoir;
+
+    const uint32_t count = uint32_t(lights.size());
+
+    for (uint32_t i = 0; i < candidates; i++)
+    {
+        const uint32_t candidate = std::min(uint32_t(next_random(seed) * float(count)), count - 1);
+
+        // Source pdf is 1 / count.
+        reservoir.update(candidate, light_target_pdf(lights[candidate], position, normal) * float(count), next_random(seed));
+    }
+
+    finalize_reservoir(reservoir, lights, position, normal);
+
+    return reservoir;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void combine_reservoirs(LightReservoir& reservoir, const LightReservoir& other, const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, float u)
+{
+    if (other.m <= 0.0f)
+        return;
+
+    const float m = reservoir.m;
+
+    // Streaming the other reservoir as a single candidate with weight p_hat * W * M keeps the result unbiased.
+    // Reservoirs that found no light still count their candidates, otherwise W would be overestimated.
+    if (other.light_idx < lights.size())
+        reservoir.update(other.light_idx, light_target_pdf(lights[other.light_idx], position, normal) * other.w * other.m, u);
+
+    reservoir.m = m + other.m;
+
+    finalize_reservoir(reservoir, lights, position, normal);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float relative_error(const glm::vec3& estimate, const glm::vec3& reference)
+{
+    const float reference_luminance = luminance(reference);
+
+    return reference_luminance > 0.0f ? std::fabs(luminance(estimate) - reference_luminance) / reference_luminance : luminance(estimate);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+LightSamplerValidation validate_light_sampler(const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, uint32_t candidates, uint32_t iterations, uint32_t seed)
+{
+    LightSamplerValidation result;
+
+    result.reference      = glm::vec3(0.0f);
+    result.estimate       = glm::vec3(0.0f);
+    result.reuse_estimate = glm::vec3(0.0f);
+
+    for (const auto& light : lights)
+        result.reference += light_contribution(light, position, normal);
+
+    if (iterations == 0)
+        return result;
+
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        LightReservoir reservoir = sample_lights_ris(lights, position, normal, candidates, seed);
+
+        if (reservoir.light_idx != kInvalidLight)
+            result.estimate += light_contribution(lights[reservoir.light_idx], position, normal) * reservoir.w;
+
+        const LightReservoir other = sample_lights_ris(lights, position, normal, candidates, seed);
+
+        combine_reservoirs(reservoir, other, lights, position, normal, next_random(seed));
+
+        if (reservoir.light_idx != kInvalidLight)
+            result.reuse_estimate += light_contribution(lights[reservoir.light_idx], position, normal) * reservoir.w;
+    }
+
+    result.estimate /= float(iterations);
+    result.reuse_estimate /= float(iterations);
+    result.relative_error       = relative_error(result.estimate, result.reference);
+    result.reuse_relative_error = relative_error(result.reuse_estimate, result.reference);
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
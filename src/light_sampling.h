@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+enum LightType
+{
+    LIGHT_TYPE_POINT = 0,
+    LIGHT_TYPE_SPOT,
+    LIGHT_TYPE_AREA // Spherical light, shadow rays target a random point on its surface.
+};
+
+static const uint32_t kInvalidLight = 0xffffffff;
+
+// GPU layout of a light. Must match the Light struct in common.glsl.
+struct Light
+{
+    glm::vec4 position_range;   // xyz: Position, w: Range
+    glm::vec4 color_type;       // rgb: Color * intensity, a: LightType
+    glm::vec4 direction_radius; // xyz: Spot direction, w: Area light radius
+    glm::vec4 spot_params;      // x: Cosine of the inner cone angle, y: Cosine of the outer cone angle
+};
+
+// Weighted reservoir holding a single light sample. Must match the Reservoir struct in common.glsl.
+struct LightReservoir
+{
+    uint32_t light_idx = kInvalidLight;
+    float    w_sum     = 0.0f; // Sum of the resampling weights seen so far.
+    float    m         = 0.0f; // Number of candidates the reservoir represents.
+    float    w         = 0.0f; // Unbiased contribution weight of the selected light.
+
+    // Streams a candidate into the reservoir, 'u' is a uniform random number in [0, 1).
+    bool update(uint32_t candidate, float weight, float u);
+};
+
+struct LightSamplingSettings
+{
+    uint32_t initial_candidates = 32;   // Lights considered per pixel before reuse.
+    float    temporal_m_cap     = 20.0f; // Caps the history to this many times the current candidate count.
+    uint32_t spatial_neighbours = 3;
+};
+
+// Generates a deterministic mix of point, spot and area lights inside the given box.
+std::vector<Light> generate_lights(uint32_t count, const glm::vec3& bounds_min, const glm::vec3& bounds_max, uint32_t seed);
+
+// Moves every light along a small circle around its rest position.
+void animate_lights(const std::vector<Light>& rest, std::vector<Light>& lights, float time);
+
+// Unshadowed radiance reaching a Lambertian surface from the light, including the cosine term.
+glm::vec3 light_contribution(const Light& light, const glm::vec3& position, const glm::vec3& normal);
+
+// Target function used for resampling: the luminance of light_contribution().
+float light_target_pdf(const Light& light, const glm::vec3& position, const glm::vec3& normal);
+
+// CPU reference of the initial resampling pass in light_resample.rgen: picks 'candidates' lights
+// uniformly and keeps one proportional to its target function.
+LightReservoir sample_lights_ris(const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, uint32_t candidates, uint32_t& seed);
+
+// Merges 'other' into 'reservoir' by re-evaluating its light at the current surface, as the temporal
+// and spatial reuse passes do.
+void combine_reservoirs(LightReservoir& reservoir, const LightReservoir& other, const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, float u);
+
+struct LightSamplerValidation
+{
+    glm::vec3 reference;      // Sum over every light.
+    glm::vec3 estimate;       // Mean of the resampled estimates.
+    glm::vec3 reuse_estimate; // Mean of estimates that also merged an independent reservoir.
+    float     relative_error       = 0.0f;
+    float     reuse_relative_error = 0.0f;
+};
+
+// Compares the resampled estimator against a loop over every light. Both errors should converge
+// towards zero as 'iterations' grows if the sampler is unbiased.
+LightSamplerValidation validate_light_sampler(const std::vector<Light>& lights, const glm::vec3& position, const glm::vec3& normal, uint32_t candidates, uint32_t iterations, uint32_t seed);
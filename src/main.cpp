@@ -5,35 +5,297 @@
 #include <vk.h>
 #include <profiler.h>
 #include <assimp/scene.h>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
 #include <vk_mem_alloc.h>
 #include <scene.h>
+#include <float.h>
+#include <stb_image.h>
+
+#include "batch_render.h"
+#include "cascaded_shadows.h"
+#include "command_cache.h"
+#include "cpu_timer.h"
+#include "dynamic_resolution.h"
+#include "frame_capture.h"
+#include "frame_pipeline.h"
+#include "gpu_timer.h"
+#include "input_recording.h"
+#include "light_sampling.h"
+#include "memory_registry.h"
+#include "occlusion_culling.h"
+#include "opacity_baker.h"
+#include "ray_cones.h"
+#include "ray_stats.h"
+#include "screen_space_reflections.h"
+#include "skinning.h"
+#include "startup_graph.h"
+#include "thread_pool.h"
+#include "timing_report.h"
+#include "trace_exporter.h"
+#include "transforms.h"
+#include "virtual_texturing.h"
+
+// Records a framework profiler sample along with the CPU and GPU timings that get exported.
+#define SCOPED_SAMPLE(name, cmd_buf)                            \
+    DW_SCOPED_SAMPLE(name, cmd_buf);                            \
+    ScopedCpuTimer scoped_cpu_timer(&m_cpu_timer, name);        \
+    ScopedGpuTimer scoped_gpu_timer(m_gpu_timer.get(), cmd_buf, name)
+
+// Inputs of the simulation stage. Captured on the main thread so that the worker never reads anything the GUI
+// or the window callbacks can change under it.
+struct SimulationInput
+{
+    CameraInputFrame       camera;
+    float                  camera_sensitivity;
+    float                  aspect;
+    glm::vec3              light_dir;
+    CascadedShadowSettings csm_settings;
+    bool                   animate_lights;
+    bool                   occlusion_culling;
+    bool                   use_camera_pose = false; // Batch rendering: the camera follows a path instead of the input.
+    CameraPose             camera_pose;
+    float                  light_time = 0.0f; // Of the path frame, batch frames are rendered out of order.
+    bool                   animate_skins;
+    SwaySettings           sway_settings;
+};
+
+// Everything the simulation stage produces for a frame. There is one per frame in flight: the worker fills the
+// state of frame N + 1 while the main thread records frame N from its own.
+struct FrameState
+{
+    uint64_t             frame = UINT64_MAX;
+    Transforms           transforms; // Camera and cascades, the rest is filled in while recording.
+    glm::vec3            camera_position;
+    std::vector<Light>   lights;
+    std::vector<uint8_t> submesh_visible; // Empty when culling is off.
+    std::vector<glm::mat4> joint_palette; // Of every skin, empty without skinned geometry.
+    double               sim_start_ms = 0.0;
+    float                sim_ms       = 0.0f;
+    float                culling_ms   = 0.0f;
+};
+
+// Length of the sub-pixel jitter sequence used by the temporal upsample.
+static const uint32_t kJitterSampleCount = 8;
+
+// Number of frames between ray statistics log messages.
+static const uint32_t kRayStatsLogInterval = 300;
+
+// Frame --validate-ray-stats checks, late enough for the temporal reuse and the cascades to have settled.
+static const uint64_t kRayStatsValidationFrame = 120;
+
+// Fraction of a counter the CPU model may be off by, for rays that graze triangle edges.
+static const double kRayStatsValidationTolerance = 0.01;
+
+// Size of each frame's block in the light buffer.
+static const uint32_t kMaxLights = 4096;
+
+// Size of HitRecord in common.glsl.
+static const uint32_t kHitRecordSize = 32;
+
+// Number of material bins used to sort deferred reflection hits. Must match MAX_REFLECTION_MATERIALS in common.glsl.
+static const uint32_t kMaxReflectionMaterials = 1024;
+
+// Push constants of hiz_build.comp.
+struct HiZPushConstants
+{
+    glm::ivec2 src_size;
+    glm::ivec2 dst_size;
+    uint32_t   level;
+};
+
+// Push constants of skinning.comp.
+struct SkinningPushConstants
+{
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t first_influence;
+    uint32_t first_joint;
+    uint32_t skinned;
+};
+
+// VkGeometryInstanceNV, an instance of a top level acceleration structure. The extension leaves it to the
+// application to declare.
+struct RayTracingInstance
+{
+    float    transform[12]; // Row major 3x4.
+    uint32_t custom_index : 24;
+    uint32_t mask : 8;
+    uint32_t sbt_offset : 24;
+    uint32_t flags : 8;
+    uint64_t acceleration_structure;
+};
+
+// Joints of the procedural rig of every skinned submesh.
+static const uint32_t kSkinJointCount = 6;
+
+// The skinned BLAS and the hit shaders read the skinned vertices from a multiple of this many vertices on, which
+// puts the start at a multiple of 256 bytes, the largest storage buffer offset alignment Vulkan allows.
+static const uint32_t kSkinnedVertexAlignment = 16;
+
+// A submesh of the scene file as imported on the CPU, the framework keeps the geometry on the GPU only.
+struct SceneSubmesh
+{
+    SubmeshGeometry        geometry;           // Object space, triangles only.
+    std::vector<glm::vec2> tex_coords;         // Flipped the way the framework imports them. Empty without UVs.
+    std::string            material;           // Lower case name.
+    std::string            maps[VT_MAP_COUNT]; // Albedo, normal, roughness and metallic map paths, empty when missing.
+    bool                   matches = false;    // The triangles line up with the framework's submesh.
+};
+
+// Bindings of the global set of the ray tracing passes. Must match g_buffer.glsl, material_shading.glsl and
+// alpha_test.rahit.
+static const uint32_t kGlobalBindingPerFrame       = 0;
+static const uint32_t kGlobalBindingGBuffer        = 1; // G-Buffer 1, 2, 3 and depth
+static const uint32_t kGlobalBindingGeometry       = 5; // Material indices, vertices and indices, per mesh
+static const uint32_t kGlobalBindingTextures       = 8; // Albedo, normal, roughness and metallic maps, per material
+static const uint32_t kGlobalBindingOpacity        = 12; // Per triangle opacity, two bits per triangle, per mesh
+static const uint32_t kGlobalBindingVirtualTexture = 13; // Indirection, physical caches, texture table and feedback
+
+// Alpha cutoff of the G-Buffer, depth prepass and alpha test shaders.
+static const float kAlphaCutoff = 0.1f;
+
+// Scene loaded by the framework, and imported again on the CPU for occlusion culling.
+static const char* kSceneMeshPath = "mesh/sponza.obj";
+
+// Pages of every material texture, built from the scene's textures on the first run with virtual texturing.
+static const char* kVtPageFilePath = "mesh/sponza_vt.bin";
+
+// Texels per side of a frame's feedback buffer, 4K at kVtFeedbackScale, and pages uploaded per frame at most.
+static const uint32_t kVtFeedbackMaxSize    = 256;
+static const uint32_t kVtMaxUploadsPerFrame = 32;
+
+// Formats of the physical caches, with the texel sizes of kVtMapTexelSize.
+static const VkFormat kVtMapFormats[VT_MAP_COUNT] = { VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM, VK_FORMAT_R8_UNORM, VK_FORMAT_R8_UNORM };
 
-// Uniform buffer data structure.
-struct Transforms
+// Readback buffer sets of the frame capture. Frames in flight plus a couple that can wait for an encoder.
+static const uint32_t kCaptureRingSize = dw::vk::Backend::kMaxFramesInFlight + 2;
+
+// Frames whose timings are kept until their batch capture is encoded and sent.
+static const uint32_t kBatchTimingHistory = 32;
+
+// Worker threads of the startup graph, few of its phases can run at once.
+static const uint32_t kMaxStartupThreads = 4;
+
+enum CaptureTarget
+{
+    CAPTURE_TARGET_FINAL,
+    CAPTURE_TARGET_SHADOW_MASK,
+    CAPTURE_TARGET_REFLECTION,
+    CAPTURE_TARGET_G_BUFFER_1,
+    CAPTURE_TARGET_G_BUFFER_2,
+    CAPTURE_TARGET_G_BUFFER_3,
+    CAPTURE_TARGET_COUNT
+};
+
+static const char*         kCaptureTargetNames[CAPTURE_TARGET_COUNT]   = { "final", "shadow_mask", "reflection", "gbuffer1", "gbuffer2", "gbuffer3" };
+static const CaptureFormat kCaptureTargetFormats[CAPTURE_TARGET_COUNT] = { CAPTURE_FORMAT_RGBA16F, CAPTURE_FORMAT_R8_SNORM, CAPTURE_FORMAT_RGBA16F, CAPTURE_FORMAT_RGBA8, CAPTURE_FORMAT_RGBA16F, CAPTURE_FORMAT_RGBA32F };
+
+// One set of readback buffers of the capture ring.
+struct CaptureSlot
+{
+    dw::vk::Buffer::Ptr   buffers[CAPTURE_TARGET_COUNT];
+    uint32_t              width[CAPTURE_TARGET_COUNT]  = {};
+    uint32_t              height[CAPTURE_TARGET_COUNT] = {};
+    uint32_t              target_count                 = 0;
+    uint64_t              frame                        = 0;
+    uint32_t              frame_in_flight              = 0;
+    bool                  recorded                     = false;      // Copies submitted, waiting for the GPU.
+    uint32_t              batch_frame                  = UINT32_MAX; // Path frame of a batch capture.
+    std::atomic<uint32_t> pending { 0 };                             // Encodes still reading the buffers.
+};
+
+// Readbacks of the frame --validate-ray-stats traces on the CPU.
+struct RayStatsValidation
+{
+    dw::vk::Buffer::Ptr g_buffer[3];
+    dw::vk::Buffer::Ptr shadow_map; // Only with hybrid shadows.
+    dw::vk::Buffer::Ptr ray_list;   // Only with screen space reflections.
+    dw::vk::Buffer::Ptr hiz;        // Depth the screen space reflections march, with them.
+    dw::vk::Buffer::Ptr reservoirs; // Only with many lights.
+    RayTracingFrame     frame;      // Everything but the per-pixel data, filled in while recording.
+    SsrView             ssr_view;
+    SsrSettings         ssr_settings;
+    uint32_t            frame_in_flight = 0;
+    bool                recorded        = false;
+};
+
+// A frame of a batch job. Warmup frames only build up the temporal history of the frames after them.
+struct BatchFrame
+{
+    uint32_t path_frame    = 0;
+    bool     capture       = false;
+    bool     reset_history = false; // The camera jumps here.
+};
+
+// A batch capture the encoders are done with, waiting to be sent.
+struct BatchEncodedFrame
 {
-    DW_ALIGNED(16)
-    glm::mat4 view_inverse;
-    DW_ALIGNED(16)
-    glm::mat4 proj_inverse;
-    DW_ALIGNED(16)
-    glm::mat4 model;
-    DW_ALIGNED(16)
-    glm::mat4 view;
-    DW_ALIGNED(16)
-    glm::mat4 proj;
-    DW_ALIGNED(16)
-    glm::vec4 cam_pos;
-    DW_ALIGNED(16)
-    glm::vec4 light_dir;
+    uint32_t    path_frame;
+    uint64_t    frame; // Application frame it was rendered in.
+    std::string path;
 };
 
+struct BatchFrameTiming
+{
+    uint64_t frame  = UINT64_MAX;
+    float    cpu_ms = 0.0f;
+    float    gpu_ms = 0.0f;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Parses the value of a command line option, which has to be consumed whole. A malformed value is logged and leaves
+// 'value' at its default.
+static bool parse_option(const char* option, const char* text, float& value)
+{
+    char*       end    = nullptr;
+    const float parsed = strtof(text, &end);
+
+    if (end == text || *end != '\0')
+    {
+        DW_LOG_ERROR(std::string("Ignoring ") + option + ": '" + text + "' is not a number");
+        return false;
+    }
+
+    value = parsed;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool parse_option(const char* option, const char* text, uint32_t& value)
+{
+    char*                    end    = nullptr;
+    const unsigned long long parsed = strtoull(text, &end, 10);
+
+    if (end == text || *end != '\0' || text[0] == '-' || parsed > UINT32_MAX)
+    {
+        DW_LOG_ERROR(std::string("Ignoring ") + option + ": '" + text + "' is not a count");
+        return false;
+    }
+
+    value = uint32_t(parsed);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
 class Sample : public dw::Application
 {
+public:
+    // Non-zero when a --validate-* run found the GPU disagreeing with its CPU reference, for scripted runs.
+    inline int exit_code() const { return m_validation_failed ? 1 : 0; }
+
 protected:
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     bool init(int argc, const char* argv[]) override
     {
+        m_startup_start_ms = m_cpu_timer.now_ms();
+
         // Create GPU resources.
         if (!create_shaders())
             return false;
@@ -41,30 +303,145 @@ protected:
         if (!create_uniform_buffer())
             return false;
 
-        // Load mesh.
-        if (!load_mesh())
+        m_gpu_timer = std::unique_ptr<GpuTimer>(new GpuTimer(m_vk_backend));
+        m_gpu_timer->calibrate(m_vk_backend, m_cpu_timer);
+
+        for (int i = 1; i < argc; i++)
         {
-            DW_LOG_INFO("Failed to load mesh");
-            return false;
+            if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+            {
+                m_cpu_track = m_trace_exporter.register_track("CPU");
+                m_gpu_track = m_trace_exporter.register_track("GPU");
+                m_sim_track = m_trace_exporter.register_track("CPU Simulation");
+
+                if (!m_trace_exporter.open(argv[++i]))
+                    DW_LOG_ERROR("Failed to open trace file: " + std::string(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--record" && i + 1 < argc)
+                m_input_recorder.begin(argv[++i], m_width, m_height);
+            else if (std::string(argv[i]) == "--replay" && i + 1 < argc)
+            {
+                if (!m_input_replay.load(argv[++i]))
+                    DW_LOG_ERROR("Failed to load input recording: " + std::string(argv[i]));
+            }
+            else if (std::string(argv[i]) == "--timing-csv" && i + 1 < argc)
+                m_timing_csv_path = argv[++i];
+            else if (std::string(argv[i]) == "--resolution-trace" && i + 1 < argc)
+                m_resolution_trace_path = argv[++i];
+            else if (std::string(argv[i]) == "--baseline" && i + 1 < argc)
+                m_baseline_csv_path = argv[++i];
+            else if (std::string(argv[i]) == "--threshold-mean" && i + 1 < argc)
+                parse_option("--threshold-mean", argv[++i], m_regression_thresholds.mean_pct);
+            else if (std::string(argv[i]) == "--threshold-p95" && i + 1 < argc)
+                parse_option("--threshold-p95", argv[++i], m_regression_thresholds.p95_pct);
+            else if (std::string(argv[i]) == "--warmup-frames" && i + 1 < argc)
+                parse_option("--warmup-frames", argv[++i], m_regression_thresholds.warmup_frames);
+            else if (std::string(argv[i]) == "--fixed-timestep" && i + 1 < argc)
+                parse_option("--fixed-timestep", argv[++i], m_fixed_timestep);
+            else if (std::string(argv[i]) == "--visibility-buffer")
+                m_visibility_buffer = true;
+            else if (std::string(argv[i]) == "--no-depth-prepass")
+                m_depth_prepass = false;
+            else if (std::string(argv[i]) == "--no-occlusion-culling")
+                m_occlusion_culling = false;
+            else if (std::string(argv[i]) == "--no-frame-pipelining")
+                m_pipelined_simulation = false;
+            else if (std::string(argv[i]) == "--no-command-cache")
+                m_cache_commands = false;
+            else if (std::string(argv[i]) == "--no-alpha-tested-rays")
+                m_alpha_tested_rays = false;
+            else if (std::string(argv[i]) == "--no-ray-cones")
+                m_ray_cones = false;
+            else if (std::string(argv[i]) == "--no-ssr")
+                m_ssr = false;
+            else if (std::string(argv[i]) == "--no-compute-deferred")
+                m_compute_deferred = false;
+            else if (std::string(argv[i]) == "--no-skinning")
+                m_skinning = false;
+            else if (std::string(argv[i]) == "--skin-material" && i + 1 < argc)
+                m_skin_material = argv[++i];
+            else if (std::string(argv[i]) == "--validate-skinning")
+                m_validate_skinning = true;
+            else if (std::string(argv[i]) == "--validate-ray-stats")
+                m_validate_ray_stats = true;
+            else if (std::string(argv[i]) == "--virtual-texturing")
+                m_virtual_texturing = true;
+            else if (std::string(argv[i]) == "--vt-cache-slots" && i + 1 < argc)
+                parse_option("--vt-cache-slots", argv[++i], m_vt_slots_per_side);
+            else if (std::string(argv[i]) == "--capture" && i + 1 < argc)
+            {
+                m_capture_dir    = argv[++i];
+                m_capture_frames = true;
+            }
+            else if (std::string(argv[i]) == "--capture-aovs")
+                m_capture_aovs = true;
+            else if (std::string(argv[i]) == "--capture-threads" && i + 1 < argc)
+                parse_option("--capture-threads", argv[++i], m_capture_threads);
+            else if (std::string(argv[i]) == "--memory-report" && i + 1 < argc)
+                m_memory_report_path = argv[++i];
+            else if (std::string(argv[i]) == "--memory-budget-mb" && i + 1 < argc)
+                parse_option("--memory-budget-mb", argv[++i], m_memory_budget_mb);
+            else if (std::string(argv[i]) == "--pass-budget-mb" && i + 2 < argc)
+            {
+                const std::string pass   = argv[++i];
+                uint32_t          budget = 0;
+
+                if (parse_option("--pass-budget-mb", argv[++i], budget))
+                    m_pass_budgets_mb[pass] = budget;
+            }
+            else if (std::string(argv[i]) == "--serial-startup")
+                m_startup_threads = 0;
+            else if (std::string(argv[i]) == "--startup-report" && i + 1 < argc)
+                m_startup_report_path = argv[++i];
+            else if (std::string(argv[i]) == "--batch-worker" && i + 1 < argc)
+                m_batch_address = argv[++i];
+            else if (std::string(argv[i]) == "--lights" && i + 1 < argc)
+            {
+                uint32_t count = 0;
+
+                if (parse_option("--lights", argv[++i], count))
+                {
+                    m_light_count = std::min(count, kMaxLights);
+                    m_many_lights = true;
+                }
+            }
         }
 
-        load_blue_noise();
-        create_output_images();
-        create_render_passes();
-        create_framebuffers();
-        create_descriptor_set_layouts();
-        create_descriptor_sets();
-        write_descriptor_sets();
-        create_deferred_pipeline();
-        create_gbuffer_pipeline();
-        create_shadow_mask_ray_tracing_pipeline();
-        create_reflection_ray_tracing_pipeline();
+        // The CPU tracer only has the opaque, static scene.
+        if (m_validate_ray_stats)
+        {
+            m_ray_stats_enabled = true;
+            m_alpha_tested_rays = false;
+            m_skinning          = false;
+        }
+
+        // Replays are used for performance comparisons, so keep the amount of work per frame constant.
+        if (m_input_replay.is_loaded())
+        {
+            if (m_input_replay.width() != m_width || m_input_replay.height() != m_height)
+                DW_LOG_INFO("Input recording was captured at " + std::to_string(m_input_replay.width()) + "x" + std::to_string(m_input_replay.height()) + ", timings may not be comparable");
+
+            m_dynamic_resolution = false;
+        }
+
+        m_thread_pool = std::unique_ptr<ThreadPool>(new ThreadPool());
+
+        if (!create_scene_and_pipelines())
+            return false;
 
         // Create camera.
         create_camera();
 
         m_light_direction = glm::normalize(glm::vec3(0.2f, 0.9770f, 0.2f));
 
+        create_lights();
+
+        create_memory_budget();
+        check_memory_budget();
+
+        if (!m_batch_address.empty() && !start_batch_worker())
+            return false;
+
         return true;
     }
 
@@ -72,6 +449,12 @@ protected:
 
     void update(double delta) override
     {
+        // The worker simulated this frame while the previous one was being recorded.
+        const float  stall_ms       = m_frame_pipeline.wait();
+        const double frame_start_ms = m_cpu_timer.now_ms();
+
+        FrameState& state = m_frame_states[m_frame_index % dw::vk::Backend::kMaxFramesInFlight];
+
         dw::vk::CommandBuffer::Ptr cmd_buf = m_vk_backend->allocate_graphics_command_buffer();
 
         VkCommandBufferBeginInfo begin_info;
@@ -81,44 +464,200 @@ protected:
 
         vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
 
+        const bool gpu_timings_resolved = m_gpu_timer->begin_frame(cmd_buf, m_vk_backend->current_frame_idx());
+
+        m_cpu_timer.begin_frame();
+
         {
-            DW_SCOPED_SAMPLE("update", cmd_buf);
+            SCOPED_SAMPLE("update", cmd_buf);
 
             // Render profiler.
-            //dw::profiler::ui();
+            if (m_debug_gui && m_show_profiler)
+                dw::profiler::ui();
+
+            if (m_debug_gui)
+                debug_gui();
+
+            // Take the next frame of the batch job, which may wait for the coordinator.
+            if (m_batch_client)
+                next_batch_frame();
+
+            // Pick the internal resolution for this frame.
+            update_dynamic_resolution(gpu_timings_resolved);
 
-            // Update camera.
-            update_camera();
+            // Collect the ray counters of the frame that last used this slot and reset them.
+            update_ray_stats(cmd_buf, gpu_timings_resolved);
 
-            // Update uniforms.
-            update_uniforms(cmd_buf);
+            // Stream in the pages the feedback of the frame that last used this slot asked for.
+            update_virtual_texturing(cmd_buf);
+
+            // Hand the captures of the frame that last used this slot to the encoders.
+            collect_captures();
+
+            // Send the batch frames the encoders finished.
+            if (m_batch_client)
+                update_batch_worker(gpu_timings_resolved);
+
+            // Simulate this frame here unless the worker already did, then start on the next one so that it runs
+            // while this one is recorded and submitted.
+            if (state.frame != m_frame_index)
+                simulate_frame(m_frame_index, capture_simulation_input());
+
+            if (m_pipelined_simulation)
+            {
+                const uint64_t        next_frame = m_frame_index + 1;
+                const SimulationInput input      = capture_simulation_input();
+
+                m_frame_pipeline.kick([this, next_frame, input]() { simulate_frame(next_frame, input); });
+            }
+
+            // Update lights and uniforms.
+            update_lights(state);
+            update_uniforms(cmd_buf, state);
+
+            // Deform the skinned geometry before anything reads it.
+            update_skinned_geometry(cmd_buf, state);
 
             // Render.
-            render_gbuffer(cmd_buf);
+            render_shadow_map(cmd_buf);
+
+            if (m_visibility_buffer)
+                render_visibility_buffer(cmd_buf);
+            else
+                render_gbuffer(cmd_buf);
+
             ray_trace_shadow_mask(cmd_buf);
+            trace_screen_space_reflections(cmd_buf);
             ray_trace_reflection(cmd_buf);
+            ray_trace_lights(cmd_buf);
+            render_deferred(cmd_buf);
 
             render(cmd_buf);
+
+            record_capture(cmd_buf);
+            record_ray_stats_validation(cmd_buf, state);
         }
 
         vkEndCommandBuffer(cmd_buf->handle());
 
+        update_command_cache_stats();
+
+        m_frame_descriptor_bind_calls = m_descriptor_bind_calls;
+        m_frame_descriptor_sets_bound = m_descriptor_sets_bound;
+        m_descriptor_bind_calls       = 0;
+        m_descriptor_sets_bound       = 0;
+
         submit_and_present({ cmd_buf });
+
+        m_cpu_timer.end_frame();
+
+        if (m_frame_index == 0)
+            report_first_frame();
+
+        if (m_ray_stats_validation.recorded)
+            validate_ray_stats();
+
+        if (m_batch_client)
+        {
+            BatchFrameTiming& timing = m_batch_timings[m_frame_index % kBatchTimingHistory];
+
+            timing.frame  = m_frame_index;
+            timing.cpu_ms = float(m_cpu_timer.now_ms() - frame_start_ms);
+            timing.gpu_ms = 0.0f;
+        }
+
+        m_frame_pipeline.record_frame(frame_start_ms, float(m_cpu_timer.now_ms() - frame_start_ms), state.sim_ms, stall_ms, gpu_timings_resolved ? m_gpu_timer->elapsed_ms("update") : 0.0f);
+
+        if (m_trace_exporter.is_open())
+            export_timings(gpu_timings_resolved, state);
+
+        if (!m_timing_csv_path.empty() || !m_baseline_csv_path.empty())
+            record_frame_timings(gpu_timings_resolved, state, stall_ms);
+
+        if (m_input_replay.is_loaded() && m_input_replay.is_finished())
+            finish_replay();
+
+        m_frame_index++;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     void shutdown() override
     {
+        m_frame_pipeline.wait();
+
+        // Captures still in flight are finished here rather than dropped.
+        if (m_capture_writer)
+        {
+            m_vk_backend->wait_idle();
+
+            for (uint32_t i = 0; i < kCaptureRingSize; i++)
+                submit_capture(m_capture_slots[i]);
+
+            m_capture_writer->wait();
+            release_capture_buffers();
+        }
+
+        // Frames of an unfinished job go back to the queue when the connection closes.
+        if (m_batch_client)
+        {
+            update_batch_worker(false);
+            m_batch_client->disconnect();
+        }
+
+        if (!m_memory_report_path.empty())
+            write_memory_report();
+
+        // Replayed by CpuBenchmark --timing-trace.
+        if (!m_resolution_trace_path.empty() && !save_timing_trace(m_resolution_trace_path, m_resolution_trace))
+            DW_LOG_ERROR("Failed to write resolution trace: " + m_resolution_trace_path);
+
+        if (m_input_recorder.is_recording())
+        {
+            const size_t frame_count = m_input_recorder.frame_count();
+
+            if (m_input_recorder.end())
+                DW_LOG_INFO("Recorded " + std::to_string(frame_count) + " frames of input");
+            else
+                DW_LOG_ERROR("Failed to write input recording");
+        }
+
+        if (m_trace_exporter.is_open())
+        {
+            m_trace_exporter.close();
+            DW_LOG_INFO("Frame timing summary:\n" + m_trace_exporter.summary());
+        }
+
+        m_gpu_timer.reset();
+        m_g_buffer_commands.reset();
+        m_depth_prepass_commands.reset();
+        m_shadow_map_commands.reset();
+        m_deferred_commands.reset();
+        m_reflection_commands.reset();
+        m_occlusion_culler.reset();
+        m_thread_pool.reset();
+        m_copy_ds[0].reset();
+        m_copy_ds[1].reset();
+        m_copy_ds_layout.reset();
+        m_copy_pipeline.reset();
+        m_copy_pipeline_layout.reset();
+        m_deferred_ds[0].reset();
+        m_deferred_ds[1].reset();
+        m_deferred_fbo[0].reset();
+        m_deferred_fbo[1].reset();
+        m_deferred_rp.reset();
+        m_history_view[0].reset();
+        m_history_view[1].reset();
+        m_history_image[0].reset();
+        m_history_image[1].reset();
         m_blue_noise.reset();
         m_blue_noise_view.reset();
         m_reflection_ds.reset();
-        m_deferred_ds.reset();
         m_per_frame_ds.reset();
-        m_g_buffer_ds.reset();
+        m_global_ds.reset();
         m_shadow_mask_ds.reset();
         m_per_frame_ds_layout.reset();
-        m_g_buffer_ds_layout.reset();
+        m_global_ds_layout.reset();
         m_reflection_ds_layout.reset();
         m_shadow_mask_ds_layout.reset();
         m_shadow_mask_pipeline_layout.reset();
@@ -127,12 +666,32 @@ protected:
         m_deferred_layout.reset();
         m_deferred_pipeline_layout.reset();
         m_ubo.reset();
+        m_ray_stats_buffer.reset();
         m_deferred_pipeline.reset();
+        m_deferred_compute_pipeline.reset();
         m_shadow_mask_pipeline.reset();
         m_g_buffer_pipeline.reset();
         m_reflection_pipeline.reset();
         m_g_buffer_fbo.reset();
         m_g_buffer_rp.reset();
+        m_g_buffer_masked_pipeline.reset();
+        m_g_buffer_equal_pipeline.reset();
+        m_g_buffer_load_depth_rp.reset();
+        m_depth_prepass_pipeline.reset();
+        m_depth_prepass_masked_pipeline.reset();
+        m_depth_prepass_fbo.reset();
+        m_depth_prepass_rp.reset();
+        m_visibility_resolve_pipeline.reset();
+        m_visibility_resolve_sbt.reset();
+        m_visibility_resolve_pipeline_layout.reset();
+        m_visibility_pipeline.reset();
+        m_visibility_pipeline_layout.reset();
+        m_visibility_ds.reset();
+        m_visibility_ds_layout.reset();
+        m_visibility_fbo.reset();
+        m_visibility_rp.reset();
+        m_visibility_view.reset();
+        m_visibility_image.reset();
         m_reflection_view.reset();
         m_shadow_mask_view.reset();
         m_g_buffer_1_view.reset();
@@ -148,7 +707,92 @@ protected:
         m_g_buffer_3.reset();
         m_g_buffer_depth.reset();
         m_shadow_mask_sbt.reset();
+        m_shadow_refine_pipeline.reset();
+        m_shadow_refine_sbt.reset();
+        m_shadow_visibility_view.reset();
+        m_shadow_visibility_image.reset();
         m_reflection_sbt.reset();
+        m_reflection_record_pipeline.reset();
+        m_reflection_record_sbt.reset();
+        m_reflection_shade_pipeline.reset();
+        m_reflection_shade_sbt.reset();
+        m_reflection_scan_pipeline.reset();
+        m_reflection_scatter_pipeline.reset();
+        m_reflection_bin_pipeline_layout.reset();
+        m_reflection_bin_ds.reset();
+        m_reflection_bin_ds_layout.reset();
+        m_hit_record_buffer.reset();
+        m_material_bin_buffer.reset();
+        m_sorted_hit_buffer.reset();
+        m_ssr_pipeline.reset();
+        m_ssr_pipeline_layout.reset();
+        m_ssr_ds.reset();
+        m_ssr_ds_layout.reset();
+        m_hiz_pipeline.reset();
+        m_hiz_pipeline_layout.reset();
+
+        for (uint32_t i = 0; i < kHiZLevels; i++)
+        {
+            m_hiz_ds[i].reset();
+            m_hiz_level_views[i].reset();
+        }
+
+        m_hiz_ds_layout.reset();
+        m_hiz_view.reset();
+        m_hiz_image.reset();
+        m_ray_list_buffer.reset();
+        m_lights_ds.reset();
+        m_lights_ds_layout.reset();
+        m_lights_pipeline_layout.reset();
+        m_light_resample_pipeline.reset();
+        m_light_resample_sbt.reset();
+        m_light_shade_pipeline.reset();
+        m_light_shade_sbt.reset();
+        m_lighting_view.reset();
+        m_lighting_image.reset();
+        m_light_buffer.reset();
+        m_reservoir_buffer.reset();
+        m_prev_reservoir_buffer.reset();
+        m_shadow_map_pipeline.reset();
+        m_shadow_map_pipeline_layout.reset();
+        for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+        {
+            m_shadow_map_fbo[i].reset();
+            m_shadow_map_layer_view[i].reset();
+        }
+        m_shadow_map_rp.reset();
+        m_shadow_map_view.reset();
+        m_shadow_map.reset();
+
+        m_skinned_tlas.reset();
+        m_skinned_blas.reset();
+        m_instance_buffer.reset();
+        m_as_scratch_buffer.reset();
+        m_skinning_ds.reset();
+        m_skinning_pipeline.reset();
+        m_skinning_pipeline_layout.reset();
+        m_skinning_ds_layout.reset();
+        m_joint_buffer.reset();
+        m_influence_buffer.reset();
+        m_skinned_vertex_buffer.reset();
+        m_skinned_index_buffer.reset();
+        m_skinned_opacity_buffer.reset();
+
+        // Stops the streaming thread before the page file closes.
+        m_vt_streamer.reset();
+        m_vt_ds.reset();
+        m_vt_ds_layout.reset();
+        m_vt_staging_buffer.reset();
+        m_vt_feedback_buffer.reset();
+        m_vt_texture_buffer.reset();
+        m_vt_indirection_view.reset();
+        m_vt_indirection_image.reset();
+        for (uint32_t i = 0; i < VT_MAP_COUNT; i++)
+        {
+            m_vt_physical_view[i].reset();
+            m_vt_physical_image[i].reset();
+        }
+        m_vt_page_file.close();
 
         // Unload assets.
         m_scene.reset();
@@ -231,14 +875,35 @@ protected:
 
     void window_resized(int width, int height) override
     {
+        // The camera belongs to the simulation stage until it finishes.
+        m_frame_pipeline.wait();
+
         // Override window resized method to update camera projection.
         m_main_camera->update_projection(60.0f, 0.1f, 10000.0f, float(m_width) / float(m_height));
 
         m_vk_backend->wait_idle();
 
+        m_reset_history = true;
+
         create_output_images();
         create_framebuffers();
         write_descriptor_sets();
+
+        // Every recording references the old framebuffers and descriptor sets.
+        m_command_generation++;
+
+        // Pending captures were made for the old size. Nothing is in flight on the GPU anymore, so let the
+        // encoders finish with them and reallocate the ring at the next capture.
+        if (m_capture_writer)
+        {
+            for (uint32_t i = 0; i < kCaptureRingSize; i++)
+                submit_capture(m_capture_slots[i]);
+
+            m_capture_writer->wait();
+            release_capture_buffers();
+        }
+
+        check_memory_budget();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -253,12 +918,109 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
+    // Runs the startup work as a dependency graph. Phases that record or submit command buffers, allocate
+    // descriptor sets or write them stay on the main thread, in the order they are added here, while the workers
+    // compile the pipelines and prepare the CPU side data. The mesh goes first since most of the pipelines wait
+    // for its vertex layout or material count, after which the ray tracing pipelines build while the main thread
+    // builds the acceleration structures and uploads the rest.
+    bool create_scene_and_pipelines()
+    {
+        const StartupThread kMain = STARTUP_THREAD_MAIN;
+        const StartupThread kAny  = STARTUP_THREAD_ANY;
+
+        StartupGraph& graph = m_startup_graph;
+
+        const uint32_t mesh       = graph.add("Load Mesh", {}, kMain, [this]() { return load_mesh(); });
+        const uint32_t blue_noise = graph.add("Blue Noise", {}, kMain, [this]() { load_blue_noise(); return true; });
+        const uint32_t accel      = graph.add("Acceleration Structures", { mesh }, kMain, [this]() { build_acceleration_structures(); return true; });
+        const uint32_t outputs    = graph.add("Output Images", {}, kMain, [this]() { create_output_images(); return true; });
+        const uint32_t passes     = graph.add("Render Passes", {}, kAny, [this]() { create_render_passes(); return true; });
+        const uint32_t shadow_map = graph.add("Shadow Map", { passes }, kMain, [this]() { create_shadow_map(); return true; });
+        const uint32_t layouts    = graph.add("Descriptor Set Layouts", {}, kAny, [this]() { create_descriptor_set_layouts(); return true; });
+        const uint32_t global     = graph.add("Global Descriptor Set Layout", { mesh }, kAny, [this]() { create_global_descriptor_set_layout(); return true; });
+
+        // The scene file is imported on the CPU once, for every phase that reads its geometry or materials.
+        const uint32_t scene = graph.add("Scene Import", { mesh }, kAny, [this]() { import_scene(); return true; });
+
+        // The triangle opacity, the occlusion culler and the virtual texture pages split their work over the thread
+        // pool, which only takes one job at a time, so they wait for one another. The textures are read with
+        // stb_image, whose flip setting is a global that the framework's image loading sets.
+        const uint32_t opacity = graph.add("Triangle Opacity", { scene, blue_noise }, kAny, [this]() { create_triangle_opacity_buffer(); return true; });
+
+        // Replaces the mesh's vertex buffer and acceleration structures in the descriptor sets when a submesh is
+        // skinned, and hides the skinned triangles' bind pose in the triangle opacity.
+        const uint32_t skinning = graph.add("Skinning Pipeline", { layouts }, kAny, [this]() { create_skinning_pipeline(); return true; });
+        const uint32_t skinned  = graph.add("Skinned Geometry", { scene, accel, opacity, skinning }, kMain, [this]() { create_skinned_geometry(); return true; });
+
+        const uint32_t culler = graph.add("Occlusion Culler", { scene, opacity, skinned }, kAny, [this]() { create_occlusion_culler(); return true; });
+
+        const uint32_t vt_pages = graph.add("Virtual Texture Pages", { scene, culler }, kAny, [this]() { create_virtual_texture_pages(); return true; });
+        const uint32_t vt       = graph.add("Virtual Texture Cache", { vt_pages }, kMain, [this]() { create_virtual_texture_cache(); return true; });
+
+        graph.add("Framebuffers", { passes, outputs }, kAny, [this]() { create_framebuffers(); return true; });
+        graph.add("Deferred Pipeline", { layouts, passes }, kAny, [this]() { create_deferred_pipeline(); return true; });
+        graph.add("Copy Pipeline", { layouts }, kAny, [this]() { create_copy_pipeline(); return true; });
+        graph.add("Reflection Binning Pipelines", { layouts }, kAny, [this]() { create_reflection_binning_pipelines(); return true; });
+        graph.add("Screen Space Reflection Pipelines", { layouts }, kAny, [this]() { create_screen_space_reflection_pipelines(); return true; });
+        graph.add("G-Buffer Pipelines", { mesh, layouts, passes }, kAny, [this]() { create_gbuffer_pipeline(); return true; });
+        graph.add("Visibility Pipelines", { mesh, layouts, global, passes }, kAny, [this]() { create_visibility_pipelines(); return true; });
+        graph.add("Shadow Map Pipeline", { mesh, layouts, passes }, kAny, [this]() { create_shadow_map_pipeline(); return true; });
+        graph.add("Shadow Ray Tracing Pipelines", { layouts, global }, kAny, [this]() { create_shadow_mask_ray_tracing_pipeline(); return true; });
+        graph.add("Reflection Ray Tracing Pipelines", { layouts, global }, kAny, [this]() { create_reflection_ray_tracing_pipeline(); return true; });
+        graph.add("Light Ray Tracing Pipelines", { layouts, global }, kAny, [this]() { create_light_ray_tracing_pipelines(); return true; });
+
+        const uint32_t sets = graph.add("Descriptor Sets", { layouts, global, accel, skinned }, kMain, [this]() { create_descriptor_sets(); return true; });
+
+        graph.add("Write Descriptor Sets", { sets, accel, blue_noise, outputs, shadow_map, opacity, skinned, vt }, kMain, [this]() { write_descriptor_sets(); return true; });
+
+        graph.add("Command Caches", {}, kMain, [this]() { create_command_caches(); return true; });
+
+        const bool success = graph.run(m_startup_threads);
+
+        // Only the startup phases read the imported scene and the unpacked triangle opacity.
+        m_scene_submeshes.clear();
+        m_scene_submeshes.shrink_to_fit();
+        m_triangle_opacity.clear();
+        m_triangle_opacity.shrink_to_fit();
+
+        for (const auto& line : graph.report())
+            DW_LOG_INFO(line);
+
+        if (!success)
+            DW_LOG_ERROR("Startup failed in phase: " + graph.failed_phase());
+
+        return success;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void report_first_frame()
+    {
+        const double first_frame_ms = m_cpu_timer.now_ms() - m_startup_start_ms;
+
+        DW_LOG_INFO("First frame submitted " + std::to_string(first_frame_ms) + " ms after the start of initialization, " + std::to_string(m_startup_graph.wall_ms()) + " ms of it in the startup graph");
+
+        if (!m_startup_report_path.empty())
+        {
+            if (m_startup_graph.write_json(m_startup_report_path, first_frame_ms))
+                DW_LOG_INFO("Startup report written to " + m_startup_report_path);
+            else
+                DW_LOG_ERROR("Failed to write startup report: " + m_startup_report_path);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
     void create_output_images()
     {
         m_shadow_mask_image.reset();
         m_shadow_mask_view.reset();
+        m_shadow_visibility_image.reset();
+        m_shadow_visibility_view.reset();
         m_reflection_image.reset();
         m_reflection_view.reset();
+        m_lighting_image.reset();
+        m_lighting_view.reset();
         m_g_buffer_1.reset();
         m_g_buffer_2.reset();
         m_g_buffer_3.reset();
@@ -267,22 +1029,176 @@ private:
         m_g_buffer_2_view.reset();
         m_g_buffer_3_view.reset();
         m_g_buffer_depth_view.reset();
+        m_history_image[0].reset();
+        m_history_image[1].reset();
+        m_history_view[0].reset();
+        m_history_view[1].reset();
 
-        m_shadow_mask_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R8_SNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_shadow_mask_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R8_SNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_shadow_mask_view  = dw::vk::ImageView::create(m_vk_backend, m_shadow_mask_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        m_reflection_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_shadow_visibility_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_shadow_visibility_view  = dw::vk::ImageView::create(m_vk_backend, m_shadow_visibility_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        m_reflection_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_reflection_view  = dw::vk::ImageView::create(m_vk_backend, m_reflection_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
 
-        m_g_buffer_1     = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
-        m_g_buffer_2     = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
-        m_g_buffer_3     = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_lighting_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_lighting_view  = dw::vk::ImageView::create(m_vk_backend, m_lighting_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        m_g_buffer_1     = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R8G8B8A8_UNORM, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_g_buffer_2     = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_g_buffer_3     = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R32G32B32A32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
         m_g_buffer_depth = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, m_vk_backend->swap_chain_depth_format(), VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
 
         m_g_buffer_1_view     = dw::vk::ImageView::create(m_vk_backend, m_g_buffer_1, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_g_buffer_2_view     = dw::vk::ImageView::create(m_vk_backend, m_g_buffer_2, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_g_buffer_3_view     = dw::vk::ImageView::create(m_vk_backend, m_g_buffer_3, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
         m_g_buffer_depth_view = dw::vk::ImageView::create(m_vk_backend, m_g_buffer_depth, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT);
+
+        // The render targets above are allocated at the output resolution and only the top-left
+        // corner is used when rendering at a lower scale, so changing the scale never reallocates.
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            m_history_image[i] = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_width, m_height, 1, 1, 1, VK_FORMAT_R16G16B16A16_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+            m_history_view[i]  = dw::vk::ImageView::create(m_vk_backend, m_history_image[i], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+
+        m_reset_history = true;
+
+        track_output_images();
+
+        // The resources of features that can be switched off. Their descriptor sets stay bound either way, so a
+        // disabled feature keeps a single element or pixel of each and switching it reallocates them.
+        create_light_reservoirs();
+        create_reflection_hit_buffers();
+        create_screen_space_reflection_targets();
+        create_visibility_targets();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Tracking the window sized resources again after a resize releases the allocations they replaced.
+    void track_output_images()
+    {
+        const std::string extent = std::to_string(m_width) + "x" + std::to_string(m_height);
+
+        track_image("Shadow Mask", "Shadows", m_shadow_mask_image, extent + " R8_SNORM", true);
+        track_image("Shadow Visibility", "Shadows", m_shadow_visibility_image, extent + " R16G16_SFLOAT", true);
+        track_image("Reflection", "Reflections", m_reflection_image, extent + " R16G16B16A16_SFLOAT", true);
+        track_image("Lighting", "Many Lights", m_lighting_image, extent + " R16G16B16A16_SFLOAT", true);
+        track_image("G-Buffer 1", "G-Buffer", m_g_buffer_1, extent + " R8G8B8A8_UNORM", true);
+        track_image("G-Buffer 2", "G-Buffer", m_g_buffer_2, extent + " R16G16B16A16_SFLOAT", true);
+        track_image("G-Buffer 3", "G-Buffer", m_g_buffer_3, extent + " R32G32B32A32_SFLOAT", true);
+        track_image("G-Buffer Depth", "G-Buffer", m_g_buffer_depth, extent + " depth", true);
+        track_image("History 0", "Deferred", m_history_image[0], extent + " R16G16B16A16_SFLOAT", true);
+        track_image("History 1", "Deferred", m_history_image[1], extent + " R16G16B16A16_SFLOAT", true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // One reservoir per pixel for the current frame and one kept for temporal reuse in the next.
+    void create_light_reservoirs()
+    {
+        const uint32_t pixels = m_many_lights ? m_width * m_height : 1;
+
+        m_reservoir_buffer.reset();
+        m_prev_reservoir_buffer.reset();
+
+        m_reservoir_buffer      = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(LightReservoir) * pixels, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        m_prev_reservoir_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(LightReservoir) * pixels, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        m_reset_reservoirs      = true;
+
+        const std::string extent = m_many_lights ? std::to_string(m_width) + "x" + std::to_string(m_height) : "1";
+
+        track_buffer("Reservoirs", "Many Lights", m_reservoir_buffer, MEMORY_LOCATION_DEVICE, extent + " x LightReservoir", true);
+        track_buffer("Previous Reservoirs", "Many Lights", m_prev_reservoir_buffer, MEMORY_LOCATION_DEVICE, extent + " x LightReservoir", true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // One hit record and one sorted index per pixel for deferred reflection shading.
+    void create_reflection_hit_buffers()
+    {
+        const uint32_t pixels = m_deferred_reflections ? m_width * m_height : 1;
+
+        m_hit_record_buffer.reset();
+        m_sorted_hit_buffer.reset();
+
+        m_hit_record_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, kHitRecordSize * pixels, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        m_sorted_hit_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * pixels, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+        const std::string extent = m_deferred_reflections ? std::to_string(m_width) + "x" + std::to_string(m_height) : "1";
+
+        track_buffer("Hit Records", "Reflections", m_hit_record_buffer, MEMORY_LOCATION_DEVICE, extent + " x " + std::to_string(kHitRecordSize) + " bytes", true);
+        track_buffer("Sorted Hits", "Reflections", m_sorted_hit_buffer, MEMORY_LOCATION_DEVICE, extent + " x uint", true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The pixels the screen space reflections left for the ray traced pass, after a count and padding, and the
+    // nearest depth pyramid they march, with one view per level to build it and one to march it. Without them the
+    // pyramid is as small as its levels allow.
+    void create_screen_space_reflection_targets()
+    {
+        const uint32_t pixels     = m_ssr ? m_width * m_height : 1;
+        const uint32_t hiz_width  = hiz_base_size(m_ssr ? m_width : 1);
+        const uint32_t hiz_height = hiz_base_size(m_ssr ? m_height : 1);
+
+        m_ray_list_buffer.reset();
+
+        for (uint32_t i = 0; i < kHiZLevels; i++)
+            m_hiz_level_views[i].reset();
+
+        m_hiz_view.reset();
+        m_hiz_image.reset();
+
+        m_ray_list_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, sizeof(uint32_t) * (4 + pixels), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+        m_hiz_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, hiz_width, hiz_height, 1, kHiZLevels, 1, VK_FORMAT_R32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_hiz_view  = dw::vk::ImageView::create(m_vk_backend, m_hiz_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, 0, kHiZLevels, 0, 1);
+
+        for (uint32_t i = 0; i < kHiZLevels; i++)
+            m_hiz_level_views[i] = dw::vk::ImageView::create(m_vk_backend, m_hiz_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, i, 1, 0, 1);
+
+        const std::string extent = m_ssr ? std::to_string(m_width) + "x" + std::to_string(m_height) : "1";
+
+        track_buffer("Ray List", "Reflections", m_ray_list_buffer, MEMORY_LOCATION_DEVICE, extent + " x uint", true);
+        track_image("Hierarchical Depth", "Reflections", m_hiz_image, std::to_string(hiz_width) + "x" + std::to_string(hiz_height) + " R32_SFLOAT, " + std::to_string(kHiZLevels) + " mips", true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Triangle and instance ID of the visibility buffer mode, which shares the G-Buffer depth. Its framebuffer only
+    // exists while the mode is on.
+    void create_visibility_targets()
+    {
+        const uint32_t width  = m_visibility_buffer ? m_width : 1;
+        const uint32_t height = m_visibility_buffer ? m_height : 1;
+
+        m_visibility_fbo.reset();
+        m_visibility_view.reset();
+        m_visibility_image.reset();
+
+        m_visibility_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, width, height, 1, 1, 1, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_visibility_view  = dw::vk::ImageView::create(m_vk_backend, m_visibility_image, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        track_image("Visibility", "Visibility Buffer", m_visibility_image, std::to_string(width) + "x" + std::to_string(height) + " R32_UINT", true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Called when a feature above is switched, right after the frame pipeline was waited for. Nothing in flight may
+    // still use the old resources, and every recording references the old descriptor sets and framebuffers.
+    void reallocate_feature_resources(const std::function<void()>& create)
+    {
+        m_vk_backend->wait_idle();
+
+        create();
+        create_framebuffers();
+        write_descriptor_sets();
+
+        m_command_generation++;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -329,7 +1245,7 @@ private:
         attachments[3].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_CLEAR;
         attachments[3].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         attachments[3].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
-        attachments[3].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+        attachments[3].finalLayout    = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
         VkAttachmentReference gbuffer_references[3];
 
@@ -371,30 +1287,230 @@ private:
 
         dependencies[1].srcSubpass      = 0;
         dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
-        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
         dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        dependencies[1].srcAccessMask   = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
         dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
         dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
         m_g_buffer_rp = dw::vk::RenderPass::create(m_vk_backend, attachments, subpass_description, dependencies);
-    }
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        {
+            // Same G-Buffer pass, but keeping the depth written by the prepass.
+            std::vector<VkAttachmentDescription> load_attachments = attachments;
 
-    void create_framebuffers()
-    {
-        m_g_buffer_fbo.reset();
-        m_g_buffer_fbo = dw::vk::Framebuffer::create(m_vk_backend, m_g_buffer_rp, { m_g_buffer_1_view, m_g_buffer_2_view, m_g_buffer_3_view, m_g_buffer_depth_view }, m_width, m_height, 1);
-    }
+            load_attachments[3].loadOp        = VK_ATTACHMENT_LOAD_OP_LOAD;
+            load_attachments[3].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            load_attachments[3].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+            std::vector<VkSubpassDependency> load_dependencies = dependencies;
 
-    bool create_uniform_buffer()
-    {
+            load_dependencies[0].srcStageMask |= VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            load_dependencies[0].dstStageMask |= VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+            load_dependencies[0].srcAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            load_dependencies[0].dstAccessMask |= VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT;
+
+            m_g_buffer_load_depth_rp = dw::vk::RenderPass::create(m_vk_backend, load_attachments, subpass_description, load_dependencies);
+        }
+
+        {
+            // Depth prepass: only the G-Buffer depth attachment, left writable for the G-Buffer pass.
+            std::vector<VkAttachmentDescription> prepass_attachments(1, attachments[3]);
+
+            prepass_attachments[0].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            VkAttachmentReference prepass_depth_reference;
+            prepass_depth_reference.attachment = 0;
+            prepass_depth_reference.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            std::vector<VkSubpassDescription> prepass_subpass(1, subpass_description[0]);
+
+            prepass_subpass[0].colorAttachmentCount    = 0;
+            prepass_subpass[0].pColorAttachments       = nullptr;
+            prepass_subpass[0].pDepthStencilAttachment = &prepass_depth_reference;
+
+            m_depth_prepass_rp = dw::vk::RenderPass::create(m_vk_backend, prepass_attachments, prepass_subpass, dependencies);
+        }
+
+        {
+            // Visibility buffer: a single ID target and the same depth attachment, read by the resolve and ray tracing passes.
+            std::vector<VkAttachmentDescription> visibility_attachments(2);
+
+            visibility_attachments[0].format         = VK_FORMAT_R32_UINT;
+            visibility_attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+            visibility_attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            visibility_attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+            visibility_attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            visibility_attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            visibility_attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+            visibility_attachments[0].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            visibility_attachments[1] = attachments[3];
+
+            VkAttachmentReference visibility_reference;
+            visibility_reference.attachment = 0;
+            visibility_reference.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            VkAttachmentReference visibility_depth_reference;
+            visibility_depth_reference.attachment = 1;
+            visibility_depth_reference.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            std::vector<VkSubpassDescription> visibility_subpass(1);
+
+            visibility_subpass[0]                         = subpass_description[0];
+            visibility_subpass[0].colorAttachmentCount    = 1;
+            visibility_subpass[0].pColorAttachments       = &visibility_reference;
+            visibility_subpass[0].pDepthStencilAttachment = &visibility_depth_reference;
+
+            m_visibility_rp = dw::vk::RenderPass::create(m_vk_backend, visibility_attachments, visibility_subpass, dependencies);
+        }
+
+        {
+            std::vector<VkAttachmentDescription> deferred_attachments(1);
+
+            // Temporal history attachment
+            deferred_attachments[0].format         = VK_FORMAT_R16G16B16A16_SFLOAT;
+            deferred_attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+            deferred_attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            deferred_attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+            deferred_attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            deferred_attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            deferred_attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+            deferred_attachments[0].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkAttachmentReference color_reference;
+            color_reference.attachment = 0;
+            color_reference.layout     = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+            std::vector<VkSubpassDescription> deferred_subpass_description(1);
+
+            deferred_subpass_description[0].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            deferred_subpass_description[0].colorAttachmentCount    = 1;
+            deferred_subpass_description[0].pColorAttachments       = &color_reference;
+            deferred_subpass_description[0].pDepthStencilAttachment = nullptr;
+            deferred_subpass_description[0].inputAttachmentCount    = 0;
+            deferred_subpass_description[0].pInputAttachments       = nullptr;
+            deferred_subpass_description[0].preserveAttachmentCount = 0;
+            deferred_subpass_description[0].pPreserveAttachments    = nullptr;
+            deferred_subpass_description[0].pResolveAttachments     = nullptr;
+
+            m_deferred_rp = dw::vk::RenderPass::create(m_vk_backend, deferred_attachments, deferred_subpass_description, dependencies);
+        }
+
+        {
+            std::vector<VkAttachmentDescription> shadow_map_attachments(1);
+
+            // Cascade depth attachment
+            shadow_map_attachments[0].format         = VK_FORMAT_D32_SFLOAT;
+            shadow_map_attachments[0].samples        = VK_SAMPLE_COUNT_1_BIT;
+            shadow_map_attachments[0].loadOp         = VK_ATTACHMENT_LOAD_OP_CLEAR;
+            shadow_map_attachments[0].storeOp        = VK_ATTACHMENT_STORE_OP_STORE;
+            shadow_map_attachments[0].stencilLoadOp  = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+            shadow_map_attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            shadow_map_attachments[0].initialLayout  = VK_IMAGE_LAYOUT_UNDEFINED;
+            shadow_map_attachments[0].finalLayout    = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkAttachmentReference shadow_map_depth_reference;
+            shadow_map_depth_reference.attachment = 0;
+            shadow_map_depth_reference.layout     = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+            std::vector<VkSubpassDescription> shadow_map_subpass_description(1);
+
+            shadow_map_subpass_description[0].pipelineBindPoint       = VK_PIPELINE_BIND_POINT_GRAPHICS;
+            shadow_map_subpass_description[0].colorAttachmentCount    = 0;
+            shadow_map_subpass_description[0].pColorAttachments       = nullptr;
+            shadow_map_subpass_description[0].pDepthStencilAttachment = &shadow_map_depth_reference;
+            shadow_map_subpass_description[0].inputAttachmentCount    = 0;
+            shadow_map_subpass_description[0].pInputAttachments       = nullptr;
+            shadow_map_subpass_description[0].preserveAttachmentCount = 0;
+            shadow_map_subpass_description[0].pPreserveAttachments    = nullptr;
+            shadow_map_subpass_description[0].pResolveAttachments     = nullptr;
+
+            // The cascades are read by the shadow ray generation shader.
+            std::vector<VkSubpassDependency> shadow_map_dependencies(2);
+
+            shadow_map_dependencies[0].srcSubpass      = VK_SUBPASS_EXTERNAL;
+            shadow_map_dependencies[0].dstSubpass      = 0;
+            shadow_map_dependencies[0].srcStageMask    = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV;
+            shadow_map_dependencies[0].dstStageMask    = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+            shadow_map_dependencies[0].srcAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+            shadow_map_dependencies[0].dstAccessMask   = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            shadow_map_dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+            shadow_map_dependencies[1].srcSubpass      = 0;
+            shadow_map_dependencies[1].dstSubpass      = VK_SUBPASS_EXTERNAL;
+            shadow_map_dependencies[1].srcStageMask    = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+            shadow_map_dependencies[1].dstStageMask    = VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV;
+            shadow_map_dependencies[1].srcAccessMask   = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+            shadow_map_dependencies[1].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
+            shadow_map_dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+            m_shadow_map_rp = dw::vk::RenderPass::create(m_vk_backend, shadow_map_attachments, shadow_map_subpass_description, shadow_map_dependencies);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_shadow_map()
+    {
+        // One array layer per cascade. Sized independently of the window, so it survives resizes.
+        m_shadow_map      = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, m_csm_settings.resolution, m_csm_settings.resolution, 1, 1, kShadowCascadeCount, VK_FORMAT_D32_SFLOAT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_shadow_map_view = dw::vk::ImageView::create(m_vk_backend, m_shadow_map, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, kShadowCascadeCount);
+
+        for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+        {
+            m_shadow_map_layer_view[i] = dw::vk::ImageView::create(m_vk_backend, m_shadow_map, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, i, 1);
+            m_shadow_map_fbo[i]        = dw::vk::Framebuffer::create(m_vk_backend, m_shadow_map_rp, { m_shadow_map_layer_view[i] }, m_csm_settings.resolution, m_csm_settings.resolution, 1);
+        }
+
+        track_image("Shadow Map", "Shadows", m_shadow_map, std::to_string(m_csm_settings.resolution) + "x" + std::to_string(m_csm_settings.resolution) + "x" + std::to_string(kShadowCascadeCount) + " D32_SFLOAT", false);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_framebuffers()
+    {
+        m_g_buffer_fbo.reset();
+        m_g_buffer_fbo = dw::vk::Framebuffer::create(m_vk_backend, m_g_buffer_rp, { m_g_buffer_1_view, m_g_buffer_2_view, m_g_buffer_3_view, m_g_buffer_depth_view }, m_width, m_height, 1);
+
+        m_visibility_fbo.reset();
+
+        if (m_visibility_buffer)
+            m_visibility_fbo = dw::vk::Framebuffer::create(m_vk_backend, m_visibility_rp, { m_visibility_view, m_g_buffer_depth_view }, m_width, m_height, 1);
+
+        m_depth_prepass_fbo.reset();
+        m_depth_prepass_fbo = dw::vk::Framebuffer::create(m_vk_backend, m_depth_prepass_rp, { m_g_buffer_depth_view }, m_width, m_height, 1);
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            m_deferred_fbo[i].reset();
+            m_deferred_fbo[i] = dw::vk::Framebuffer::create(m_vk_backend, m_deferred_rp, { m_history_view[i] }, m_width, m_height, 1);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool create_uniform_buffer()
+    {
         m_ubo_size = m_vk_backend->aligned_dynamic_ubo_size(sizeof(Transforms));
         m_ubo      = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, m_ubo_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
 
+        // One block of ray counters per frame-in-flight, read back on the CPU when the frame slot comes around again.
+        m_ray_stats_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * RAY_STAT_COUNT * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        // Lights are uploaded every frame into that frame's block.
+        m_light_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(Light) * kMaxLights * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        // Hit count followed by the per-material counts and offsets of the deferred reflection hits.
+        m_material_bin_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, sizeof(uint32_t) * (4 + 2 * kMaxReflectionMaterials), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+        const std::string frames = std::to_string(dw::vk::Backend::kMaxFramesInFlight);
+
+        track_buffer("Uniforms", "Frame", m_ubo, MEMORY_LOCATION_HOST, frames + " x Transforms", false);
+        track_buffer("Ray Stats", "Frame", m_ray_stats_buffer, MEMORY_LOCATION_HOST, frames + " x " + std::to_string(RAY_STAT_COUNT) + " counters", false);
+        track_buffer("Lights", "Many Lights", m_light_buffer, MEMORY_LOCATION_HOST, frames + " x " + std::to_string(kMaxLights) + " lights", false);
+        track_buffer("Material Bins", "Reflections", m_material_bin_buffer, MEMORY_LOCATION_DEVICE, std::to_string(kMaxReflectionMaterials) + " materials", false);
+
         return true;
     }
 
@@ -405,11 +1521,11 @@ private:
         {
             dw::vk::DescriptorSetLayout::Desc desc;
 
-            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-            desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-            desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-            desc.add_binding(3, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-            desc.add_binding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+            // Shared by deferred.frag and deferred.comp, only the compute version writes the history through binding 8.
+            for (uint32_t i = 0; i < 8; i++)
+                desc.add_binding(i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+
+            desc.add_binding(8, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
 
             m_deferred_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
         }
@@ -417,11 +1533,19 @@ private:
         {
             dw::vk::DescriptorSetLayout::Desc desc;
 
-            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_FRAGMENT_BIT);
-            desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_FRAGMENT_BIT);
-            desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_FRAGMENT_BIT);
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+            m_copy_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
 
-            m_g_buffer_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+            m_visibility_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
         }
 
         {
@@ -429,6 +1553,9 @@ private:
 
             desc.add_binding(0, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
             desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_MISS_BIT_NV);
+            desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
 
             m_shadow_mask_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
         }
@@ -439,6 +1566,11 @@ private:
             desc.add_binding(0, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
             desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
             desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_MISS_BIT_NV);
+            desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+            desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
+            desc.add_binding(6, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV);
 
             m_reflection_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
         }
@@ -446,7 +1578,74 @@ private:
         {
             dw::vk::DescriptorSetLayout::Desc desc;
 
-            desc.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT);
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+            m_hiz_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+            m_ssr_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+            m_reflection_bin_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            for (uint32_t i = 0; i < 4; i++)
+                desc.add_binding(i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT);
+
+            m_skinning_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            // Laid out like the virtual texturing bindings of the global set, see virtual_texture.glsl.
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+            desc.add_binding(1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VT_MAP_COUNT, VK_SHADER_STAGE_FRAGMENT_BIT);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+            desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
+
+            m_vt_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+            desc.add_binding(5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV);
+
+            m_lights_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::DescriptorSetLayout::Desc desc;
+
+            desc.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_MISS_BIT_NV | VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
 
             m_per_frame_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
         }
@@ -454,21 +1653,184 @@ private:
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
+    // Global set of the ray tracing passes: the per-frame UBO, the G-Buffer, every geometry buffer and material
+    // texture of the scene and the virtual textures. Bound once per pass next to the pass' own set. Sized for the scene, so it waits for the
+    // mesh while the other layouts don't.
+    void create_global_descriptor_set_layout()
+    {
+        const VkShaderStageFlags stages = VK_SHADER_STAGE_RAYGEN_BIT_NV | VK_SHADER_STAGE_CLOSEST_HIT_BIT_NV | VK_SHADER_STAGE_ANY_HIT_BIT_NV | VK_SHADER_STAGE_MISS_BIT_NV;
+
+        dw::vk::DescriptorSetLayout::Desc desc;
+
+        desc.add_binding(kGlobalBindingPerFrame, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1, stages);
+
+        for (uint32_t i = 0; i < 4; i++)
+            desc.add_binding(kGlobalBindingGBuffer + i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stages);
+
+        for (uint32_t i = 0; i < 3; i++)
+            desc.add_binding(kGlobalBindingGeometry + i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_global_mesh_count, stages);
+
+        for (uint32_t i = 0; i < 4; i++)
+            desc.add_binding(kGlobalBindingTextures + i, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_global_material_count, stages);
+
+        desc.add_binding(kGlobalBindingOpacity, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, m_global_mesh_count, stages);
+        desc.add_binding(kGlobalBindingVirtualTexture, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, stages);
+        desc.add_binding(kGlobalBindingVirtualTexture + 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VT_MAP_COUNT, stages);
+        desc.add_binding(kGlobalBindingVirtualTexture + 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages);
+        desc.add_binding(kGlobalBindingVirtualTexture + 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, stages);
+
+        m_global_ds_layout = dw::vk::DescriptorSetLayout::create(m_vk_backend, desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
     void create_descriptor_sets()
     {
-        m_deferred_ds = m_vk_backend->allocate_descriptor_set(m_deferred_layout);
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            m_deferred_ds[i] = m_vk_backend->allocate_descriptor_set(m_deferred_layout);
+            m_copy_ds[i]     = m_vk_backend->allocate_descriptor_set(m_copy_ds_layout);
+        }
+
         m_per_frame_ds = m_vk_backend->allocate_descriptor_set(m_per_frame_ds_layout);
-        m_g_buffer_ds = m_vk_backend->allocate_descriptor_set(m_g_buffer_ds_layout);
+        m_global_ds = m_vk_backend->allocate_descriptor_set(m_global_ds_layout);
+        m_visibility_ds = m_vk_backend->allocate_descriptor_set(m_visibility_ds_layout);
         m_shadow_mask_ds = m_vk_backend->allocate_descriptor_set(m_shadow_mask_ds_layout);
         m_reflection_ds  = m_vk_backend->allocate_descriptor_set(m_reflection_ds_layout);
+        m_reflection_bin_ds = m_vk_backend->allocate_descriptor_set(m_reflection_bin_ds_layout);
+        m_lights_ds      = m_vk_backend->allocate_descriptor_set(m_lights_ds_layout);
+        m_ssr_ds         = m_vk_backend->allocate_descriptor_set(m_ssr_ds_layout);
+        m_vt_ds          = m_vk_backend->allocate_descriptor_set(m_vt_ds_layout);
+
+        for (uint32_t i = 0; i < kHiZLevels; i++)
+            m_hiz_ds[i] = m_vk_backend->allocate_descriptor_set(m_hiz_ds_layout);
+
+        copy_scene_descriptors();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The scene's geometry buffers and material textures live in five sets owned by the scene. They never change
+    // after loading, so they are copied into the global set once instead of being bound separately by every pass.
+    void copy_scene_descriptors()
+    {
+        const VkDescriptorSet texture_sets[] = { m_scene->albedo_descriptor_set()->handle(),
+                                                 m_scene->normal_descriptor_set()->handle(),
+                                                 m_scene->roughness_descriptor_set()->handle(),
+                                                 m_scene->metallic_descriptor_set()->handle() };
+
+        VkCopyDescriptorSet copies[7];
+
+        for (uint32_t i = 0; i < 7; i++)
+        {
+            DW_ZERO_MEMORY(copies[i]);
+
+            copies[i].sType  = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET;
+            copies[i].dstSet = m_global_ds->handle();
+        }
+
+        // Material indices, vertices and indices, one array element per mesh. The scene holds a single one.
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            copies[i].srcSet          = m_scene->ray_tracing_geometry_descriptor_set()->handle();
+            copies[i].srcBinding      = i;
+            copies[i].dstBinding      = kGlobalBindingGeometry + i;
+            copies[i].descriptorCount = 1;
+        }
+
+        // Albedo, normal, roughness and metallic maps, one array element per material.
+        for (uint32_t i = 0; i < 4; i++)
+        {
+            copies[3 + i].srcSet          = texture_sets[i];
+            copies[3 + i].srcBinding      = 0;
+            copies[3 + i].dstBinding      = kGlobalBindingTextures + i;
+            copies[3 + i].descriptorCount = m_global_material_count;
+        }
+
+        vkUpdateDescriptorSets(m_vk_backend->device(), 0, nullptr, 7, &copies[0]);
+
+        if (m_global_mesh_count == 1)
+            return;
+
+        // The skinned submeshes are mesh 1 and share the scene's material indices. Without a skin it repeats
+        // mesh 0, which no instance refers to.
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            DW_ZERO_MEMORY(copies[i]);
+
+            copies[i].sType           = VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET;
+            copies[i].srcSet          = m_global_ds->handle();
+            copies[i].srcBinding      = kGlobalBindingGeometry + i;
+            copies[i].dstSet          = m_global_ds->handle();
+            copies[i].dstBinding      = kGlobalBindingGeometry + i;
+            copies[i].dstArrayElement = 1;
+            copies[i].descriptorCount = 1;
+        }
+
+        vkUpdateDescriptorSets(m_vk_backend->device(), 0, nullptr, 3, &copies[0]);
+
+        if (m_skins.empty())
+            return;
+
+        // Hit shaders read the skinned vertices for both meshes, mesh 1's from where its BLAS reads them, and the
+        // indices of the skinned triangles only.
+        VkDescriptorBufferInfo buffer_info[3];
+
+        buffer_info[0].buffer = m_skinned_vertex_buffer->handle();
+        buffer_info[0].offset = 0;
+        buffer_info[0].range  = VK_WHOLE_SIZE;
+
+        buffer_info[1].buffer = m_skinned_vertex_buffer->handle();
+        buffer_info[1].offset = sizeof(SkinVertex) * m_skinned_vertex_base;
+        buffer_info[1].range  = VK_WHOLE_SIZE;
+
+        buffer_info[2].buffer = m_skinned_index_buffer->handle();
+        buffer_info[2].offset = 0;
+        buffer_info[2].range  = VK_WHOLE_SIZE;
+
+        const uint32_t bindings[]       = { kGlobalBindingGeometry + 1, kGlobalBindingGeometry + 1, kGlobalBindingGeometry + 2 };
+        const uint32_t array_elements[] = { 0, 1, 1 };
+
+        VkWriteDescriptorSet write_data[3];
+
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            DW_ZERO_MEMORY(write_data[i]);
+
+            write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[i].descriptorCount = 1;
+            write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[i].pBufferInfo     = &buffer_info[i];
+            write_data[i].dstBinding      = bindings[i];
+            write_data[i].dstArrayElement = array_elements[i];
+            write_data[i].dstSet          = m_global_ds->handle();
+        }
+
+        vkUpdateDescriptorSets(m_vk_backend->device(), 3, &write_data[0], 0, nullptr);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // What the passes draw and trace against, the skinned copies when anything is skinned.
+    dw::vk::Buffer::Ptr scene_vertex_buffer()
+    {
+        return m_skinned_vertex_buffer ? m_skinned_vertex_buffer : m_mesh->vertex_buffer();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    dw::vk::AccelerationStructure::Ptr scene_acceleration_structure()
+    {
+        return m_skinned_tlas ? m_skinned_tlas : m_scene->acceleration_structure();
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
     void write_descriptor_sets()
     {
+        for (uint32_t i = 0; i < 2; i++)
         {
-            VkDescriptorImageInfo image_info[5];
+            VkDescriptorImageInfo image_info[9];
 
             image_info[0].sampler     = dw::Material::common_sampler()->handle();
             image_info[0].imageView   = m_shadow_mask_view->handle();
@@ -490,49 +1852,60 @@ private:
             image_info[4].imageView   = m_g_buffer_3_view->handle();
             image_info[4].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            VkWriteDescriptorSet write_data[5];
-            DW_ZERO_MEMORY(write_data[0]);
-            DW_ZERO_MEMORY(write_data[1]);
-            DW_ZERO_MEMORY(write_data[2]);
-            DW_ZERO_MEMORY(write_data[3]);
-            DW_ZERO_MEMORY(write_data[4]);
+            // The set used while writing history image 'i' reads the other one.
+            image_info[5].sampler     = dw::Material::common_sampler()->handle();
+            image_info[5].imageView   = m_history_view[1 - i]->handle();
+            image_info[5].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[0].descriptorCount = 1;
-            write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[0].pImageInfo      = &image_info[0];
-            write_data[0].dstBinding      = 0;
-            write_data[0].dstSet          = m_deferred_ds->handle();
+            image_info[6].sampler     = dw::Material::common_sampler()->handle();
+            image_info[6].imageView   = m_lighting_view->handle();
+            image_info[6].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-            write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[1].descriptorCount = 1;
-            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[1].pImageInfo      = &image_info[1];
-            write_data[1].dstBinding      = 1;
-            write_data[1].dstSet          = m_deferred_ds->handle();
+            image_info[7].sampler     = dw::Material::common_sampler()->handle();
+            image_info[7].imageView   = m_g_buffer_depth_view->handle();
+            image_info[7].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
 
-            write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[2].descriptorCount = 1;
-            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[2].pImageInfo      = &image_info[2];
-            write_data[2].dstBinding      = 2;
-            write_data[2].dstSet          = m_deferred_ds->handle();
+            // The history image this set's pass writes, only while the compute pass runs.
+            image_info[8].sampler     = VK_NULL_HANDLE;
+            image_info[8].imageView   = m_history_view[i]->handle();
+            image_info[8].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
 
-            write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[3].descriptorCount = 1;
-            write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[3].pImageInfo      = &image_info[3];
-            write_data[3].dstBinding      = 3;
-            write_data[3].dstSet          = m_deferred_ds->handle();
+            VkWriteDescriptorSet write_data[9];
 
-            write_data[4].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            write_data[4].descriptorCount = 1;
-            write_data[4].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            write_data[4].pImageInfo      = &image_info[4];
-            write_data[4].dstBinding      = 4;
-            write_data[4].dstSet          = m_deferred_ds->handle();
+            for (uint32_t j = 0; j < 9; j++)
+            {
+                DW_ZERO_MEMORY(write_data[j]);
 
-            vkUpdateDescriptorSets(m_vk_backend->device(), 5, &write_data[0], 0, nullptr);
+                write_data[j].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[j].descriptorCount = 1;
+                write_data[j].descriptorType  = j == 8 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                write_data[j].pImageInfo      = &image_info[j];
+                write_data[j].dstBinding      = j;
+                write_data[j].dstSet          = m_deferred_ds[i]->handle();
+            }
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 9, &write_data[0], 0, nullptr);
+        }
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            VkDescriptorImageInfo image_info;
+
+            image_info.sampler     = dw::Material::common_sampler()->handle();
+            image_info.imageView   = m_history_view[i]->handle();
+            image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            VkWriteDescriptorSet write_data;
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data.pImageInfo      = &image_info;
+            write_data.dstBinding      = 0;
+            write_data.dstSet          = m_copy_ds[i]->handle();
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 1, &write_data, 0, nullptr);
         }
 
         {
@@ -553,10 +1926,15 @@ private:
             write_data.dstSet          = m_per_frame_ds->handle();
 
             vkUpdateDescriptorSets(m_vk_backend->device(), 1, &write_data, 0, nullptr);
+
+            write_data.dstBinding = kGlobalBindingPerFrame;
+            write_data.dstSet     = m_global_ds->handle();
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 1, &write_data, 0, nullptr);
         }
 
         {
-            VkDescriptorImageInfo image_info[3];
+            VkDescriptorImageInfo image_info[4];
 
             image_info[0].sampler     = dw::Material::common_sampler()->handle();
             image_info[0].imageView   = m_g_buffer_1_view->handle();
@@ -570,6 +1948,66 @@ private:
             image_info[2].imageView   = m_g_buffer_3_view->handle();
             image_info[2].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
+            image_info[3].sampler     = dw::Material::common_sampler()->handle();
+            image_info[3].imageView   = m_g_buffer_depth_view->handle();
+            image_info[3].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+            VkWriteDescriptorSet write_data[4];
+
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                DW_ZERO_MEMORY(write_data[i]);
+
+                write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[i].descriptorCount = 1;
+                write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                write_data[i].pImageInfo      = &image_info[i];
+                write_data[i].dstBinding      = kGlobalBindingGBuffer + i;
+                write_data[i].dstSet          = m_global_ds->handle();
+            }
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 4, &write_data[0], 0, nullptr);
+        }
+
+        {
+            // One per mesh like the geometry, without a skin mesh 1 repeats mesh 0's.
+            VkDescriptorBufferInfo buffer_info[2];
+
+            for (uint32_t i = 0; i < m_global_mesh_count; i++)
+            {
+                buffer_info[i].buffer = i == 1 && m_skinned_opacity_buffer ? m_skinned_opacity_buffer->handle() : m_triangle_opacity_buffer->handle();
+                buffer_info[i].offset = 0;
+                buffer_info[i].range  = VK_WHOLE_SIZE;
+            }
+
+            VkWriteDescriptorSet write_data;
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = m_global_mesh_count;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &buffer_info[0];
+            write_data.dstBinding      = kGlobalBindingOpacity;
+            write_data.dstSet          = m_global_ds->handle();
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 1, &write_data, 0, nullptr);
+        }
+
+        {
+            VkDescriptorImageInfo image_info[3];
+
+            image_info[0].sampler     = dw::Material::common_sampler()->handle();
+            image_info[0].imageView   = m_visibility_view->handle();
+            image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[1].sampler     = VK_NULL_HANDLE;
+            image_info[1].imageView   = m_g_buffer_1_view->handle();
+            image_info[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            image_info[2].sampler     = VK_NULL_HANDLE;
+            image_info[2].imageView   = m_g_buffer_2_view->handle();
+            image_info[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
             VkWriteDescriptorSet write_data[3];
             DW_ZERO_MEMORY(write_data[0]);
             DW_ZERO_MEMORY(write_data[1]);
@@ -580,36 +2018,39 @@ private:
             write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
             write_data[0].pImageInfo      = &image_info[0];
             write_data[0].dstBinding      = 0;
-            write_data[0].dstSet          = m_g_buffer_ds->handle();
+            write_data[0].dstSet          = m_visibility_ds->handle();
 
             write_data[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data[1].descriptorCount = 1;
-            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
             write_data[1].pImageInfo      = &image_info[1];
             write_data[1].dstBinding      = 1;
-            write_data[1].dstSet          = m_g_buffer_ds->handle();
+            write_data[1].dstSet          = m_visibility_ds->handle();
 
             write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data[2].descriptorCount = 1;
-            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
             write_data[2].pImageInfo      = &image_info[2];
             write_data[2].dstBinding      = 2;
-            write_data[2].dstSet          = m_g_buffer_ds->handle();
+            write_data[2].dstSet          = m_visibility_ds->handle();
 
             vkUpdateDescriptorSets(m_vk_backend->device(), 3, &write_data[0], 0, nullptr);
         }
 
         {
-            VkWriteDescriptorSet write_data[2];
+            VkWriteDescriptorSet write_data[5];
             DW_ZERO_MEMORY(write_data[0]);
             DW_ZERO_MEMORY(write_data[1]);
+            DW_ZERO_MEMORY(write_data[2]);
+            DW_ZERO_MEMORY(write_data[3]);
+            DW_ZERO_MEMORY(write_data[4]);
 
             VkWriteDescriptorSetAccelerationStructureNV descriptor_as;
 
             descriptor_as.sType                      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV;
             descriptor_as.pNext                      = nullptr;
             descriptor_as.accelerationStructureCount = 1;
-            descriptor_as.pAccelerationStructures    = &m_scene->acceleration_structure()->handle();
+            descriptor_as.pAccelerationStructures    = &scene_acceleration_structure()->handle();
 
             write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data[0].pNext           = &descriptor_as;
@@ -630,21 +2071,58 @@ private:
             write_data[1].dstBinding      = 1;
             write_data[1].dstSet          = m_shadow_mask_ds->handle();
 
-            vkUpdateDescriptorSets(m_vk_backend->device(), 2, &write_data[0], 0, nullptr);
-        }
-
-        {
-            VkWriteDescriptorSet write_data[3];
-            DW_ZERO_MEMORY(write_data[0]);
-            DW_ZERO_MEMORY(write_data[1]);
-            DW_ZERO_MEMORY(write_data[2]);
+            VkDescriptorBufferInfo ray_stats_buffer;
+            ray_stats_buffer.buffer = m_ray_stats_buffer->handle();
+            ray_stats_buffer.offset = 0;
+            ray_stats_buffer.range  = VK_WHOLE_SIZE;
 
-            VkWriteDescriptorSetAccelerationStructureNV descriptor_as;
+            write_data[2].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[2].descriptorCount = 1;
+            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[2].pBufferInfo     = &ray_stats_buffer;
+            write_data[2].dstBinding      = 2;
+            write_data[2].dstSet          = m_shadow_mask_ds->handle();
+
+            VkDescriptorImageInfo visibility_image;
+            visibility_image.sampler     = VK_NULL_HANDLE;
+            visibility_image.imageView   = m_shadow_visibility_view->handle();
+            visibility_image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[3].descriptorCount = 1;
+            write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data[3].pImageInfo      = &visibility_image;
+            write_data[3].dstBinding      = 3;
+            write_data[3].dstSet          = m_shadow_mask_ds->handle();
+
+            VkDescriptorImageInfo shadow_map_image;
+            shadow_map_image.sampler     = dw::Material::common_sampler()->handle();
+            shadow_map_image.imageView   = m_shadow_map_view->handle();
+            shadow_map_image.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            write_data[4].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[4].descriptorCount = 1;
+            write_data[4].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[4].pImageInfo      = &shadow_map_image;
+            write_data[4].dstBinding      = 4;
+            write_data[4].dstSet          = m_shadow_mask_ds->handle();
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 5, &write_data[0], 0, nullptr);
+        }
+
+        {
+            VkWriteDescriptorSet write_data[4];
+            DW_ZERO_MEMORY(write_data[0]);
+            DW_ZERO_MEMORY(write_data[1]);
+            DW_ZERO_MEMORY(write_data[2]);
+            DW_ZERO_MEMORY(write_data[3]);
+
+            VkWriteDescriptorSetAccelerationStructureNV descriptor_as;
 
             descriptor_as.sType                      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV;
             descriptor_as.pNext                      = nullptr;
             descriptor_as.accelerationStructureCount = 1;
-            descriptor_as.pAccelerationStructures    = &m_scene->acceleration_structure()->handle();
+            descriptor_as.pAccelerationStructures    = &scene_acceleration_structure()->handle();
 
             write_data[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             write_data[0].pNext           = &descriptor_as;
@@ -677,8 +2155,290 @@ private:
             write_data[2].dstBinding      = 2;
             write_data[2].dstSet          = m_reflection_ds->handle();
 
+            VkDescriptorBufferInfo ray_stats_buffer;
+            ray_stats_buffer.buffer = m_ray_stats_buffer->handle();
+            ray_stats_buffer.offset = 0;
+            ray_stats_buffer.range  = VK_WHOLE_SIZE;
+
+            write_data[3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data[3].descriptorCount = 1;
+            write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[3].pBufferInfo     = &ray_stats_buffer;
+            write_data[3].dstBinding      = 3;
+            write_data[3].dstSet          = m_reflection_ds->handle();
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 4, &write_data[0], 0, nullptr);
+        }
+
+        {
+            // The deferred reflection buffers are shared between the ray tracing and the binning descriptor sets.
+            VkDescriptorBufferInfo buffer_info[3];
+
+            buffer_info[0].buffer = m_hit_record_buffer->handle();
+            buffer_info[1].buffer = m_material_bin_buffer->handle();
+            buffer_info[2].buffer = m_sorted_hit_buffer->handle();
+
+            VkWriteDescriptorSet write_data[6];
+
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                buffer_info[i].offset = 0;
+                buffer_info[i].range  = VK_WHOLE_SIZE;
+
+                DW_ZERO_MEMORY(write_data[i]);
+
+                write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[i].descriptorCount = 1;
+                write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write_data[i].pBufferInfo     = &buffer_info[i];
+                write_data[i].dstBinding      = 4 + i;
+                write_data[i].dstSet          = m_reflection_ds->handle();
+
+                DW_ZERO_MEMORY(write_data[i + 3]);
+
+                write_data[i + 3].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[i + 3].descriptorCount = 1;
+                write_data[i + 3].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write_data[i + 3].pBufferInfo     = &buffer_info[i];
+                write_data[i + 3].dstBinding      = i;
+                write_data[i + 3].dstSet          = m_reflection_bin_ds->handle();
+            }
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 6, &write_data[0], 0, nullptr);
+        }
+
+        write_screen_space_reflection_descriptor_sets();
+        write_virtual_texture_descriptor_sets();
+
+        {
+            VkWriteDescriptorSet write_data[6];
+
+            for (uint32_t i = 0; i < 6; i++)
+            {
+                DW_ZERO_MEMORY(write_data[i]);
+
+                write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[i].descriptorCount = 1;
+                write_data[i].dstBinding      = i;
+                write_data[i].dstSet          = m_lights_ds->handle();
+            }
+
+            VkWriteDescriptorSetAccelerationStructureNV descriptor_as;
+
+            descriptor_as.sType                      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_NV;
+            descriptor_as.pNext                      = nullptr;
+            descriptor_as.accelerationStructureCount = 1;
+            descriptor_as.pAccelerationStructures    = &scene_acceleration_structure()->handle();
+
+            write_data[0].pNext          = &descriptor_as;
+            write_data[0].descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_NV;
+
+            VkDescriptorImageInfo output_image;
+            output_image.sampler     = VK_NULL_HANDLE;
+            output_image.imageView   = m_lighting_view->handle();
+            output_image.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            write_data[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data[1].pImageInfo     = &output_image;
+
+            VkDescriptorBufferInfo buffer_info[4];
+
+            buffer_info[0].buffer = m_ray_stats_buffer->handle();
+            buffer_info[1].buffer = m_light_buffer->handle();
+            buffer_info[2].buffer = m_reservoir_buffer->handle();
+            buffer_info[3].buffer = m_prev_reservoir_buffer->handle();
+
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                buffer_info[i].offset = 0;
+                buffer_info[i].range  = VK_WHOLE_SIZE;
+
+                write_data[i + 2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write_data[i + 2].pBufferInfo    = &buffer_info[i];
+            }
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 6, &write_data[0], 0, nullptr);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The same resources in the G-Buffer's set and the global set.
+    void write_virtual_texture_descriptor_sets()
+    {
+        VkDescriptorImageInfo image_info[1 + VT_MAP_COUNT];
+
+        image_info[0].sampler     = dw::Material::common_sampler()->handle();
+        image_info[0].imageView   = m_vt_indirection_view->handle();
+        image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+        {
+            image_info[1 + map].sampler     = dw::Material::common_sampler()->handle();
+            image_info[1 + map].imageView   = m_vt_physical_view[map]->handle();
+            image_info[1 + map].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        }
+
+        VkDescriptorBufferInfo buffer_info[2];
+
+        buffer_info[0].buffer = m_vt_texture_buffer->handle();
+        buffer_info[0].offset = 0;
+        buffer_info[0].range  = VK_WHOLE_SIZE;
+
+        buffer_info[1].buffer = m_vt_feedback_buffer->handle();
+        buffer_info[1].offset = 0;
+        buffer_info[1].range  = VK_WHOLE_SIZE;
+
+        const VkDescriptorSet sets[]     = { m_vt_ds->handle(), m_global_ds->handle() };
+        const uint32_t        bindings[] = { 0, kGlobalBindingVirtualTexture };
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            VkWriteDescriptorSet write_data[4];
+
+            for (uint32_t j = 0; j < 4; j++)
+            {
+                DW_ZERO_MEMORY(write_data[j]);
+
+                write_data[j].sType      = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[j].dstBinding = bindings[i] + j;
+                write_data[j].dstSet     = sets[i];
+            }
+
+            write_data[0].descriptorCount = 1;
+            write_data[0].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[0].pImageInfo      = &image_info[0];
+
+            write_data[1].descriptorCount = VT_MAP_COUNT;
+            write_data[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            write_data[1].pImageInfo      = &image_info[1];
+
+            write_data[2].descriptorCount = 1;
+            write_data[2].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[2].pBufferInfo     = &buffer_info[0];
+
+            write_data[3].descriptorCount = 1;
+            write_data[3].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[3].pBufferInfo     = &buffer_info[1];
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 4, &write_data[0], 0, nullptr);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The hierarchical depth levels, the screen space pass and the ray list binding of the reflection set.
+    void write_screen_space_reflection_descriptor_sets()
+    {
+        VkDescriptorBufferInfo ray_list_buffer;
+
+        ray_list_buffer.buffer = m_ray_list_buffer->handle();
+        ray_list_buffer.offset = 0;
+        ray_list_buffer.range  = VK_WHOLE_SIZE;
+
+        VkDescriptorBufferInfo ray_stats_buffer;
+
+        ray_stats_buffer.buffer = m_ray_stats_buffer->handle();
+        ray_stats_buffer.offset = 0;
+        ray_stats_buffer.range  = VK_WHOLE_SIZE;
+
+        {
+            VkWriteDescriptorSet write_data;
+            DW_ZERO_MEMORY(write_data);
+
+            write_data.sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            write_data.descriptorCount = 1;
+            write_data.descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data.pBufferInfo     = &ray_list_buffer;
+            write_data.dstBinding      = 7;
+            write_data.dstSet          = m_reflection_ds->handle();
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 1, &write_data, 0, nullptr);
+        }
+
+        // The pyramid stays in the general layout, it is written and sampled by compute shaders only.
+        for (uint32_t i = 0; i < kHiZLevels; i++)
+        {
+            VkDescriptorImageInfo image_info[3];
+
+            image_info[0].sampler     = dw::Material::common_sampler()->handle();
+            image_info[0].imageView   = m_g_buffer_depth_view->handle();
+            image_info[0].imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+            // Level 0 copies the depth and doesn't read a source level.
+            image_info[1].sampler     = VK_NULL_HANDLE;
+            image_info[1].imageView   = m_hiz_level_views[i == 0 ? 0 : i - 1]->handle();
+            image_info[1].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            image_info[2].sampler     = VK_NULL_HANDLE;
+            image_info[2].imageView   = m_hiz_level_views[i]->handle();
+            image_info[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet write_data[3];
+
+            for (uint32_t j = 0; j < 3; j++)
+            {
+                DW_ZERO_MEMORY(write_data[j]);
+
+                write_data[j].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[j].descriptorCount = 1;
+                write_data[j].descriptorType  = j == 0 ? VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                write_data[j].pImageInfo      = &image_info[j];
+                write_data[j].dstBinding      = j;
+                write_data[j].dstSet          = m_hiz_ds[i]->handle();
+            }
+
             vkUpdateDescriptorSets(m_vk_backend->device(), 3, &write_data[0], 0, nullptr);
         }
+
+        {
+            VkDescriptorImageInfo image_info[4];
+
+            image_info[0].sampler     = dw::Material::common_sampler()->handle();
+            image_info[0].imageView   = m_g_buffer_1_view->handle();
+            image_info[0].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[1].sampler     = dw::Material::common_sampler()->handle();
+            image_info[1].imageView   = m_g_buffer_2_view->handle();
+            image_info[1].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+            image_info[2].sampler     = dw::Material::common_sampler()->handle();
+            image_info[2].imageView   = m_hiz_view->handle();
+            image_info[2].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            image_info[3].sampler     = VK_NULL_HANDLE;
+            image_info[3].imageView   = m_reflection_view->handle();
+            image_info[3].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+            VkWriteDescriptorSet write_data[6];
+
+            for (uint32_t i = 0; i < 6; i++)
+            {
+                DW_ZERO_MEMORY(write_data[i]);
+
+                write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[i].descriptorCount = 1;
+                write_data[i].dstBinding      = i;
+                write_data[i].dstSet          = m_ssr_ds->handle();
+            }
+
+            for (uint32_t i = 0; i < 3; i++)
+            {
+                write_data[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+                write_data[i].pImageInfo     = &image_info[i];
+            }
+
+            write_data[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+            write_data[3].pImageInfo     = &image_info[3];
+
+            write_data[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[4].pBufferInfo    = &ray_list_buffer;
+
+            write_data[5].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            write_data[5].pBufferInfo    = &ray_stats_buffer;
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 6, &write_data[0], 0, nullptr);
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -691,7 +2451,28 @@ private:
         desc.add_descriptor_set_layout(m_per_frame_ds_layout);
 
         m_deferred_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, desc);
-        m_deferred_pipeline        = dw::vk::GraphicsPipeline::create_for_post_process(m_vk_backend, "shaders/triangle.vert.spv", "shaders/deferred.frag.spv", m_deferred_pipeline_layout, m_vk_backend->swapchain_render_pass());
+        m_deferred_pipeline        = dw::vk::GraphicsPipeline::create_for_post_process(m_vk_backend, "shaders/triangle.vert.spv", "shaders/deferred.frag.spv", m_deferred_pipeline_layout, m_deferred_rp);
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/deferred.comp.spv");
+
+        dw::vk::ComputePipeline::Desc compute_desc;
+
+        compute_desc.set_shader_stage(module, "main");
+        compute_desc.set_pipeline_layout(m_deferred_pipeline_layout);
+
+        m_deferred_compute_pipeline = dw::vk::ComputePipeline::create(m_vk_backend, compute_desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_copy_pipeline()
+    {
+        dw::vk::PipelineLayout::Desc desc;
+
+        desc.add_descriptor_set_layout(m_copy_ds_layout);
+
+        m_copy_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, desc);
+        m_copy_pipeline        = dw::vk::GraphicsPipeline::create_for_post_process(m_vk_backend, "shaders/triangle.vert.spv", "shaders/copy.frag.spv", m_copy_pipeline_layout, m_vk_backend->swapchain_render_pass());
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -704,12 +2485,13 @@ private:
 
         dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow.rgen.spv");
         dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow.rchit.spv");
+        dw::vk::ShaderModule::Ptr rahit = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/alpha_test.rahit.spv");
         dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow.rmiss.spv");
 
         dw::vk::ShaderBindingTable::Desc sbt_desc;
 
         sbt_desc.add_ray_gen_group(rgen, "main");
-        sbt_desc.add_hit_group(rchit, "main");
+        sbt_desc.add_hit_group(rchit, "main", rahit, "main");
         sbt_desc.add_miss_group(rmiss, "main");
 
         m_shadow_mask_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, sbt_desc);
@@ -726,14 +2508,101 @@ private:
         dw::vk::PipelineLayout::Desc pl_desc;
 
         pl_desc.add_descriptor_set_layout(m_shadow_mask_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_per_frame_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_g_buffer_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_global_ds_layout);
 
         m_shadow_mask_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
 
         desc.set_pipeline_layout(m_shadow_mask_pipeline_layout);
 
         m_shadow_mask_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, desc);
+
+        // ---------------------------------------------------------------------------
+        // Create penumbra refinement pipeline
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ShaderModule::Ptr refine_rgen = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow_refine.rgen.spv");
+
+        dw::vk::ShaderBindingTable::Desc refine_sbt_desc;
+
+        refine_sbt_desc.add_ray_gen_group(refine_rgen, "main");
+        refine_sbt_desc.add_hit_group(rchit, "main", rahit, "main");
+        refine_sbt_desc.add_miss_group(rmiss, "main");
+
+        m_shadow_refine_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, refine_sbt_desc);
+
+        dw::vk::RayTracingPipeline::Desc refine_desc;
+
+        refine_desc.set_recursion_depth(1);
+        refine_desc.set_shader_binding_table(m_shadow_refine_sbt);
+        refine_desc.set_pipeline_layout(m_shadow_mask_pipeline_layout);
+
+        m_shadow_refine_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, refine_desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_light_ray_tracing_pipelines()
+    {
+        // ---------------------------------------------------------------------------
+        // Create shader modules
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ShaderModule::Ptr resample_rgen = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/light_resample.rgen.spv");
+        dw::vk::ShaderModule::Ptr shade_rgen    = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/light_shade.rgen.spv");
+        dw::vk::ShaderModule::Ptr rchit         = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow.rchit.spv");
+        dw::vk::ShaderModule::Ptr rahit         = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/alpha_test.rahit.spv");
+        dw::vk::ShaderModule::Ptr rmiss         = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow.rmiss.spv");
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline layout
+        // ---------------------------------------------------------------------------
+
+        dw::vk::PipelineLayout::Desc pl_desc;
+
+        pl_desc.add_descriptor_set_layout(m_lights_ds_layout);
+        pl_desc.add_descriptor_set_layout(m_global_ds_layout);
+
+        m_lights_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create pipelines
+        // ---------------------------------------------------------------------------
+
+        {
+            dw::vk::ShaderBindingTable::Desc sbt_desc;
+
+            sbt_desc.add_ray_gen_group(resample_rgen, "main");
+            sbt_desc.add_hit_group(rchit, "main");
+            sbt_desc.add_miss_group(rmiss, "main");
+
+            m_light_resample_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, sbt_desc);
+
+            dw::vk::RayTracingPipeline::Desc desc;
+
+            desc.set_recursion_depth(1);
+            desc.set_shader_binding_table(m_light_resample_sbt);
+            desc.set_pipeline_layout(m_lights_pipeline_layout);
+
+            m_light_resample_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::ShaderBindingTable::Desc sbt_desc;
+
+            sbt_desc.add_ray_gen_group(shade_rgen, "main");
+            sbt_desc.add_hit_group(rchit, "main", rahit, "main");
+            sbt_desc.add_miss_group(rmiss, "main");
+
+            m_light_shade_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, sbt_desc);
+
+            dw::vk::RayTracingPipeline::Desc desc;
+
+            desc.set_recursion_depth(1);
+            desc.set_shader_binding_table(m_light_shade_sbt);
+            desc.set_pipeline_layout(m_lights_pipeline_layout);
+
+            m_light_shade_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, desc);
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
@@ -746,12 +2615,13 @@ private:
 
         dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection.rgen.spv");
         dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection.rchit.spv");
+        dw::vk::ShaderModule::Ptr rahit = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/alpha_test.rahit.spv");
         dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection.rmiss.spv");
 
         dw::vk::ShaderBindingTable::Desc sbt_desc;
 
         sbt_desc.add_ray_gen_group(rgen, "main");
-        sbt_desc.add_hit_group(rchit, "main");
+        sbt_desc.add_hit_group(rchit, "main", rahit, "main");
         sbt_desc.add_miss_group(rmiss, "main");
 
         m_reflection_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, sbt_desc);
@@ -768,84 +2638,244 @@ private:
         dw::vk::PipelineLayout::Desc pl_desc;
 
         pl_desc.add_descriptor_set_layout(m_reflection_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_per_frame_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_g_buffer_ds_layout);
-        pl_desc.add_descriptor_set_layout(m_scene->ray_tracing_geometry_descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_scene->material_descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_scene->material_descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_scene->material_descriptor_set_layout());
-        pl_desc.add_descriptor_set_layout(m_scene->material_descriptor_set_layout());
+        pl_desc.add_descriptor_set_layout(m_global_ds_layout);
 
         m_reflection_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
 
         desc.set_pipeline_layout(m_reflection_pipeline_layout);
 
         m_reflection_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, desc);
-    }
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
-
-    void create_gbuffer_pipeline()
-    {
         // ---------------------------------------------------------------------------
-        // Create shader modules
+        // Create deferred hit shading pipelines
         // ---------------------------------------------------------------------------
 
-        dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/g_buffer.vert.spv");
-        dw::vk::ShaderModule::Ptr fs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/g_buffer.frag.spv");
+        dw::vk::ShaderModule::Ptr record_rchit = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection_record.rchit.spv");
+        dw::vk::ShaderModule::Ptr shade_rgen   = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection_shade.rgen.spv");
 
-        dw::vk::GraphicsPipeline::Desc pso_desc;
+        {
+            dw::vk::ShaderBindingTable::Desc record_sbt_desc;
 
-        pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main")
-            .add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
+            record_sbt_desc.add_ray_gen_group(rgen, "main");
+            record_sbt_desc.add_hit_group(record_rchit, "main", rahit, "main");
+            record_sbt_desc.add_miss_group(rmiss, "main");
 
-        // ---------------------------------------------------------------------------
-        // Create vertex input state
-        // ---------------------------------------------------------------------------
+            m_reflection_record_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, record_sbt_desc);
 
-        pso_desc.set_vertex_input_state(m_mesh->vertex_input_state_desc());
+            dw::vk::RayTracingPipeline::Desc record_desc;
 
-        // ---------------------------------------------------------------------------
-        // Create pipeline input assembly state
-        // ---------------------------------------------------------------------------
+            record_desc.set_recursion_depth(1);
+            record_desc.set_shader_binding_table(m_reflection_record_sbt);
+            record_desc.set_pipeline_layout(m_reflection_pipeline_layout);
 
-        dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
+            m_reflection_record_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, record_desc);
+        }
 
-        input_assembly_state_desc.set_primitive_restart_enable(false)
-            .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+        {
+            // Doesn't trace any rays, the hit and miss groups only complete the shader binding table.
+            dw::vk::ShaderBindingTable::Desc shade_sbt_desc;
 
-        pso_desc.set_input_assembly_state(input_assembly_state_desc);
+            shade_sbt_desc.add_ray_gen_group(shade_rgen, "main");
+            shade_sbt_desc.add_hit_group(rchit, "main");
+            shade_sbt_desc.add_miss_group(rmiss, "main");
 
-        // ---------------------------------------------------------------------------
-        // Create viewport state
-        // ---------------------------------------------------------------------------
+            m_reflection_shade_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, shade_sbt_desc);
 
-        dw::vk::ViewportStateDesc vp_desc;
+            dw::vk::RayTracingPipeline::Desc shade_desc;
 
-        vp_desc.add_viewport(0.0f, 0.0f, m_width, m_height, 0.0f, 1.0f)
-            .add_scissor(0, 0, m_width, m_height);
+            shade_desc.set_recursion_depth(1);
+            shade_desc.set_shader_binding_table(m_reflection_shade_sbt);
+            shade_desc.set_pipeline_layout(m_reflection_pipeline_layout);
 
-        pso_desc.set_viewport_state(vp_desc);
+            m_reflection_shade_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, shade_desc);
+        }
+    }
 
-        // ---------------------------------------------------------------------------
-        // Create rasterization state
-        // ---------------------------------------------------------------------------
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        dw::vk::RasterizationStateDesc rs_state;
+    void create_reflection_binning_pipelines()
+    {
+        dw::vk::PipelineLayout::Desc pl_desc;
 
-        rs_state.set_depth_clamp(VK_FALSE)
-            .set_rasterizer_discard_enable(VK_FALSE)
-            .set_polygon_mode(VK_POLYGON_MODE_FILL)
-            .set_line_width(1.0f)
-            .set_cull_mode(VK_CULL_MODE_BACK_BIT)
-            .set_front_face(VK_FRONT_FACE_CLOCKWISE)
-            .set_depth_bias(VK_FALSE);
+        pl_desc.add_descriptor_set_layout(m_reflection_bin_ds_layout)
+            .add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t));
 
-        pso_desc.set_rasterization_state(rs_state);
+        m_reflection_bin_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+        {
+            dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection_bin_scan.comp.spv");
+
+            dw::vk::ComputePipeline::Desc desc;
+
+            desc.set_shader_stage(module, "main");
+            desc.set_pipeline_layout(m_reflection_bin_pipeline_layout);
+
+            m_reflection_scan_pipeline = dw::vk::ComputePipeline::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection_bin_scatter.comp.spv");
+
+            dw::vk::ComputePipeline::Desc desc;
+
+            desc.set_shader_stage(module, "main");
+            desc.set_pipeline_layout(m_reflection_bin_pipeline_layout);
+
+            m_reflection_scatter_pipeline = dw::vk::ComputePipeline::create(m_vk_backend, desc);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_screen_space_reflection_pipelines()
+    {
+        {
+            dw::vk::PipelineLayout::Desc pl_desc;
+
+            pl_desc.add_descriptor_set_layout(m_hiz_ds_layout)
+                .add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZPushConstants));
+
+            m_hiz_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+            dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/hiz_build.comp.spv");
+
+            dw::vk::ComputePipeline::Desc desc;
+
+            desc.set_shader_stage(module, "main");
+            desc.set_pipeline_layout(m_hiz_pipeline_layout);
+
+            m_hiz_pipeline = dw::vk::ComputePipeline::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::PipelineLayout::Desc pl_desc;
+
+            pl_desc.add_descriptor_set_layout(m_ssr_ds_layout)
+                .add_descriptor_set_layout(m_per_frame_ds_layout)
+                .add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::ivec2));
+
+            m_ssr_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+            dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/ssr.comp.spv");
+
+            dw::vk::ComputePipeline::Desc desc;
+
+            desc.set_shader_stage(module, "main");
+            desc.set_pipeline_layout(m_ssr_pipeline_layout);
+
+            m_ssr_pipeline = dw::vk::ComputePipeline::create(m_vk_backend, desc);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_gbuffer_pipeline()
+    {
+        // ---------------------------------------------------------------------------
+        // Create pipeline layout
+        // ---------------------------------------------------------------------------
+
+        dw::vk::PipelineLayout::Desc pl_desc;
+
+        // The push constant is the draw's material, which picks its virtual texture.
+        pl_desc.add_descriptor_set_layout(m_per_frame_ds_layout)
+            .add_descriptor_set_layout(dw::Material::pbr_descriptor_set_layout())
+            .add_descriptor_set_layout(m_vt_ds_layout)
+            .add_push_constant_range(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t));
+
+        m_g_buffer_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create shader modules
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ShaderModule::Ptr vs         = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/g_buffer.vert.spv");
+        dw::vk::ShaderModule::Ptr fs         = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/g_buffer.frag.spv");
+        dw::vk::ShaderModule::Ptr masked_fs  = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/g_buffer_masked.frag.spv");
+        dw::vk::ShaderModule::Ptr prepass_vs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/visibility.vert.spv");
+        dw::vk::ShaderModule::Ptr prepass_fs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/depth_prepass.frag.spv");
+
+        // ---------------------------------------------------------------------------
+        // Create pipelines
+        // ---------------------------------------------------------------------------
+
+        // Without a prepass the opaque materials keep early depth testing, only the alpha tested ones discard.
+        m_g_buffer_pipeline        = create_geometry_pipeline(vs, fs, m_g_buffer_rp, 3, VK_COMPARE_OP_LESS, true);
+        m_g_buffer_masked_pipeline = create_geometry_pipeline(vs, masked_fs, m_g_buffer_rp, 3, VK_COMPARE_OP_LESS, true);
+
+        // After the prepass only the visible surface of every pixel passes the depth test, holes of alpha
+        // tested materials included, so none of the materials need to discard.
+        m_g_buffer_equal_pipeline = create_geometry_pipeline(vs, fs, m_g_buffer_load_depth_rp, 3, VK_COMPARE_OP_EQUAL, false);
+
+        m_depth_prepass_pipeline        = create_geometry_pipeline(prepass_vs, nullptr, m_depth_prepass_rp, 0, VK_COMPARE_OP_LESS, true);
+        m_depth_prepass_masked_pipeline = create_geometry_pipeline(prepass_vs, prepass_fs, m_depth_prepass_rp, 0, VK_COMPARE_OP_LESS, true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The G-Buffer and depth prepass pipelines only differ in their shaders, depth state and color attachments.
+    // 'fs' is null for depth-only pipelines.
+    dw::vk::GraphicsPipeline::Ptr create_geometry_pipeline(dw::vk::ShaderModule::Ptr vs,
+                                                           dw::vk::ShaderModule::Ptr fs,
+                                                           dw::vk::RenderPass::Ptr   render_pass,
+                                                           uint32_t                  color_attachment_count,
+                                                           VkCompareOp               depth_compare_op,
+                                                           bool                      depth_write)
+    {
+        dw::vk::GraphicsPipeline::Desc pso_desc;
+
+        pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main");
+
+        if (fs)
+            pso_desc.add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
+
+        // ---------------------------------------------------------------------------
+        // Create vertex input state
+        // ---------------------------------------------------------------------------
+
+        pso_desc.set_vertex_input_state(m_mesh->vertex_input_state_desc());
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline input assembly state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
+
+        input_assembly_state_desc.set_primitive_restart_enable(false)
+            .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+        pso_desc.set_input_assembly_state(input_assembly_state_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create viewport state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ViewportStateDesc vp_desc;
+
+        vp_desc.add_viewport(0.0f, 0.0f, m_width, m_height, 0.0f, 1.0f)
+            .add_scissor(0, 0, m_width, m_height);
+
+        pso_desc.set_viewport_state(vp_desc);
 
         // ---------------------------------------------------------------------------
-        // Create multisample state
-        // ---------------------------------------------------------------------------
+        // Create rasterization state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::RasterizationStateDesc rs_state;
+
+        rs_state.set_depth_clamp(VK_FALSE)
+            .set_rasterizer_discard_enable(VK_FALSE)
+            .set_polygon_mode(VK_POLYGON_MODE_FILL)
+            .set_line_width(1.0f)
+            .set_cull_mode(VK_CULL_MODE_BACK_BIT)
+            .set_front_face(VK_FRONT_FACE_CLOCKWISE)
+            .set_depth_bias(VK_FALSE);
+
+        pso_desc.set_rasterization_state(rs_state);
+
+        // ---------------------------------------------------------------------------
+        // Create multisample state
+        // ---------------------------------------------------------------------------
 
         dw::vk::MultisampleStateDesc ms_state;
 
@@ -861,8 +2891,8 @@ private:
         dw::vk::DepthStencilStateDesc ds_state;
 
         ds_state.set_depth_test_enable(VK_TRUE)
-            .set_depth_write_enable(VK_TRUE)
-            .set_depth_compare_op(VK_COMPARE_OP_LESS)
+            .set_depth_write_enable(depth_write ? VK_TRUE : VK_FALSE)
+            .set_depth_compare_op(depth_compare_op)
             .set_depth_bounds_test_enable(VK_FALSE)
             .set_stencil_test_enable(VK_FALSE);
 
@@ -881,364 +2911,4518 @@ private:
 
         blend_state.set_logic_op_enable(VK_FALSE)
             .set_logic_op(VK_LOGIC_OP_COPY)
-            .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f)
-            .add_attachment(blend_att_desc)
-            .add_attachment(blend_att_desc)
-            .add_attachment(blend_att_desc);
+            .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f);
+
+        for (uint32_t i = 0; i < color_attachment_count; i++)
+            blend_state.add_attachment(blend_att_desc);
 
         pso_desc.set_color_blend_state(blend_state);
 
         // ---------------------------------------------------------------------------
-        // Create pipeline layout
+        // Set pipeline layout
+        // ---------------------------------------------------------------------------
+
+        pso_desc.set_pipeline_layout(m_g_buffer_pipeline_layout);
+
+        // ---------------------------------------------------------------------------
+        // Create dynamic state
+        // ---------------------------------------------------------------------------
+
+        pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
+            .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline
         // ---------------------------------------------------------------------------
 
-        dw::vk::PipelineLayout::Desc pl_desc;
+        pso_desc.set_render_pass(render_pass);
+
+        return dw::vk::GraphicsPipeline::create(m_vk_backend, pso_desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The framework keeps the scene's geometry on the GPU only and drops its material names, so the file is
+    // imported once more on the CPU for the phases that need them. The phases read m_scene_submeshes, which is
+    // empty when the import fails or the file's meshes don't line up with the framework's submeshes.
+    void import_scene()
+    {
+        m_scene_submeshes.clear();
+
+        Assimp::Importer importer;
+
+        // UVs flipped the way the framework imports them, so that they match the vertex buffer's.
+        const aiScene* scene = importer.ReadFile(kSceneMeshPath, aiProcess_Triangulate | aiProcess_FlipUVs);
+
+        if (!scene || scene->mNumMeshes != m_mesh->sub_mesh_count())
+        {
+            DW_LOG_ERROR("Scene import: failed to import the scene's submeshes");
+            return;
+        }
+
+        const std::string mesh_path = kSceneMeshPath;
+        const std::string directory = mesh_path.substr(0, mesh_path.find_last_of("/\\") + 1);
+
+        // Where the framework finds the albedo, normal, roughness and metallic maps, in order of preference.
+        const std::vector<aiTextureType> map_types[VT_MAP_COUNT] = { { aiTextureType_DIFFUSE }, { aiTextureType_NORMALS, aiTextureType_HEIGHT }, { aiTextureType_SHININESS }, { aiTextureType_AMBIENT, aiTextureType_REFLECTION } };
+
+        m_scene_submeshes.resize(scene->mNumMeshes);
+
+        for (uint32_t i = 0; i < scene->mNumMeshes; i++)
+        {
+            const aiMesh*     mesh     = scene->mMeshes[i];
+            const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+            SceneSubmesh&     submesh  = m_scene_submeshes[i];
+            SubmeshGeometry&  geometry = submesh.geometry;
+
+            geometry.bounds.min_extents = glm::vec3(FLT_MAX);
+            geometry.bounds.max_extents = glm::vec3(-FLT_MAX);
+
+            for (uint32_t j = 0; j < mesh->mNumVertices; j++)
+            {
+                const glm::vec3 position = glm::vec3(mesh->mVertices[j].x, mesh->mVertices[j].y, mesh->mVertices[j].z);
+
+                geometry.positions.push_back(position);
+                geometry.bounds.min_extents = glm::min(geometry.bounds.min_extents, position);
+                geometry.bounds.max_extents = glm::max(geometry.bounds.max_extents, position);
+            }
+
+            if (mesh->HasTextureCoords(0))
+            {
+                for (uint32_t j = 0; j < mesh->mNumVertices; j++)
+                    submesh.tex_coords.push_back(glm::vec2(mesh->mTextureCoords[0][j].x, mesh->mTextureCoords[0][j].y));
+            }
+
+            for (uint32_t j = 0; j < mesh->mNumFaces; j++)
+            {
+                if (mesh->mFaces[j].mNumIndices != 3)
+                    continue;
+
+                for (uint32_t k = 0; k < 3; k++)
+                    geometry.indices.push_back(mesh->mFaces[j].mIndices[k]);
+            }
+
+            submesh.matches = geometry.indices.size() == m_mesh->sub_meshes()[i].index_count;
+
+            aiString name;
+
+            material->Get(AI_MATKEY_NAME, name);
+
+            submesh.material = name.C_Str();
+
+            std::transform(submesh.material.begin(), submesh.material.end(), submesh.material.begin(), ::tolower);
+
+            for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            {
+                for (aiTextureType type : map_types[map])
+                {
+                    aiString path;
+
+                    if (material->GetTexture(type, 0, &path) == AI_SUCCESS)
+                    {
+                        submesh.maps[map] = directory + path.C_Str();
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Classifies every triangle of the scene as opaque, transparent or alpha tested from the albedo texels its
+    // UVs can reach, so that alpha_test.rahit only samples textures for the last kind. Triangles of submeshes that
+    // don't line up with the framework's, or without a readable albedo map, stay alpha tested, which is never wrong.
+    // The raster passes draw the submeshes with any triangle that isn't opaque with the alpha tested pipelines.
+    void create_triangle_opacity_buffer()
+    {
+        uint32_t triangle_count = 0;
+
+        for (const auto& submesh : m_mesh->sub_meshes())
+            triangle_count = std::max(triangle_count, (submesh.base_index + submesh.index_count) / 3);
+
+        std::vector<uint8_t> opacity(triangle_count, TRIANGLE_OPACITY_MIXED);
+
+        m_opacity_stats = OpacityBakeStats();
+
+        if (!m_scene_submeshes.empty())
+        {
+            std::vector<std::string>    texture_paths;
+            std::vector<OpacitySubmesh> submeshes;
+
+            for (uint32_t i = 0; i < m_scene_submeshes.size(); i++)
+            {
+                const SceneSubmesh& scene_submesh = m_scene_submeshes[i];
+
+                if (!scene_submesh.matches || scene_submesh.tex_coords.empty())
+                    continue;
+
+                OpacitySubmesh submesh;
+
+                submesh.first_triangle = m_mesh->sub_meshes()[i].base_index / 3;
+                submesh.tex_coords     = scene_submesh.tex_coords;
+                submesh.indices        = scene_submesh.geometry.indices;
+
+                const std::string& path = scene_submesh.maps[VT_MAP_ALBEDO];
+
+                if (!path.empty())
+                {
+                    const auto it = std::find(texture_paths.begin(), texture_paths.end(), path);
+
+                    submesh.texture = uint32_t(it - texture_paths.begin());
+
+                    if (it == texture_paths.end())
+                        texture_paths.push_back(path);
+                }
+
+                submeshes.push_back(submesh);
+            }
+
+            const uint8_t cutoff = opacity_cutoff(kAlphaCutoff);
+
+            std::vector<OpacityTexture> textures(texture_paths.size());
+
+            // Only the alpha channel is kept, a texture that fails to load leaves its triangles alpha tested.
+            m_thread_pool->parallel_for(uint32_t(textures.size()), [&](uint32_t i) {
+                int width    = 0;
+                int height   = 0;
+                int channels = 0;
+
+                stbi_uc* pixels = stbi_load(texture_paths[i].c_str(), &width, &height, &channels, 4);
+
+                if (!pixels)
+                    return;
+
+                OpacityTexture& texture = textures[i];
+
+                texture.width  = uint32_t(width);
+                texture.height = uint32_t(height);
+                texture.alpha.resize(size_t(width) * size_t(height));
+
+                for (size_t j = 0; j < texture.alpha.size(); j++)
+                    texture.alpha[j] = pixels[4 * j + 3];
+
+                stbi_image_free(pixels);
+
+                analyze_opacity_texture(texture, cutoff);
+            });
+
+            m_opacity_stats = bake_triangle_opacity(m_thread_pool.get(), submeshes, textures, cutoff, opacity);
+        }
+        else
+            DW_LOG_ERROR("Triangle opacity: the scene wasn't imported, every triangle is alpha tested");
+
+        // Count what wasn't baked as alpha tested.
+        m_opacity_stats.mixed += triangle_count - m_opacity_stats.triangles;
+        m_opacity_stats.triangles = triangle_count;
+
+        m_opaque_submeshes.clear();
+        m_masked_submeshes.clear();
+
+        for (uint32_t i = 0; i < m_mesh->sub_mesh_count(); i++)
+        {
+            const auto& submesh = m_mesh->sub_meshes()[i];
+            const auto  first   = opacity.begin() + submesh.base_index / 3;
+            const auto  last    = first + submesh.index_count / 3;
+
+            if (std::all_of(first, last, [](uint8_t triangle) { return triangle == TRIANGLE_OPACITY_OPAQUE; }))
+                m_opaque_submeshes.push_back(i);
+            else
+                m_masked_submeshes.push_back(i);
+        }
+
+        const std::vector<uint32_t> packed = pack_triangle_opacity(opacity);
+        const size_t                size   = sizeof(uint32_t) * std::max(packed.size(), size_t(1));
+
+        // The skinned geometry splits its triangles off this once it knows them.
+        m_triangle_opacity = std::move(opacity);
+
+        m_triangle_opacity_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, size, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        memcpy(m_triangle_opacity_buffer->mapped_ptr(), packed.data(), sizeof(uint32_t) * packed.size());
+
+        track_buffer("Triangle Opacity", "Alpha Testing", m_triangle_opacity_buffer, MEMORY_LOCATION_HOST, std::to_string(triangle_count) + " triangles", false);
+
+        DW_LOG_INFO("Triangle opacity: " + std::to_string(m_opacity_stats.opaque) + " opaque, " + std::to_string(m_opacity_stats.transparent) + " transparent, " + std::to_string(m_opacity_stats.mixed) + " alpha tested triangles, baked in " + std::to_string(m_opacity_stats.bake_ms) + " ms");
+        DW_LOG_INFO("Alpha classification: " + std::to_string(m_opaque_submeshes.size()) + " opaque, " + std::to_string(m_masked_submeshes.size()) + " alpha tested submeshes");
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Cuts the maps of every material into the pages of the page file, which later runs only open. A file built for
+    // other textures or cut short by an interrupted build is built again. Material i of the global set is virtual
+    // texture i, its maps are those of the imported submeshes that use it.
+    void create_virtual_texture_pages()
+    {
+        if (!m_virtual_texturing)
+            return;
+
+        if (m_scene_submeshes.empty())
+        {
+            DW_LOG_ERROR("Virtual texturing disabled: the scene wasn't imported");
+            return;
+        }
+
+        // VT_MAP_COUNT per material.
+        std::vector<std::string> paths(m_global_material_count * VT_MAP_COUNT);
+
+        for (uint32_t i = 0; i < m_scene_submeshes.size(); i++)
+        {
+            for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            {
+                if (!m_scene_submeshes[i].maps[map].empty())
+                    paths[m_mesh->sub_meshes()[i].mat_idx * VT_MAP_COUNT + map] = m_scene_submeshes[i].maps[map];
+            }
+        }
+
+        // Every map of a virtual texture has the size of its largest map.
+        std::vector<VirtualTextureDesc> textures(m_global_material_count);
+
+        for (uint32_t i = 0; i < m_global_material_count; i++)
+        {
+            int max_width  = 0;
+            int max_height = 0;
+
+            for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            {
+                const std::string& path = paths[i * VT_MAP_COUNT + map];
+
+                int width    = 0;
+                int height   = 0;
+                int channels = 0;
+
+                if (!path.empty() && stbi_info(path.c_str(), &width, &height, &channels))
+                {
+                    max_width  = std::max(max_width, width);
+                    max_height = std::max(max_height, height);
+                }
+            }
+
+            textures[i] = describe_virtual_texture(uint32_t(max_width), uint32_t(max_height));
+        }
+
+        if (m_vt_page_file.open(kVtPageFilePath, m_global_material_count))
+        {
+            bool matches = true;
+
+            for (uint32_t i = 0; i < m_global_material_count; i++)
+            {
+                const VirtualTextureDesc& desc = m_vt_page_file.textures()[i];
+
+                matches = matches && desc.pages_x == textures[i].pages_x && desc.pages_y == textures[i].pages_y && desc.mip_count == textures[i].mip_count;
+            }
+
+            if (matches)
+            {
+                DW_LOG_INFO("Virtual texturing: opened " + std::string(kVtPageFilePath));
+                return;
+            }
+
+            m_vt_page_file.close();
+        }
+
+        const double start_ms = m_cpu_timer.now_ms();
+
+        if (!m_vt_page_file.create(kVtPageFilePath, textures))
+        {
+            DW_LOG_ERROR("Virtual texturing disabled: failed to create " + std::string(kVtPageFilePath));
+            return;
+        }
+
+        // The pages of a material take tens of megabytes, so only as many are built at once as there are threads.
+        const uint32_t batch_size = m_thread_pool->thread_count();
+
+        uint64_t page_count = 0;
+        bool     success    = true;
+
+        for (uint32_t first = 0; first < m_global_material_count && success; first += batch_size)
+        {
+            const uint32_t count = std::min(batch_size, m_global_material_count - first);
+
+            std::vector<std::vector<uint8_t>> pages(count);
+
+            m_thread_pool->parallel_for(count, [&](uint32_t i) {
+                VtSourceImage maps[VT_MAP_COUNT];
+
+                // A map that fails to load is left out and takes its constant value.
+                for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+                {
+                    const std::string& path = paths[(first + i) * VT_MAP_COUNT + map];
+
+                    if (path.empty())
+                        continue;
+
+                    int width    = 0;
+                    int height   = 0;
+                    int channels = 0;
+
+                    stbi_uc* pixels = stbi_load(path.c_str(), &width, &height, &channels, 0);
+
+                    if (!pixels)
+                        continue;
+
+                    maps[map].width    = uint32_t(width);
+                    maps[map].height   = uint32_t(height);
+                    maps[map].channels = uint32_t(channels);
+                    maps[map].texels.assign(pixels, pixels + size_t(width) * size_t(height) * size_t(channels));
+
+                    stbi_image_free(pixels);
+                }
+
+                build_virtual_texture_pages(maps, textures[first + i], pages[i]);
+            });
+
+            for (uint32_t i = 0; i < count && success; i++)
+            {
+                success = m_vt_page_file.append(pages[i]);
+                page_count += textures[first + i].page_count();
+            }
+        }
+
+        m_vt_page_file.close();
+
+        if (!success || !m_vt_page_file.open(kVtPageFilePath, m_global_material_count))
+        {
+            DW_LOG_ERROR("Virtual texturing disabled: failed to write " + std::string(kVtPageFilePath));
+            return;
+        }
+
+        DW_LOG_INFO("Virtual texturing: built " + std::to_string(page_count) + " pages of " + std::to_string(m_global_material_count) + " materials in " + std::to_string(m_cpu_timer.now_ms() - start_ms) + " ms");
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Without virtual texturing, or without its page file, the G-Buffer and the ray tracing sets still have the
+    // cache bound. It is then a texel of every image and an entry of every buffer, which the shaders never read.
+    void create_virtual_texture_stand_ins()
+    {
+        m_virtual_texturing = false;
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+        {
+            m_vt_physical_image[map] = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, 1, 1, 1, 1, 1, kVtMapFormats[map], VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+            m_vt_physical_view[map]  = dw::vk::ImageView::create(m_vk_backend, m_vt_physical_image[map], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+
+        m_vt_indirection_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, 1, 1, 1, 1, 1, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_vt_indirection_view  = dw::vk::ImageView::create(m_vk_backend, m_vt_indirection_image, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1);
+
+        m_vt_texture_buffer  = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::uvec4), VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_vt_feedback_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t), VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+        memset(m_vt_texture_buffer->mapped_ptr(), 0, sizeof(glm::uvec4));
+
+        dw::vk::CommandBuffer::Ptr cmd_buf = m_vk_backend->allocate_graphics_command_buffer();
+
+        VkCommandBufferBeginInfo begin_info;
+        DW_ZERO_MEMORY(begin_info);
+
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_physical_image[map]->handle(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range);
+
+        dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresource_range);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        m_vk_backend->flush_graphics({ cmd_buf });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The physical caches, the indirection texture and the feedback buffers, sized for the page file.
+    void create_virtual_texture_cache()
+    {
+        if (!m_virtual_texturing || !m_vt_page_file.is_open())
+        {
+            create_virtual_texture_stand_ins();
+            return;
+        }
+
+        const uint32_t layers = std::max(m_global_material_count, 1u);
+
+        // Room for the pinned last mip of every material and a working set, within the largest image size.
+        const uint32_t min_slots      = uint32_t(std::ceil(std::sqrt(float(2 * layers))));
+        const uint32_t slots_per_side = std::min(std::max(m_vt_slots_per_side, min_slots), 16384 / kVtPageSize);
+
+        m_vt_streamer       = std::unique_ptr<VirtualTextureStreamer>(new VirtualTextureStreamer(&m_vt_page_file, slots_per_side));
+        m_vt_slots_per_side = slots_per_side;
+
+        // Bytes of the indirection of every texture.
+        size_t indirection = 0;
+
+        for (const auto& desc : m_vt_page_file.textures())
+            indirection += sizeof(uint32_t) * desc.page_count();
+
+        const uint32_t cache_size = slots_per_side * kVtPageSize;
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+        {
+            m_vt_physical_image[map] = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, cache_size, cache_size, 1, 1, 1, kVtMapFormats[map], VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+            m_vt_physical_view[map]  = dw::vk::ImageView::create(m_vk_backend, m_vt_physical_image[map], VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        }
+
+        m_vt_indirection_image = dw::vk::Image::create(m_vk_backend, VK_IMAGE_TYPE_2D, kVtMaxPages, kVtMaxPages, 1, kVtMaxMips, layers, VK_FORMAT_R32_UINT, VMA_MEMORY_USAGE_GPU_ONLY, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_SAMPLE_COUNT_1_BIT);
+        m_vt_indirection_view  = dw::vk::ImageView::create(m_vk_backend, m_vt_indirection_image, VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_IMAGE_ASPECT_COLOR_BIT, 0, kVtMaxMips, 0, layers);
+
+        m_vt_texture_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(glm::uvec4) * layers, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        glm::uvec4* texture_table = (glm::uvec4*)m_vt_texture_buffer->mapped_ptr();
+
+        for (uint32_t i = 0; i < layers; i++)
+        {
+            const VirtualTextureDesc& desc = m_vt_page_file.textures()[i];
+
+            texture_table[i] = glm::uvec4(desc.pages_x, desc.pages_y, desc.mip_count, 0);
+        }
+
+        const size_t feedback_size = sizeof(uint32_t) * kVtFeedbackMaxSize * kVtFeedbackMaxSize;
+
+        m_vt_feedback_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, feedback_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        m_vt_staging_size   = kVtMaxUploadsPerFrame * vt_page_bytes() + indirection;
+        m_vt_staging_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, m_vt_staging_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        track_buffer("Staging", "Virtual Texturing", m_vt_staging_buffer, MEMORY_LOCATION_HOST, std::to_string(dw::vk::Backend::kMaxFramesInFlight) + " x " + std::to_string(kVtMaxUploadsPerFrame) + " pages", false);
+
+        VtStreamingBatch batch;
+
+        if (!m_vt_streamer->initialize(batch))
+        {
+            DW_LOG_ERROR("Virtual texturing disabled: failed to read the last mips from " + std::string(kVtPageFilePath));
+
+            m_vt_streamer.reset();
+            m_virtual_texturing = false;
+        }
+
+        // The pinned pages are too many for a frame's staging, so they go through a buffer of their own.
+        dw::vk::Buffer::Ptr initial_staging;
+
+        if (!batch.pages.empty())
+            initial_staging = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, batch.pages.size() * vt_page_bytes() + indirection, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        dw::vk::CommandBuffer::Ptr cmd_buf = m_vk_backend->allocate_graphics_command_buffer();
+
+        VkCommandBufferBeginInfo begin_info;
+        DW_ZERO_MEMORY(begin_info);
+
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+        VkImageSubresourceRange physical_range    = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+        VkImageSubresourceRange indirection_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, kVtMaxMips, 0, layers };
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_physical_image[map]->handle(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, physical_range);
+
+        dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, indirection_range);
+
+        // Pages of the textures the page file lacks resolve to nothing.
+        VkClearColorValue clear_value;
+        DW_ZERO_MEMORY(clear_value);
+
+        vkCmdClearColorImage(cmd_buf->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &clear_value, 1, &indirection_range);
+
+        if (initial_staging)
+        {
+            VkMemoryBarrier memory_barrier;
+            DW_ZERO_MEMORY(memory_barrier);
+
+            memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            copy_virtual_texture_batch(cmd_buf->handle(), batch, initial_staging, 0);
+        }
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_physical_image[map]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, physical_range);
+
+        dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, indirection_range);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        m_vk_backend->flush_graphics({ cmd_buf });
+
+        const std::string cache_desc = std::to_string(slots_per_side * slots_per_side) + " pages";
+
+        track_image("Albedo Cache", "Virtual Texturing", m_vt_physical_image[VT_MAP_ALBEDO], cache_desc, false);
+        track_image("Normal Cache", "Virtual Texturing", m_vt_physical_image[VT_MAP_NORMAL], cache_desc, false);
+        track_image("Roughness Cache", "Virtual Texturing", m_vt_physical_image[VT_MAP_ROUGHNESS], cache_desc, false);
+        track_image("Metallic Cache", "Virtual Texturing", m_vt_physical_image[VT_MAP_METALLIC], cache_desc, false);
+        track_image("Indirection", "Virtual Texturing", m_vt_indirection_image, std::to_string(layers) + " materials", false);
+        track_buffer("Textures", "Virtual Texturing", m_vt_texture_buffer, MEMORY_LOCATION_HOST, std::to_string(layers) + " materials", false);
+        track_buffer("Feedback", "Virtual Texturing", m_vt_feedback_buffer, MEMORY_LOCATION_HOST, std::to_string(dw::vk::Backend::kMaxFramesInFlight) + " x " + std::to_string(kVtFeedbackMaxSize) + "x" + std::to_string(kVtFeedbackMaxSize), false);
+
+        if (m_vt_streamer)
+            DW_LOG_INFO("Virtual texturing: " + std::to_string(slots_per_side * slots_per_side) + " page cache, " + std::to_string(batch.pages.size()) + " pages pinned");
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_command_caches()
+    {
+        const uint32_t frames = dw::vk::Backend::kMaxFramesInFlight;
+
+        m_g_buffer_commands      = std::unique_ptr<SecondaryCommandCache>(new SecondaryCommandCache(m_vk_backend, frames));
+        m_depth_prepass_commands = std::unique_ptr<SecondaryCommandCache>(new SecondaryCommandCache(m_vk_backend, frames));
+        m_shadow_map_commands    = std::unique_ptr<SecondaryCommandCache>(new SecondaryCommandCache(m_vk_backend, frames * kShadowCascadeCount));
+        m_deferred_commands      = std::unique_ptr<SecondaryCommandCache>(new SecondaryCommandCache(m_vk_backend, frames * 2));
+        m_reflection_commands    = std::unique_ptr<SecondaryCommandCache>(new SecondaryCommandCache(m_vk_backend, frames));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_command_cache_stats()
+    {
+        SecondaryCommandCache* caches[] = { m_g_buffer_commands.get(), m_depth_prepass_commands.get(), m_shadow_map_commands.get(), m_deferred_commands.get(), m_reflection_commands.get() };
+
+        CommandCacheStats frame_stats;
+
+        for (SecondaryCommandCache* cache : caches)
+        {
+            const CommandCacheStats stats = cache->take_stats();
+
+            frame_stats.hits += stats.hits;
+            frame_stats.misses += stats.misses;
+            frame_stats.recorded_ms += stats.recorded_ms;
+            frame_stats.saved_ms += stats.saved_ms;
+        }
+
+        m_command_cache_stats = frame_stats;
+        m_command_hits += frame_stats.hits;
+        m_command_misses += frame_stats.misses;
+
+        // Smoothed for display, a miss every few frames would make the raw numbers flicker.
+        m_command_saved_ms    = glm::mix(m_command_saved_ms, frame_stats.saved_ms, 0.05f);
+        m_command_recorded_ms = glm::mix(m_command_recorded_ms, frame_stats.recorded_ms, 0.05f);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The software occlusion culler rasterizes the imported geometry, whose meshes have to line up with the
+    // framework's submeshes, culling stays off otherwise.
+    void create_occlusion_culler()
+    {
+        if (m_scene_submeshes.empty())
+        {
+            DW_LOG_ERROR("Occlusion culling disabled: the scene wasn't imported");
+            return;
+        }
+
+        for (uint32_t i = 0; i < m_scene_submeshes.size(); i++)
+        {
+            if (!m_scene_submeshes[i].matches)
+            {
+                DW_LOG_ERROR("Occlusion culling disabled: submesh " + std::to_string(i) + " doesn't match the imported geometry");
+                return;
+            }
+        }
+
+        m_submesh_geometry.resize(m_scene_submeshes.size());
+        m_submesh_bounds.resize(m_scene_submeshes.size());
+
+        for (uint32_t i = 0; i < m_scene_submeshes.size(); i++)
+        {
+            m_submesh_geometry[i] = m_scene_submeshes[i].geometry;
+            m_submesh_bounds[i]   = m_submesh_geometry[i].bounds;
+        }
+
+        // A skin's joints never reach farther from its root than the chain is long, which the bounds of the bind
+        // pose cover in any direction.
+        for (uint32_t i = 0; i < m_skins.size(); i++)
+        {
+            const Skin&     skin = m_skins[i];
+            const glm::vec3 root = glm::vec3(glm::inverse(skin.joints[0].inverse_bind)[3]);
+            Aabb&           aabb = m_submesh_bounds[m_skinned_submeshes[i]];
+
+            aabb.min_extents = glm::min(aabb.min_extents, root - glm::vec3(skin.extent));
+            aabb.max_extents = glm::max(aabb.max_extents, root + glm::vec3(skin.extent));
+        }
+
+        m_occlusion_culler = std::unique_ptr<OcclusionCuller>(new OcclusionCuller(m_thread_pool.get()));
+
+        // Only opaque submeshes can occlude, alpha tested ones have holes. Skinned ones move away from the
+        // occluder geometry, which is rasterized in the bind pose.
+        std::vector<uint32_t> candidates;
+
+        for (uint32_t submesh : m_opaque_submeshes)
+        {
+            if (std::find(m_skinned_submeshes.begin(), m_skinned_submeshes.end(), submesh) == m_skinned_submeshes.end())
+                candidates.push_back(submesh);
+        }
+
+        const OcclusionCullingSettings& settings  = m_occlusion_culler->settings();
+        const std::vector<uint32_t>     occluders = select_occluders(m_submesh_geometry, candidates, settings.max_occluders, settings.max_occluder_triangles);
+
+        m_occlusion_culler->set_occluders(m_submesh_geometry, occluders);
+
+        DW_LOG_INFO("Occlusion culling: " + std::to_string(occluders.size()) + " occluders, " + std::to_string(m_occlusion_culler->stats().occluder_triangles) + " triangles, " + std::to_string(m_thread_pool->thread_count()) + " threads");
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void cull_submeshes(FrameState& state, const SimulationInput& input)
+    {
+        if (!m_occlusion_culler || !input.occlusion_culling)
+        {
+            state.submesh_visible.clear();
+            state.culling_ms = 0.0f;
+            return;
+        }
+
+        const double start = m_cpu_timer.now_ms();
+
+        m_occlusion_culler->render(state.transforms.proj * state.transforms.view);
+        m_occlusion_culler->cull(m_submesh_bounds, state.submesh_visible);
+
+        state.culling_ms = float(m_cpu_timer.now_ms() - start);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_visibility_pipelines()
+    {
+        // ---------------------------------------------------------------------------
+        // Create shader modules
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/visibility.vert.spv");
+        dw::vk::ShaderModule::Ptr fs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/visibility.frag.spv");
+
+        dw::vk::GraphicsPipeline::Desc pso_desc;
+
+        pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main")
+            .add_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, fs, "main");
+
+        // ---------------------------------------------------------------------------
+        // Create vertex input state
+        // ---------------------------------------------------------------------------
+
+        pso_desc.set_vertex_input_state(m_mesh->vertex_input_state_desc());
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline input assembly state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
+
+        input_assembly_state_desc.set_primitive_restart_enable(false)
+            .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+        pso_desc.set_input_assembly_state(input_assembly_state_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create viewport state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ViewportStateDesc vp_desc;
+
+        vp_desc.add_viewport(0.0f, 0.0f, m_width, m_height, 0.0f, 1.0f)
+            .add_scissor(0, 0, m_width, m_height);
+
+        pso_desc.set_viewport_state(vp_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create rasterization state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::RasterizationStateDesc rs_state;
+
+        rs_state.set_depth_clamp(VK_FALSE)
+            .set_rasterizer_discard_enable(VK_FALSE)
+            .set_polygon_mode(VK_POLYGON_MODE_FILL)
+            .set_line_width(1.0f)
+            .set_cull_mode(VK_CULL_MODE_BACK_BIT)
+            .set_front_face(VK_FRONT_FACE_CLOCKWISE)
+            .set_depth_bias(VK_FALSE);
+
+        pso_desc.set_rasterization_state(rs_state);
+
+        // ---------------------------------------------------------------------------
+        // Create multisample state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::MultisampleStateDesc ms_state;
+
+        ms_state.set_sample_shading_enable(VK_FALSE)
+            .set_rasterization_samples(VK_SAMPLE_COUNT_1_BIT);
+
+        pso_desc.set_multisample_state(ms_state);
+
+        // ---------------------------------------------------------------------------
+        // Create depth stencil state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::DepthStencilStateDesc ds_state;
+
+        ds_state.set_depth_test_enable(VK_TRUE)
+            .set_depth_write_enable(VK_TRUE)
+            .set_depth_compare_op(VK_COMPARE_OP_LESS)
+            .set_depth_bounds_test_enable(VK_FALSE)
+            .set_stencil_test_enable(VK_FALSE);
+
+        pso_desc.set_depth_stencil_state(ds_state);
+
+        // ---------------------------------------------------------------------------
+        // Create color blend state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ColorBlendAttachmentStateDesc blend_att_desc;
+
+        blend_att_desc.set_color_write_mask(VK_COLOR_COMPONENT_R_BIT)
+            .set_blend_enable(VK_FALSE);
+
+        dw::vk::ColorBlendStateDesc blend_state;
+
+        blend_state.set_logic_op_enable(VK_FALSE)
+            .set_logic_op(VK_LOGIC_OP_COPY)
+            .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f)
+            .add_attachment(blend_att_desc);
+
+        pso_desc.set_color_blend_state(blend_state);
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline layout
+        // ---------------------------------------------------------------------------
+
+        dw::vk::PipelineLayout::Desc pl_desc;
+
+        // The material sets are only used for alpha testing, the push constants identify the draw's triangles and
+        // its material.
+        pl_desc.add_descriptor_set_layout(m_per_frame_ds_layout)
+            .add_descriptor_set_layout(dw::Material::pbr_descriptor_set_layout())
+            .add_descriptor_set_layout(m_vt_ds_layout)
+            .add_push_constant_range(VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t) * 3);
+
+        m_visibility_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+        pso_desc.set_pipeline_layout(m_visibility_pipeline_layout);
+
+        // ---------------------------------------------------------------------------
+        // Create dynamic state
+        // ---------------------------------------------------------------------------
+
+        pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
+            .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline
+        // ---------------------------------------------------------------------------
+
+        pso_desc.set_render_pass(m_visibility_rp);
+
+        m_visibility_pipeline = dw::vk::GraphicsPipeline::create(m_vk_backend, pso_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create resolve pipeline
+        // ---------------------------------------------------------------------------
+
+        // A ray generation shader so that it can reach the scene's bindless geometry and textures. It doesn't
+        // trace any rays, the hit and miss groups only complete the shader binding table.
+        dw::vk::ShaderModule::Ptr rgen  = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/visibility_resolve.rgen.spv");
+        dw::vk::ShaderModule::Ptr rchit = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection.rchit.spv");
+        dw::vk::ShaderModule::Ptr rmiss = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/reflection.rmiss.spv");
+
+        dw::vk::ShaderBindingTable::Desc sbt_desc;
+
+        sbt_desc.add_ray_gen_group(rgen, "main");
+        sbt_desc.add_hit_group(rchit, "main");
+        sbt_desc.add_miss_group(rmiss, "main");
+
+        m_visibility_resolve_sbt = dw::vk::ShaderBindingTable::create(m_vk_backend, sbt_desc);
+
+        dw::vk::PipelineLayout::Desc resolve_pl_desc;
+
+        resolve_pl_desc.add_descriptor_set_layout(m_visibility_ds_layout);
+        resolve_pl_desc.add_descriptor_set_layout(m_global_ds_layout);
+
+        m_visibility_resolve_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, resolve_pl_desc);
+
+        dw::vk::RayTracingPipeline::Desc desc;
+
+        desc.set_recursion_depth(1);
+        desc.set_shader_binding_table(m_visibility_resolve_sbt);
+        desc.set_pipeline_layout(m_visibility_resolve_pipeline_layout);
+
+        m_visibility_resolve_pipeline = dw::vk::RayTracingPipeline::create(m_vk_backend, desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_shadow_map_pipeline()
+    {
+        // ---------------------------------------------------------------------------
+        // Create shader modules
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ShaderModule::Ptr vs = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/shadow_map.vert.spv");
+
+        dw::vk::GraphicsPipeline::Desc pso_desc;
+
+        pso_desc.add_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, vs, "main");
+
+        // ---------------------------------------------------------------------------
+        // Create vertex input state
+        // ---------------------------------------------------------------------------
+
+        pso_desc.set_vertex_input_state(m_mesh->vertex_input_state_desc());
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline input assembly state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::InputAssemblyStateDesc input_assembly_state_desc;
+
+        input_assembly_state_desc.set_primitive_restart_enable(false)
+            .set_topology(VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+        pso_desc.set_input_assembly_state(input_assembly_state_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create viewport state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ViewportStateDesc vp_desc;
+
+        vp_desc.add_viewport(0.0f, 0.0f, m_csm_settings.resolution, m_csm_settings.resolution, 0.0f, 1.0f)
+            .add_scissor(0, 0, m_csm_settings.resolution, m_csm_settings.resolution);
+
+        pso_desc.set_viewport_state(vp_desc);
+
+        // ---------------------------------------------------------------------------
+        // Create rasterization state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::RasterizationStateDesc rs_state;
+
+        // Sponza has plenty of single sided geometry, so both faces cast shadows.
+        rs_state.set_depth_clamp(VK_FALSE)
+            .set_rasterizer_discard_enable(VK_FALSE)
+            .set_polygon_mode(VK_POLYGON_MODE_FILL)
+            .set_line_width(1.0f)
+            .set_cull_mode(VK_CULL_MODE_NONE)
+            .set_front_face(VK_FRONT_FACE_CLOCKWISE)
+            .set_depth_bias(VK_TRUE);
+
+        pso_desc.set_rasterization_state(rs_state);
+
+        // ---------------------------------------------------------------------------
+        // Create multisample state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::MultisampleStateDesc ms_state;
+
+        ms_state.set_sample_shading_enable(VK_FALSE)
+            .set_rasterization_samples(VK_SAMPLE_COUNT_1_BIT);
+
+        pso_desc.set_multisample_state(ms_state);
+
+        // ---------------------------------------------------------------------------
+        // Create depth stencil state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::DepthStencilStateDesc ds_state;
+
+        ds_state.set_depth_test_enable(VK_TRUE)
+            .set_depth_write_enable(VK_TRUE)
+            .set_depth_compare_op(VK_COMPARE_OP_LESS)
+            .set_depth_bounds_test_enable(VK_FALSE)
+            .set_stencil_test_enable(VK_FALSE);
+
+        pso_desc.set_depth_stencil_state(ds_state);
+
+        // ---------------------------------------------------------------------------
+        // Create color blend state
+        // ---------------------------------------------------------------------------
+
+        dw::vk::ColorBlendStateDesc blend_state;
+
+        blend_state.set_logic_op_enable(VK_FALSE)
+            .set_logic_op(VK_LOGIC_OP_COPY)
+            .set_blend_constants(0.0f, 0.0f, 0.0f, 0.0f);
+
+        pso_desc.set_color_blend_state(blend_state);
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline layout
+        // ---------------------------------------------------------------------------
+
+        dw::vk::PipelineLayout::Desc pl_desc;
+
+        // The cascade index is the only thing that changes between the cascade draws.
+        pl_desc.add_descriptor_set_layout(m_per_frame_ds_layout)
+            .add_push_constant_range(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t));
+
+        m_shadow_map_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+        pso_desc.set_pipeline_layout(m_shadow_map_pipeline_layout);
+
+        // ---------------------------------------------------------------------------
+        // Create dynamic state
+        // ---------------------------------------------------------------------------
+
+        pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_DEPTH_BIAS);
+
+        // ---------------------------------------------------------------------------
+        // Create pipeline
+        // ---------------------------------------------------------------------------
+
+        pso_desc.set_render_pass(m_shadow_map_rp);
+
+        m_shadow_map_pipeline = dw::vk::GraphicsPipeline::create(m_vk_backend, pso_desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool load_mesh()
+    {
+        m_mesh = dw::Mesh::load(m_vk_backend, kSceneMeshPath);
+
+        if (!m_mesh)
+        {
+            DW_LOG_INFO("Failed to load mesh");
+            return false;
+        }
+
+        track_buffer("Vertices", "Scene", m_mesh->vertex_buffer(), MEMORY_LOCATION_DEVICE, kSceneMeshPath, false);
+        track_buffer("Indices", "Scene", m_mesh->index_buffer(), MEMORY_LOCATION_DEVICE, kSceneMeshPath, false);
+
+        // The scene holds a single mesh, whose materials fill the scene's texture arrays in order. The skinned
+        // submeshes are a second mesh of their own, see create_skinned_geometry().
+        m_global_mesh_count     = m_skinning ? 2 : 1;
+        m_global_material_count = 0;
+
+        for (const auto& submesh : m_mesh->sub_meshes())
+            m_global_material_count = std::max(m_global_material_count, submesh.mat_idx + 1);
+
+        // Recordings bind the buffers and descriptor sets of the scene they were made with.
+        m_command_generation++;
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void build_acceleration_structures()
+    {
+        m_mesh->initialize_for_ray_tracing(m_vk_backend);
+
+        m_scene = dw::Scene::create();
+        m_scene->add_instance(m_mesh, glm::mat4(1.0f));
+
+        m_scene->initialize_for_ray_tracing(m_vk_backend);
+
+        track_acceleration_structure("BLAS", "Scene", m_mesh->acceleration_structure(), kSceneMeshPath);
+        track_acceleration_structure("TLAS", "Scene", m_scene->acceleration_structure(), "1 instance");
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_skinning_pipeline()
+    {
+        dw::vk::PipelineLayout::Desc pl_desc;
+
+        pl_desc.add_descriptor_set_layout(m_skinning_ds_layout)
+            .add_push_constant_range(VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants));
+
+        m_skinning_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+
+        dw::vk::ShaderModule::Ptr module = dw::vk::ShaderModule::create_from_file(m_vk_backend, "shaders/skinning.comp.spv");
+
+        dw::vk::ComputePipeline::Desc desc;
+
+        desc.set_shader_stage(module, "main");
+        desc.set_pipeline_layout(m_skinning_pipeline_layout);
+
+        m_skinning_pipeline = dw::vk::ComputePipeline::create(m_vk_backend, desc);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The scene has no animated content, so the submeshes whose material matches m_skin_material are rigged as
+    // hanging cloth. Their vertices are skinned into a copy of the mesh's vertex buffer, which the raster passes
+    // and the ray traced shading read instead. The skinned triangles get a BLAS of their own, which a TLAS
+    // instances next to the framework's untouched mesh BLAS, and are mesh 1 of the global set. Their bind pose
+    // copy in the mesh BLAS is hidden through the triangle opacity. The framework's TLAS is used as before when
+    // nothing is skinned.
+    void create_skinned_geometry()
+    {
+        if (!m_skinning)
+            return;
+
+        if (m_scene_submeshes.empty())
+        {
+            DW_LOG_ERROR("Skinning disabled: the scene wasn't imported");
+            return;
+        }
+
+        std::string material_filter = m_skin_material;
+
+        std::transform(material_filter.begin(), material_filter.end(), material_filter.begin(), ::tolower);
+
+        // The mesh's vertex buffer holds the submeshes' vertices one after the other.
+        m_scene_vertex_count = 0;
+
+        for (uint32_t i = 0; i < m_scene_submeshes.size(); i++)
+        {
+            const SceneSubmesh& submesh      = m_scene_submeshes[i];
+            const uint32_t      first_vertex = m_scene_vertex_count;
+
+            m_scene_vertex_count += uint32_t(submesh.geometry.positions.size());
+
+            // The skinned triangles are split off by the framework's triangle order, which only matching submeshes share.
+            if (!submesh.matches || material_filter.empty() || submesh.material.find(material_filter) == std::string::npos)
+                continue;
+
+            Skin skin = build_hanging_skin(submesh.geometry.positions, first_vertex, kSkinJointCount, 1.7f * float(m_skins.size()));
+
+            skin.first_joint = m_skin_joint_count;
+            m_skin_joint_count += uint32_t(skin.joints.size());
+            m_skin_vertex_count += skin.vertex_count();
+
+            m_skins.push_back(skin);
+            m_skinned_submeshes.push_back(i);
+        }
+
+        if (m_skins.empty())
+        {
+            DW_LOG_INFO("Skinning: no submesh with a material matching '" + m_skin_material + "'");
+            return;
+        }
+
+        // ---------------------------------------------------------------------------
+        // Buffers
+        // ---------------------------------------------------------------------------
+
+        const size_t vertex_size = sizeof(SkinVertex) * m_scene_vertex_count;
+        const size_t joint_size  = sizeof(glm::mat4) * m_skin_joint_count;
+
+        m_skinned_vertex_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_RAY_TRACING_BIT_NV | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, vertex_size, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+        m_influence_buffer      = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(JointInfluence) * m_skin_vertex_count, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_joint_buffer          = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, joint_size * dw::vk::Backend::kMaxFramesInFlight, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_instance_buffer       = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, sizeof(RayTracingInstance) * 2, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        JointInfluence* influences = (JointInfluence*)m_influence_buffer->mapped_ptr();
+
+        for (const auto& skin : m_skins)
+        {
+            memcpy(influences, skin.influences.data(), sizeof(JointInfluence) * skin.vertex_count());
+            influences += skin.vertex_count();
+        }
+
+        // Every frame's palette starts out in the bind pose, where all skinning matrices are the identity.
+        const std::vector<glm::mat4> bind_palette(m_skin_joint_count, glm::mat4(1.0f));
+
+        for (uint32_t i = 0; i < dw::vk::Backend::kMaxFramesInFlight; i++)
+            memcpy((uint8_t*)m_joint_buffer->mapped_ptr() + joint_size * i, bind_palette.data(), joint_size);
+
+        // The skinned triangles one skin after the other, indexing the skinned vertices from m_skinned_vertex_base
+        // on. They keep the opacity they were baked with, while their bind pose copy in the mesh is hidden.
+        m_skinned_vertex_base = m_skins.front().first_vertex / kSkinnedVertexAlignment * kSkinnedVertexAlignment;
+
+        const uint32_t skinned_vertex_count = m_skins.back().first_vertex + m_skins.back().vertex_count() - m_skinned_vertex_base;
+
+        std::vector<uint32_t> skinned_indices;
+        std::vector<uint8_t>  skinned_opacity;
+
+        for (uint32_t i = 0; i < m_skins.size(); i++)
+        {
+            const std::vector<uint32_t>& indices        = m_scene_submeshes[m_skinned_submeshes[i]].geometry.indices;
+            const uint32_t               first_vertex   = m_skins[i].first_vertex - m_skinned_vertex_base;
+            const uint32_t               first_triangle = m_mesh->sub_meshes()[m_skinned_submeshes[i]].base_index / 3;
+
+            for (uint32_t index : indices)
+                skinned_indices.push_back(first_vertex + index);
+
+            for (uint32_t j = 0; j < indices.size() / 3; j++)
+            {
+                uint8_t& opacity = m_triangle_opacity[first_triangle + j];
+
+                skinned_opacity.push_back(opacity);
+                opacity = TRIANGLE_OPACITY_HIDDEN;
+            }
+        }
+
+        const std::vector<uint32_t> packed_opacity         = pack_triangle_opacity(m_triangle_opacity);
+        const std::vector<uint32_t> packed_skinned_opacity = pack_triangle_opacity(skinned_opacity);
+        const size_t                index_size             = sizeof(uint32_t) * skinned_indices.size();
+
+        // The mesh's opacity buffer is mapped and keeps its size, the triangles only change value.
+        memcpy(m_triangle_opacity_buffer->mapped_ptr(), packed_opacity.data(), sizeof(uint32_t) * packed_opacity.size());
+
+        m_skinned_opacity_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, sizeof(uint32_t) * packed_skinned_opacity.size(), VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+        m_skinned_index_buffer   = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_RAY_TRACING_BIT_NV | VK_BUFFER_USAGE_TRANSFER_DST_BIT, index_size, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+        memcpy(m_skinned_opacity_buffer->mapped_ptr(), packed_skinned_opacity.data(), sizeof(uint32_t) * packed_skinned_opacity.size());
+
+        // Only read by the initial build's copy.
+        dw::vk::Buffer::Ptr index_staging = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, index_size, VMA_MEMORY_USAGE_CPU_TO_GPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        memcpy(index_staging->mapped_ptr(), skinned_indices.data(), index_size);
+
+        // ---------------------------------------------------------------------------
+        // Acceleration structures
+        // ---------------------------------------------------------------------------
+
+        // A single geometry over the skinned triangles, which the shaders index with gl_PrimitiveID in mesh 1's
+        // buffers, so the builds and refits only cost what is skinned. No geometry flags, the rays' flags decide
+        // whether the any-hit shader runs.
+        DW_ZERO_MEMORY(m_skinned_geometry);
+
+        m_skinned_geometry.sType                              = VK_STRUCTURE_TYPE_GEOMETRY_NV;
+        m_skinned_geometry.geometryType                       = VK_GEOMETRY_TYPE_TRIANGLES_NV;
+        m_skinned_geometry.geometry.triangles.sType           = VK_STRUCTURE_TYPE_GEOMETRY_TRIANGLES_NV;
+        m_skinned_geometry.geometry.triangles.vertexData      = m_skinned_vertex_buffer->handle();
+        m_skinned_geometry.geometry.triangles.vertexOffset    = sizeof(SkinVertex) * m_skinned_vertex_base;
+        m_skinned_geometry.geometry.triangles.vertexCount     = skinned_vertex_count;
+        m_skinned_geometry.geometry.triangles.vertexStride    = sizeof(SkinVertex);
+        m_skinned_geometry.geometry.triangles.vertexFormat    = VK_FORMAT_R32G32B32_SFLOAT;
+        m_skinned_geometry.geometry.triangles.indexData       = m_skinned_index_buffer->handle();
+        m_skinned_geometry.geometry.triangles.indexOffset     = 0;
+        m_skinned_geometry.geometry.triangles.indexCount      = uint32_t(skinned_indices.size());
+        m_skinned_geometry.geometry.triangles.indexType       = VK_INDEX_TYPE_UINT32;
+        m_skinned_geometry.geometry.triangles.transformData   = VK_NULL_HANDLE;
+        m_skinned_geometry.geometry.triangles.transformOffset = 0;
+        m_skinned_geometry.geometry.aabbs.sType               = VK_STRUCTURE_TYPE_GEOMETRY_AABB_NV;
+
+        {
+            dw::vk::AccelerationStructure::Desc desc;
+
+            desc.set_type(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV);
+            desc.set_geometries({ m_skinned_geometry });
+            desc.set_instance_count(0);
+            desc.set_flags(VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_NV);
+
+            m_skinned_blas = dw::vk::AccelerationStructure::create(m_vk_backend, desc);
+        }
+
+        {
+            dw::vk::AccelerationStructure::Desc desc;
+
+            desc.set_type(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV);
+            desc.set_instance_count(2);
+            desc.set_flags(VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_NV);
+
+            m_skinned_tlas = dw::vk::AccelerationStructure::create(m_vk_backend, desc);
+        }
+
+        // The mesh's BLAS as mesh 0 and the skinned one as mesh 1.
+        const dw::vk::AccelerationStructure::Ptr instance_blas[] = { m_mesh->acceleration_structure(), m_skinned_blas };
+
+        RayTracingInstance* instances = (RayTracingInstance*)m_instance_buffer->mapped_ptr();
+
+        for (uint32_t i = 0; i < 2; i++)
+        {
+            RayTracingInstance& instance = instances[i];
+
+            DW_ZERO_MEMORY(instance);
+
+            instance.transform[0]  = 1.0f;
+            instance.transform[5]  = 1.0f;
+            instance.transform[10] = 1.0f;
+            instance.custom_index  = i; // The mesh index in the global set.
+            instance.mask          = 0xff;
+            instance.sbt_offset    = 0;
+            instance.flags         = VK_GEOMETRY_INSTANCE_TRIANGLE_CULL_DISABLE_BIT_NV;
+
+            vkGetAccelerationStructureHandleNV(m_vk_backend->device(), instance_blas[i]->handle(), sizeof(uint64_t), &instance.acceleration_structure);
+        }
+
+        // One scratch buffer serves the BLAS build, its refits and the TLAS build, which never overlap.
+        const VkDeviceSize scratch_size = std::max(std::max(acceleration_structure_scratch_size(m_skinned_blas, VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV),
+                                                            acceleration_structure_scratch_size(m_skinned_blas, VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_UPDATE_SCRATCH_NV)),
+                                                   acceleration_structure_scratch_size(m_skinned_tlas, VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_BUILD_SCRATCH_NV));
+
+        m_as_scratch_buffer = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_RAY_TRACING_BIT_NV, scratch_size, VMA_MEMORY_USAGE_GPU_ONLY, 0);
+
+        // ---------------------------------------------------------------------------
+        // Descriptor set
+        // ---------------------------------------------------------------------------
+
+        m_skinning_ds = m_vk_backend->allocate_descriptor_set(m_skinning_ds_layout);
+
+        {
+            const dw::vk::Buffer::Ptr buffers[] = { m_mesh->vertex_buffer(), m_influence_buffer, m_joint_buffer, m_skinned_vertex_buffer };
+
+            VkDescriptorBufferInfo buffer_info[4];
+            VkWriteDescriptorSet   write_data[4];
+
+            for (uint32_t i = 0; i < 4; i++)
+            {
+                buffer_info[i].buffer = buffers[i]->handle();
+                buffer_info[i].offset = 0;
+                buffer_info[i].range  = VK_WHOLE_SIZE;
+
+                DW_ZERO_MEMORY(write_data[i]);
+
+                write_data[i].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write_data[i].descriptorCount = 1;
+                write_data[i].descriptorType  = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+                write_data[i].pBufferInfo     = &buffer_info[i];
+                write_data[i].dstBinding      = i;
+                write_data[i].dstSet          = m_skinning_ds->handle();
+            }
+
+            vkUpdateDescriptorSets(m_vk_backend->device(), 4, &write_data[0], 0, nullptr);
+        }
+
+        // ---------------------------------------------------------------------------
+        // Initial build
+        // ---------------------------------------------------------------------------
+
+        dw::vk::CommandBuffer::Ptr cmd_buf = m_vk_backend->allocate_graphics_command_buffer();
+
+        VkCommandBufferBeginInfo begin_info;
+        DW_ZERO_MEMORY(begin_info);
+
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+        VkBufferCopy region;
+
+        region.srcOffset = 0;
+        region.dstOffset = 0;
+        region.size      = index_size;
+
+        vkCmdCopyBuffer(cmd_buf->handle(), index_staging->handle(), m_skinned_index_buffer->handle(), 1, &region);
+
+        // Copies every vertex, the ones no skin touches are never written again.
+        SkinningPushConstants constants;
+
+        constants.first_vertex    = 0;
+        constants.vertex_count    = m_scene_vertex_count;
+        constants.first_influence = 0;
+        constants.first_joint     = 0;
+        constants.skinned         = 0;
+
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_skinning_pipeline->handle());
+        bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_skinning_pipeline_layout->handle(), 0, 1, &m_skinning_ds->handle(), 0, nullptr);
+        vkCmdPushConstants(cmd_buf->handle(), m_skinning_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &constants);
+        vkCmdDispatch(cmd_buf->handle(), (m_scene_vertex_count + 63) / 64, 1, 1);
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        build_skinned_acceleration_structures(cmd_buf->handle(), true);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        m_vk_backend->flush_graphics({ cmd_buf });
+
+        m_blas_heuristic.built(bind_palette);
+
+        track_buffer("Skinned Vertices", "Skinning", m_skinned_vertex_buffer, MEMORY_LOCATION_DEVICE, std::to_string(m_scene_vertex_count) + " vertices", false);
+        track_buffer("Joint Influences", "Skinning", m_influence_buffer, MEMORY_LOCATION_HOST, std::to_string(m_skin_vertex_count) + " vertices", false);
+        track_buffer("Joints", "Skinning", m_joint_buffer, MEMORY_LOCATION_HOST, std::to_string(dw::vk::Backend::kMaxFramesInFlight) + " x " + std::to_string(m_skin_joint_count) + " joints", false);
+        track_buffer("Skinned Indices", "Skinning", m_skinned_index_buffer, MEMORY_LOCATION_DEVICE, std::to_string(skinned_opacity.size()) + " triangles", false);
+        track_buffer("Skinned Triangle Opacity", "Skinning", m_skinned_opacity_buffer, MEMORY_LOCATION_HOST, std::to_string(skinned_opacity.size()) + " triangles", false);
+        track_buffer("AS Scratch", "Skinning", m_as_scratch_buffer, MEMORY_LOCATION_DEVICE, "BLAS build, refit and TLAS build", false);
+        track_acceleration_structure("BLAS", "Skinning", m_skinned_blas, std::to_string(skinned_opacity.size()) + " skinned triangles");
+        track_acceleration_structure("TLAS", "Skinning", m_skinned_tlas, "2 instances");
+
+        DW_LOG_INFO("Skinning: " + std::to_string(m_skins.size()) + " skins, " + std::to_string(m_skin_vertex_count) + " vertices, " + std::to_string(skinned_opacity.size()) + " triangles, " + std::to_string(m_skin_joint_count) + " joints");
+
+        if (m_validate_skinning)
+            validate_skinning();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    VkDeviceSize acceleration_structure_scratch_size(const dw::vk::AccelerationStructure::Ptr& as, VkAccelerationStructureMemoryRequirementsTypeNV type)
+    {
+        VkAccelerationStructureMemoryRequirementsInfoNV info;
+        DW_ZERO_MEMORY(info);
+
+        info.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+        info.type                  = type;
+        info.accelerationStructure = as->handle();
+
+        VkMemoryRequirements2 requirements;
+        DW_ZERO_MEMORY(requirements);
+
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+
+        vkGetAccelerationStructureMemoryRequirementsNV(m_vk_backend->device(), &info, &requirements);
+
+        return requirements.memoryRequirements.size;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Builds or refits the skinned BLAS from the skinned vertices, then builds the TLAS over it and the mesh's
+    // BLAS. The TLAS holds two instances and is always built, which costs next to nothing.
+    void build_skinned_acceleration_structures(VkCommandBuffer cmd, bool rebuild_blas)
+    {
+        VkAccelerationStructureInfoNV blas_info;
+        DW_ZERO_MEMORY(blas_info);
+
+        blas_info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+        blas_info.type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_NV;
+        blas_info.flags         = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_NV | VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_NV;
+        blas_info.geometryCount = 1;
+        blas_info.pGeometries   = &m_skinned_geometry;
+
+        // A refit reads the BLAS it updates in place.
+        const VkAccelerationStructureNV src = rebuild_blas ? VK_NULL_HANDLE : m_skinned_blas->handle();
+
+        vkCmdBuildAccelerationStructureNV(cmd, &blas_info, VK_NULL_HANDLE, 0, rebuild_blas ? VK_FALSE : VK_TRUE, m_skinned_blas->handle(), src, m_as_scratch_buffer->handle(), 0);
+
+        // The TLAS build reads the BLAS and reuses the scratch buffer.
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+        memory_barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        VkAccelerationStructureInfoNV tlas_info;
+        DW_ZERO_MEMORY(tlas_info);
+
+        tlas_info.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_INFO_NV;
+        tlas_info.type          = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_NV;
+        tlas_info.flags         = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_NV;
+        tlas_info.instanceCount = 2;
+
+        vkCmdBuildAccelerationStructureNV(cmd, &tlas_info, m_instance_buffer->handle(), 0, VK_FALSE, m_skinned_tlas->handle(), VK_NULL_HANDLE, m_as_scratch_buffer->handle(), 0);
+
+        // Traced against by this frame's ray tracing passes.
+        memory_barrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_NV;
+        memory_barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV;
+
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Skins a test pose on the GPU and compares the result with skin_vertices_cpu(), run with --validate-skinning.
+    void validate_skinning()
+    {
+        const size_t vertex_size = sizeof(SkinVertex) * m_scene_vertex_count;
+
+        // Holds the rest pose copied out of the skinned vertex buffer, then the skinned pose.
+        dw::vk::Buffer::Ptr readback = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, vertex_size * 2, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        std::vector<glm::mat4> palette(m_skin_joint_count);
+        SwaySettings           settings;
+
+        settings.amplitude = 0.2f;
+
+        for (const auto& skin : m_skins)
+            pose_skin(skin, settings, 1.3f, &palette[skin.first_joint]);
+
+        memcpy(m_joint_buffer->mapped_ptr(), palette.data(), sizeof(glm::mat4) * m_skin_joint_count);
+
+        dw::vk::CommandBuffer::Ptr cmd_buf = m_vk_backend->allocate_graphics_command_buffer();
+
+        VkCommandBufferBeginInfo begin_info;
+        DW_ZERO_MEMORY(begin_info);
+
+        begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+        vkBeginCommandBuffer(cmd_buf->handle(), &begin_info);
+
+        VkBufferCopy region;
+
+        region.srcOffset = 0;
+        region.dstOffset = 0;
+        region.size      = vertex_size;
+
+        vkCmdCopyBuffer(cmd_buf->handle(), m_skinned_vertex_buffer->handle(), readback->handle(), 1, &region);
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        dispatch_skinning(cmd_buf->handle(), 0);
+
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        region.dstOffset = vertex_size;
+
+        vkCmdCopyBuffer(cmd_buf->handle(), m_skinned_vertex_buffer->handle(), readback->handle(), 1, &region);
+
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        vkEndCommandBuffer(cmd_buf->handle());
+
+        m_vk_backend->flush_graphics({ cmd_buf });
+
+        const SkinVertex* rest_vertices    = (const SkinVertex*)readback->mapped_ptr();
+        const SkinVertex* skinned_vertices = rest_vertices + m_scene_vertex_count;
+
+        SkinningError error;
+
+        for (const auto& skin : m_skins)
+        {
+            const std::vector<SkinVertex> rest(rest_vertices + skin.first_vertex, rest_vertices + skin.first_vertex + skin.vertex_count());
+            const std::vector<SkinVertex> gpu(skinned_vertices + skin.first_vertex, skinned_vertices + skin.first_vertex + skin.vertex_count());
+
+            std::vector<SkinVertex> reference;
+
+            skin_vertices_cpu(rest, skin, &palette[skin.first_joint], reference);
+
+            const SkinningError skin_error = compare_skinned_vertices(reference, gpu);
+
+            error.max_position = std::max(error.max_position, skin_error.max_position);
+            error.max_normal   = std::max(error.max_normal, skin_error.max_normal);
+            error.vertices += skin_error.vertices;
+            error.mismatched += skin_error.mismatched;
+        }
+
+        DW_LOG_INFO("Skinning validation: " + std::to_string(error.vertices) + " vertices, max position error " + std::to_string(error.max_position) + ", max normal error " + std::to_string(error.max_normal) + ", " + std::to_string(error.mismatched) + " mismatched");
+
+        if (error.mismatched > 0)
+            finish_validation(false);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void load_blue_noise()
+    {
+        m_blue_noise      = dw::vk::Image::create_from_file(m_vk_backend, "texture/LDR_RGBA_0.png");
+        m_blue_noise_view = dw::vk::ImageView::create(m_vk_backend, m_blue_noise, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        track_image("Blue Noise", "Textures", m_blue_noise, "LDR_RGBA_0.png", false);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void track_image(const std::string& name, const std::string& pass, const dw::vk::Image::Ptr& image, const std::string& description, bool resolution_dependent)
+    {
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(m_vk_backend->device(), image->handle(), &requirements);
+
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+
+        m_memory_registry.track(name, pass, MEMORY_RESOURCE_IMAGE, MEMORY_LOCATION_DEVICE, requirements.size, description, resolution_dependent, m_frame_index);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void track_buffer(const std::string& name, const std::string& pass, const dw::vk::Buffer::Ptr& buffer, MemoryLocation location, const std::string& description, bool resolution_dependent)
+    {
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(m_vk_backend->device(), buffer->handle(), &requirements);
+
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+
+        m_memory_registry.track(name, pass, MEMORY_RESOURCE_BUFFER, location, requirements.size, description, resolution_dependent, m_frame_index);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void track_acceleration_structure(const std::string& name, const std::string& pass, const dw::vk::AccelerationStructure::Ptr& as, const std::string& description)
+    {
+        VkAccelerationStructureMemoryRequirementsInfoNV info;
+        DW_ZERO_MEMORY(info);
+
+        info.sType                 = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_INFO_NV;
+        info.type                  = VK_ACCELERATION_STRUCTURE_MEMORY_REQUIREMENTS_TYPE_OBJECT_NV;
+        info.accelerationStructure = as->handle();
+
+        VkMemoryRequirements2 requirements;
+        DW_ZERO_MEMORY(requirements);
+
+        requirements.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+
+        vkGetAccelerationStructureMemoryRequirementsNV(m_vk_backend->device(), &info, &requirements);
+
+        std::lock_guard<std::mutex> lock(m_memory_mutex);
+
+        m_memory_registry.track(name, pass, MEMORY_RESOURCE_ACCELERATION_STRUCTURE, MEMORY_LOCATION_DEVICE, requirements.memoryRequirements.size, description, false, m_frame_index);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Defaults the device and host limits to the size of the largest heap of each kind. Software drivers expose
+    // system memory as a single device local heap, which then becomes the device limit.
+    void create_memory_budget()
+    {
+        VkPhysicalDeviceMemoryProperties properties;
+        vkGetPhysicalDeviceMemoryProperties(m_vk_backend->physical_device(), &properties);
+
+        MemoryBudget budget;
+
+        for (uint32_t i = 0; i < properties.memoryHeapCount; i++)
+        {
+            const MemoryLocation location = (properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? MEMORY_LOCATION_DEVICE : MEMORY_LOCATION_HOST;
+
+            budget.location_bytes[location] = std::max(budget.location_bytes[location], uint64_t(properties.memoryHeaps[i].size));
+        }
+
+        if (m_memory_budget_mb > 0)
+            budget.location_bytes[MEMORY_LOCATION_DEVICE] = uint64_t(m_memory_budget_mb) * 1024ull * 1024ull;
+
+        for (const auto& pass_budget : m_pass_budgets_mb)
+            budget.pass_bytes[pass_budget.first] = uint64_t(pass_budget.second) * 1024ull * 1024ull;
+
+        m_memory_registry.set_budget(budget);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void check_memory_budget()
+    {
+        for (const auto& warning : m_memory_registry.check_budget())
+        {
+            DW_LOG_WARNING("GPU memory: " + warning);
+            m_memory_warnings.push_back(warning);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void write_memory_report()
+    {
+        if (m_memory_registry.write_json(m_memory_report_path, m_frame_index, m_width, m_height))
+            DW_LOG_INFO("Wrote GPU memory report to " + m_memory_report_path);
+        else
+            DW_LOG_ERROR("Failed to write GPU memory report: " + m_memory_report_path);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    dw::vk::Image::Ptr capture_image(uint32_t target)
+    {
+        switch (target)
+        {
+            case CAPTURE_TARGET_FINAL:
+                // render() already flipped the history index.
+                return m_history_image[1 - m_history_idx];
+            case CAPTURE_TARGET_SHADOW_MASK:
+                return m_shadow_mask_image;
+            case CAPTURE_TARGET_REFLECTION:
+                return m_reflection_image;
+            case CAPTURE_TARGET_G_BUFFER_1:
+                return m_g_buffer_1;
+            case CAPTURE_TARGET_G_BUFFER_2:
+                return m_g_buffer_2;
+            default:
+                return m_g_buffer_3;
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void release_capture_buffers()
+    {
+        for (uint32_t i = 0; i < kCaptureRingSize; i++)
+        {
+            for (uint32_t j = 0; j < CAPTURE_TARGET_COUNT; j++)
+            {
+                if (m_capture_slots[i].buffers[j])
+                {
+                    m_capture_slots[i].buffers[j].reset();
+                    m_memory_registry.release("Capture " + std::to_string(i) + " " + kCaptureTargetNames[j], m_frame_index);
+                }
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Copies the final image, and the AOVs if enabled, into a free set of readback buffers. When every set is
+    // still waiting for the GPU or an encoder the frame is dropped instead of stalling the render loop.
+    void record_capture(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        if (!m_capture_frames && !m_capture_next_frame)
+            return;
+
+        m_capture_next_frame = false;
+
+        if (!m_capture_writer)
+            m_capture_writer = std::unique_ptr<FrameCaptureWriter>(new FrameCaptureWriter(m_capture_threads));
+
+        CaptureSlot* slot = find_free_capture_slot();
+
+        // Batch frames can't be dropped, wait for the encoders to release a slot instead. At most the frames in
+        // flight hold one afterwards.
+        if (!slot && m_batch_client)
+        {
+            m_capture_writer->wait();
+            slot = find_free_capture_slot();
+        }
+
+        if (!slot)
+        {
+            m_capture_dropped++;
+            return;
+        }
+
+        SCOPED_SAMPLE("capture", cmd_buf);
+
+        const uint32_t          slot_idx          = uint32_t(slot - &m_capture_slots[0]);
+        const uint32_t          target_count      = m_capture_aovs ? CAPTURE_TARGET_COUNT : 1;
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        for (uint32_t i = 0; i < target_count; i++)
+        {
+            const size_t size = capture_format_size(kCaptureTargetFormats[i]) * m_width * m_height;
+
+            // Sized for the output resolution, so that the AOVs fit at any render scale.
+            if (!slot->buffers[i])
+            {
+                slot->buffers[i] = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+                track_buffer("Capture " + std::to_string(slot_idx) + " " + kCaptureTargetNames[i], "Capture", slot->buffers[i], MEMORY_LOCATION_HOST, std::to_string(m_width) + "x" + std::to_string(m_height) + " " + kCaptureTargetNames[i], true);
+            }
+
+            // The final image is upsampled to the output resolution, everything else covers the render area.
+            const uint32_t width  = i == CAPTURE_TARGET_FINAL ? m_width : m_render_width;
+            const uint32_t height = i == CAPTURE_TARGET_FINAL ? m_height : m_render_height;
+
+            dw::vk::Image::Ptr image = capture_image(i);
+
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                image->handle(),
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                subresource_range);
+
+            VkBufferImageCopy region;
+            DW_ZERO_MEMORY(region);
+
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.layerCount = 1;
+            region.imageExtent.width           = width;
+            region.imageExtent.height          = height;
+            region.imageExtent.depth           = 1;
+
+            vkCmdCopyImageToBuffer(cmd_buf->handle(), image->handle(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot->buffers[i]->handle(), 1, &region);
+
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                image->handle(),
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+
+            slot->width[i]  = width;
+            slot->height[i] = height;
+        }
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        slot->frame           = m_frame_index;
+        slot->frame_in_flight = m_vk_backend->current_frame_idx();
+        slot->target_count    = target_count;
+        slot->batch_frame     = m_batch_client ? m_batch_frame.path_frame : UINT32_MAX;
+        slot->recorded        = true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    CaptureSlot* find_free_capture_slot()
+    {
+        for (uint32_t i = 0; i < kCaptureRingSize; i++)
+        {
+            if (!m_capture_slots[i].recorded && m_capture_slots[i].pending.load() == 0)
+                return &m_capture_slots[i];
+        }
+
+        return nullptr;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Queues the encodes of a recorded slot. The GPU must be done with it. The slot becomes free again once the
+    // last encoder has read its buffers.
+    void submit_capture(CaptureSlot& slot)
+    {
+        if (!slot.recorded)
+            return;
+
+        slot.recorded = false;
+        slot.pending.store(slot.target_count);
+
+        char frame[16];
+        snprintf(frame, sizeof(frame), "%06llu", (unsigned long long)(slot.batch_frame != UINT32_MAX ? slot.batch_frame : slot.frame));
+
+        // Batch frames are only written to be sent, next to the worker rather than into the capture directory.
+        const std::string prefix = slot.batch_frame != UINT32_MAX ? m_batch_name + "_" : m_capture_dir + "/frame_";
+
+        for (uint32_t i = 0; i < slot.target_count; i++)
+        {
+            CaptureJob job;
+
+            job.path    = prefix + frame + "_" + kCaptureTargetNames[i];
+            job.format  = kCaptureTargetFormats[i];
+            job.display = i == CAPTURE_TARGET_FINAL;
+            job.flip_y  = true; // Render targets are stored upside down, the copy pass flips them on present.
+            job.width   = slot.width[i];
+            job.height  = slot.height[i];
+            job.pixels  = (const uint8_t*)slot.buffers[i]->mapped_ptr();
+            job.done    = [&slot]() { slot.pending.fetch_sub(1); };
+
+            if (slot.batch_frame != UINT32_MAX && i == CAPTURE_TARGET_FINAL)
+            {
+                BatchEncodedFrame encoded;
+
+                // Display encodes are PNGs.
+                encoded.path_frame = slot.batch_frame;
+                encoded.frame      = slot.frame;
+                encoded.path       = job.path + ".png";
+
+                job.done = [this, &slot, encoded]() {
+                    {
+                        std::lock_guard<std::mutex> lock(m_batch_mutex);
+                        m_batch_encoded.push_back(encoded);
+                    }
+
+                    slot.pending.fetch_sub(1);
+                };
+            }
+
+            m_capture_writer->submit(job);
+        }
+
+        m_captured_frames++;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void collect_captures()
+    {
+        if (!m_capture_writer)
+            return;
+
+        for (uint32_t i = 0; i < kCaptureRingSize; i++)
+        {
+            if (m_capture_slots[i].recorded && m_capture_slots[i].frame_in_flight == m_vk_backend->current_frame_idx())
+                submit_capture(m_capture_slots[i]);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_lights()
+    {
+        // Scattered through the Sponza atrium.
+        m_rest_lights = generate_lights(m_light_count, glm::vec3(-1200.0f, 10.0f, -500.0f), glm::vec3(1200.0f, 700.0f, 500.0f), 1337);
+
+        m_reset_reservoirs = true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_lights(const FrameState& state)
+    {
+        if (state.lights.empty())
+            return;
+
+        uint8_t* ptr = (uint8_t*)m_light_buffer->mapped_ptr();
+        memcpy(ptr + sizeof(Light) * kMaxLights * m_vk_backend->current_frame_idx(), state.lights.data(), sizeof(Light) * state.lights.size());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void create_camera()
+    {
+        m_main_camera = std::make_unique<dw::Camera>(
+            60.0f, 0.1f, 10000.0f, float(m_width) / float(m_height), glm::vec3(0.0f, 35.0f, 125.0f), glm::vec3(0.0f, 0.0, -1.0f));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void ray_trace_shadow_mask(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("ray-tracing-shadows", cmd_buf);
+
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        // Transition ray tracing output image back to general layout
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_shadow_mask_image->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            subresource_range);
+
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_shadow_visibility_image->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            subresource_range);
+
+        auto& rt_props = m_vk_backend->ray_tracing_properties();
+
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_shadow_mask_pipeline->handle());
+
+        bind_ray_tracing_sets(cmd_buf->handle(), m_shadow_mask_pipeline_layout->handle(), m_shadow_mask_ds->handle());
+
+        vkCmdTraceRaysNV(cmd_buf->handle(),
+                         m_shadow_mask_pipeline->shader_binding_table_buffer()->handle(),
+                         0,
+                         m_shadow_mask_pipeline->shader_binding_table_buffer()->handle(),
+                         m_shadow_mask_sbt->miss_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         m_shadow_mask_pipeline->shader_binding_table_buffer()->handle(),
+                         m_shadow_mask_sbt->hit_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         VK_NULL_HANDLE,
+                         0,
+                         0,
+                         m_render_width,
+                         m_render_height,
+                         1);
+
+        // Area light: trace extra rays for the pixels whose neighbourhood disagrees about visibility.
+        if (m_soft_shadows)
+        {
+            VkMemoryBarrier memory_barrier;
+            DW_ZERO_MEMORY(memory_barrier);
+
+            memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_shadow_refine_pipeline->handle());
+
+            vkCmdTraceRaysNV(cmd_buf->handle(),
+                             m_shadow_refine_pipeline->shader_binding_table_buffer()->handle(),
+                             0,
+                             m_shadow_refine_pipeline->shader_binding_table_buffer()->handle(),
+                             m_shadow_refine_sbt->miss_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             m_shadow_refine_pipeline->shader_binding_table_buffer()->handle(),
+                             m_shadow_refine_sbt->hit_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             VK_NULL_HANDLE,
+                             0,
+                             0,
+                             m_render_width,
+                             m_render_height,
+                             1);
+        }
+
+        // Prepare ray tracing output image as transfer source
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_shadow_mask_image->handle(),
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresource_range);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // First pass of the reflections. Marches the mirror pixels through a depth pyramid and writes the hits it is
+    // confident about, the rest go into the ray list that the ray traced pass works through. The ray traced pass
+    // still launches over the whole render area, ray tracing has no indirect launch, but the invocations past the
+    // list's count exit right away and the traced pixels are packed into full subgroups.
+    void trace_screen_space_reflections(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("screen-space-reflections", cmd_buf);
+
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        // Transition ray tracing output image back to general layout
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_reflection_image->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            subresource_range);
+
+        if (!m_ssr)
+            return;
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+        {
+            SCOPED_SAMPLE("hiz-build", cmd_buf);
+
+            VkImageSubresourceRange hiz_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, kHiZLevels, 0, 1 };
+
+            // The previous frame's march is done with it once the layout transition waited for it.
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_hiz_image->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_GENERAL,
+                hiz_range);
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_hiz_pipeline->handle());
+
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+            HiZPushConstants constants;
+
+            constants.dst_size = glm::ivec2(m_render_width, m_render_height);
+
+            for (uint32_t i = 0; i < kHiZLevels; i++)
+            {
+                constants.src_size = constants.dst_size;
+                constants.dst_size = i == 0 ? constants.src_size : (constants.src_size + 1) / 2;
+                constants.level    = i;
+
+                if (i > 0)
+                    vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+                bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_hiz_pipeline_layout->handle(), 0, 1, &m_hiz_ds[i]->handle(), 0, nullptr);
+
+                vkCmdPushConstants(cmd_buf->handle(), m_hiz_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(HiZPushConstants), &constants);
+                vkCmdDispatch(cmd_buf->handle(), (constants.dst_size.x + 7) / 8, (constants.dst_size.y + 7) / 8, 1);
+            }
+        }
+
+        {
+            SCOPED_SAMPLE("ssr-march", cmd_buf);
+
+            // The previous frame's ray traced pass must be done with the list before its count is cleared.
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdFillBuffer(cmd_buf->handle(), m_ray_list_buffer->handle(), 0, sizeof(uint32_t), 0);
+
+            // Both the cleared count and the finished pyramid.
+            memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            const uint32_t  dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+            VkDescriptorSet sets[]         = { m_ssr_ds->handle(), m_per_frame_ds->handle() };
+
+            bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ssr_pipeline_layout->handle(), 0, 2, sets, 1, &dynamic_offset);
+
+            const glm::ivec2 render_size = glm::ivec2(m_render_width, m_render_height);
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_ssr_pipeline->handle());
+            vkCmdPushConstants(cmd_buf->handle(), m_ssr_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(glm::ivec2), &render_size);
+            vkCmdDispatch(cmd_buf->handle(), (m_render_width + 7) / 8, (m_render_height + 7) / 8, 1);
+
+            // The hits and the list are read and written by the ray traced pass.
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void ray_trace_reflection(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("ray-tracing-reflections", cmd_buf);
+
+        if (m_deferred_reflections)
+        {
+            // Recorded inline so that every stage keeps its own GPU timer.
+            begin_reflections(cmd_buf->handle());
+            trace_deferred_reflections(cmd_buf);
+            end_reflections(cmd_buf->handle());
+        }
+        else
+        {
+            const uint64_t key = hash_combine(m_render_width, m_render_height);
+
+            record_cached(cmd_buf, m_reflection_commands.get(), m_vk_backend->current_frame_idx(), key, nullptr, [this](VkCommandBuffer cmd) {
+                record_reflections(cmd);
+            });
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_reflections(VkCommandBuffer cmd)
+    {
+        begin_reflections(cmd);
+
+        auto& rt_props = m_vk_backend->ray_tracing_properties();
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline->handle());
+
+        vkCmdTraceRaysNV(cmd,
+                         m_reflection_pipeline->shader_binding_table_buffer()->handle(),
+                         0,
+                         m_reflection_pipeline->shader_binding_table_buffer()->handle(),
+                         m_reflection_sbt->miss_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         m_reflection_pipeline->shader_binding_table_buffer()->handle(),
+                         m_reflection_sbt->hit_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         VK_NULL_HANDLE,
+                         0,
+                         0,
+                         m_render_width,
+                         m_render_height,
+                         1);
+
+        end_reflections(cmd);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // The reflection image is already in the general layout, the screen space pass moved it there.
+    void begin_reflections(VkCommandBuffer cmd)
+    {
+        // Every reflection pipeline shares the same layout, so the sets stay bound across pipeline changes.
+        bind_ray_tracing_sets(cmd, m_reflection_pipeline_layout->handle(), m_reflection_ds->handle());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void end_reflections(VkCommandBuffer cmd)
+    {
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        // Prepare ray tracing output image as transfer source
+        dw::vk::utilities::set_image_layout(
+            cmd,
+            m_reflection_image->handle(),
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresource_range);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Traces the reflection rays recording only the hits, sorts the hits by material and shades them in that order.
+    void trace_deferred_reflections(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        auto& rt_props = m_vk_backend->ray_tracing_properties();
+
+        const uint32_t record_count = m_render_width * m_render_height;
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+        {
+            SCOPED_SAMPLE("reflection-record", cmd_buf);
+
+            // The previous frame's binning and shading must be done with the buffers before they are cleared.
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            // Records of rays that missed or were never traced keep the invalid material.
+            vkCmdFillBuffer(cmd_buf->handle(), m_hit_record_buffer->handle(), 0, kHitRecordSize * record_count, 0xffffffff);
+            vkCmdFillBuffer(cmd_buf->handle(), m_material_bin_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
+
+            memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_record_pipeline->handle());
+
+            vkCmdTraceRaysNV(cmd_buf->handle(),
+                             m_reflection_record_pipeline->shader_binding_table_buffer()->handle(),
+                             0,
+                             m_reflection_record_pipeline->shader_binding_table_buffer()->handle(),
+                             m_reflection_record_sbt->miss_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             m_reflection_record_pipeline->shader_binding_table_buffer()->handle(),
+                             m_reflection_record_sbt->hit_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             VK_NULL_HANDLE,
+                             0,
+                             0,
+                             m_render_width,
+                             m_render_height,
+                             1);
+        }
+
+        {
+            SCOPED_SAMPLE("reflection-binning", cmd_buf);
+
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reflection_bin_pipeline_layout->handle(), 0, 1, &m_reflection_bin_ds->handle(), 0, nullptr);
+
+            // Per-material offsets from the hit counts.
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reflection_scan_pipeline->handle());
+            vkCmdDispatch(cmd_buf->handle(), 1, 1, 1);
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            // Hit indices into their material's range.
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_reflection_scatter_pipeline->handle());
+            vkCmdPushConstants(cmd_buf->handle(), m_reflection_bin_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(uint32_t), &record_count);
+            vkCmdDispatch(cmd_buf->handle(), (record_count + 255) / 256, 1, 1);
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+        }
+
+        {
+            SCOPED_SAMPLE("reflection-shade", cmd_buf);
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_shade_pipeline->handle());
+
+            vkCmdTraceRaysNV(cmd_buf->handle(),
+                             m_reflection_shade_pipeline->shader_binding_table_buffer()->handle(),
+                             0,
+                             m_reflection_shade_pipeline->shader_binding_table_buffer()->handle(),
+                             m_reflection_shade_sbt->miss_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             m_reflection_shade_pipeline->shader_binding_table_buffer()->handle(),
+                             m_reflection_shade_sbt->hit_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             VK_NULL_HANDLE,
+                             0,
+                             0,
+                             m_render_width,
+                             m_render_height,
+                             1);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void ray_trace_lights(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("ray-tracing-lights", cmd_buf);
+
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        if (!m_many_lights)
+        {
+            // The deferred pass still binds the lighting image, so keep it in a readable layout.
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_lighting_image->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+
+            m_reset_reservoirs = true;
+            return;
+        }
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+
+        // Zeroed reservoirs represent no candidates, so stale data never leaks into the temporal reuse.
+        if (m_reset_reservoirs)
+        {
+            vkCmdFillBuffer(cmd_buf->handle(), m_reservoir_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
+            vkCmdFillBuffer(cmd_buf->handle(), m_prev_reservoir_buffer->handle(), 0, VK_WHOLE_SIZE, 0);
+
+            memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+            m_reset_reservoirs = false;
+        }
+
+        // Transition ray tracing output image back to general layout
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_lighting_image->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            subresource_range);
+
+        auto& rt_props = m_vk_backend->ray_tracing_properties();
+
+        bind_ray_tracing_sets(cmd_buf->handle(), m_lights_pipeline_layout->handle(), m_lights_ds->handle());
+
+        // Initial candidates and temporal reuse.
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_light_resample_pipeline->handle());
+
+        vkCmdTraceRaysNV(cmd_buf->handle(),
+                         m_light_resample_pipeline->shader_binding_table_buffer()->handle(),
+                         0,
+                         m_light_resample_pipeline->shader_binding_table_buffer()->handle(),
+                         m_light_resample_sbt->miss_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         m_light_resample_pipeline->shader_binding_table_buffer()->handle(),
+                         m_light_resample_sbt->hit_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         VK_NULL_HANDLE,
+                         0,
+                         0,
+                         m_render_width,
+                         m_render_height,
+                         1);
+
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        // Spatial reuse and one shadow ray per pixel.
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_light_shade_pipeline->handle());
+
+        vkCmdTraceRaysNV(cmd_buf->handle(),
+                         m_light_shade_pipeline->shader_binding_table_buffer()->handle(),
+                         0,
+                         m_light_shade_pipeline->shader_binding_table_buffer()->handle(),
+                         m_light_shade_sbt->miss_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         m_light_shade_pipeline->shader_binding_table_buffer()->handle(),
+                         m_light_shade_sbt->hit_group_offset(),
+                         rt_props.shaderGroupHandleSize,
+                         VK_NULL_HANDLE,
+                         0,
+                         0,
+                         m_render_width,
+                         m_render_height,
+                         1);
+
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_lighting_image->handle(),
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresource_range);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Skins every skin's vertices with the palette in block 'palette_idx' of the joint buffer.
+    void dispatch_skinning(VkCommandBuffer cmd, uint32_t palette_idx)
+    {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_skinning_pipeline->handle());
+
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_skinning_pipeline_layout->handle(), 0, 1, &m_skinning_ds->handle(), 0, nullptr);
+
+        uint32_t first_influence = 0;
+
+        for (const auto& skin : m_skins)
+        {
+            SkinningPushConstants constants;
+
+            constants.first_vertex    = skin.first_vertex;
+            constants.vertex_count    = skin.vertex_count();
+            constants.first_influence = first_influence;
+            constants.first_joint     = palette_idx * m_skin_joint_count + skin.first_joint;
+            constants.skinned         = 1;
+
+            vkCmdPushConstants(cmd, m_skinning_pipeline_layout->handle(), VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SkinningPushConstants), &constants);
+            vkCmdDispatch(cmd, (constants.vertex_count + 63) / 64, 1, 1);
+
+            first_influence += skin.vertex_count();
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Skins this frame's pose and brings the skinned BLAS up to date, refitting it unless the heuristic asks for a
+    // build. There is one skinned vertex buffer rather than one per frame in flight, the barriers keep this frame
+    // from overwriting it while the previous one still reads it.
+    void update_skinned_geometry(dw::vk::CommandBuffer::Ptr cmd_buf, const FrameState& state)
+    {
+        if (m_skins.empty())
+            return;
+
+        SCOPED_SAMPLE("skinning", cmd_buf);
+
+        const uint32_t frame_idx  = m_vk_backend->current_frame_idx();
+        const size_t   joint_size = sizeof(glm::mat4) * m_skin_joint_count;
+
+        memcpy((uint8_t*)m_joint_buffer->mapped_ptr() + joint_size * frame_idx, state.joint_palette.data(), joint_size);
+
+        {
+            SCOPED_SAMPLE("skin-vertices", cmd_buf);
+
+            // Only an execution dependency, the previous frame's draws, rays and refit just read the vertices.
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV | VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+            dispatch_skinning(cmd_buf->handle(), frame_idx);
+
+            VkMemoryBarrier memory_barrier;
+            DW_ZERO_MEMORY(memory_barrier);
+
+            memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+            memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            memory_barrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_NV | VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+        }
+
+        {
+            SCOPED_SAMPLE("blas-update", cmd_buf);
+
+            m_blas_rebuilt = m_blas_heuristic.should_rebuild(m_skins, state.joint_palette);
+
+            // The previous frame's rays are done with the acceleration structures before they change.
+            vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_NV, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+            build_skinned_acceleration_structures(cmd_buf->handle(), m_blas_rebuilt);
+
+            if (m_blas_rebuilt)
+                m_blas_heuristic.built(state.joint_palette);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_shadow_map(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("shadow-map", cmd_buf);
+
+        if (!m_hybrid_shadows)
+        {
+            VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, kShadowCascadeCount };
+
+            // The shadow ray generation shader still binds the cascades, so keep them in a readable layout.
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_shadow_map->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+
+            return;
+        }
+
+        VkClearValue clear_value;
+
+        clear_value.depthStencil.depth   = 1.0f;
+        clear_value.depthStencil.stencil = 0;
+
+        const uint32_t frame_idx = m_vk_backend->current_frame_idx();
+
+        for (uint32_t cascade = 0; cascade < kShadowCascadeCount; cascade++)
+        {
+            VkRenderPassBeginInfo info    = {};
+            info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            info.renderPass               = m_shadow_map_rp->handle();
+            info.framebuffer              = m_shadow_map_fbo[cascade]->handle();
+            info.renderArea.extent.width  = m_csm_settings.resolution;
+            info.renderArea.extent.height = m_csm_settings.resolution;
+            info.clearValueCount          = 1;
+            info.pClearValues             = &clear_value;
+
+            // Every submesh is drawn into every cascade, so the commands only change with the frame slot.
+            record_cached(cmd_buf, m_shadow_map_commands.get(), frame_idx * kShadowCascadeCount + cascade, 0, &info, [this, cascade](VkCommandBuffer cmd) {
+                record_shadow_cascade(cmd, cascade);
+            });
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_shadow_cascade(VkCommandBuffer cmd, uint32_t cascade)
+    {
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadow_map_pipeline->handle());
+
+        // Slope scaled bias keeps surfaces at grazing angles to the light from shadowing themselves.
+        vkCmdSetDepthBias(cmd, 1.25f, 0.0f, 1.75f);
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &scene_vertex_buffer()->handle(), &offset);
+        vkCmdBindIndexBuffer(cmd, m_mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+
+        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_shadow_map_pipeline_layout->handle(), 0, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+
+        vkCmdPushConstants(cmd, m_shadow_map_pipeline_layout->handle(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(uint32_t), &cascade);
+
+        for (uint32_t i = 0; i < m_mesh->sub_mesh_count(); i++)
+        {
+            auto& submesh = m_mesh->sub_meshes()[i];
+
+            // Issue draw call.
+            vkCmdDrawIndexed(cmd, submesh.index_count, 1, submesh.base_index, submesh.base_vertex, 0);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("render_gbuffer", cmd_buf);
+
+        if (m_depth_prepass)
+            render_depth_prepass(cmd_buf);
+
+        VkClearValue clear_values[4];
+
+        clear_values[0].color.float32[0] = 0.0f;
+        clear_values[0].color.float32[1] = 0.0f;
+        clear_values[0].color.float32[2] = 0.0f;
+        clear_values[0].color.float32[3] = 1.0f;
+
+        clear_values[1].color.float32[0] = 0.0f;
+        clear_values[1].color.float32[1] = 0.0f;
+        clear_values[1].color.float32[2] = 0.0f;
+        clear_values[1].color.float32[3] = 1.0f;
+
+        clear_values[2].color.float32[0] = 0.0f;
+        clear_values[2].color.float32[1] = 0.0f;
+        clear_values[2].color.float32[2] = 0.0f;
+        clear_values[2].color.float32[3] = 1.0f;
+
+        clear_values[3].color.float32[0] = 1.0f;
+        clear_values[3].color.float32[1] = 1.0f;
+        clear_values[3].color.float32[2] = 1.0f;
+        clear_values[3].color.float32[3] = 1.0f;
+
+        VkRenderPassBeginInfo info    = {};
+        info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.renderPass               = m_depth_prepass ? m_g_buffer_load_depth_rp->handle() : m_g_buffer_rp->handle();
+        info.framebuffer              = m_g_buffer_fbo->handle();
+        info.renderArea.extent.width  = m_render_width;
+        info.renderArea.extent.height = m_render_height;
+        info.clearValueCount          = 4;
+        info.pClearValues             = &clear_values[0];
+
+        record_cached(cmd_buf, m_g_buffer_commands.get(), m_vk_backend->current_frame_idx(), raster_commands_key(), &info, [this](VkCommandBuffer cmd) {
+            record_gbuffer(cmd);
+        });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_gbuffer(VkCommandBuffer cmd)
+    {
+        VkViewport vp;
+
+        vp.x        = 0.0f;
+        vp.y        = 0.0f;
+        vp.width    = (float)m_render_width;
+        vp.height   = (float)m_render_height;
+        vp.minDepth = 0.0f;
+        vp.maxDepth = 1.0f;
+
+        vkCmdSetViewport(cmd, 0, 1, &vp);
+
+        VkRect2D scissor_rect;
+
+        scissor_rect.extent.width  = m_render_width;
+        scissor_rect.extent.height = m_render_height;
+        scissor_rect.offset.x      = 0;
+        scissor_rect.offset.y      = 0;
+
+        vkCmdSetScissor(cmd, 0, 1, &scissor_rect);
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &scene_vertex_buffer()->handle(), &offset);
+        vkCmdBindIndexBuffer(cmd, m_mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+
+        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 0, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 2, 1, &m_vt_ds->handle(), 0, nullptr);
+
+        if (m_depth_prepass)
+        {
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_equal_pipeline->handle());
+
+            draw_submeshes(cmd, m_opaque_submeshes, true);
+            draw_submeshes(cmd, m_masked_submeshes, true);
+        }
+        else
+        {
+            // Opaque first so that the alpha tested draws, which can't use early depth testing, get occluded.
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline->handle());
+
+            draw_submeshes(cmd, m_opaque_submeshes, true);
+
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_masked_pipeline->handle());
+
+            draw_submeshes(cmd, m_masked_submeshes, true);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Lays down the depth of the scene so that the G-Buffer pass only shades the visible surface of every pixel.
+    void render_depth_prepass(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("depth-prepass", cmd_buf);
+
+        VkClearValue clear_value;
+
+        clear_value.depthStencil.depth   = 1.0f;
+        clear_value.depthStencil.stencil = 0;
+
+        VkRenderPassBeginInfo info    = {};
+        info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.renderPass               = m_depth_prepass_rp->handle();
+        info.framebuffer              = m_depth_prepass_fbo->handle();
+        info.renderArea.extent.width  = m_render_width;
+        info.renderArea.extent.height = m_render_height;
+        info.clearValueCount          = 1;
+        info.pClearValues             = &clear_value;
+
+        record_cached(cmd_buf, m_depth_prepass_commands.get(), m_vk_backend->current_frame_idx(), raster_commands_key(), &info, [this](VkCommandBuffer cmd) {
+            record_depth_prepass(cmd);
+        });
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_depth_prepass(VkCommandBuffer cmd)
+    {
+        VkViewport vp;
+
+        vp.x        = 0.0f;
+        vp.y        = 0.0f;
+        vp.width    = (float)m_render_width;
+        vp.height   = (float)m_render_height;
+        vp.minDepth = 0.0f;
+        vp.maxDepth = 1.0f;
+
+        vkCmdSetViewport(cmd, 0, 1, &vp);
+
+        VkRect2D scissor_rect;
+
+        scissor_rect.extent.width  = m_render_width;
+        scissor_rect.extent.height = m_render_height;
+        scissor_rect.offset.x      = 0;
+        scissor_rect.offset.y      = 0;
+
+        vkCmdSetScissor(cmd, 0, 1, &scissor_rect);
+
+        VkDeviceSize offset = 0;
+        vkCmdBindVertexBuffers(cmd, 0, 1, &scene_vertex_buffer()->handle(), &offset);
+        vkCmdBindIndexBuffer(cmd, m_mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+
+        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 0, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 2, 1, &m_vt_ds->handle(), 0, nullptr);
+
+        // Opaque draws have no fragment shader and don't need their material.
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depth_prepass_pipeline->handle());
+
+        draw_submeshes(cmd, m_opaque_submeshes, false);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_depth_prepass_masked_pipeline->handle());
+
+        draw_submeshes(cmd, m_masked_submeshes, true);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline const FrameState& last_recorded_state() const
+    {
+        return m_frame_states[(m_frame_index + dw::vk::Backend::kMaxFramesInFlight - 1) % dw::vk::Backend::kMaxFramesInFlight];
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline bool is_submesh_visible(uint32_t idx) const
+    {
+        const std::vector<uint8_t>& visible = m_frame_states[m_frame_index % dw::vk::Backend::kMaxFramesInFlight].submesh_visible;
+
+        return visible.empty() || visible[idx] != 0;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Everything the G-Buffer and depth prepass recordings depend on that can change between frames.
+    uint64_t raster_commands_key() const
+    {
+        const std::vector<uint8_t>& visible = m_frame_states[m_frame_index % dw::vk::Backend::kMaxFramesInFlight].submesh_visible;
+
+        uint64_t key = hash_combine(m_render_width, m_render_height);
+
+        key = hash_combine(key, m_depth_prepass ? 1 : 0);
+
+        // An empty set draws everything, which differs from an all-visible set only in size.
+        return hash_bytes(visible.data(), visible.size(), hash_combine(key, visible.size()));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Executes the recording of 'variant' in 'cache', recording it with 'record' first if it is missing or was made
+    // with a different key. With 'info' set the commands are executed inside that render pass. Without caching the
+    // commands are recorded straight into the primary command buffer every frame.
+    void record_cached(dw::vk::CommandBuffer::Ptr cmd_buf, SecondaryCommandCache* cache, uint32_t variant, uint64_t key, const VkRenderPassBeginInfo* info, const std::function<void(VkCommandBuffer)>& record)
+    {
+        if (!m_cache_commands)
+        {
+            if (info)
+                vkCmdBeginRenderPass(cmd_buf->handle(), info, VK_SUBPASS_CONTENTS_INLINE);
+
+            record(cmd_buf->handle());
+
+            if (info)
+                vkCmdEndRenderPass(cmd_buf->handle());
+
+            return;
+        }
+
+        key = hash_combine(key, m_command_generation);
+
+        VkCommandBuffer secondary = cache->find(variant, key);
+
+        if (secondary == VK_NULL_HANDLE)
+        {
+            secondary = cache->begin(variant, info ? info->renderPass : VK_NULL_HANDLE, info ? info->framebuffer : VK_NULL_HANDLE);
+            record(secondary);
+            cache->end(variant, key);
+        }
+
+        if (info)
+            vkCmdBeginRenderPass(cmd_buf->handle(), info, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+        vkCmdExecuteCommands(cmd_buf->handle(), 1, &secondary);
+
+        if (info)
+            vkCmdEndRenderPass(cmd_buf->handle());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    inline void bind_descriptor_sets(VkCommandBuffer cmd, VkPipelineBindPoint bind_point, VkPipelineLayout layout, uint32_t first_set, uint32_t set_count, const VkDescriptorSet* sets, uint32_t dynamic_offset_count, const uint32_t* dynamic_offsets)
+    {
+        vkCmdBindDescriptorSets(cmd, bind_point, layout, first_set, set_count, sets, dynamic_offset_count, dynamic_offsets);
+
+        m_descriptor_bind_calls++;
+        m_descriptor_sets_bound += set_count;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Every ray tracing pipeline layout is the pass' own set followed by the global set, bound in a single call
+    // with the per-frame UBO offset as the only dynamic offset.
+    void bind_ray_tracing_sets(VkCommandBuffer cmd, VkPipelineLayout layout, VkDescriptorSet pass_ds)
+    {
+        const VkDescriptorSet sets[]         = { pass_ds, m_global_ds->handle() };
+        const uint32_t        dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, layout, 0, 2, &sets[0], 1, &dynamic_offset);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void draw_submeshes(VkCommandBuffer cmd, const std::vector<uint32_t>& submeshes, bool bind_materials)
+    {
+        // Consecutive submeshes often share a material, which then stays bound.
+        VkDescriptorSet bound_material = VK_NULL_HANDLE;
+
+        for (uint32_t i : submeshes)
+        {
+            if (!is_submesh_visible(i))
+                continue;
+
+            auto& submesh = m_mesh->sub_meshes()[i];
+
+            if (bind_materials)
+            {
+                auto& mat = m_mesh->material(submesh.mat_idx);
+
+                if (mat->pbr_descriptor_set() && mat->pbr_descriptor_set()->handle() != bound_material)
+                {
+                    bound_material = mat->pbr_descriptor_set()->handle();
+                    bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 1, 1, &bound_material, 0, nullptr);
+                }
+
+                vkCmdPushConstants(cmd, m_g_buffer_pipeline_layout->handle(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(uint32_t), &submesh.mat_idx);
+            }
+
+            // Issue draw call.
+            vkCmdDrawIndexed(cmd, submesh.index_count, 1, submesh.base_index, submesh.base_vertex, 0);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Rasterizes triangle IDs and depth only, then resolves the albedo, roughness, normal and metallic targets
+    // once per pixel. The position target is left unwritten, its readers rebuild it from depth.
+    void render_visibility_buffer(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("render_gbuffer", cmd_buf);
+
+        {
+            SCOPED_SAMPLE("visibility-raster", cmd_buf);
+
+            VkClearValue clear_values[2];
+
+            clear_values[0].color.uint32[0] = 0xffffffff;
+            clear_values[0].color.uint32[1] = 0xffffffff;
+            clear_values[0].color.uint32[2] = 0xffffffff;
+            clear_values[0].color.uint32[3] = 0xffffffff;
+
+            clear_values[1].depthStencil.depth   = 1.0f;
+            clear_values[1].depthStencil.stencil = 0;
+
+            VkRenderPassBeginInfo info    = {};
+            info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            info.renderPass               = m_visibility_rp->handle();
+            info.framebuffer              = m_visibility_fbo->handle();
+            info.renderArea.extent.width  = m_render_width;
+            info.renderArea.extent.height = m_render_height;
+            info.clearValueCount          = 2;
+            info.pClearValues             = &clear_values[0];
+
+            vkCmdBeginRenderPass(cmd_buf->handle(), &info, VK_SUBPASS_CONTENTS_INLINE);
+
+            VkViewport vp;
+
+            vp.x        = 0.0f;
+            vp.y        = 0.0f;
+            vp.width    = (float)m_render_width;
+            vp.height   = (float)m_render_height;
+            vp.minDepth = 0.0f;
+            vp.maxDepth = 1.0f;
+
+            vkCmdSetViewport(cmd_buf->handle(), 0, 1, &vp);
+
+            VkRect2D scissor_rect;
+
+            scissor_rect.extent.width  = m_render_width;
+            scissor_rect.extent.height = m_render_height;
+            scissor_rect.offset.x      = 0;
+            scissor_rect.offset.y      = 0;
+
+            vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_visibility_pipeline->handle());
+
+            VkDeviceSize offset = 0;
+            vkCmdBindVertexBuffers(cmd_buf->handle(), 0, 1, &scene_vertex_buffer()->handle(), &offset);
+            vkCmdBindIndexBuffer(cmd_buf->handle(), m_mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+
+            const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+            bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_visibility_pipeline_layout->handle(), 0, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+            bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_visibility_pipeline_layout->handle(), 2, 1, &m_vt_ds->handle(), 0, nullptr);
+
+            for (uint32_t i = 0; i < m_mesh->sub_mesh_count(); i++)
+            {
+                if (!is_submesh_visible(i))
+                    continue;
+
+                auto& submesh = m_mesh->sub_meshes()[i];
+                auto& mat     = m_mesh->material(submesh.mat_idx);
+
+                if (mat->pbr_descriptor_set())
+                    bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_visibility_pipeline_layout->handle(), 1, 1, &mat->pbr_descriptor_set()->handle(), 0, nullptr);
+
+                // The mesh is the only instance of the scene. Triangles are numbered like the primitive IDs of the
+                // closest hit shaders, which index the whole mesh.
+                const uint32_t draw_constants[3] = { 0, submesh.base_index / 3, submesh.mat_idx };
+
+                vkCmdPushConstants(cmd_buf->handle(), m_visibility_pipeline_layout->handle(), VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(draw_constants), &draw_constants[0]);
+
+                // Issue draw call.
+                vkCmdDrawIndexed(cmd_buf->handle(), submesh.index_count, 1, submesh.base_index, submesh.base_vertex, 0);
+            }
+
+            vkCmdEndRenderPass(cmd_buf->handle());
+        }
+
+        {
+            SCOPED_SAMPLE("visibility-resolve", cmd_buf);
+
+            VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_g_buffer_1->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_GENERAL,
+                subresource_range);
+
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_g_buffer_2->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_GENERAL,
+                subresource_range);
+
+            // Never written in this mode, only transitioned so that the G-Buffer descriptors stay valid.
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_g_buffer_3->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+
+            auto& rt_props = m_vk_backend->ray_tracing_properties();
+
+            vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_visibility_resolve_pipeline->handle());
+
+            bind_ray_tracing_sets(cmd_buf->handle(), m_visibility_resolve_pipeline_layout->handle(), m_visibility_ds->handle());
+
+            vkCmdTraceRaysNV(cmd_buf->handle(),
+                             m_visibility_resolve_pipeline->shader_binding_table_buffer()->handle(),
+                             0,
+                             m_visibility_resolve_pipeline->shader_binding_table_buffer()->handle(),
+                             m_visibility_resolve_sbt->miss_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             m_visibility_resolve_pipeline->shader_binding_table_buffer()->handle(),
+                             m_visibility_resolve_sbt->hit_group_offset(),
+                             rt_props.shaderGroupHandleSize,
+                             VK_NULL_HANDLE,
+                             0,
+                             0,
+                             m_render_width,
+                             m_render_height,
+                             1);
+
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_g_buffer_1->handle(),
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_g_buffer_2->handle(),
+                VK_IMAGE_LAYOUT_GENERAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render_deferred(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("deferred", cmd_buf);
+
+        if (m_reset_history)
+        {
+            VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+            // The history image has never been written, transition it so it can be bound. Its contents are ignored this frame.
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                m_history_image[1 - m_history_idx]->handle(),
+                VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                subresource_range);
+        }
+
+        if (m_compute_deferred)
+            dispatch_deferred(cmd_buf);
+        else
+        {
+            VkClearValue clear_value;
+
+            clear_value.color.float32[0] = 0.0f;
+            clear_value.color.float32[1] = 0.0f;
+            clear_value.color.float32[2] = 0.0f;
+            clear_value.color.float32[3] = 1.0f;
+
+            VkRenderPassBeginInfo info    = {};
+            info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+            info.renderPass               = m_deferred_rp->handle();
+            info.framebuffer              = m_deferred_fbo[m_history_idx]->handle();
+            info.renderArea.extent.width  = m_width;
+            info.renderArea.extent.height = m_height;
+            info.clearValueCount          = 1;
+            info.pClearValues             = &clear_value;
+
+            // One recording per frame slot and history image.
+            record_cached(cmd_buf, m_deferred_commands.get(), m_vk_backend->current_frame_idx() * 2 + m_history_idx, 0, &info, [this](VkCommandBuffer cmd) {
+                record_deferred(cmd);
+            });
+        }
+
+        m_reset_history = false;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Lighting, tonemapping and the history resolve in a single dispatch over 8x8 output tiles, writing the history
+    // image the copy pass presents. Leaves the history in the layout the render pass of the fragment path ends in.
+    void dispatch_deferred(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_history_image[m_history_idx]->handle(),
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            subresource_range);
+
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_deferred_compute_pipeline->handle());
+
+        const VkDescriptorSet sets[]         = { m_deferred_ds[m_history_idx]->handle(), m_per_frame_ds->handle() };
+        const uint32_t        dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+        bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_COMPUTE, m_deferred_pipeline_layout->handle(), 0, 2, &sets[0], 1, &dynamic_offset);
+
+        vkCmdDispatch(cmd_buf->handle(), (m_width + 7) / 8, (m_height + 7) / 8, 1);
+
+        dw::vk::utilities::set_image_layout(
+            cmd_buf->handle(),
+            m_history_image[m_history_idx]->handle(),
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+            subresource_range);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_deferred(VkCommandBuffer cmd)
+    {
+        // The history is kept in the same orientation as the G-Buffer, the flip happens when copying to the swap chain.
+        VkViewport vp;
+
+        vp.x        = 0.0f;
+        vp.y        = 0.0f;
+        vp.width    = (float)m_width;
+        vp.height   = (float)m_height;
+        vp.minDepth = 0.0f;
+        vp.maxDepth = 1.0f;
+
+        vkCmdSetViewport(cmd, 0, 1, &vp);
+
+        VkRect2D scissor_rect;
+
+        scissor_rect.extent.width  = m_width;
+        scissor_rect.extent.height = m_height;
+        scissor_rect.offset.x      = 0;
+        scissor_rect.offset.y      = 0;
+
+        vkCmdSetScissor(cmd, 0, 1, &scissor_rect);
+
+        vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_deferred_pipeline->handle());
+
+        const VkDescriptorSet sets[]         = { m_deferred_ds[m_history_idx]->handle(), m_per_frame_ds->handle() };
+        const uint32_t        dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+
+        bind_descriptor_sets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_deferred_pipeline_layout->handle(), 0, 2, &sets[0], 1, &dynamic_offset);
+
+        vkCmdDraw(cmd, 3, 1, 0, 0);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void render(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        SCOPED_SAMPLE("copy", cmd_buf);
+
+        VkClearValue clear_values[2];
+
+        clear_values[0].color.float32[0] = 0.0f;
+        clear_values[0].color.float32[1] = 0.0f;
+        clear_values[0].color.float32[2] = 0.0f;
+        clear_values[0].color.float32[3] = 1.0f;
+
+        clear_values[1].color.float32[0] = 1.0f;
+        clear_values[1].color.float32[1] = 1.0f;
+        clear_values[1].color.float32[2] = 1.0f;
+        clear_values[1].color.float32[3] = 1.0f;
+
+        VkRenderPassBeginInfo info    = {};
+        info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        info.renderPass               = m_vk_backend->swapchain_render_pass()->handle();
+        info.framebuffer              = m_vk_backend->swapchain_framebuffer()->handle();
+        info.renderArea.extent.width  = m_width;
+        info.renderArea.extent.height = m_height;
+        info.clearValueCount          = 2;
+        info.pClearValues             = &clear_values[0];
+
+        vkCmdBeginRenderPass(cmd_buf->handle(), &info, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport vp;
+
+        vp.x        = 0.0f;
+        vp.y        = (float)m_height;
+        vp.width    = (float)m_width;
+        vp.height   = -(float)m_height;
+        vp.minDepth = 0.0f;
+        vp.maxDepth = 1.0f;
+
+        vkCmdSetViewport(cmd_buf->handle(), 0, 1, &vp);
+
+        VkRect2D scissor_rect;
+
+        scissor_rect.extent.width  = m_width;
+        scissor_rect.extent.height = m_height;
+        scissor_rect.offset.x      = 0;
+        scissor_rect.offset.y      = 0;
+
+        vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
+
+        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_copy_pipeline->handle());
+        bind_descriptor_sets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_copy_pipeline_layout->handle(), 0, 1, &m_copy_ds[m_history_idx]->handle(), 0, nullptr);
+
+        vkCmdDraw(cmd_buf->handle(), 3, 1, 0, 0);
+
+        render_gui(cmd_buf);
+
+        vkCmdEndRenderPass(cmd_buf->handle());
+
+        m_history_idx = 1 - m_history_idx;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_uniforms(dw::vk::CommandBuffer::Ptr cmd_buf, FrameState& state)
+    {
+        SCOPED_SAMPLE("update_uniforms", cmd_buf);
+
+        Transforms& transforms = state.transforms;
+
+        // Reprojection uses the unjittered matrices of the previous frame.
+        const glm::mat4 view_proj = transforms.proj * transforms.view;
+
+        transforms.prev_view_proj   = m_reset_history ? view_proj : m_prev_view_proj;
+        transforms.upsample_params  = glm::vec4(m_render_scale, m_reset_history ? 1.0f : m_history_blend, m_jitter.x, m_jitter.y);
+        transforms.ray_stats_params = glm::uvec4(m_ray_stats_enabled ? 1u : 0u, RAY_STAT_COUNT * m_vk_backend->current_frame_idx(), 0, 0);
+        m_prev_view_proj            = view_proj;
+
+        transforms.soft_shadow_params  = glm::vec4(m_soft_shadows ? glm::radians(m_light_angular_radius) : 0.0f, m_penumbra_variance_threshold, float(m_max_penumbra_radius), 0.0f);
+        transforms.soft_shadow_samples = glm::uvec4(m_penumbra_rays, uint32_t(m_gpu_timer->current_frame()), 0, 0);
+        transforms.light_params        = glm::uvec4(m_many_lights ? uint32_t(state.lights.size()) : 0u, kMaxLights * m_vk_backend->current_frame_idx(), m_light_candidates, m_spatial_neighbours);
+        transforms.restir_params       = glm::vec4(m_temporal_reuse ? m_temporal_m_cap : 0.0f, m_spatial_reuse ? m_spatial_radius : 0.0f, m_many_lights ? 1.0f : 0.0f, 0.0f);
+
+        transforms.csm_params = glm::vec4(m_hybrid_shadows ? 1.0f : 0.0f, m_cascade_boundary_band, m_depth_ambiguity_texels, m_contact_hardening_distance);
+
+        transforms.visibility_params = glm::uvec4(m_visibility_buffer ? 1 : 0, 0, 0, 0);
+        transforms.alpha_test_params = glm::uvec4(m_alpha_tested_rays || !m_skins.empty() ? 1 : 0, m_alpha_tested_rays ? 1 : 0, 0, 0);
+        transforms.ray_cone_params   = glm::vec4(m_ray_cones ? 1.0f : 0.0f, m_ray_cone_lod_bias, 0.0f, 0.0f);
+        transforms.ssr_params        = glm::vec4(m_ssr ? 1.0f : 0.0f, m_ssr_thickness, float(m_ssr_max_iterations), 0.0f);
+
+        // The pixel of every feedback square that writes steps through all of them, 97 being coprime with their count.
+        const uint32_t feedback_pixel = uint32_t(m_frame_index * 97) % (kVtFeedbackScale * kVtFeedbackScale);
+        const uint32_t vt_flags       = m_virtual_texturing ? 1u | (feedback_pixel % kVtFeedbackScale) << 8 | (feedback_pixel / kVtFeedbackScale) << 16 : 0u;
+
+        transforms.vt_params = glm::uvec4(vt_flags, m_vt_feedback_width, m_vt_feedback_height, kVtFeedbackMaxSize * kVtFeedbackMaxSize * m_vk_backend->current_frame_idx());
+
+        uint8_t* ptr = (uint8_t*)m_ubo->mapped_ptr();
+        memcpy(ptr + m_ubo_size * m_vk_backend->current_frame_idx(), &transforms, sizeof(Transforms));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_dynamic_resolution(bool gpu_timings_resolved)
+    {
+        if (m_dynamic_resolution)
+        {
+            if (gpu_timings_resolved)
+            {
+                GpuFrameTiming timing;
+
+                timing.scaled_ms = m_gpu_timer->elapsed_ms("render_gbuffer") + m_gpu_timer->elapsed_ms("ray-tracing-shadows") + m_gpu_timer->elapsed_ms("screen-space-reflections") + m_gpu_timer->elapsed_ms("ray-tracing-reflections") + m_gpu_timer->elapsed_ms("ray-tracing-lights");
+                timing.fixed_ms  = m_gpu_timer->elapsed_ms("shadow-map") + m_gpu_timer->elapsed_ms("deferred") + m_gpu_timer->elapsed_ms("copy");
+
+                m_render_scale = m_resolution_controller.update(timing);
+
+                if (!m_resolution_trace_path.empty())
+                    m_resolution_trace.push_back(timing);
+            }
+        }
+        else
+            m_render_scale = 1.0f;
+
+        m_render_width  = std::max(1u, uint32_t(float(m_width) * m_render_scale));
+        m_render_height = std::max(1u, uint32_t(float(m_height) * m_render_scale));
+
+        // Sub-pixel jitter from a Halton(2, 3) sequence so that the temporal upsample accumulates new samples every frame.
+        m_jitter_idx = (m_jitter_idx + 1) % kJitterSampleCount;
+
+        const glm::vec2 offset = glm::vec2(halton(m_jitter_idx + 1, 2), halton(m_jitter_idx + 1, 3)) - glm::vec2(0.5f);
+
+        m_jitter = glm::vec2(2.0f * offset.x / float(m_render_width), 2.0f * offset.y / float(m_render_height));
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    float halton(uint32_t index, uint32_t base)
+    {
+        float f      = 1.0f;
+        float result = 0.0f;
+
+        while (index > 0)
+        {
+            f      = f / float(base);
+            result = result + f * float(index % base);
+            index  = index / base;
+        }
+
+        return result;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Hands the streamer the feedback of the frame that last used this slot, applies the pages it streamed in
+    // since and clears this frame's feedback.
+    void update_virtual_texturing(dw::vk::CommandBuffer::Ptr cmd_buf)
+    {
+        if (!m_vt_streamer)
+            return;
+
+        const uint32_t frame_idx       = m_vk_backend->current_frame_idx();
+        const size_t   feedback_offset = sizeof(uint32_t) * kVtFeedbackMaxSize * kVtFeedbackMaxSize * frame_idx;
+
+        if (m_vt_feedback_recorded[frame_idx])
+        {
+            const uint32_t* requests = (const uint32_t*)((uint8_t*)m_vt_feedback_buffer->mapped_ptr() + feedback_offset);
+
+            m_vt_streamer->submit_feedback(requests, m_vt_feedback_count[frame_idx], m_vt_feedback_frame[frame_idx]);
+            m_vt_feedback_recorded[frame_idx] = false;
+        }
+
+        m_vt_stats          = m_vt_streamer->stats();
+        m_vt_resident_pages = m_vt_streamer->resident_count();
+        m_vt_frame_uploads  = 0;
+
+        if (!m_virtual_texturing)
+            return;
+
+        SCOPED_SAMPLE("virtual-texturing", cmd_buf);
+
+        m_vt_streamer->set_settings(m_vt_settings);
+
+        VtStreamingBatch batch;
+
+        if (m_vt_streamer->take_batch(batch))
+        {
+            VkImageSubresourceRange physical_range    = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            VkImageSubresourceRange indirection_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, kVtMaxMips, 0, std::max(m_global_material_count, 1u) };
+
+            // Ordered after the frames in flight that still sample the evicted pages.
+            for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+                dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_physical_image[map]->handle(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, physical_range);
+
+            dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, indirection_range);
+
+            copy_virtual_texture_batch(cmd_buf->handle(), batch, m_vt_staging_buffer, m_vt_staging_size * frame_idx);
+
+            for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+                dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_physical_image[map]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, physical_range);
+
+            dw::vk::utilities::set_image_layout(cmd_buf->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, indirection_range);
+
+            m_vt_frame_uploads = uint32_t(batch.pages.size());
+        }
+
+        // A texel per kVtFeedbackScale pixels square of the render area.
+        m_vt_feedback_width  = std::min((m_render_width + kVtFeedbackScale - 1) / kVtFeedbackScale, kVtFeedbackMaxSize);
+        m_vt_feedback_height = std::min((m_render_height + kVtFeedbackScale - 1) / kVtFeedbackScale, kVtFeedbackMaxSize);
+
+        const uint32_t feedback_count = m_vt_feedback_width * m_vt_feedback_height;
+
+        vkCmdFillBuffer(cmd_buf->handle(), m_vt_feedback_buffer->handle(), feedback_offset, sizeof(uint32_t) * feedback_count, kVtInvalidPage);
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        m_vt_feedback_recorded[frame_idx] = true;
+        m_vt_feedback_count[frame_idx]    = feedback_count;
+        m_vt_feedback_frame[frame_idx]    = m_frame_index;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Copies the pages of a batch into their slots and the indirection of its textures into their layers, through
+    // 'staging' from 'offset' on. The images have to be in the transfer destination layout.
+    void copy_virtual_texture_batch(VkCommandBuffer cmd, const VtStreamingBatch& batch, const dw::vk::Buffer::Ptr& staging, size_t offset)
+    {
+        uint8_t* ptr = (uint8_t*)staging->mapped_ptr();
+
+        std::vector<VkBufferImageCopy> regions[VT_MAP_COUNT];
+
+        for (const auto& upload : batch.pages)
+        {
+            memcpy(ptr + offset, upload.texels.data(), upload.texels.size());
+
+            for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+            {
+                VkBufferImageCopy region;
+                DW_ZERO_MEMORY(region);
+
+                region.bufferOffset                = offset + vt_map_offset(map);
+                region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.layerCount = 1;
+                region.imageOffset.x               = int32_t((upload.slot % m_vt_slots_per_side) * kVtPageSize);
+                region.imageOffset.y               = int32_t((upload.slot / m_vt_slots_per_side) * kVtPageSize);
+                region.imageExtent.width           = kVtPageSize;
+                region.imageExtent.height          = kVtPageSize;
+                region.imageExtent.depth           = 1;
+
+                regions[map].push_back(region);
+            }
+
+            offset += upload.texels.size();
+        }
+
+        for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+        {
+            if (!regions[map].empty())
+                vkCmdCopyBufferToImage(cmd, staging->handle(), m_vt_physical_image[map]->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(regions[map].size()), regions[map].data());
+        }
+
+        std::vector<VkBufferImageCopy> indirection_regions;
+
+        for (const auto& update : batch.indirection)
+        {
+            const VirtualTextureDesc& desc = m_vt_page_file.textures()[update.texture];
+
+            memcpy(ptr + offset, update.entries.data(), sizeof(uint32_t) * update.entries.size());
+
+            // The entries hold every mip one after the other, each in the corner of its level.
+            for (uint32_t mip = 0; mip < desc.mip_count; mip++)
+            {
+                VkBufferImageCopy region;
+                DW_ZERO_MEMORY(region);
+
+                region.bufferOffset                    = offset + sizeof(uint32_t) * desc.page_index(mip, 0, 0);
+                region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+                region.imageSubresource.mipLevel       = mip;
+                region.imageSubresource.baseArrayLayer = update.texture;
+                region.imageSubresource.layerCount     = 1;
+                region.imageExtent.width               = desc.pages_x_at(mip);
+                region.imageExtent.height              = desc.pages_y_at(mip);
+                region.imageExtent.depth               = 1;
+
+                indirection_regions.push_back(region);
+            }
+
+            offset += sizeof(uint32_t) * update.entries.size();
+        }
+
+        if (!indirection_regions.empty())
+            vkCmdCopyBufferToImage(cmd, staging->handle(), m_vt_indirection_image->handle(), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, uint32_t(indirection_regions.size()), indirection_regions.data());
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void update_ray_stats(dw::vk::CommandBuffer::Ptr cmd_buf, bool gpu_timings_resolved)
+    {
+        const uint32_t frame_idx = m_vk_backend->current_frame_idx();
+        const size_t   offset    = sizeof(uint32_t) * RAY_STAT_COUNT * frame_idx;
+        const uint32_t mode      = m_reflection_mode_recorded[frame_idx] ? 1 : 0;
+
+        // Timings and counters are kept per reflection shading mode so that both can be compared side by side.
+        if (gpu_timings_resolved)
+            m_reflection_ms[mode] = m_gpu_timer->elapsed_ms("ray-tracing-reflections");
+
+        m_reflection_mode_recorded[frame_idx] = m_deferred_reflections;
+
+        if (m_ray_stats_recorded[frame_idx])
+        {
+            const uint32_t* counters = (const uint32_t*)((uint8_t*)m_ray_stats_buffer->mapped_ptr() + offset);
+
+            m_ray_stats                     = RayStats::unpack(counters);
+            m_ray_stats_recorded[frame_idx] = false;
+            m_shadow_rays_per_pixel         = m_ray_stats.shadow_rays_per_pixel(m_ray_stats_pixels[frame_idx]);
+            m_penumbra_fraction             = m_ray_stats.penumbra_fraction(m_ray_stats_pixels[frame_idx]);
+            m_shadow_traced_fraction        = m_ray_stats.shadow_traced_fraction(m_ray_stats_pixels[frame_idx]);
+            m_reflection_divergence[mode]   = m_ray_stats.reflection_materials_per_subgroup();
+
+            // Rays/sec needs the pass timings of the same frame, which the GPU timer resolved from this slot too.
+            if (gpu_timings_resolved)
+            {
+                m_shadow_rays_per_sec     = m_ray_stats.shadow.rays_per_second(m_gpu_timer->elapsed_ms("ray-tracing-shadows"));
+                m_reflection_rays_per_sec = m_ray_stats.reflection.rays_per_second(m_gpu_timer->elapsed_ms("ray-tracing-reflections"));
+                m_light_rays_per_sec      = m_ray_stats.light.rays_per_second(m_gpu_timer->elapsed_ms("ray-tracing-lights"));
+            }
+
+            report_ray_stats();
+        }
+
+        if (!m_ray_stats_enabled)
+            return;
+
+        vkCmdFillBuffer(cmd_buf->handle(), m_ray_stats_buffer->handle(), offset, sizeof(uint32_t) * RAY_STAT_COUNT, 0);
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_NV, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        m_ray_stats_recorded[frame_idx] = true;
+        m_ray_stats_pixels[frame_idx]   = uint64_t(m_render_width) * uint64_t(m_render_height);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void report_ray_stats()
+    {
+        if (m_trace_exporter.is_open())
+        {
+            const double now = m_cpu_timer.now_ms();
+
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_rays", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.shadow.rays));
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_hits", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.shadow.hits));
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_misses", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.shadow.misses));
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_rays_per_sec", m_gpu_timer->resolved_frame(), now, m_shadow_rays_per_sec);
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_rays_per_pixel", m_gpu_timer->resolved_frame(), now, m_shadow_rays_per_pixel);
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_penumbra_fraction", m_gpu_timer->resolved_frame(), now, m_penumbra_fraction);
+            m_trace_exporter.record_counter(m_gpu_track, "shadow_traced_fraction", m_gpu_timer->resolved_frame(), now, m_shadow_traced_fraction);
+            m_trace_exporter.record_counter(m_gpu_track, "reflection_rays", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.reflection.rays));
+            m_trace_exporter.record_counter(m_gpu_track, "reflection_hits", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.reflection.hits));
+            m_trace_exporter.record_counter(m_gpu_track, "reflection_misses", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.reflection.misses));
+            m_trace_exporter.record_counter(m_gpu_track, "reflection_rays_per_sec", m_gpu_timer->resolved_frame(), now, m_reflection_rays_per_sec);
+            m_trace_exporter.record_counter(m_gpu_track, "reflection_materials_per_subgroup", m_gpu_timer->resolved_frame(), now, m_ray_stats.reflection_materials_per_subgroup());
+            m_trace_exporter.record_counter(m_gpu_track, "ssr_hit_fraction", m_gpu_timer->resolved_frame(), now, m_ray_stats.ssr_hit_fraction());
+            m_trace_exporter.record_counter(m_gpu_track, "ssr_rays_saved", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.ssr_hits));
+            m_trace_exporter.record_counter(m_gpu_track, "light_rays", m_gpu_timer->resolved_frame(), now, double(m_ray_stats.light.rays));
+            m_trace_exporter.record_counter(m_gpu_track, "light_rays_per_sec", m_gpu_timer->resolved_frame(), now, m_light_rays_per_sec);
+        }
+
+        if (++m_ray_stats_log_counter >= kRayStatsLogInterval)
+        {
+            m_ray_stats_log_counter = 0;
+
+            char buffer[256];
+
+            snprintf(buffer, sizeof(buffer), "Shadow rays: %llu (%llu hits, %llu misses, %.1f MRays/s)", (unsigned long long)m_ray_stats.shadow.rays, (unsigned long long)m_ray_stats.shadow.hits, (unsigned long long)m_ray_stats.shadow.misses, m_shadow_rays_per_sec * 1e-6);
+            DW_LOG_INFO(buffer);
+
+            snprintf(buffer, sizeof(buffer), "Shadow rays per pixel: %.3f (%.1f%% penumbra pixels)", m_shadow_rays_per_pixel, m_penumbra_fraction * 100.0);
+            DW_LOG_INFO(buffer);
+
+            if (m_hybrid_shadows)
+            {
+                snprintf(buffer, sizeof(buffer), "Shadow map resolved %.1f%% of pixels, %.1f%% ray traced", (1.0 - m_shadow_traced_fraction) * 100.0, m_shadow_traced_fraction * 100.0);
+                DW_LOG_INFO(buffer);
+            }
+
+            snprintf(buffer, sizeof(buffer), "Reflection rays: %llu (%llu hits, %llu misses, %.1f MRays/s)", (unsigned long long)m_ray_stats.reflection.rays, (unsigned long long)m_ray_stats.reflection.hits, (unsigned long long)m_ray_stats.reflection.misses, m_reflection_rays_per_sec * 1e-6);
+            DW_LOG_INFO(buffer);
+
+            if (m_ssr)
+            {
+                snprintf(buffer, sizeof(buffer), "Screen space reflections: %.1f%% of %llu mirror pixels hit, %llu rays saved", m_ray_stats.ssr_hit_fraction() * 100.0, (unsigned long long)m_ray_stats.ssr_pixels, (unsigned long long)m_ray_stats.ssr_hits);
+                DW_LOG_INFO(buffer);
+            }
+
+            snprintf(buffer, sizeof(buffer), "Reflection hit shading: inline %.3f ms (%.2f materials/subgroup), deferred %.3f ms (%.2f materials/subgroup)", m_reflection_ms[0], m_reflection_divergence[0], m_reflection_ms[1], m_reflection_divergence[1]);
+            DW_LOG_INFO(buffer);
+
+            if (m_many_lights)
+            {
+                snprintf(buffer, sizeof(buffer), "Light rays: %llu (%llu hits, %llu misses, %.1f MRays/s) for %u lights", (unsigned long long)m_ray_stats.light.rays, (unsigned long long)m_ray_stats.light.hits, (unsigned long long)m_ray_stats.light.misses, m_light_rays_per_sec * 1e-6, uint32_t(m_rest_lights.size()));
+                DW_LOG_INFO(buffer);
+            }
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Copies what the ray tracing passes of this frame read, so that validate_ray_stats() can trace the same rays on
+    // the CPU once it finished.
+    void record_ray_stats_validation(dw::vk::CommandBuffer::Ptr cmd_buf, const FrameState& state)
+    {
+        if (!m_validate_ray_stats || m_frame_index != kRayStatsValidationFrame)
+            return;
+
+        // The CPU model reads positions from the G-Buffer, which the visibility buffer doesn't write.
+        if (m_visibility_buffer)
+        {
+            DW_LOG_ERROR("Ray stats validation needs the G-Buffer, run it without --visibility-buffer");
+            finish_validation(false);
+            return;
+        }
+
+        RayStatsValidation& validation = m_ray_stats_validation;
+        RayTracingFrame&    frame      = validation.frame;
+        const Transforms&   transforms = state.transforms;
+
+        frame.width                       = m_render_width;
+        frame.height                      = m_render_height;
+        frame.view                        = transforms.view;
+        frame.projection                  = transforms.proj;
+        frame.camera_pos                  = glm::vec3(transforms.cam_pos);
+        frame.light_dir                   = glm::vec3(transforms.light_dir);
+        frame.frame                       = transforms.soft_shadow_samples.y;
+        frame.light_angular_radius        = transforms.soft_shadow_params.x;
+        frame.penumbra_variance_threshold = transforms.soft_shadow_params.y;
+        frame.max_penumbra_radius         = uint32_t(transforms.soft_shadow_params.z);
+        frame.penumbra_rays               = transforms.soft_shadow_samples.x;
+        frame.hybrid_shadows              = transforms.csm_params.x > 0.0f;
+        frame.shadow_map_resolution       = m_csm_settings.resolution;
+        frame.cascade_boundary_band       = transforms.csm_params.y;
+        frame.depth_ambiguity_texels      = transforms.csm_params.z;
+        frame.contact_hardening_distance  = transforms.csm_params.w;
+        frame.ssr                         = transforms.ssr_params.x > 0.0f;
+        frame.spatial_neighbours          = transforms.light_params.w;
+        frame.spatial_radius              = transforms.restir_params.y;
+
+        for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+        {
+            frame.cascades[i].view_proj   = transforms.cascade_view_proj[i];
+            frame.cascades[i].split_far   = transforms.cascade_splits[i];
+            frame.cascades[i].texel_size  = transforms.cascade_texel_sizes[i];
+            frame.cascades[i].depth_range = transforms.cascade_depth_ranges[i];
+        }
+
+        if (transforms.light_params.x > 0)
+            frame.lights = state.lights;
+
+        validation.ssr_view.view               = transforms.view;
+        validation.ssr_view.projection         = transforms.proj;
+        validation.ssr_view.camera_pos         = frame.camera_pos;
+        validation.ssr_view.jitter             = glm::vec2(transforms.upsample_params.z, transforms.upsample_params.w);
+        validation.ssr_settings.thickness      = transforms.ssr_params.y;
+        validation.ssr_settings.max_iterations = uint32_t(transforms.ssr_params.z);
+
+        VkMemoryBarrier memory_barrier;
+        DW_ZERO_MEMORY(memory_barrier);
+
+        memory_barrier.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        const dw::vk::Image::Ptr g_buffer[]    = { m_g_buffer_1, m_g_buffer_2, m_g_buffer_3 };
+        const size_t             texel_sizes[] = { 4, 8, 16 };
+
+        for (uint32_t i = 0; i < 3; i++)
+            validation.g_buffer[i] = copy_image_to_readback(cmd_buf, g_buffer[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, 1, m_render_width, m_render_height, texel_sizes[i]);
+
+        if (frame.hybrid_shadows)
+            validation.shadow_map = copy_image_to_readback(cmd_buf, m_shadow_map, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_DEPTH_BIT, kShadowCascadeCount, m_csm_settings.resolution, m_csm_settings.resolution, sizeof(float));
+
+        // The first level of the pyramid is the depth of the render area.
+        if (frame.ssr)
+        {
+            validation.ray_list = copy_buffer_to_readback(cmd_buf, m_ray_list_buffer, sizeof(uint32_t) * (4 + m_width * m_height));
+            validation.hiz      = copy_image_to_readback(cmd_buf, m_hiz_image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, 1, m_render_width, m_render_height, sizeof(float));
+        }
+
+        if (!frame.lights.empty())
+            validation.reservoirs = copy_buffer_to_readback(cmd_buf, m_prev_reservoir_buffer, sizeof(LightReservoir) * m_width * m_height);
+
+        memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memory_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+        vkCmdPipelineBarrier(cmd_buf->handle(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+        validation.frame_in_flight = m_vk_backend->current_frame_idx();
+        validation.recorded        = true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Copies the top left corner of every layer of the first mip, leaving the image in the layout it was in. Images
+    // in the general layout are copied from without a transition.
+    dw::vk::Buffer::Ptr copy_image_to_readback(dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::Image::Ptr image, VkImageLayout layout, VkImageAspectFlags aspect, uint32_t layers, uint32_t width, uint32_t height, size_t texel_size)
+    {
+        dw::vk::Buffer::Ptr readback = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, texel_size * width * height * layers, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        VkImageSubresourceRange subresource_range = { aspect, 0, 1, 0, layers };
+        const VkImageLayout     copy_layout       = layout == VK_IMAGE_LAYOUT_GENERAL ? layout : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        if (copy_layout != layout)
+        {
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                image->handle(),
+                layout,
+                copy_layout,
+                subresource_range);
+        }
+
+        VkBufferImageCopy region;
+        DW_ZERO_MEMORY(region);
+
+        region.imageSubresource.aspectMask = aspect;
+        region.imageSubresource.layerCount = layers;
+        region.imageExtent.width           = width;
+        region.imageExtent.height          = height;
+        region.imageExtent.depth           = 1;
+
+        vkCmdCopyImageToBuffer(cmd_buf->handle(), image->handle(), copy_layout, readback->handle(), 1, &region);
+
+        if (copy_layout != layout)
+        {
+            dw::vk::utilities::set_image_layout(
+                cmd_buf->handle(),
+                image->handle(),
+                copy_layout,
+                layout,
+                subresource_range);
+        }
+
+        return readback;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    dw::vk::Buffer::Ptr copy_buffer_to_readback(dw::vk::CommandBuffer::Ptr cmd_buf, dw::vk::Buffer::Ptr buffer, size_t size)
+    {
+        dw::vk::Buffer::Ptr readback = dw::vk::Buffer::create(m_vk_backend, VK_BUFFER_USAGE_TRANSFER_DST_BIT, size, VMA_MEMORY_USAGE_GPU_TO_CPU, VMA_ALLOCATION_CREATE_MAPPED_BIT);
+
+        VkBufferCopy region;
+
+        region.srcOffset = 0;
+        region.dstOffset = 0;
+        region.size      = size;
+
+        vkCmdCopyBuffer(cmd_buf->handle(), buffer->handle(), readback->handle(), 1, &region);
+
+        return readback;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Traces the rays of the frame record_ray_stats_validation() copied on the CPU and compares the counts with what
+    // the GPU counted for it.
+    void validate_ray_stats()
+    {
+        RayStatsValidation validation;
+
+        std::swap(validation, m_ray_stats_validation);
+
+        RayTracingFrame& frame = validation.frame;
+
+        m_vk_backend->wait_idle();
+
+        if (m_submesh_geometry.empty())
+        {
+            DW_LOG_ERROR("Ray stats validation needs the scene geometry on the CPU, which failed to import");
+            finish_validation(false);
+            return;
+        }
+
+        std::vector<glm::vec3> positions;
+        std::vector<uint32_t>  indices;
+
+        for (const auto& geometry : m_submesh_geometry)
+        {
+            const uint32_t base_vertex = uint32_t(positions.size());
+
+            positions.insert(positions.end(), geometry.positions.begin(), geometry.positions.end());
+
+            for (uint32_t index : geometry.indices)
+                indices.push_back(base_vertex + index);
+        }
+
+        CpuRayTracer tracer;
+
+        tracer.build(positions, indices);
+
+        const uint8_t*  g_buffer_1 = (const uint8_t*)validation.g_buffer[0]->mapped_ptr();
+        const uint16_t* g_buffer_2 = (const uint16_t*)validation.g_buffer[1]->mapped_ptr();
+        const float*    g_buffer_3 = (const float*)validation.g_buffer[2]->mapped_ptr();
+        const size_t    pixels     = size_t(frame.width) * frame.height;
+
+        frame.g_buffer.resize(pixels);
+
+        for (size_t i = 0; i < pixels; i++)
+        {
+            frame.g_buffer[i].position  = glm::vec3(g_buffer_3[i * 4 + 0], g_buffer_3[i * 4 + 1], g_buffer_3[i * 4 + 2]);
+            frame.g_buffer[i].normal    = glm::vec3(half_to_float(g_buffer_2[i * 4 + 0]), half_to_float(g_buffer_2[i * 4 + 1]), half_to_float(g_buffer_2[i * 4 + 2]));
+            frame.g_buffer[i].roughness = float(g_buffer_1[i * 4 + 3]) / 255.0f;
+        }
+
+        if (validation.shadow_map)
+        {
+            const float* depths = (const float*)validation.shadow_map->mapped_ptr();
+
+            frame.shadow_map.assign(depths, depths + size_t(kShadowCascadeCount) * frame.shadow_map_resolution * frame.shadow_map_resolution);
+        }
+
+        // The count comes first, padded to 16 bytes.
+        if (validation.ray_list)
+        {
+            const uint32_t* ray_list = (const uint32_t*)validation.ray_list->mapped_ptr();
+
+            frame.reflection_ray_list.assign(ray_list + 4, ray_list + 4 + std::min(size_t(ray_list[0]), pixels));
+        }
+
+        // The reservoirs cover the whole G-Buffer rather than the render area.
+        if (validation.reservoirs)
+        {
+            const LightReservoir* reservoirs = (const LightReservoir*)validation.reservoirs->mapped_ptr();
+
+            frame.reservoirs.resize(pixels);
+
+            for (uint32_t y = 0; y < frame.height; y++)
+                std::copy(reservoirs + size_t(y) * m_width, reservoirs + size_t(y) * m_width + frame.width, frame.reservoirs.begin() + size_t(y) * frame.width);
+        }
+
+        const uint32_t* counters = (const uint32_t*)((uint8_t*)m_ray_stats_buffer->mapped_ptr() + sizeof(uint32_t) * RAY_STAT_COUNT * validation.frame_in_flight);
+        const RayStats  expected = trace_frame_rays_cpu(tracer, frame);
+        const RayStats  actual   = RayStats::unpack(counters);
+
+        char buffer[512];
+
+        snprintf(buffer, sizeof(buffer), "Ray stats validation: %llu shadow, %llu reflection and %llu light rays expected, %llu, %llu and %llu counted", (unsigned long long)expected.shadow.rays, (unsigned long long)expected.reflection.rays, (unsigned long long)expected.light.rays, (unsigned long long)actual.shadow.rays, (unsigned long long)actual.reflection.rays, (unsigned long long)actual.light.rays);
+        DW_LOG_INFO(buffer);
+
+        const std::string mismatches = compare_ray_stats(expected, actual, kRayStatsValidationTolerance);
+
+        if (mismatches.empty())
+            DW_LOG_INFO("Ray stats validation passed");
+        else
+            DW_LOG_ERROR("Ray stats validation failed: " + mismatches);
+
+        const bool ssr_passed = !validation.hiz || validate_ssr_hit_fraction(validation, actual);
+
+        finish_validation(mismatches.empty() && ssr_passed);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // A validation run checks a single frame, so it ends once that frame was checked. Any failure makes the process
+    // exit with 1.
+    void finish_validation(bool passed)
+    {
+        if (!passed)
+            m_validation_failed = true;
+
+        glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Marches the mirror pixels of the validated frame on the CPU. The march is float math over the same depths,
+    // so the hit fraction has to agree within the tolerance rather than pixel for pixel.
+    bool validate_ssr_hit_fraction(const RayStatsValidation& validation, const RayStats& actual)
+    {
+        const RayTracingFrame& frame = validation.frame;
+        const float*           depth = (const float*)validation.hiz->mapped_ptr();
+        SsrGBuffer             g_buffer;
+
+        g_buffer.width  = frame.width;
+        g_buffer.height = frame.height;
+        g_buffer.depth.assign(depth, depth + frame.g_buffer.size());
+
+        for (const auto& sample : frame.g_buffer)
+        {
+            g_buffer.normal.push_back(sample.normal);
+            g_buffer.roughness.push_back(sample.roughness);
+        }
+
+        const SsrStats expected = trace_screen_space_reflections_cpu(g_buffer, validation.ssr_view, validation.ssr_settings);
+
+        char buffer[512];
+
+        snprintf(buffer, sizeof(buffer), "SSR validation: %.1f%% of %llu mirror pixels hit on the CPU, %.1f%% of %llu on the GPU", expected.hit_fraction() * 100.0, (unsigned long long)expected.pixels, actual.ssr_hit_fraction() * 100.0, (unsigned long long)actual.ssr_pixels);
+
+        const bool passed = expected.pixels == actual.ssr_pixels && std::abs(expected.hit_fraction() - actual.ssr_hit_fraction()) <= kRayStatsValidationTolerance;
+
+        if (passed)
+            DW_LOG_INFO(buffer);
+        else
+            DW_LOG_ERROR(buffer);
+
+        return passed;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void export_timings(bool gpu_timings_resolved, const FrameState& state)
+    {
+        for (const auto& result : m_cpu_timer.results())
+            m_trace_exporter.record_scope(m_cpu_track, result.name, m_cpu_timer.frame(), result.start_ms, result.elapsed_ms);
+
+        // The simulation of this frame, which ran on the worker during the previous frame when pipelined.
+        m_trace_exporter.record_scope(m_sim_track, "simulate", m_cpu_timer.frame(), state.sim_start_ms, state.sim_ms);
+
+        if (state.culling_ms > 0.0f)
+            m_trace_exporter.record_scope(m_sim_track, "occlusion-culling", m_cpu_timer.frame(), state.sim_start_ms + state.sim_ms - state.culling_ms, state.culling_ms);
+
+        m_trace_exporter.record_counter(m_cpu_track, "cpu_frame_ms", m_cpu_timer.frame(), m_cpu_timer.now_ms(), m_cpu_timer.elapsed_ms("update"));
+        m_trace_exporter.record_counter(m_cpu_track, "descriptor_bind_calls", m_cpu_timer.frame(), m_cpu_timer.now_ms(), float(m_frame_descriptor_bind_calls));
+
+        if (!m_skins.empty())
+        {
+            m_trace_exporter.record_counter(m_cpu_track, "blas_deformation", m_cpu_timer.frame(), m_cpu_timer.now_ms(), m_blas_heuristic.deformation());
+            m_trace_exporter.record_counter(m_cpu_track, "blas_rebuild", m_cpu_timer.frame(), m_cpu_timer.now_ms(), m_blas_rebuilt ? 1.0f : 0.0f);
+        }
+
+        if (m_virtual_texturing)
+        {
+            m_trace_exporter.record_counter(m_cpu_track, "vt_uploads", m_cpu_timer.frame(), m_cpu_timer.now_ms(), float(m_vt_frame_uploads));
+            m_trace_exporter.record_counter(m_cpu_track, "vt_missing", m_cpu_timer.frame(), m_cpu_timer.now_ms(), float(m_vt_stats.missing));
+        }
+
+        // GPU results arrive a few frames late and are tagged with the frame that recorded them. Their timestamps are
+        // calibrated to the CPU timer, so the frame's counter goes where its GPU work ended rather than where it
+        // was read back.
+        if (gpu_timings_resolved)
+        {
+            double frame_end_ms = 0.0;
+
+            for (const auto& result : m_gpu_timer->results())
+            {
+                m_trace_exporter.record_scope(m_gpu_track, result.name, m_gpu_timer->resolved_frame(), result.start_ms, result.elapsed_ms);
+
+                if (result.name == "update")
+                    frame_end_ms = result.start_ms + result.elapsed_ms;
+            }
+
+            m_trace_exporter.record_counter(m_gpu_track, "gpu_frame_ms", m_gpu_timer->resolved_frame(), frame_end_ms, m_gpu_timer->elapsed_ms("update"));
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void record_frame_timings(bool gpu_timings_resolved, const FrameState& state, float stall_ms)
+    {
+        m_frame_timings.record(m_gpu_timer->current_frame(), "cpu_frame_ms", m_cpu_timer.elapsed_ms("update"));
+        m_frame_timings.record(m_gpu_timer->current_frame(), "cpu_sim_ms", state.sim_ms);
+        m_frame_timings.record(m_gpu_timer->current_frame(), "cpu_stall_ms", stall_ms);
+        m_frame_timings.record(m_gpu_timer->current_frame(), "cpu_command_record_ms", m_command_cache_stats.recorded_ms);
+        m_frame_timings.record(m_gpu_timer->current_frame(), "cpu_command_saved_ms", m_command_cache_stats.saved_ms);
+
+        if (gpu_timings_resolved)
+        {
+            for (const auto& result : m_gpu_timer->results())
+                m_frame_timings.record(m_gpu_timer->resolved_frame(), "gpu_" + result.name + "_ms", result.elapsed_ms);
+        }
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void finish_replay()
+    {
+        if (m_replay_finished)
+            return;
+
+        m_replay_finished = true;
+
+        DW_LOG_INFO("Replay finished after " + std::to_string(m_input_replay.frame_count()) + " frames");
+
+        if (!m_timing_csv_path.empty() && !m_frame_timings.write_csv(m_timing_csv_path))
+            DW_LOG_ERROR("Failed to write timing CSV: " + m_timing_csv_path);
+
+        if (!m_baseline_csv_path.empty())
+        {
+            FrameTimingLog baseline;
+
+            if (baseline.load_csv(m_baseline_csv_path))
+            {
+                const std::vector<TimingComparison> comparisons = compare_timings(m_frame_timings, baseline, m_regression_thresholds);
+                const std::string                   report_path = (m_timing_csv_path.empty() ? m_baseline_csv_path : m_timing_csv_path) + ".comparison.csv";
+
+                DW_LOG_INFO("Timing comparison against " + m_baseline_csv_path + ":\n" + write_comparison_report(report_path, comparisons));
+            }
+            else
+                DW_LOG_ERROR("Failed to load baseline timings: " + m_baseline_csv_path);
+        }
+
+        glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    bool start_batch_worker()
+    {
+        m_batch_name   = batch_worker_name("gpu");
+        m_batch_client = std::unique_ptr<BatchWorkerClient>(new BatchWorkerClient());
+
+        if (!m_batch_client->connect(m_batch_address, m_batch_name))
+        {
+            DW_LOG_ERROR("Batch worker: " + m_batch_client->error());
+            return false;
+        }
+
+        const BatchSetup& setup = m_batch_client->setup();
+
+        // Every frame must render the same whichever worker gets it: fixed work per frame, and a simulation that
+        // can't run ahead of the job it belongs to.
+        m_dynamic_resolution   = false;
+        m_pipelined_simulation = false;
+        m_capture_frames       = false;
+
+        if (setup.width != uint32_t(m_width) || setup.height != uint32_t(m_height))
+            glfwSetWindowSize(m_window, int(setup.width), int(setup.height));
+
+        m_batch_client->request_job();
+        m_batch_job_requested = true;
+
+        DW_LOG_INFO("Batch worker " + m_batch_name + " connected to " + m_batch_address + ", " + std::to_string(setup.width) + "x" + std::to_string(setup.height) + " at " + std::to_string(setup.fps) + " fps");
+
+        return true;
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    // Picks the frame to render. The next job is asked for while the last frame of the current one renders, and
+    // only waited for once there is nothing left to render.
+    void next_batch_frame()
+    {
+        BatchJob job;
+
+        while (m_batch_schedule.empty() && !m_batch_finished)
+        {
+            // The coordinator may be waiting for the frames still in flight before it can answer.
+            flush_batch_captures();
+
+            handle_batch_message(m_batch_client->poll(job, -1), job);
+        }
+
+        if (m_batch_job_requested)
+            handle_batch_message(m_batch_client->poll(job, 0), job);
+
+        if (m_batch_schedule.empty())
+        {
+            // Finishing, render whatever was last on screen until the window closes.
+            m_batch_frame.capture = false;
+            return;
+        }
+
+        m_batch_frame = m_batch_schedule.front();
+        m_batch_schedule.pop_front();
+
+        if (m_batch_frame.reset_history)
+            m_reset_history = true;
+
+        m_capture_next_frame = m_batch_frame.capture;
+
+        if (m_batch_schedule.empty() && !m_batch_job_requested && !m_batch_finished)
+            m_batch_job_requested = m_batch_client->request_job();
+    }
+
+    // -----------------------------------------------------------------------------------------------------------------------------------
+
+    void handle_batch_message(BatchMessage message, const BatchJob& job)
+    {
+        if (message == BATCH_MESSAGE_NONE)
+            return;
+
+        m_batch_job_requested = false;
+
+        if (message == BATCH_MESSAGE_JOB)
+        {
+            // Temporal effects need the frames before a job, unless this worker just rendered them.
+            if (job.first_frame != m_batch_next_frame)
+            {
+                const uint32_t warmup = m_batch_client->setup().warmup_frames;
+
+                for (uint32_t i = warmup; i > 0; i--)
+                {
+                    BatchFrame frame;
+
+                    frame.path_frame    = job.first_frame >= i ? job.first_frame - i : 0;
+                    frame.reset_history = i == warmup;
+
+                    m_batch_schedule.push_back(frame);
+                }
+            }
+
+            for (uint32_t i = 0; i < job.frame_count; i++)
+            {
+                BatchFrame frame;
+
+                frame.path_frame    = job.first_frame + i;
+                frame.capture       = true;
+                frame.reset_history = i == 0 && job.first_frame != m_batch_next_frame && m_batch_client->setup().warmup_frames == 0;
+
+                m_batch_schedule.push_back(frame);
+            }
+
+            m_batch_next_frame = job.first_frame + job.frame_count;
+            m_batch_jobs++;
+        }
+        else
+        {
+            if (message == BATCH_MESSAGE_ERROR)
+                DW_LOG_ERROR("Batch worker: " + m_batch_client->error());
+            else
+                DW_LOG_INFO("Batch rendering finished, " + std::to_string(m_batch_frames_sent) + " frames sent");
+
+            m_batch_finished = true;
+            glfwSetWindowShouldClose(m_window, GLFW_TRUE);
+        }
+    }
 
-        pl_desc.add_descriptor_set_layout(m_per_frame_ds_layout)
-            .add_descriptor_set_layout(dw::Material::pbr_descriptor_set_layout());
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        m_g_buffer_pipeline_layout = dw::vk::PipelineLayout::create(m_vk_backend, pl_desc);
+    void update_batch_worker(bool gpu_timings_resolved)
+    {
+        if (gpu_timings_resolved)
+        {
+            BatchFrameTiming& timing = m_batch_timings[m_gpu_timer->resolved_frame() % kBatchTimingHistory];
 
-        pso_desc.set_pipeline_layout(m_g_buffer_pipeline_layout);
+            if (timing.frame == m_gpu_timer->resolved_frame())
+                timing.gpu_ms = m_gpu_timer->elapsed_ms("update");
+        }
 
-        // ---------------------------------------------------------------------------
-        // Create dynamic state
-        // ---------------------------------------------------------------------------
+        std::vector<BatchEncodedFrame> encoded;
 
-        pso_desc.add_dynamic_state(VK_DYNAMIC_STATE_VIEWPORT)
-            .add_dynamic_state(VK_DYNAMIC_STATE_SCISSOR);
+        {
+            std::lock_guard<std::mutex> lock(m_batch_mutex);
+            encoded.swap(m_batch_encoded);
+        }
 
-        // ---------------------------------------------------------------------------
-        // Create pipeline
-        // ---------------------------------------------------------------------------
+        for (const auto& frame : encoded)
+        {
+            const BatchFrameTiming& timing = m_batch_timings[frame.frame % kBatchTimingHistory];
+            const bool              valid  = timing.frame == frame.frame;
 
-        pso_desc.set_render_pass(m_g_buffer_rp);
+            if (m_batch_client->send_frame_file(frame.path_frame, valid ? timing.cpu_ms : 0.0f, valid ? timing.gpu_ms : 0.0f, frame.path))
+                m_batch_frames_sent++;
+            else if (!m_batch_finished)
+                handle_batch_message(BATCH_MESSAGE_ERROR, BatchJob());
 
-        m_g_buffer_pipeline = dw::vk::GraphicsPipeline::create(m_vk_backend, pso_desc);
+            remove(frame.path.c_str());
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    bool load_mesh()
+    // Finishes and sends every batch capture recorded so far. The GPU timings of the last frames aren't resolved
+    // yet, so they go without.
+    void flush_batch_captures()
     {
-        m_mesh = dw::Mesh::load(m_vk_backend, "mesh/sponza.obj");
-        m_mesh->initialize_for_ray_tracing(m_vk_backend);
+        if (!m_capture_writer)
+            return;
 
-        m_scene = dw::Scene::create();
-        m_scene->add_instance(m_mesh, glm::mat4(1.0f));
+        m_vk_backend->wait_idle();
 
-        m_scene->initialize_for_ray_tracing(m_vk_backend);
+        for (uint32_t i = 0; i < kCaptureRingSize; i++)
+            submit_capture(m_capture_slots[i]);
 
-        return m_mesh != nullptr;
+        m_capture_writer->wait();
+
+        update_batch_worker(false);
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void load_blue_noise()
+    void debug_gui()
     {
-        m_blue_noise      = dw::vk::Image::create_from_file(m_vk_backend, "texture/LDR_RGBA_0.png");
-        m_blue_noise_view = dw::vk::ImageView::create(m_vk_backend, m_blue_noise, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-    }
+        ImGui::Checkbox("Show Profiler", &m_show_profiler);
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        if (m_trace_exporter.is_open())
+            ImGui::Text("Trace Export: %llu events dropped", (unsigned long long)m_trace_exporter.dropped_events());
 
-    void create_camera()
-    {
-        m_main_camera = std::make_unique<dw::Camera>(
-            60.0f, 0.1f, 10000.0f, float(m_width) / float(m_height), glm::vec3(0.0f, 35.0f, 125.0f), glm::vec3(0.0f, 0.0, -1.0f));
-    }
+        if (m_input_replay.is_loaded())
+            ImGui::Text("Replay: frame %u / %u", uint32_t(m_input_replay.position()), uint32_t(m_input_replay.frame_count()));
+        else if (m_input_recorder.is_recording())
+            ImGui::Text("Recording Input: %u frames", uint32_t(m_input_recorder.frame_count()));
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+        if (ImGui::CollapsingHeader("Dynamic Resolution", ImGuiTreeNodeFlags_DefaultOpen))
+        {
+            DynamicResolutionSettings settings = m_resolution_controller.settings();
 
-    void ray_trace_shadow_mask(dw::vk::CommandBuffer::Ptr cmd_buf)
-    {
-        DW_SCOPED_SAMPLE("ray-tracing-shadows", cmd_buf);
+            ImGui::Checkbox("Enabled", &m_dynamic_resolution);
 
-        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            if (ImGui::InputFloat("Target Frame Time (ms)", &settings.target_frame_ms))
+            {
+                settings.target_frame_ms = std::max(settings.target_frame_ms, 1.0f);
+                m_resolution_controller.set_settings(settings);
+            }
 
-        // Transition ray tracing output image back to general layout
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_shadow_mask_image->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
+            if (ImGui::SliderFloat("Min Scale", &settings.min_scale, 0.25f, 1.0f))
+                m_resolution_controller.set_settings(settings);
 
-        auto& rt_props = m_vk_backend->ray_tracing_properties();
+            ImGui::SliderFloat("History Blend", &m_history_blend, 0.01f, 1.0f);
+            ImGui::Checkbox("Compute Resolve", &m_compute_deferred);
+            ImGui::Text("Render Scale: %.2f (%ux%u)", m_render_scale, m_render_width, m_render_height);
+            ImGui::Text("Filtered GPU Frame Time: %.2f ms", m_resolution_controller.filtered_frame_ms());
+        }
 
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_shadow_mask_pipeline->handle());
+        if (ImGui::CollapsingHeader("G-Buffer"))
+        {
+            if (ImGui::Checkbox("Visibility Buffer", &m_visibility_buffer))
+                reallocate_feature_resources([this]() { create_visibility_targets(); });
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_shadow_mask_pipeline_layout->handle(), 0, 1, &m_shadow_mask_ds->handle(), 0, nullptr);
+            if (!m_visibility_buffer)
+                ImGui::Checkbox("Depth Prepass", &m_depth_prepass);
 
-        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+            ImGui::Text("Submeshes: %u opaque, %u alpha tested", uint32_t(m_opaque_submeshes.size()), uint32_t(m_masked_submeshes.size()));
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_shadow_mask_pipeline_layout->handle(), 1, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+            // Color target bytes written per covered fragment by the raster pass, before any overdraw.
+            ImGui::Text("Raster Targets: %u bytes/fragment", m_visibility_buffer ? 4 : 4 + 8 + 16);
+        }
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_shadow_mask_pipeline_layout->handle(), 2, 1, &m_g_buffer_ds->handle(), 0, VK_NULL_HANDLE);
+        if (ImGui::CollapsingHeader("Occlusion Culling"))
+        {
+            if (!m_occlusion_culler)
+                ImGui::Text("Unavailable, the scene's geometry couldn't be imported");
+            else
+            {
+                ImGui::Checkbox("Enabled", &m_occlusion_culling);
+
+                const OcclusionCullingStats& stats = m_occlusion_culler->stats();
+
+                ImGui::Text("Occluders: %u triangles, %u rasterized, %u tile bin entries", stats.occluder_triangles, stats.rasterized_triangles, stats.bin_entries);
+                ImGui::Text("Submeshes: %u tested, %u frustum culled, %u occluded", stats.tested, stats.frustum_culled, stats.occluded);
+                ImGui::Text("CPU: %.3f ms on %u threads", last_recorded_state().culling_ms, m_thread_pool->thread_count());
+            }
+        }
 
-        vkCmdTraceRaysNV(cmd_buf->handle(),
-                         m_shadow_mask_pipeline->shader_binding_table_buffer()->handle(),
-                         0,
-                         m_shadow_mask_pipeline->shader_binding_table_buffer()->handle(),
-                         m_shadow_mask_sbt->miss_group_offset(),
-                         rt_props.shaderGroupHandleSize,
-                         m_shadow_mask_pipeline->shader_binding_table_buffer()->handle(),
-                         m_shadow_mask_sbt->hit_group_offset(),
-                         rt_props.shaderGroupHandleSize,
-                         VK_NULL_HANDLE,
-                         0,
-                         0,
-                         m_width,
-                         m_height,
-                         1);
+        if (ImGui::CollapsingHeader("GPU Memory"))
+        {
+            for (uint32_t i = 0; i < MEMORY_LOCATION_COUNT; i++)
+            {
+                const MemoryLocation location = MemoryLocation(i);
+                const uint64_t       budget   = m_memory_registry.budget().location_bytes[i];
+
+                ImGui::Text("%s: %s of %s (peak %s)",
+                            i == MEMORY_LOCATION_DEVICE ? "Device" : "Host",
+                            format_memory_size(m_memory_registry.total(location)).c_str(),
+                            budget > 0 ? format_memory_size(budget).c_str() : "unlimited",
+                            format_memory_size(m_memory_registry.peak(location)).c_str());
+            }
+
+            ImGui::Text("Device at 4K: %s", format_memory_size(m_memory_registry.projected_total(MEMORY_LOCATION_DEVICE, uint64_t(m_width) * uint64_t(m_height), 3840ull * 2160ull)).c_str());
+
+            for (const auto& warning : m_memory_warnings)
+                ImGui::Text("Over budget: %s", warning.c_str());
+
+            ImGui::Columns(3, "memory_passes");
+            ImGui::Text("Pass");
+            ImGui::NextColumn();
+            ImGui::Text("Device");
+            ImGui::NextColumn();
+            ImGui::Text("Host");
+            ImGui::NextColumn();
+
+            for (const auto& total : m_memory_registry.pass_totals())
+            {
+                ImGui::Text("%s (%u)", total.pass.c_str(), total.count);
+                ImGui::NextColumn();
+                ImGui::Text("%s", format_memory_size(total.size[MEMORY_LOCATION_DEVICE]).c_str());
+                ImGui::NextColumn();
+                ImGui::Text("%s", format_memory_size(total.size[MEMORY_LOCATION_HOST]).c_str());
+                ImGui::NextColumn();
+            }
+
+            ImGui::Columns(1);
+
+            ImGui::Checkbox("Show Resources", &m_show_memory_resources);
+
+            if (m_show_memory_resources)
+            {
+                ImGui::Columns(4, "memory_resources");
+
+                for (const auto& allocation : m_memory_registry.live())
+                {
+                    ImGui::Text("%s", allocation.name.c_str());
+                    ImGui::NextColumn();
+                    ImGui::Text("%s", allocation.pass.c_str());
+                    ImGui::NextColumn();
+                    ImGui::Text("%s", format_memory_size(allocation.size).c_str());
+                    ImGui::NextColumn();
+                    ImGui::Text("%s, frame %llu", allocation.description.c_str(), (unsigned long long)allocation.created_frame);
+                    ImGui::NextColumn();
+                }
+
+                ImGui::Columns(1);
+            }
+
+            if (ImGui::Button("Write Memory Report"))
+            {
+                if (m_memory_report_path.empty())
+                    m_memory_report_path = "gpu_memory.json";
+
+                write_memory_report();
+            }
+        }
 
-        // Prepare ray tracing output image as transfer source
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_shadow_mask_image->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-    }
+        if (ImGui::CollapsingHeader("Frame Capture"))
+        {
+            ImGui::Checkbox("Capture Every Frame", &m_capture_frames);
+            ImGui::Checkbox("Include AOVs", &m_capture_aovs);
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+            if (ImGui::Button("Capture Next Frame"))
+                m_capture_next_frame = true;
 
-    void ray_trace_reflection(dw::vk::CommandBuffer::Ptr cmd_buf)
-    {
-        DW_SCOPED_SAMPLE("ray-tracing-reflections", cmd_buf);
+            ImGui::Text("Directory: %s", m_capture_dir.c_str());
 
-        VkImageSubresourceRange subresource_range = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 };
+            if (m_capture_writer)
+            {
+                const FrameCaptureStats stats = m_capture_writer->stats();
 
-        // Transition ray tracing output image back to general layout
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_reflection_image->handle(),
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_GENERAL,
-            subresource_range);
+                ImGui::Text("Frames: %llu captured, %llu dropped", (unsigned long long)m_captured_frames, (unsigned long long)m_capture_dropped);
+                ImGui::Text("Images: %llu written (%s), %llu failed, %u queued", (unsigned long long)stats.encoded, format_memory_size(stats.bytes_written).c_str(), (unsigned long long)stats.failed, uint32_t(m_capture_writer->pending()));
+                ImGui::Text("Encode: %.3f ms per image on %u threads", stats.encode_ms, m_capture_writer->thread_count());
+            }
+        }
 
-        auto& rt_props = m_vk_backend->ray_tracing_properties();
+        if (m_batch_client && ImGui::CollapsingHeader("Batch Rendering"))
+        {
+            ImGui::Text("Worker: %s", m_batch_name.c_str());
+            ImGui::Text("Path Frame: %u%s", m_batch_frame.path_frame, m_batch_frame.capture ? "" : " (warmup)");
+            ImGui::Text("Jobs: %u, Frames Sent: %u, Queued: %u", m_batch_jobs, m_batch_frames_sent, uint32_t(m_batch_schedule.size()));
+        }
 
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline->handle());
+        if (ImGui::CollapsingHeader("Frame Pipelining"))
+        {
+            ImGui::Checkbox("Simulate Next Frame On Worker", &m_pipelined_simulation);
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 0, 1, &m_reflection_ds->handle(), 0, nullptr);
+            const FramePipelineMetrics& metrics = m_frame_pipeline.metrics();
 
-        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+            ImGui::Text("Frame Interval: %.3f ms", metrics.frame_interval_ms);
+            ImGui::Text("Main Thread: %.3f ms, %.3f ms stalled", metrics.record_ms, metrics.stall_ms);
+            ImGui::Text("Simulation: %.3f ms, %.0f%% hidden", metrics.sim_ms, metrics.sim_hidden * 100.0f);
+            ImGui::Text("GPU: %.3f ms", metrics.gpu_ms);
+            ImGui::Text("CPU/GPU Overlap: %.0f%%", metrics.cpu_gpu_overlap * 100.0f);
+        }
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 1, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 2, 1, &m_g_buffer_ds->handle(), 0, VK_NULL_HANDLE);
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 3, 1, &m_scene->ray_tracing_geometry_descriptor_set()->handle(), 0, VK_NULL_HANDLE);
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 4, 1, &m_scene->albedo_descriptor_set()->handle(), 0, VK_NULL_HANDLE);
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 5, 1, &m_scene->normal_descriptor_set()->handle(), 0, VK_NULL_HANDLE);
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 6, 1, &m_scene->roughness_descriptor_set()->handle(), 0, VK_NULL_HANDLE);
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_RAY_TRACING_NV, m_reflection_pipeline_layout->handle(), 7, 1, &m_scene->metallic_descriptor_set()->handle(), 0, VK_NULL_HANDLE);
+        if (ImGui::CollapsingHeader("Command Caching"))
+        {
+            ImGui::Checkbox("Reuse Secondary Command Buffers", &m_cache_commands);
 
-        vkCmdTraceRaysNV(cmd_buf->handle(),
-                         m_reflection_pipeline->shader_binding_table_buffer()->handle(),
-                         0,
-                         m_reflection_pipeline->shader_binding_table_buffer()->handle(),
-                         m_reflection_sbt->miss_group_offset(),
-                         rt_props.shaderGroupHandleSize,
-                         m_reflection_pipeline->shader_binding_table_buffer()->handle(),
-                         m_reflection_sbt->hit_group_offset(),
-                         rt_props.shaderGroupHandleSize,
-                         VK_NULL_HANDLE,
-                         0,
-                         0,
-                         m_width,
-                         m_height,
-                         1);
+            ImGui::Text("Recording: %.3f ms per frame", m_command_recorded_ms);
+            ImGui::Text("Saved: %.3f ms per frame", m_command_saved_ms);
+            ImGui::Text("Last Frame: %u reused, %u recorded", m_command_cache_stats.hits, m_command_cache_stats.misses);
 
-        // Prepare ray tracing output image as transfer source
-        dw::vk::utilities::set_image_layout(
-            cmd_buf->handle(),
-            m_reflection_image->handle(),
-            VK_IMAGE_LAYOUT_GENERAL,
-            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            subresource_range);
-    }
+            const uint64_t total = m_command_hits + m_command_misses;
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+            ImGui::Text("Hit Rate: %.1f%%", total > 0 ? 100.0 * double(m_command_hits) / double(total) : 0.0);
+        }
 
-    void render_gbuffer(dw::vk::CommandBuffer::Ptr cmd_buf)
-    {
-        DW_SCOPED_SAMPLE("render_gbuffer", cmd_buf);
+        if (ImGui::CollapsingHeader("Descriptor Binding"))
+        {
+            ImGui::Text("Bind Calls: %u per frame", m_frame_descriptor_bind_calls);
+            ImGui::Text("Sets Bound: %u per frame", m_frame_descriptor_sets_bound);
+            ImGui::Text("Global Set: %u meshes, %u materials", m_global_mesh_count, m_global_material_count);
+        }
 
-        VkClearValue clear_values[4];
+        if (ImGui::CollapsingHeader("Alpha Testing"))
+        {
+            ImGui::Checkbox("Alpha Tested Rays", &m_alpha_tested_rays);
 
-        clear_values[0].color.float32[0] = 0.0f;
-        clear_values[0].color.float32[1] = 0.0f;
-        clear_values[0].color.float32[2] = 0.0f;
-        clear_values[0].color.float32[3] = 1.0f;
+            const float triangles = float(std::max(m_opacity_stats.triangles, 1u));
 
-        clear_values[1].color.float32[0] = 0.0f;
-        clear_values[1].color.float32[1] = 0.0f;
-        clear_values[1].color.float32[2] = 0.0f;
-        clear_values[1].color.float32[3] = 1.0f;
+            ImGui::Text("Opaque: %u triangles (%.1f%%)", m_opacity_stats.opaque, 100.0f * float(m_opacity_stats.opaque) / triangles);
+            ImGui::Text("Transparent: %u triangles (%.1f%%)", m_opacity_stats.transparent, 100.0f * float(m_opacity_stats.transparent) / triangles);
+            ImGui::Text("Alpha Tested: %u triangles (%.1f%%)", m_opacity_stats.mixed, 100.0f * float(m_opacity_stats.mixed) / triangles);
+            ImGui::Text("Bake: %.2f ms", m_opacity_stats.bake_ms);
+        }
 
-        clear_values[2].color.float32[0] = 0.0f;
-        clear_values[2].color.float32[1] = 0.0f;
-        clear_values[2].color.float32[2] = 0.0f;
-        clear_values[2].color.float32[3] = 1.0f;
+        if (ImGui::CollapsingHeader("Soft Shadows"))
+        {
+            ImGui::Checkbox("Area Light", &m_soft_shadows);
+
+            if (m_soft_shadows)
+            {
+                ImGui::SliderFloat("Angular Radius (deg)", &m_light_angular_radius, 0.05f, 5.0f);
+                ImGui::SliderInt("Penumbra Rays", (int32_t*)&m_penumbra_rays, 1, 32);
+                ImGui::SliderFloat("Variance Threshold", &m_penumbra_variance_threshold, 0.0f, 0.25f);
+                ImGui::SliderInt("Max Search Radius", (int32_t*)&m_max_penumbra_radius, 1, 32);
+            }
+        }
 
-        clear_values[3].color.float32[0] = 1.0f;
-        clear_values[3].color.float32[1] = 1.0f;
-        clear_values[3].color.float32[2] = 1.0f;
-        clear_values[3].color.float32[3] = 1.0f;
+        if (ImGui::CollapsingHeader("Hybrid Shadows"))
+        {
+            ImGui::Checkbox("Cascaded Shadow Map", &m_hybrid_shadows);
+
+            if (m_hybrid_shadows)
+            {
+                ImGui::SliderFloat("Split Lambda", &m_csm_settings.split_lambda, 0.0f, 1.0f);
+                ImGui::SliderFloat("Shadow Distance", &m_csm_settings.shadow_distance, 100.0f, 5000.0f);
+                ImGui::SliderFloat("Boundary Band", &m_cascade_boundary_band, 0.0f, 0.5f);
+                ImGui::SliderFloat("Ambiguity (texels)", &m_depth_ambiguity_texels, 0.0f, 8.0f);
+                ImGui::SliderFloat("Contact Distance", &m_contact_hardening_distance, 0.0f, 50.0f);
+
+                if (m_ray_stats_enabled)
+                    ImGui::Text("Ray Traced Pixels: %.1f%%", m_shadow_traced_fraction * 100.0);
+                else
+                    ImGui::Text("Enable 'Count Rays' to see the ray traced fraction");
+            }
+        }
 
-        VkRenderPassBeginInfo info    = {};
-        info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        info.renderPass               = m_g_buffer_rp->handle();
-        info.framebuffer              = m_g_buffer_fbo->handle();
-        info.renderArea.extent.width  = m_width;
-        info.renderArea.extent.height = m_height;
-        info.clearValueCount          = 4;
-        info.pClearValues             = &clear_values[0];
+        if (ImGui::CollapsingHeader("Reflections"))
+        {
+            if (ImGui::Checkbox("Deferred Hit Shading", &m_deferred_reflections))
+                reallocate_feature_resources([this]() { create_reflection_hit_buffers(); });
 
-        vkCmdBeginRenderPass(cmd_buf->handle(), &info, VK_SUBPASS_CONTENTS_INLINE);
+            if (ImGui::Checkbox("Screen Space First", &m_ssr))
+                reallocate_feature_resources([this]() { create_screen_space_reflection_targets(); });
 
-        VkViewport vp;
+            if (m_ssr)
+            {
+                ImGui::SliderFloat("Thickness", &m_ssr_thickness, 0.0f, 5.0f);
+                ImGui::SliderInt("Max Iterations", &m_ssr_max_iterations, 8, 256);
 
-        vp.x        = 0.0f;
-        vp.y        = 0.0f;
-        vp.width    = (float)m_width;
-        vp.height   = (float)m_height;
-        vp.minDepth = 0.0f;
-        vp.maxDepth = 1.0f;
+                // Every screen space hit is a ray the ray traced pass didn't launch.
+                if (m_ray_stats_enabled)
+                    ImGui::Text("SSR Hits: %.1f%% of mirror pixels, %llu rays saved", m_ray_stats.ssr_hit_fraction() * 100.0, (unsigned long long)m_ray_stats.ssr_hits);
+                else
+                    ImGui::Text("Enable 'Count Rays' to see the rays saved");
+            }
 
-        vkCmdSetViewport(cmd_buf->handle(), 0, 1, &vp);
+            ImGui::Checkbox("Ray Cone Texture LOD", &m_ray_cones);
 
-        VkRect2D scissor_rect;
+            if (m_ray_cones)
+            {
+                ImGui::SliderFloat("LOD Bias", &m_ray_cone_lod_bias, -2.0f, 2.0f);
 
-        scissor_rect.extent.width  = m_width;
-        scissor_rect.extent.height = m_height;
-        scissor_rect.offset.x      = 0;
-        scissor_rect.offset.y      = 0;
+                // Same as the shaders compute, the cone's width at the mirror is this times its distance.
+                const float spread = pixel_spread_angle(glm::inverse(m_main_camera->m_projection), float(m_render_height));
 
-        vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
+                ImGui::Text("Pixel Spread: %.3f mrad", spread * 1000.0f);
+            }
 
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline->handle());
+            // Materials per subgroup is how many times a subgroup serializes its texture fetches, 1.0 is fully coherent.
+            ImGui::Text("Inline: %.3f ms, %.2f materials/subgroup", m_reflection_ms[0], m_reflection_divergence[0]);
+            ImGui::Text("Deferred: %.3f ms, %.2f materials/subgroup", m_reflection_ms[1], m_reflection_divergence[1]);
 
-        VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(cmd_buf->handle(), 0, 1, &m_mesh->vertex_buffer()->handle(), &offset);
-        vkCmdBindIndexBuffer(cmd_buf->handle(), m_mesh->index_buffer()->handle(), 0, VK_INDEX_TYPE_UINT32);
+            if (!m_ray_stats_enabled)
+                ImGui::Text("Enable 'Count Rays' to measure divergence");
+        }
 
-        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+        if (ImGui::CollapsingHeader("Many Lights"))
+        {
+            if (ImGui::Checkbox("Enabled##ManyLights", &m_many_lights))
+                reallocate_feature_resources([this]() { create_light_reservoirs(); });
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 0, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+            if (ImGui::SliderInt("Light Count", (int32_t*)&m_light_count, 1, kMaxLights))
+                create_lights();
 
-        for (uint32_t i = 0; i < m_mesh->sub_mesh_count(); i++)
+            ImGui::Checkbox("Animate", &m_animate_lights);
+            ImGui::SliderInt("Initial Candidates", (int32_t*)&m_light_candidates, 1, 64);
+            ImGui::Checkbox("Temporal Reuse", &m_temporal_reuse);
+            ImGui::SliderFloat("History Cap (x M)", &m_temporal_m_cap, 1.0f, 50.0f);
+            ImGui::Checkbox("Spatial Reuse", &m_spatial_reuse);
+            ImGui::SliderInt("Spatial Neighbours", (int32_t*)&m_spatial_neighbours, 1, 8);
+            ImGui::SliderFloat("Spatial Radius", &m_spatial_radius, 1.0f, 64.0f);
+
+            // Checks the resampled estimator against a loop over every light at the camera position.
+            if (ImGui::Button("Validate CPU Sampler"))
+                m_light_sampler_validation = validate_light_sampler(m_rest_lights, m_main_camera->m_position, glm::vec3(0.0f, 1.0f, 0.0f), m_light_candidates, 100000, 1);
+
+            ImGui::Text("Reference: %.4f, RIS Error: %.2f%%, With Reuse: %.2f%%", m_light_sampler_validation.reference.y, m_light_sampler_validation.relative_error * 100.0f, m_light_sampler_validation.reuse_relative_error * 100.0f);
+        }
+
+        if (ImGui::CollapsingHeader("Skinning"))
         {
-            auto& submesh = m_mesh->sub_meshes()[i];
-            auto& mat     = m_mesh->material(submesh.mat_idx);
+            ImGui::Text("%u skins, %u vertices, %u joints", uint32_t(m_skins.size()), m_skin_vertex_count, m_skin_joint_count);
+            ImGui::Checkbox("Animate##Skinning", &m_animate_skins);
+            ImGui::SliderFloat("Sway Amplitude", &m_sway_settings.amplitude, 0.0f, 0.3f);
+            ImGui::SliderFloat("Sway Frequency", &m_sway_settings.frequency, 0.05f, 2.0f);
 
-            if (mat->pbr_descriptor_set())
-                vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_g_buffer_pipeline_layout->handle(), 1, 1, &mat->pbr_descriptor_set()->handle(), 0, nullptr);
+            BlasRebuildSettings settings = m_blas_heuristic.settings();
 
-            // Issue draw call.
-            vkCmdDrawIndexed(cmd_buf->handle(), submesh.index_count, 1, submesh.base_index, submesh.base_vertex, 0);
+            ImGui::SliderFloat("Max Deformation", &settings.max_deformation, 0.0f, 0.5f);
+            ImGui::SliderInt("Max Refits", (int32_t*)&settings.max_refits, 1, 1000);
+
+            m_blas_heuristic.set_settings(settings);
+
+            ImGui::Text("Deformation: %.3f, %u builds, %u refits since", m_blas_heuristic.deformation(), m_blas_heuristic.builds(), m_blas_heuristic.refits());
         }
 
-        vkCmdEndRenderPass(cmd_buf->handle());
+        if (ImGui::CollapsingHeader("Virtual Texturing"))
+        {
+            if (m_vt_streamer)
+            {
+                ImGui::Checkbox("Enabled##VirtualTexturing", &m_virtual_texturing);
+                ImGui::SliderInt("Max Uploads", (int32_t*)&m_vt_settings.max_uploads, 1, kVtMaxUploadsPerFrame);
+
+                // Deferred pages are the working set not fitting the cache, which then serves coarser mips.
+                ImGui::Text("Resident: %u / %u pages, %u uploaded this frame", m_vt_resident_pages, m_vt_streamer->slot_count(), m_vt_frame_uploads);
+                ImGui::Text("Requested: %u, Missing: %u, Deferred: %u", m_vt_stats.requested, m_vt_stats.missing, m_vt_stats.deferred);
+                ImGui::Text("%llu uploads, %llu evictions", (unsigned long long)m_vt_stats.uploads, (unsigned long long)m_vt_stats.evictions);
+            }
+            else
+                ImGui::Text("Run with --virtual-texturing to stream the material textures");
+        }
+
+        if (ImGui::CollapsingHeader("Ray Statistics"))
+        {
+            ImGui::Checkbox("Count Rays", &m_ray_stats_enabled);
+
+            if (m_ray_stats_enabled)
+            {
+                ImGui::Text("Shadows: %llu rays, %llu hits, %llu misses, %.1f MRays/s", (unsigned long long)m_ray_stats.shadow.rays, (unsigned long long)m_ray_stats.shadow.hits, (unsigned long long)m_ray_stats.shadow.misses, m_shadow_rays_per_sec * 1e-6);
+                ImGui::Text("Shadow Rays/Pixel: %.3f (max %u), Penumbra: %.1f%%", m_shadow_rays_per_pixel, m_soft_shadows ? m_penumbra_rays + 1 : 1, m_penumbra_fraction * 100.0);
+                ImGui::Text("Shadow Ray Traced Pixels: %.1f%%", m_shadow_traced_fraction * 100.0);
+                ImGui::Text("Reflections: %llu rays, %llu hits, %llu misses, %.1f MRays/s", (unsigned long long)m_ray_stats.reflection.rays, (unsigned long long)m_ray_stats.reflection.hits, (unsigned long long)m_ray_stats.reflection.misses, m_reflection_rays_per_sec * 1e-6);
+                ImGui::Text("Lights: %llu rays, %llu hits, %llu misses, %.1f MRays/s", (unsigned long long)m_ray_stats.light.rays, (unsigned long long)m_ray_stats.light.hits, (unsigned long long)m_ray_stats.light.misses, m_light_rays_per_sec * 1e-6);
+            }
+        }
+
+        if (ImGui::CollapsingHeader("GPU Timings"))
+        {
+            for (const auto& result : m_gpu_timer->results())
+                ImGui::Text("%*s%s: %.3f ms", int(result.depth * 2), "", result.name.c_str(), result.elapsed_ms);
+        }
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void render(dw::vk::CommandBuffer::Ptr cmd_buf)
+    SimulationInput capture_simulation_input()
     {
-        DW_SCOPED_SAMPLE("copy", cmd_buf);
+        SimulationInput sim_input;
 
-        VkClearValue clear_values[2];
+        CameraInputFrame& input = sim_input.camera;
 
-        clear_values[0].color.float32[0] = 0.0f;
-        clear_values[0].color.float32[1] = 0.0f;
-        clear_values[0].color.float32[2] = 0.0f;
-        clear_values[0].color.float32[3] = 1.0f;
+        input.delta          = float(m_delta);
+        input.heading_speed  = m_heading_speed;
+        input.sideways_speed = m_sideways_speed;
+        input.mouse_delta_x  = float(m_mouse_delta_x);
+        input.mouse_delta_y  = float(m_mouse_delta_y);
+        input.mouse_look     = m_mouse_look;
 
-        clear_values[1].color.float32[0] = 1.0f;
-        clear_values[1].color.float32[1] = 1.0f;
-        clear_values[1].color.float32[2] = 1.0f;
-        clear_values[1].color.float32[3] = 1.0f;
+        // Batch frames depend on nothing but their time on the path, whichever worker renders them and in
+        // whichever order.
+        if (m_batch_client)
+        {
+            const BatchSetup& setup = m_batch_client->setup();
+            const float       time  = float(m_batch_frame.path_frame) / setup.fps;
+
+            sim_input.use_camera_pose = true;
+            sim_input.camera_pose     = setup.path.evaluate(time);
+            sim_input.light_time      = time;
+            input                     = CameraInputFrame();
+            input.delta               = 1000.0f / setup.fps;
+        }
+        // During a replay the camera is driven purely by the recording, stepped by the recorded (or an overridden
+        // fixed) timestep instead of the wall clock so that every run renders exactly the same frames.
+        else if (m_input_replay.is_loaded())
+        {
+            if (!m_input_replay.next(input))
+                input = CameraInputFrame();
+            else if (m_fixed_timestep > 0.0f)
+                input.delta = m_fixed_timestep;
+        }
+        else if (m_input_recorder.is_recording())
+            m_input_recorder.record(input);
+
+        sim_input.camera_sensitivity = m_camera_sensitivity;
+        sim_input.aspect             = float(m_width) / float(m_height);
+        sim_input.light_dir          = m_light_direction;
+        sim_input.csm_settings       = m_csm_settings;
+        sim_input.animate_lights     = m_animate_lights;
+        sim_input.occlusion_culling  = m_occlusion_culling;
+        sim_input.animate_skins      = m_animate_skins;
+        sim_input.sway_settings      = m_sway_settings;
+
+        return sim_input;
+    }
 
-        VkRenderPassBeginInfo info    = {};
-        info.sType                    = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-        info.renderPass               = m_vk_backend->swapchain_render_pass()->handle();
-        info.framebuffer              = m_vk_backend->swapchain_framebuffer()->handle();
-        info.renderArea.extent.width  = m_width;
-        info.renderArea.extent.height = m_height;
-        info.clearValueCount          = 2;
-        info.pClearValues             = &clear_values[0];
+    // -----------------------------------------------------------------------------------------------------------------------------------
 
-        vkCmdBeginRenderPass(cmd_buf->handle(), &info, VK_SUBPASS_CONTENTS_INLINE);
+    // Simulation stage: camera, light and skin animation and occlusion culling. With pipelining on it runs on the frame
+    // pipeline's worker, so it may only touch the camera, the occlusion culler and the state of its own frame.
+    void simulate_frame(uint64_t frame, const SimulationInput& input)
+    {
+        FrameState& state = m_frame_states[frame % dw::vk::Backend::kMaxFramesInFlight];
 
-        VkViewport vp;
+        state.sim_start_ms = m_cpu_timer.now_ms();
 
-        vp.x        = 0.0f;
-        vp.y        = (float)m_height;
-        vp.width    = (float)m_width;
-        vp.height   = -(float)m_height;
-        vp.minDepth = 0.0f;
-        vp.maxDepth = 1.0f;
+        update_camera(input);
 
-        vkCmdSetViewport(cmd_buf->handle(), 0, 1, &vp);
+        Transforms& transforms = state.transforms;
 
-        VkRect2D scissor_rect;
+        transforms.proj_inverse = glm::inverse(m_main_camera->m_projection);
+        transforms.view_inverse = glm::inverse(m_main_camera->m_view);
+        transforms.proj         = m_main_camera->m_projection;
+        transforms.view         = m_main_camera->m_view;
+        transforms.model        = glm::mat4(1.0f);
+        transforms.cam_pos      = glm::vec4(m_main_camera->m_position, 0.0f);
+        transforms.light_dir    = glm::vec4(input.light_dir, 0.0f);
+        state.camera_position   = m_main_camera->m_position;
 
-        scissor_rect.extent.width  = m_width;
-        scissor_rect.extent.height = m_height;
-        scissor_rect.offset.x      = 0;
-        scissor_rect.offset.y      = 0;
+        ShadowCascade cascades[kShadowCascadeCount];
 
-        vkCmdSetScissor(cmd_buf->handle(), 0, 1, &scissor_rect);
+        fit_shadow_cascades(m_main_camera->m_position, m_main_camera->m_forward, m_main_camera->m_right, 60.0f, input.aspect, 0.1f, input.light_dir, input.csm_settings, cascades);
 
-        vkCmdBindPipeline(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_deferred_pipeline->handle());
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_deferred_pipeline_layout->handle(), 0, 1, &m_deferred_ds->handle(), 0, nullptr);
+        for (uint32_t i = 0; i < kShadowCascadeCount; i++)
+        {
+            transforms.cascade_view_proj[i]    = cascades[i].view_proj;
+            transforms.cascade_splits[i]       = cascades[i].split_far;
+            transforms.cascade_texel_sizes[i]  = cascades[i].texel_size;
+            transforms.cascade_depth_ranges[i] = cascades[i].depth_range;
+        }
 
-        const uint32_t dynamic_offset = m_ubo_size * m_vk_backend->current_frame_idx();
+        if (input.use_camera_pose)
+            m_light_time = input.light_time;
+        else if (input.animate_lights)
+            m_light_time += input.camera.delta * 0.001f;
 
-        vkCmdBindDescriptorSets(cmd_buf->handle(), VK_PIPELINE_BIND_POINT_GRAPHICS, m_deferred_pipeline_layout->handle(), 1, 1, &m_per_frame_ds->handle(), 1, &dynamic_offset);
+        animate_lights(m_rest_lights, state.lights, m_light_time);
 
-        vkCmdDraw(cmd_buf->handle(), 3, 1, 0, 0);
+        if (input.use_camera_pose)
+            m_skin_time = input.light_time;
+        else if (input.animate_skins)
+            m_skin_time += input.camera.delta * 0.001f;
 
-        render_gui(cmd_buf);
+        state.joint_palette.resize(m_skin_joint_count);
 
-        vkCmdEndRenderPass(cmd_buf->handle());
+        for (const auto& skin : m_skins)
+            pose_skin(skin, input.sway_settings, m_skin_time, &state.joint_palette[skin.first_joint]);
+
+        // Cull the submeshes hidden behind the large occluders.
+        cull_submeshes(state, input);
+
+        state.sim_ms = float(m_cpu_timer.now_ms() - state.sim_start_ms);
+        state.frame  = frame;
     }
 
     // -----------------------------------------------------------------------------------------------------------------------------------
 
-    void update_uniforms(dw::vk::CommandBuffer::Ptr cmd_buf)
+    void update_camera(const SimulationInput& sim_input)
     {
-        DW_SCOPED_SAMPLE("update_uniforms", cmd_buf);
+        dw::Camera* current = m_main_camera.get();
 
-        m_transforms.proj_inverse = glm::inverse(m_main_camera->m_projection);
-        m_transforms.view_inverse = glm::inverse(m_main_camera->m_view);
-        m_transforms.proj         = m_main_camera->m_projection;
-        m_transforms.view         = m_main_camera->m_view;
-        m_transforms.model        = glm::mat4(1.0f);
-        m_transforms.cam_pos      = glm::vec4(m_main_camera->m_position, 0.0f);
-        m_transforms.light_dir    = glm::vec4(m_light_direction, 0.0f);
+        // Written directly, update() would rebuild the view from the mouse look orientation.
+        if (sim_input.use_camera_pose)
+        {
+            const CameraPose& pose = sim_input.camera_pose;
 
-        uint8_t* ptr = (uint8_t*)m_ubo->mapped_ptr();
-        memcpy(ptr + m_ubo_size * m_vk_backend->current_frame_idx(), &m_transforms, sizeof(Transforms));
-    }
+            current->m_position = pose.position;
+            current->m_forward  = glm::normalize(pose.target - pose.position);
+            current->m_right    = glm::normalize(glm::cross(current->m_forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+            current->m_view     = glm::lookAt(pose.position, pose.target, glm::vec3(0.0f, 1.0f, 0.0f));
 
-    // -----------------------------------------------------------------------------------------------------------------------------------
+            return;
+        }
 
-    void update_camera()
-    {
-        dw::Camera* current = m_main_camera.get();
+        const CameraInputFrame& input = sim_input.camera;
 
-        float forward_delta = m_heading_speed * m_delta;
-        float right_delta   = m_sideways_speed * m_delta;
+        float forward_delta = input.heading_speed * input.delta;
+        float right_delta   = input.sideways_speed * input.delta;
 
         current->set_translation_delta(current->m_forward, forward_delta);
         current->set_translation_delta(current->m_right, right_delta);
 
-        m_camera_x = m_mouse_delta_x * m_camera_sensitivity;
-        m_camera_y = m_mouse_delta_y * m_camera_sensitivity;
+        m_camera_x = input.mouse_delta_x * sim_input.camera_sensitivity;
+        m_camera_y = input.mouse_delta_y * sim_input.camera_sensitivity;
 
-        if (m_mouse_look)
+        if (input.mouse_look)
         {
             // Activate Mouse Look
             current->set_rotatation_delta(glm::vec3((float)(m_camera_y),
@@ -1264,8 +7448,14 @@ private:
     // Common
     dw::vk::DescriptorSet::Ptr       m_per_frame_ds;
     dw::vk::DescriptorSetLayout::Ptr m_per_frame_ds_layout;
-    dw::vk::DescriptorSet::Ptr       m_g_buffer_ds;
-    dw::vk::DescriptorSetLayout::Ptr m_g_buffer_ds_layout;
+    dw::vk::DescriptorSet::Ptr       m_global_ds;
+    dw::vk::DescriptorSetLayout::Ptr m_global_ds_layout;
+    uint32_t                         m_global_mesh_count           = 0;
+    uint32_t                         m_global_material_count       = 0;
+    uint32_t                         m_descriptor_bind_calls       = 0; // Recorded so far this frame.
+    uint32_t                         m_descriptor_sets_bound       = 0;
+    uint32_t                         m_frame_descriptor_bind_calls = 0; // Recorded by the last frame.
+    uint32_t                         m_frame_descriptor_sets_bound = 0;
     dw::vk::Buffer::Ptr              m_ubo;
     dw::vk::Image::Ptr               m_blue_noise;
     dw::vk::ImageView::Ptr           m_blue_noise_view;
@@ -1278,6 +7468,29 @@ private:
     dw::vk::Image::Ptr               m_shadow_mask_image;
     dw::vk::ImageView::Ptr           m_shadow_mask_view;
     dw::vk::ShaderBindingTable::Ptr  m_shadow_mask_sbt;
+    dw::vk::RayTracingPipeline::Ptr  m_shadow_refine_pipeline;
+    dw::vk::ShaderBindingTable::Ptr  m_shadow_refine_sbt;
+    dw::vk::Image::Ptr               m_shadow_visibility_image; // R: Single ray visibility, G: Blocker distance
+    dw::vk::ImageView::Ptr           m_shadow_visibility_view;
+    bool                             m_soft_shadows                = false;
+    float                            m_light_angular_radius        = 1.0f; // Degrees
+    uint32_t                         m_penumbra_rays               = 8;
+    float                            m_penumbra_variance_threshold = 0.01f;
+    uint32_t                         m_max_penumbra_radius         = 8;
+
+    // Cascaded shadow map, resolves the shadow mask wherever it is confident so only the rest is ray traced.
+    dw::vk::Image::Ptr            m_shadow_map;
+    dw::vk::ImageView::Ptr        m_shadow_map_view;
+    dw::vk::ImageView::Ptr        m_shadow_map_layer_view[kShadowCascadeCount];
+    dw::vk::Framebuffer::Ptr      m_shadow_map_fbo[kShadowCascadeCount];
+    dw::vk::RenderPass::Ptr       m_shadow_map_rp;
+    dw::vk::GraphicsPipeline::Ptr m_shadow_map_pipeline;
+    dw::vk::PipelineLayout::Ptr   m_shadow_map_pipeline_layout;
+    CascadedShadowSettings        m_csm_settings;
+    bool                          m_hybrid_shadows             = true;
+    float                         m_cascade_boundary_band      = 0.1f; // Fraction of the cascade's depth range
+    float                         m_depth_ambiguity_texels     = 1.0f;
+    float                         m_contact_hardening_distance = 5.0f;
 
     // Reflection pass
     dw::vk::DescriptorSet::Ptr       m_reflection_ds;
@@ -1287,16 +7500,141 @@ private:
     dw::vk::Image::Ptr               m_reflection_image;
     dw::vk::ImageView::Ptr           m_reflection_view;
     dw::vk::ShaderBindingTable::Ptr  m_reflection_sbt;
+    dw::vk::RayTracingPipeline::Ptr  m_reflection_record_pipeline;
+    dw::vk::ShaderBindingTable::Ptr  m_reflection_record_sbt;
+    dw::vk::RayTracingPipeline::Ptr  m_reflection_shade_pipeline;
+    dw::vk::ShaderBindingTable::Ptr  m_reflection_shade_sbt;
+    dw::vk::ComputePipeline::Ptr     m_reflection_scan_pipeline;
+    dw::vk::ComputePipeline::Ptr     m_reflection_scatter_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_reflection_bin_pipeline_layout;
+    dw::vk::DescriptorSet::Ptr       m_reflection_bin_ds;
+    dw::vk::DescriptorSetLayout::Ptr m_reflection_bin_ds_layout;
+    dw::vk::Buffer::Ptr              m_hit_record_buffer;
+    dw::vk::Buffer::Ptr              m_material_bin_buffer;
+    dw::vk::Buffer::Ptr              m_sorted_hit_buffer;
+    bool                             m_deferred_reflections                                          = false;
+    bool                             m_reflection_mode_recorded[dw::vk::Backend::kMaxFramesInFlight] = {};
+    float                            m_reflection_ms[2]                                              = {}; // Inline, deferred
+    double                           m_reflection_divergence[2]                                      = {}; // Materials per subgroup: inline, deferred
+    bool                             m_ray_cones                                                     = true;
+    float                            m_ray_cone_lod_bias                                             = 0.0f;
+
+    // Screen space reflections
+    dw::vk::Image::Ptr               m_hiz_image;
+    dw::vk::ImageView::Ptr           m_hiz_view;
+    dw::vk::ImageView::Ptr           m_hiz_level_views[kHiZLevels];
+    dw::vk::DescriptorSet::Ptr       m_hiz_ds[kHiZLevels];
+    dw::vk::DescriptorSetLayout::Ptr m_hiz_ds_layout;
+    dw::vk::PipelineLayout::Ptr      m_hiz_pipeline_layout;
+    dw::vk::ComputePipeline::Ptr     m_hiz_pipeline;
+    dw::vk::DescriptorSet::Ptr       m_ssr_ds;
+    dw::vk::DescriptorSetLayout::Ptr m_ssr_ds_layout;
+    dw::vk::PipelineLayout::Ptr      m_ssr_pipeline_layout;
+    dw::vk::ComputePipeline::Ptr     m_ssr_pipeline;
+    dw::vk::Buffer::Ptr              m_ray_list_buffer;
+    bool                             m_ssr                = true;
+    float                            m_ssr_thickness      = 0.5f;
+    int32_t                          m_ssr_max_iterations = 96;
+
+    // Many lights pass
+    dw::vk::DescriptorSet::Ptr       m_lights_ds;
+    dw::vk::DescriptorSetLayout::Ptr m_lights_ds_layout;
+    dw::vk::PipelineLayout::Ptr      m_lights_pipeline_layout;
+    dw::vk::RayTracingPipeline::Ptr  m_light_resample_pipeline;
+    dw::vk::ShaderBindingTable::Ptr  m_light_resample_sbt;
+    dw::vk::RayTracingPipeline::Ptr  m_light_shade_pipeline;
+    dw::vk::ShaderBindingTable::Ptr  m_light_shade_sbt;
+    dw::vk::Image::Ptr               m_lighting_image;
+    dw::vk::ImageView::Ptr           m_lighting_view;
+    dw::vk::Buffer::Ptr              m_light_buffer;
+    dw::vk::Buffer::Ptr              m_reservoir_buffer;
+    dw::vk::Buffer::Ptr              m_prev_reservoir_buffer;
+    std::vector<Light>               m_rest_lights;
+    LightSamplerValidation           m_light_sampler_validation;
+    bool                             m_many_lights        = false;
+    bool                             m_animate_lights     = false;
+    bool                             m_reset_reservoirs   = true;
+    bool                             m_temporal_reuse     = true;
+    bool                             m_spatial_reuse      = true;
+    uint32_t                         m_light_count        = 1024;
+    uint32_t                         m_light_candidates   = 32;
+    uint32_t                         m_spatial_neighbours = 3;
+    float                            m_temporal_m_cap     = 20.0f;
+    float                            m_spatial_radius     = 16.0f;
+    float                            m_light_time         = 0.0f;
 
     // Deferred pass
     dw::vk::GraphicsPipeline::Ptr    m_deferred_pipeline;
+    dw::vk::ComputePipeline::Ptr     m_deferred_compute_pipeline;
     dw::vk::PipelineLayout::Ptr      m_deferred_pipeline_layout;
-    dw::vk::DescriptorSet::Ptr       m_deferred_ds;
+    dw::vk::DescriptorSet::Ptr       m_deferred_ds[2];
     dw::vk::DescriptorSetLayout::Ptr m_deferred_layout;
+    dw::vk::RenderPass::Ptr          m_deferred_rp;
+    dw::vk::Framebuffer::Ptr         m_deferred_fbo[2];
+    dw::vk::Image::Ptr               m_history_image[2];
+    dw::vk::ImageView::Ptr           m_history_view[2];
+    uint32_t                         m_history_idx      = 0;
+    bool                             m_reset_history    = true;
+    float                            m_history_blend    = 0.1f;
+    bool                             m_compute_deferred = true;
+    glm::mat4                        m_prev_view_proj;
+
+    // Copy pass
+    dw::vk::GraphicsPipeline::Ptr    m_copy_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_copy_pipeline_layout;
+    dw::vk::DescriptorSet::Ptr       m_copy_ds[2];
+    dw::vk::DescriptorSetLayout::Ptr m_copy_ds_layout;
+
+    // Profiling
+    CpuTimer      m_cpu_timer;
+    TraceExporter m_trace_exporter;
+    uint32_t      m_cpu_track     = 0;
+    uint32_t      m_gpu_track     = 0;
+    uint32_t      m_sim_track     = 0;
+    bool          m_show_profiler = false;
+
+    // Input recording and replay
+    InputRecorder        m_input_recorder;
+    InputReplay          m_input_replay;
+    FrameTimingLog       m_frame_timings;
+    RegressionThresholds m_regression_thresholds;
+    std::string          m_timing_csv_path;
+    std::string          m_baseline_csv_path;
+    float                m_fixed_timestep  = 0.0f;
+    bool                 m_replay_finished = false;
+
+    // Ray statistics
+    dw::vk::Buffer::Ptr m_ray_stats_buffer;
+    RayStats            m_ray_stats;
+    bool                m_ray_stats_enabled                                       = false;
+    bool                m_ray_stats_recorded[dw::vk::Backend::kMaxFramesInFlight] = {};
+    uint64_t            m_ray_stats_pixels[dw::vk::Backend::kMaxFramesInFlight]   = {};
+    double              m_shadow_rays_per_sec                                     = 0.0;
+    double              m_reflection_rays_per_sec                                 = 0.0;
+    double              m_shadow_rays_per_pixel                                   = 0.0;
+    double              m_penumbra_fraction                                       = 0.0;
+    double              m_shadow_traced_fraction                                  = 0.0;
+    double              m_light_rays_per_sec                                      = 0.0;
+    uint32_t            m_ray_stats_log_counter                                   = 0;
+    bool                m_validate_ray_stats                                      = false;
+    bool                m_validation_failed                                       = false;
+    RayStatsValidation  m_ray_stats_validation;
+
+    // Dynamic resolution
+    std::unique_ptr<GpuTimer>   m_gpu_timer;
+    DynamicResolutionController m_resolution_controller;
+    std::vector<GpuFrameTiming> m_resolution_trace; // Every timing fed to the controller, with --resolution-trace.
+    std::string                 m_resolution_trace_path;
+    bool                        m_dynamic_resolution = true;
+    float                       m_render_scale       = 1.0f;
+    uint32_t                    m_render_width       = 0;
+    uint32_t                    m_render_height      = 0;
+    uint32_t                    m_jitter_idx         = 0;
+    glm::vec2                   m_jitter             = glm::vec2(0.0f);
 
     // G-Buffer pass
-    dw::vk::Image::Ptr            m_g_buffer_1; // RGB: Albedo, A: Metallic
-    dw::vk::Image::Ptr            m_g_buffer_2; // RGB: Normal, A: Roughness
+    dw::vk::Image::Ptr            m_g_buffer_1; // RGB: Albedo, A: Roughness
+    dw::vk::Image::Ptr            m_g_buffer_2; // RGB: Normal, A: Metallic
     dw::vk::Image::Ptr            m_g_buffer_3; // RGB: Position, A: -
     dw::vk::Image::Ptr            m_g_buffer_depth;
     dw::vk::ImageView::Ptr        m_g_buffer_1_view;
@@ -1305,8 +7643,105 @@ private:
     dw::vk::ImageView::Ptr        m_g_buffer_depth_view;
     dw::vk::Framebuffer::Ptr      m_g_buffer_fbo;
     dw::vk::RenderPass::Ptr       m_g_buffer_rp;
-    dw::vk::GraphicsPipeline::Ptr m_g_buffer_pipeline;
+    dw::vk::GraphicsPipeline::Ptr m_g_buffer_pipeline;        // Opaque materials
+    dw::vk::GraphicsPipeline::Ptr m_g_buffer_masked_pipeline; // Alpha tested materials
+    dw::vk::GraphicsPipeline::Ptr m_g_buffer_equal_pipeline;  // All materials after the depth prepass
     dw::vk::PipelineLayout::Ptr   m_g_buffer_pipeline_layout;
+    dw::vk::RenderPass::Ptr       m_g_buffer_load_depth_rp;
+
+    // Depth prepass
+    dw::vk::Framebuffer::Ptr      m_depth_prepass_fbo;
+    dw::vk::RenderPass::Ptr       m_depth_prepass_rp;
+    dw::vk::GraphicsPipeline::Ptr m_depth_prepass_pipeline;
+    dw::vk::GraphicsPipeline::Ptr m_depth_prepass_masked_pipeline;
+    std::vector<uint32_t>         m_opaque_submeshes;
+    std::vector<uint32_t>         m_masked_submeshes;
+    bool                          m_depth_prepass = true;
+
+    // Alpha tested ray tracing
+    dw::vk::Buffer::Ptr  m_triangle_opacity_buffer;
+    std::vector<uint8_t> m_triangle_opacity; // Unpacked, only kept during startup.
+    OpacityBakeStats     m_opacity_stats;
+    bool                 m_alpha_tested_rays = true;
+
+    // Skinned geometry
+    std::vector<Skin>                  m_skins;
+    std::vector<uint32_t>              m_skinned_submeshes; // Of every skin.
+    uint32_t                           m_skin_joint_count = 0;
+    uint32_t                           m_skin_vertex_count = 0;
+    uint32_t                           m_scene_vertex_count = 0;
+    uint32_t                           m_skinned_vertex_base = 0; // First vertex the skinned BLAS and mesh 1 read.
+    VkGeometryNV                       m_skinned_geometry;
+    dw::vk::Buffer::Ptr                m_skinned_vertex_buffer;
+    dw::vk::Buffer::Ptr                m_skinned_index_buffer;   // Mesh 1's, relative to m_skinned_vertex_base.
+    dw::vk::Buffer::Ptr                m_skinned_opacity_buffer; // Mesh 1's triangle opacity.
+    dw::vk::Buffer::Ptr                m_influence_buffer;
+    dw::vk::Buffer::Ptr                m_joint_buffer; // One palette per frame in flight.
+    dw::vk::Buffer::Ptr                m_instance_buffer;
+    dw::vk::Buffer::Ptr                m_as_scratch_buffer;
+    dw::vk::AccelerationStructure::Ptr m_skinned_blas;
+    dw::vk::AccelerationStructure::Ptr m_skinned_tlas;
+    dw::vk::ComputePipeline::Ptr       m_skinning_pipeline;
+    dw::vk::PipelineLayout::Ptr        m_skinning_pipeline_layout;
+    dw::vk::DescriptorSet::Ptr         m_skinning_ds;
+    dw::vk::DescriptorSetLayout::Ptr   m_skinning_ds_layout;
+    BlasRebuildHeuristic               m_blas_heuristic;
+    SwaySettings                       m_sway_settings;
+    std::string                        m_skin_material     = "fabric"; // Matched against the material names, case insensitive.
+    bool                               m_skinning          = true;
+    bool                               m_validate_skinning = false;
+    bool                               m_animate_skins     = true;
+    bool                               m_blas_rebuilt      = false; // Last frame's BLAS update was a build.
+    float                              m_skin_time         = 0.0f;
+
+    // Virtual texturing
+    VirtualTexturePageFile                  m_vt_page_file;
+    std::unique_ptr<VirtualTextureStreamer> m_vt_streamer; // Null without virtual texturing.
+    dw::vk::Image::Ptr                      m_vt_physical_image[VT_MAP_COUNT];
+    dw::vk::ImageView::Ptr                  m_vt_physical_view[VT_MAP_COUNT];
+    dw::vk::Image::Ptr                      m_vt_indirection_image;
+    dw::vk::ImageView::Ptr                  m_vt_indirection_view;
+    dw::vk::Buffer::Ptr                     m_vt_texture_buffer;
+    dw::vk::Buffer::Ptr                     m_vt_feedback_buffer; // One feedback buffer per frame in flight.
+    dw::vk::Buffer::Ptr                     m_vt_staging_buffer;  // One batch per frame in flight.
+    size_t                                  m_vt_staging_size = 0;
+    dw::vk::DescriptorSet::Ptr              m_vt_ds;
+    dw::vk::DescriptorSetLayout::Ptr        m_vt_ds_layout;
+    bool                                    m_vt_feedback_recorded[dw::vk::Backend::kMaxFramesInFlight] = {};
+    uint32_t                                m_vt_feedback_count[dw::vk::Backend::kMaxFramesInFlight]    = {};
+    uint64_t                                m_vt_feedback_frame[dw::vk::Backend::kMaxFramesInFlight]    = {};
+    uint32_t                                m_vt_feedback_width  = 0;
+    uint32_t                                m_vt_feedback_height = 0;
+    VirtualTextureSettings                  m_vt_settings;
+    VtCacheStats                            m_vt_stats;
+    uint32_t                                m_vt_resident_pages = 0;
+    uint32_t                                m_vt_frame_uploads  = 0;
+    uint32_t                                m_vt_slots_per_side = 24; // Of the physical caches, 24 x 24 pages of 136 texels.
+    bool                                    m_virtual_texturing = false;
+
+    // Scene file imported on the CPU, only kept during startup
+    std::vector<SceneSubmesh> m_scene_submeshes;
+
+    // Software occlusion culling
+    std::unique_ptr<ThreadPool>      m_thread_pool;
+    std::unique_ptr<OcclusionCuller> m_occlusion_culler;
+    std::vector<SubmeshGeometry>     m_submesh_geometry;
+    std::vector<Aabb>                m_submesh_bounds;
+    bool                             m_occlusion_culling = true;
+
+    // Visibility buffer
+    dw::vk::Image::Ptr               m_visibility_image; // R: Instance << 24 | Triangle
+    dw::vk::ImageView::Ptr           m_visibility_view;
+    dw::vk::Framebuffer::Ptr         m_visibility_fbo;
+    dw::vk::RenderPass::Ptr          m_visibility_rp;
+    dw::vk::GraphicsPipeline::Ptr    m_visibility_pipeline;
+    dw::vk::PipelineLayout::Ptr      m_visibility_pipeline_layout;
+    dw::vk::RayTracingPipeline::Ptr  m_visibility_resolve_pipeline;
+    dw::vk::ShaderBindingTable::Ptr  m_visibility_resolve_sbt;
+    dw::vk::PipelineLayout::Ptr      m_visibility_resolve_pipeline_layout;
+    dw::vk::DescriptorSet::Ptr       m_visibility_ds;
+    dw::vk::DescriptorSetLayout::Ptr m_visibility_ds_layout;
+    bool                             m_visibility_buffer = false;
 
     // Camera.
     std::unique_ptr<dw::Camera> m_main_camera;
@@ -1329,8 +7764,73 @@ private:
     dw::Mesh::Ptr  m_mesh;
     dw::Scene::Ptr m_scene;
 
-    // Uniforms.
-    Transforms m_transforms;
+    // GPU memory accounting
+    MemoryRegistry                  m_memory_registry;
+    std::mutex                      m_memory_mutex; // Startup phases on worker threads track their allocations too.
+    std::vector<std::string>        m_memory_warnings;
+    std::string                     m_memory_report_path;
+    uint32_t                        m_memory_budget_mb      = 0; // Zero uses the size of the device heap.
+    std::map<std::string, uint32_t> m_pass_budgets_mb;
+    bool                            m_show_memory_resources = false;
+
+    // Startup
+    StartupGraph m_startup_graph;
+    uint32_t     m_startup_threads     = std::min(std::max(std::thread::hardware_concurrency(), 2u) - 1, kMaxStartupThreads);
+    double       m_startup_start_ms    = 0.0;
+    std::string  m_startup_report_path;
+
+    // Frame capture. The writer is declared after the ring so that its threads are gone before the buffers they read.
+    CaptureSlot                         m_capture_slots[kCaptureRingSize];
+    std::unique_ptr<FrameCaptureWriter> m_capture_writer;
+    std::string                         m_capture_dir        = "capture";
+    uint32_t                            m_capture_threads    = 0;
+    bool                                m_capture_frames     = false;
+    bool                                m_capture_aovs       = false;
+    bool                                m_capture_next_frame = false;
+    uint64_t                            m_captured_frames    = 0;
+    uint64_t                            m_capture_dropped    = 0;
+
+    // Batch rendering
+    std::unique_ptr<BatchWorkerClient> m_batch_client;
+    std::string                        m_batch_address;
+    std::string                        m_batch_name;
+    std::deque<BatchFrame>             m_batch_schedule;
+    BatchFrame                         m_batch_frame;
+    uint32_t                           m_batch_next_frame    = UINT32_MAX; // Frame after the last job.
+    bool                               m_batch_job_requested = false;
+    bool                               m_batch_finished      = false;
+    uint32_t                           m_batch_jobs          = 0;
+    uint32_t                           m_batch_frames_sent   = 0;
+    BatchFrameTiming                   m_batch_timings[kBatchTimingHistory];
+    std::mutex                         m_batch_mutex;
+    std::vector<BatchEncodedFrame>     m_batch_encoded; // Filled by the encoders.
+
+    // Frame pipelining
+    FramePipeline m_frame_pipeline;
+    FrameState    m_frame_states[dw::vk::Backend::kMaxFramesInFlight];
+    uint64_t      m_frame_index          = 0;
+    bool          m_pipelined_simulation = true;
+
+    // Command caching
+    std::unique_ptr<SecondaryCommandCache> m_g_buffer_commands;
+    std::unique_ptr<SecondaryCommandCache> m_depth_prepass_commands;
+    std::unique_ptr<SecondaryCommandCache> m_shadow_map_commands;
+    std::unique_ptr<SecondaryCommandCache> m_deferred_commands;
+    std::unique_ptr<SecondaryCommandCache> m_reflection_commands;
+    CommandCacheStats                      m_command_cache_stats;
+    uint64_t                               m_command_generation  = 0; // Bumped when recordings must not be reused.
+    uint64_t                               m_command_hits        = 0;
+    uint64_t                               m_command_misses      = 0;
+    float                                  m_command_saved_ms    = 0.0f;
+    float                                  m_command_recorded_ms = 0.0f;
+    bool                                   m_cache_commands      = true;
 };
 
-DW_DECLARE_MAIN(Sample)
+int main(int argc, const char* argv[])
+{
+    Sample sample;
+
+    const int result = sample.run(argc, argv);
+
+    return result != 0 ? result : sample.exit_code();
+}
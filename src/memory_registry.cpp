@@ -0,0 +1,281 @@
+#include "memory_registry.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::string escape_json(const std::string& str)
+{
+    std::string result;
+
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+
+        result += c;
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void write_allocation(FILE* file, const MemoryAllocation& allocation, bool last)
+{
+    fprintf(file, "    { \"name\": \"%s\", \"pass\": \"%s\", \"type\": \"%s\", \"location\": \"%s\", \"size\": %llu, \"description\": \"%s\", \"resolution_dependent\": %s, \"created_frame\": %llu",
+            escape_json(allocation.name).c_str(),
+            escape_json(allocation.pass).c_str(),
+            memory_resource_type_name(allocation.type),
+            memory_location_name(allocation.location),
+            (unsigned long long)allocation.size,
+            escape_json(allocation.description).c_str(),
+            allocation.resolution_dependent ? "true" : "false",
+            (unsigned long long)allocation.created_frame);
+
+    if (allocation.released_frame != UINT64_MAX)
+        fprintf(file, ", \"released_frame\": %llu", (unsigned long long)allocation.released_frame);
+
+    fprintf(file, " }%s\n", last ? "" : ",");
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+const char* memory_location_name(MemoryLocation location)
+{
+    return location == MEMORY_LOCATION_DEVICE ? "device" : "host";
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+const char* memory_resource_type_name(MemoryResourceType type)
+{
+    switch (type)
+    {
+        case MEMORY_RESOURCE_IMAGE:
+            return "image";
+        case MEMORY_RESOURCE_BUFFER:
+            return "buffer";
+        default:
+            return "acceleration_structure";
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string format_memory_size(uint64_t bytes)
+{
+    char buffer[32];
+
+    if (bytes >= 1024ull * 1024ull)
+        snprintf(buffer, sizeof(buffer), "%.2f MB", double(bytes) / (1024.0 * 1024.0));
+    else
+        snprintf(buffer, sizeof(buffer), "%.2f KB", double(bytes) / 1024.0);
+
+    return buffer;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void MemoryRegistry::track(const std::string& name, const std::string& pass, MemoryResourceType type, MemoryLocation location, uint64_t size, const std::string& description, bool resolution_dependent, uint64_t frame)
+{
+    release(name, frame);
+
+    MemoryAllocation allocation;
+
+    allocation.name                 = name;
+    allocation.pass                 = pass;
+    allocation.description          = description;
+    allocation.type                 = type;
+    allocation.location             = location;
+    allocation.size                 = size;
+    allocation.resolution_dependent = resolution_dependent;
+    allocation.created_frame        = frame;
+
+    m_live.push_back(allocation);
+
+    m_total[location] += size;
+    m_peak[location] = std::max(m_peak[location], m_total[location]);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void MemoryRegistry::release(const std::string& name, uint64_t frame)
+{
+    for (size_t i = 0; i < m_live.size(); i++)
+    {
+        if (m_live[i].name != name)
+            continue;
+
+        MemoryAllocation allocation = m_live[i];
+
+        allocation.released_frame = frame;
+        m_total[allocation.location] -= allocation.size;
+
+        m_live.erase(m_live.begin() + i);
+
+        if (m_history.size() == kMaxHistory)
+            m_history.erase(m_history.begin());
+
+        m_history.push_back(allocation);
+
+        return;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<MemoryPassTotal> MemoryRegistry::pass_totals() const
+{
+    std::vector<MemoryPassTotal> totals;
+
+    for (const auto& allocation : m_live)
+    {
+        auto it = std::find_if(totals.begin(), totals.end(), [&allocation](const MemoryPassTotal& total) { return total.pass == allocation.pass; });
+
+        if (it == totals.end())
+        {
+            totals.push_back(MemoryPassTotal());
+            totals.back().pass = allocation.pass;
+            it                 = totals.end() - 1;
+        }
+
+        it->size[allocation.location] += allocation.size;
+        it->count++;
+    }
+
+    std::sort(totals.begin(), totals.end(), [](const MemoryPassTotal& a, const MemoryPassTotal& b) {
+        return a.size[MEMORY_LOCATION_DEVICE] > b.size[MEMORY_LOCATION_DEVICE];
+    });
+
+    return totals;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint64_t MemoryRegistry::projected_total(MemoryLocation location, uint64_t from_pixels, uint64_t to_pixels) const
+{
+    uint64_t total = 0;
+
+    for (const auto& allocation : m_live)
+    {
+        if (allocation.location != location)
+            continue;
+
+        if (allocation.resolution_dependent && from_pixels > 0)
+            total += uint64_t(double(allocation.size) * double(to_pixels) / double(from_pixels));
+        else
+            total += allocation.size;
+    }
+
+    return total;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<std::string> MemoryRegistry::check_budget()
+{
+    std::vector<std::string> warnings;
+
+    auto check = [this, &warnings](const std::string& key, const std::string& what, uint64_t used, uint64_t limit) {
+        const bool over = limit > 0 && used > limit;
+        bool&      was  = m_over_budget[key];
+
+        if (over && !was)
+            warnings.push_back(what + " uses " + format_memory_size(used) + ", over its budget of " + format_memory_size(limit));
+
+        was = over;
+    };
+
+    for (uint32_t i = 0; i < MEMORY_LOCATION_COUNT; i++)
+        check(memory_location_name(MemoryLocation(i)), std::string("Total ") + memory_location_name(MemoryLocation(i)) + " memory", m_total[i], m_budget.location_bytes[i]);
+
+    if (!m_budget.pass_bytes.empty())
+    {
+        for (const auto& total : pass_totals())
+        {
+            auto it = m_budget.pass_bytes.find(total.pass);
+
+            if (it != m_budget.pass_bytes.end())
+                check("pass:" + total.pass, "Pass '" + total.pass + "'", total.size[MEMORY_LOCATION_DEVICE], it->second);
+        }
+    }
+
+    return warnings;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool MemoryRegistry::write_json(const std::string& path, uint64_t frame, uint32_t width, uint32_t height) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+
+    if (!file)
+        return false;
+
+    const uint64_t pixels = uint64_t(width) * uint64_t(height);
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"frame\": %llu,\n", (unsigned long long)frame);
+    fprintf(file, "  \"resolution\": [%u, %u],\n", width, height);
+
+    fprintf(file, "  \"totals\": {\n");
+
+    for (uint32_t i = 0; i < MEMORY_LOCATION_COUNT; i++)
+    {
+        const MemoryLocation location = MemoryLocation(i);
+
+        fprintf(file, "    \"%s\": { \"live\": %llu, \"peak\": %llu, \"budget\": %llu, \"projected_1080p\": %llu, \"projected_4k\": %llu }%s\n",
+                memory_location_name(location),
+                (unsigned long long)m_total[i],
+                (unsigned long long)m_peak[i],
+                (unsigned long long)m_budget.location_bytes[i],
+                (unsigned long long)projected_total(location, pixels, 1920ull * 1080ull),
+                (unsigned long long)projected_total(location, pixels, 3840ull * 2160ull),
+                i + 1 < MEMORY_LOCATION_COUNT ? "," : "");
+    }
+
+    fprintf(file, "  },\n");
+
+    const std::vector<MemoryPassTotal> totals = pass_totals();
+
+    fprintf(file, "  \"passes\": [\n");
+
+    for (size_t i = 0; i < totals.size(); i++)
+    {
+        auto           it     = m_budget.pass_bytes.find(totals[i].pass);
+        const uint64_t budget = it != m_budget.pass_bytes.end() ? it->second : 0;
+
+        fprintf(file, "    { \"pass\": \"%s\", \"count\": %u, \"device\": %llu, \"host\": %llu, \"budget\": %llu }%s\n",
+                escape_json(totals[i].pass).c_str(),
+                totals[i].count,
+                (unsigned long long)totals[i].size[MEMORY_LOCATION_DEVICE],
+                (unsigned long long)totals[i].size[MEMORY_LOCATION_HOST],
+                (unsigned long long)budget,
+                i + 1 < totals.size() ? "," : "");
+    }
+
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"live\": [\n");
+
+    for (size_t i = 0; i < m_live.size(); i++)
+        write_allocation(file, m_live[i], i + 1 == m_live.size());
+
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"released\": [\n");
+
+    for (size_t i = 0; i < m_history.size(); i++)
+        write_allocation(file, m_history[i], i + 1 == m_history.size());
+
+    fprintf(file, "  ]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum MemoryResourceType
+{
+    MEMORY_RESOURCE_IMAGE,
+    MEMORY_RESOURCE_BUFFER,
+    MEMORY_RESOURCE_ACCELERATION_STRUCTURE
+};
+
+enum MemoryLocation
+{
+    MEMORY_LOCATION_DEVICE, // VMA_MEMORY_USAGE_GPU_ONLY
+    MEMORY_LOCATION_HOST,   // VMA_MEMORY_USAGE_CPU_TO_GPU and GPU_TO_CPU
+    MEMORY_LOCATION_COUNT
+};
+
+// One tracked resource. Sizes are the driver's memory requirements of the resource, which include padding and
+// alignment but not the slack of the VMA block it was suballocated from.
+struct MemoryAllocation
+{
+    std::string        name;
+    std::string        pass;
+    std::string        description; // Extent and format of images, element layout of buffers.
+    MemoryResourceType type;
+    MemoryLocation     location;
+    uint64_t           size                 = 0;
+    bool               resolution_dependent = false; // Reallocated with the window, scales with its pixel count.
+    uint64_t           created_frame        = 0;
+    uint64_t           released_frame       = UINT64_MAX; // UINT64_MAX while alive.
+};
+
+struct MemoryPassTotal
+{
+    std::string pass;
+    uint64_t    size[MEMORY_LOCATION_COUNT] = { 0, 0 };
+    uint32_t    count                       = 0;
+};
+
+// Limits checked by MemoryRegistry::check_budget(). Zero disables a limit.
+struct MemoryBudget
+{
+    uint64_t                        location_bytes[MEMORY_LOCATION_COUNT] = { 0, 0 };
+    std::map<std::string, uint64_t> pass_bytes; // Device memory limit per pass.
+};
+
+// Registry of the renderer's GPU allocations tagged with the pass that owns them. Resources are tracked by
+// name: tracking a name that is already alive releases the previous allocation, which is what recreating a
+// resource on resize looks like. Released allocations are kept in a bounded history so that their lifetime
+// shows up in the report.
+class MemoryRegistry
+{
+public:
+    static const size_t kMaxHistory = 256;
+
+    void track(const std::string& name, const std::string& pass, MemoryResourceType type, MemoryLocation location, uint64_t size, const std::string& description, bool resolution_dependent, uint64_t frame);
+    void release(const std::string& name, uint64_t frame);
+
+    // Totals of the live allocations grouped by pass, largest device footprint first.
+    std::vector<MemoryPassTotal> pass_totals() const;
+
+    // Live memory if every resolution dependent allocation was made for 'to_pixels' instead of 'from_pixels'.
+    uint64_t projected_total(MemoryLocation location, uint64_t from_pixels, uint64_t to_pixels) const;
+
+    // Returns a message for every limit that was crossed since the last call. A limit warns once and re-arms
+    // after usage drops back below it.
+    std::vector<std::string> check_budget();
+
+    // Writes live allocations, pass totals, history and budget to a JSON file. 'width' and 'height' are the
+    // resolution the resolution dependent allocations were made for.
+    bool write_json(const std::string& path, uint64_t frame, uint32_t width, uint32_t height) const;
+
+    inline void                                 set_budget(const MemoryBudget& budget) { m_budget = budget; m_over_budget.clear(); }
+    inline const MemoryBudget&                  budget() const { return m_budget; }
+    inline const std::vector<MemoryAllocation>& live() const { return m_live; }
+    inline const std::vector<MemoryAllocation>& history() const { return m_history; }
+    inline uint64_t                             total(MemoryLocation location) const { return m_total[location]; }
+    inline uint64_t                             peak(MemoryLocation location) const { return m_peak[location]; }
+
+private:
+    std::vector<MemoryAllocation> m_live;
+    std::vector<MemoryAllocation> m_history;
+    uint64_t                      m_total[MEMORY_LOCATION_COUNT] = { 0, 0 };
+    uint64_t                      m_peak[MEMORY_LOCATION_COUNT]  = { 0, 0 };
+    MemoryBudget                  m_budget;
+    std::map<std::string, bool>   m_over_budget; // Limits currently exceeded, by key.
+};
+
+const char* memory_location_name(MemoryLocation location);
+const char* memory_resource_type_name(MemoryResourceType type);
+std::string format_memory_size(uint64_t bytes);
@@ -0,0 +1,597 @@
+#include "occlusion_culling.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#endif
+
+// Vertices transformed per parallel job.
+static const uint32_t kTransformBatchSize = 4096;
+
+// Boxes tested per parallel job.
+static const uint32_t kCullBatchSize = 64;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Builds the edge functions and depth plane of a triangle given in clip space. Triangles crossing the near plane
+// are rejected rather than clipped, which only loses some occlusion. Both windings are kept since occluders are
+// rasterized without backface culling.
+static bool setup_triangle(const glm::vec4& c0, const glm::vec4& c1, const glm::vec4& c2, uint32_t width, uint32_t height, OccluderTriangle& triangle)
+{
+    if (c0.w <= 0.0f || c1.w <= 0.0f || c2.w <= 0.0f || c0.z < 0.0f || c1.z < 0.0f || c2.z < 0.0f)
+        return false;
+
+    glm::vec3 v[3];
+
+    const glm::vec4* clip[3] = { &c0, &c1, &c2 };
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        const float inv_w = 1.0f / clip[i]->w;
+
+        v[i].x = (clip[i]->x * inv_w * 0.5f + 0.5f) * float(width);
+        v[i].y = (clip[i]->y * inv_w * 0.5f + 0.5f) * float(height);
+        v[i].z = clip[i]->z * inv_w;
+    }
+
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+
+    if (area == 0.0f)
+        return false;
+
+    // Pixels whose centre lies within the screen space bounds.
+    const float min_x = std::min(std::min(v[0].x, v[1].x), v[2].x);
+    const float min_y = std::min(std::min(v[0].y, v[1].y), v[2].y);
+    const float max_x = std::max(std::max(v[0].x, v[1].x), v[2].x);
+    const float max_y = std::max(std::max(v[0].y, v[1].y), v[2].y);
+
+    triangle.min_x = std::max(int32_t(std::ceil(min_x - 0.5f)), 0);
+    triangle.min_y = std::max(int32_t(std::ceil(min_y - 0.5f)), 0);
+    triangle.max_x = std::min(int32_t(std::floor(max_x - 0.5f)), int32_t(width) - 1);
+    triangle.max_y = std::min(int32_t(std::floor(max_y - 0.5f)), int32_t(height) - 1);
+
+    if (triangle.min_x > triangle.max_x || triangle.min_y > triangle.max_y)
+        return false;
+
+    // Edge i runs from vertex i to the next one and evaluates to the barycentric weight of the opposite vertex
+    // times the area.
+    const float sign = area < 0.0f ? -1.0f : 1.0f;
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        const glm::vec3& a = v[i];
+        const glm::vec3& b = v[(i + 1) % 3];
+
+        triangle.edge_a[i] = (a.y - b.y) * sign;
+        triangle.edge_b[i] = (b.x - a.x) * sign;
+        triangle.edge_c[i] = (a.x * b.y - a.y * b.x) * sign;
+    }
+
+    area *= sign;
+
+    // Edge 2 weights vertex 1 and edge 0 weights vertex 2.
+    const float dz1 = (v[1].z - v[0].z) / area;
+    const float dz2 = (v[2].z - v[0].z) / area;
+
+    triangle.z_a = dz1 * triangle.edge_a[2] + dz2 * triangle.edge_a[0];
+    triangle.z_b = dz1 * triangle.edge_b[2] + dz2 * triangle.edge_b[0];
+    triangle.z_c = v[0].z + dz1 * triangle.edge_c[2] + dz2 * triangle.edge_c[0];
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Scalar rasterization of the pixels of [min_x, max_x] x [min_y, max_y] covered by the triangle. The expressions
+// must stay identical to the AVX2 path so that both produce the same depth.
+static void rasterize_scalar(const OccluderTriangle& triangle, int32_t min_x, int32_t min_y, int32_t max_x, int32_t max_y, float* depth, uint32_t width)
+{
+    for (int32_t y = min_y; y <= max_y; y++)
+    {
+        const float py = float(y) + 0.5f;
+
+        for (int32_t x = min_x; x <= max_x; x++)
+        {
+            const float px = float(x) + 0.5f;
+
+            const float e0 = triangle.edge_a[0] * px + triangle.edge_b[0] * py + triangle.edge_c[0];
+            const float e1 = triangle.edge_a[1] * px + triangle.edge_b[1] * py + triangle.edge_c[1];
+            const float e2 = triangle.edge_a[2] * px + triangle.edge_b[2] * py + triangle.edge_c[2];
+
+            if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f)
+            {
+                const float z = triangle.z_a * px + triangle.z_b * py + triangle.z_c;
+                float&      d = depth[y * width + x];
+
+                if (z < d)
+                    d = z;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(__AVX2__)
+
+// Eight pixels of a row at a time. Lanes outside the range or the triangle keep their depth through the mask,
+// so 'min_x' doesn't need to be aligned as long as the aligned block stays inside the caller's tile.
+static void rasterize_avx2(const OccluderTriangle& triangle, int32_t min_x, int32_t min_y, int32_t max_x, int32_t max_y, float* depth, uint32_t width)
+{
+    const __m256 lane_offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 zero         = _mm256_setzero_ps();
+    const __m256 range_min    = _mm256_set1_ps(float(min_x));
+    const __m256 range_max    = _mm256_set1_ps(float(max_x) + 1.0f);
+
+    __m256 edge_a[3];
+    __m256 edge_b[3];
+    __m256 edge_c[3];
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        edge_a[i] = _mm256_set1_ps(triangle.edge_a[i]);
+        edge_b[i] = _mm256_set1_ps(triangle.edge_b[i]);
+        edge_c[i] = _mm256_set1_ps(triangle.edge_c[i]);
+    }
+
+    const __m256 z_a = _mm256_set1_ps(triangle.z_a);
+    const __m256 z_b = _mm256_set1_ps(triangle.z_b);
+    const __m256 z_c = _mm256_set1_ps(triangle.z_c);
+
+    const int32_t first_block = min_x & ~7;
+
+    for (int32_t y = min_y; y <= max_y; y++)
+    {
+        const __m256 py = _mm256_set1_ps(float(y) + 0.5f);
+
+        const __m256 row_e0 = _mm256_mul_ps(edge_b[0], py);
+        const __m256 row_e1 = _mm256_mul_ps(edge_b[1], py);
+        const __m256 row_e2 = _mm256_mul_ps(edge_b[2], py);
+        const __m256 row_z  = _mm256_mul_ps(z_b, py);
+
+        float* row = depth + y * width;
+
+        for (int32_t x = first_block; x <= max_x; x += 8)
+        {
+            const __m256 px = _mm256_add_ps(_mm256_set1_ps(float(x)), lane_offsets);
+
+            const __m256 e0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge_a[0], px), row_e0), edge_c[0]);
+            const __m256 e1 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge_a[1], px), row_e1), edge_c[1]);
+            const __m256 e2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(edge_a[2], px), row_e2), edge_c[2]);
+            const __m256 z  = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(z_a, px), row_z), z_c);
+
+            __m256 mask = _mm256_and_ps(_mm256_cmp_ps(px, range_min, _CMP_GT_OQ), _mm256_cmp_ps(px, range_max, _CMP_LT_OQ));
+
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(e0, zero, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(e1, zero, _CMP_GE_OQ));
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+
+            if (_mm256_testz_ps(mask, mask))
+                continue;
+
+            const __m256 current = _mm256_loadu_ps(row + x);
+
+            mask = _mm256_and_ps(mask, _mm256_cmp_ps(z, current, _CMP_LT_OQ));
+
+            _mm256_storeu_ps(row + x, _mm256_blendv_ps(current, z, mask));
+        }
+    }
+}
+
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Projects a box into pixel bounds and its closest depth. Returns false when the result is already known: boxes
+// entirely outside a frustum plane are culled, and boxes crossing the near plane can't be projected and are kept.
+static bool project_box(const glm::mat4& view_proj, const Aabb& box, uint32_t width, uint32_t height, int32_t* rect, float& min_z, OcclusionResult& result)
+{
+    glm::vec4 corners[8];
+
+    uint32_t outside[6] = { 0, 0, 0, 0, 0, 0 };
+    bool     crosses_near = false;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        const glm::vec3 p = glm::vec3(i & 1 ? box.max_extents.x : box.min_extents.x,
+                                      i & 2 ? box.max_extents.y : box.min_extents.y,
+                                      i & 4 ? box.max_extents.z : box.min_extents.z);
+
+        corners[i] = view_proj * glm::vec4(p, 1.0f);
+
+        const glm::vec4& c = corners[i];
+
+        outside[0] += c.x < -c.w;
+        outside[1] += c.x > c.w;
+        outside[2] += c.y < -c.w;
+        outside[3] += c.y > c.w;
+        outside[4] += c.z < 0.0f;
+        outside[5] += c.z > c.w;
+
+        if (c.w <= 0.0f || c.z < 0.0f)
+            crosses_near = true;
+    }
+
+    for (uint32_t i = 0; i < 6; i++)
+    {
+        if (outside[i] == 8)
+        {
+            result = OCCLUSION_FRUSTUM_CULLED;
+            return false;
+        }
+    }
+
+    if (crosses_near)
+    {
+        result = OCCLUSION_VISIBLE;
+        return false;
+    }
+
+    glm::vec3 ndc_min = glm::vec3(corners[0]) / corners[0].w;
+    glm::vec3 ndc_max = ndc_min;
+
+    for (uint32_t i = 1; i < 8; i++)
+    {
+        const glm::vec3 ndc = glm::vec3(corners[i]) / corners[i].w;
+
+        ndc_min = glm::min(ndc_min, ndc);
+        ndc_max = glm::max(ndc_max, ndc);
+    }
+
+    // Every pixel the box touches, not only the ones whose centre it covers.
+    rect[0] = std::min(std::max(int32_t(std::floor((ndc_min.x * 0.5f + 0.5f) * float(width))), 0), int32_t(width) - 1);
+    rect[1] = std::min(std::max(int32_t(std::floor((ndc_min.y * 0.5f + 0.5f) * float(height))), 0), int32_t(height) - 1);
+    rect[2] = std::min(std::max(int32_t(std::floor((ndc_max.x * 0.5f + 0.5f) * float(width))), 0), int32_t(width) - 1);
+    rect[3] = std::min(std::max(int32_t(std::floor((ndc_max.y * 0.5f + 0.5f) * float(height))), 0), int32_t(height) - 1);
+
+    min_z = ndc_min.z;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<uint32_t> select_occluders(const std::vector<SubmeshGeometry>& submeshes, const std::vector<uint32_t>& candidates, uint32_t max_occluders, uint32_t max_triangles)
+{
+    std::vector<std::pair<float, uint32_t>> scored;
+
+    for (uint32_t idx : candidates)
+    {
+        const SubmeshGeometry& submesh        = submeshes[idx];
+        const size_t           triangle_count = submesh.indices.size() / 3;
+
+        if (triangle_count == 0 || triangle_count > max_triangles)
+            continue;
+
+        float area = 0.0f;
+
+        for (size_t i = 0; i < triangle_count; i++)
+        {
+            const glm::vec3& v0 = submesh.positions[submesh.indices[i * 3 + 0]];
+            const glm::vec3& v1 = submesh.positions[submesh.indices[i * 3 + 1]];
+            const glm::vec3& v2 = submesh.positions[submesh.indices[i * 3 + 2]];
+
+            area += 0.5f * glm::length(glm::cross(v1 - v0, v2 - v0));
+        }
+
+        scored.push_back(std::make_pair(area, idx));
+    }
+
+    std::sort(scored.begin(), scored.end(), [](const std::pair<float, uint32_t>& a, const std::pair<float, uint32_t>& b) { return a.first > b.first; });
+
+    std::vector<uint32_t> occluders;
+
+    for (size_t i = 0; i < scored.size() && i < max_occluders; i++)
+        occluders.push_back(scored[i].second);
+
+    return occluders;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+OcclusionCuller::OcclusionCuller(ThreadPool* pool, const OcclusionCullingSettings& settings) :
+    m_pool(pool), m_settings(settings), m_view_proj(1.0f)
+{
+    m_settings.width  = std::max((m_settings.width + kOcclusionTileWidth - 1) / kOcclusionTileWidth, 1u) * kOcclusionTileWidth;
+    m_settings.height = std::max((m_settings.height + kOcclusionTileHeight - 1) / kOcclusionTileHeight, 1u) * kOcclusionTileHeight;
+
+    m_tiles_x = m_settings.width / kOcclusionTileWidth;
+    m_tiles_y = m_settings.height / kOcclusionTileHeight;
+
+    uint32_t width  = m_settings.width;
+    uint32_t height = m_settings.height;
+
+    m_hiz.push_back(std::vector<float>(width * height, 1.0f));
+
+    while (width > 1 || height > 1)
+    {
+        width  = std::max((width + 1) / 2, 1u);
+        height = std::max((height + 1) / 2, 1u);
+
+        m_hiz.push_back(std::vector<float>(width * height, 1.0f));
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void OcclusionCuller::set_occluders(const std::vector<SubmeshGeometry>& submeshes, const std::vector<uint32_t>& occluders)
+{
+    m_positions.clear();
+    m_indices.clear();
+
+    for (uint32_t idx : occluders)
+    {
+        const SubmeshGeometry& submesh     = submeshes[idx];
+        const uint32_t         base_vertex = uint32_t(m_positions.size());
+
+        m_positions.insert(m_positions.end(), submesh.positions.begin(), submesh.positions.end());
+
+        for (uint32_t index : submesh.indices)
+            m_indices.push_back(base_vertex + index);
+    }
+
+    m_clip_positions.resize(m_positions.size());
+    m_triangles.resize(m_indices.size() / 3);
+
+    m_stats.occluder_triangles = uint32_t(m_triangles.size());
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void OcclusionCuller::render(const glm::mat4& view_proj)
+{
+    m_view_proj = view_proj;
+
+    const uint32_t vertex_count = uint32_t(m_positions.size());
+
+    m_pool->parallel_for((vertex_count + kTransformBatchSize - 1) / kTransformBatchSize, [this, vertex_count](uint32_t batch) {
+        const uint32_t end = std::min((batch + 1) * kTransformBatchSize, vertex_count);
+
+        for (uint32_t i = batch * kTransformBatchSize; i < end; i++)
+            m_clip_positions[i] = m_view_proj * glm::vec4(m_positions[i], 1.0f);
+    });
+
+    // Every job bins a contiguous range of triangles into its own set of tiles, which keeps the triangles of a
+    // tile in submission order without any synchronization.
+    const uint32_t job_count  = m_pool->thread_count();
+    const uint32_t tile_count = m_tiles_x * m_tiles_y;
+
+    m_bins.resize(job_count * tile_count);
+
+    m_pool->parallel_for(job_count, [this, job_count](uint32_t job) { bin_triangles(job, job_count); });
+
+    m_stats.rasterized_triangles = 0;
+    m_stats.bin_entries          = 0;
+
+    for (uint32_t i = 0; i < job_count * tile_count; i++)
+        m_stats.bin_entries += uint32_t(m_bins[i].size());
+
+    for (uint32_t i = 0; i < uint32_t(m_triangles.size()); i++)
+        m_stats.rasterized_triangles += m_triangles[i].min_x <= m_triangles[i].max_x;
+
+    m_pool->parallel_for(tile_count, [this, job_count](uint32_t tile) { rasterize_tile(tile, job_count); });
+
+    build_hiz();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void OcclusionCuller::bin_triangles(uint32_t job, uint32_t job_count)
+{
+    const uint32_t tile_count     = m_tiles_x * m_tiles_y;
+    const uint32_t triangle_count = uint32_t(m_triangles.size());
+    const uint32_t first          = uint32_t(uint64_t(triangle_count) * job / job_count);
+    const uint32_t last           = uint32_t(uint64_t(triangle_count) * (job + 1) / job_count);
+
+    std::vector<uint32_t>* bins = &m_bins[job * tile_count];
+
+    for (uint32_t i = 0; i < tile_count; i++)
+        bins[i].clear();
+
+    for (uint32_t i = first; i < last; i++)
+    {
+        OccluderTriangle& triangle = m_triangles[i];
+
+        if (!setup_triangle(m_clip_positions[m_indices[i * 3 + 0]], m_clip_positions[m_indices[i * 3 + 1]], m_clip_positions[m_indices[i * 3 + 2]], m_settings.width, m_settings.height, triangle))
+        {
+            // Marks the triangle as rejected for the stats.
+            triangle.min_x = 1;
+            triangle.max_x = 0;
+            continue;
+        }
+
+        const uint32_t tile_min_x = uint32_t(triangle.min_x) / kOcclusionTileWidth;
+        const uint32_t tile_min_y = uint32_t(triangle.min_y) / kOcclusionTileHeight;
+        const uint32_t tile_max_x = uint32_t(triangle.max_x) / kOcclusionTileWidth;
+        const uint32_t tile_max_y = uint32_t(triangle.max_y) / kOcclusionTileHeight;
+
+        for (uint32_t y = tile_min_y; y <= tile_max_y; y++)
+        {
+            for (uint32_t x = tile_min_x; x <= tile_max_x; x++)
+                bins[y * m_tiles_x + x].push_back(i);
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void OcclusionCuller::rasterize_tile(uint32_t tile, uint32_t job_count)
+{
+    const int32_t tile_min_x = int32_t((tile % m_tiles_x) * kOcclusionTileWidth);
+    const int32_t tile_min_y = int32_t((tile / m_tiles_x) * kOcclusionTileHeight);
+    const int32_t tile_max_x = tile_min_x + int32_t(kOcclusionTileWidth) - 1;
+    const int32_t tile_max_y = tile_min_y + int32_t(kOcclusionTileHeight) - 1;
+
+    float* depth = m_hiz[0].data();
+
+    for (int32_t y = tile_min_y; y <= tile_max_y; y++)
+        std::fill(depth + y * m_settings.width + tile_min_x, depth + y * m_settings.width + tile_max_x + 1, 1.0f);
+
+    const uint32_t tile_count = m_tiles_x * m_tiles_y;
+
+    for (uint32_t job = 0; job < job_count; job++)
+    {
+        for (uint32_t idx : m_bins[job * tile_count + tile])
+        {
+            const OccluderTriangle& triangle = m_triangles[idx];
+
+            const int32_t min_x = std::max(triangle.min_x, tile_min_x);
+            const int32_t min_y = std::max(triangle.min_y, tile_min_y);
+            const int32_t max_x = std::min(triangle.max_x, tile_max_x);
+            const int32_t max_y = std::min(triangle.max_y, tile_max_y);
+
+#if defined(__AVX2__)
+            rasterize_avx2(triangle, min_x, min_y, max_x, max_y, depth, m_settings.width);
+#else
+            rasterize_scalar(triangle, min_x, min_y, max_x, max_y, depth, m_settings.width);
+#endif
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void OcclusionCuller::build_hiz()
+{
+    uint32_t src_width  = m_settings.width;
+    uint32_t src_height = m_settings.height;
+
+    for (size_t level = 1; level < m_hiz.size(); level++)
+    {
+        const uint32_t dst_width  = std::max((src_width + 1) / 2, 1u);
+        const uint32_t dst_height = std::max((src_height + 1) / 2, 1u);
+
+        const std::vector<float>& src = m_hiz[level - 1];
+        std::vector<float>&       dst = m_hiz[level];
+
+        for (uint32_t y = 0; y < dst_height; y++)
+        {
+            const uint32_t y0 = y * 2;
+            const uint32_t y1 = std::min(y0 + 1, src_height - 1);
+
+            for (uint32_t x = 0; x < dst_width; x++)
+            {
+                const uint32_t x0 = x * 2;
+                const uint32_t x1 = std::min(x0 + 1, src_width - 1);
+
+                dst[y * dst_width + x] = std::max(std::max(src[y0 * src_width + x0], src[y0 * src_width + x1]),
+                                                  std::max(src[y1 * src_width + x0], src[y1 * src_width + x1]));
+            }
+        }
+
+        src_width  = dst_width;
+        src_height = dst_height;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+OcclusionResult OcclusionCuller::test(const Aabb& box) const
+{
+    int32_t         rect[4];
+    float           min_z;
+    OcclusionResult result;
+
+    if (!project_box(m_view_proj, box, m_settings.width, m_settings.height, rect, min_z, result))
+        return result;
+
+    // Coarsest level where the footprint spans at most 2x2 texels.
+    uint32_t level = 0;
+
+    while (level + 1 < m_hiz.size() && ((rect[2] >> level) - (rect[0] >> level) > 1 || (rect[3] >> level) - (rect[1] >> level) > 1))
+        level++;
+
+    uint32_t level_width = m_settings.width;
+
+    for (uint32_t i = 0; i < level; i++)
+        level_width = std::max((level_width + 1) / 2, 1u);
+
+    const std::vector<float>& hiz = m_hiz[level];
+
+    float max_depth = 0.0f;
+
+    for (int32_t y = rect[1] >> level; y <= rect[3] >> level; y++)
+    {
+        for (int32_t x = rect[0] >> level; x <= rect[2] >> level; x++)
+            max_depth = std::max(max_depth, hiz[y * level_width + x]);
+    }
+
+    return min_z > max_depth ? OCCLUSION_OCCLUDED : OCCLUSION_VISIBLE;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void OcclusionCuller::cull(const std::vector<Aabb>& boxes, std::vector<uint8_t>& visible)
+{
+    const uint32_t box_count = uint32_t(boxes.size());
+
+    m_results.resize(box_count);
+
+    m_pool->parallel_for((box_count + kCullBatchSize - 1) / kCullBatchSize, [this, &boxes, box_count](uint32_t batch) {
+        const uint32_t end = std::min((batch + 1) * kCullBatchSize, box_count);
+
+        for (uint32_t i = batch * kCullBatchSize; i < end; i++)
+            m_results[i] = test(boxes[i]);
+    });
+
+    visible.resize(box_count);
+
+    m_stats.tested         = box_count;
+    m_stats.frustum_culled = 0;
+    m_stats.occluded       = 0;
+
+    for (uint32_t i = 0; i < box_count; i++)
+    {
+        visible[i] = m_results[i] == OCCLUSION_VISIBLE;
+
+        m_stats.frustum_culled += m_results[i] == OCCLUSION_FRUSTUM_CULLED;
+        m_stats.occluded += m_results[i] == OCCLUSION_OCCLUDED;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void rasterize_occluders_reference(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::mat4& view_proj, uint32_t width, uint32_t height, std::vector<float>& depth)
+{
+    depth.assign(width * height, 1.0f);
+
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const glm::vec4 c0 = view_proj * glm::vec4(positions[indices[i + 0]], 1.0f);
+        const glm::vec4 c1 = view_proj * glm::vec4(positions[indices[i + 1]], 1.0f);
+        const glm::vec4 c2 = view_proj * glm::vec4(positions[indices[i + 2]], 1.0f);
+
+        OccluderTriangle triangle;
+
+        if (setup_triangle(c0, c1, c2, width, height, triangle))
+            rasterize_scalar(triangle, triangle.min_x, triangle.min_y, triangle.max_x, triangle.max_y, depth.data(), width);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+OcclusionResult test_box_reference(const std::vector<float>& depth, uint32_t width, uint32_t height, const glm::mat4& view_proj, const Aabb& box)
+{
+    int32_t         rect[4];
+    float           min_z;
+    OcclusionResult result;
+
+    if (!project_box(view_proj, box, width, height, rect, min_z, result))
+        return result;
+
+    for (int32_t y = rect[1]; y <= rect[3]; y++)
+    {
+        for (int32_t x = rect[0]; x <= rect[2]; x++)
+        {
+            if (min_z <= depth[y * width + x])
+                return OCCLUSION_VISIBLE;
+        }
+    }
+
+    return OCCLUSION_OCCLUDED;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+class ThreadPool;
+
+// Screen tiles the occluder triangles are binned into. The depth buffer must be a whole number of tiles.
+static const uint32_t kOcclusionTileWidth  = 32;
+static const uint32_t kOcclusionTileHeight = 16;
+
+struct OcclusionCullingSettings
+{
+    uint32_t width                  = 320;  // Depth buffer resolution.
+    uint32_t height                 = 192;
+    uint32_t max_occluders          = 64;   // Submeshes rasterized as occluders.
+    uint32_t max_occluder_triangles = 4096; // Submeshes with more triangles cost more to rasterize than they save.
+};
+
+struct Aabb
+{
+    glm::vec3 min_extents;
+    glm::vec3 max_extents;
+};
+
+// World space geometry of a submesh.
+struct SubmeshGeometry
+{
+    std::vector<glm::vec3> positions;
+    std::vector<uint32_t>  indices;
+    Aabb                   bounds;
+};
+
+enum OcclusionResult
+{
+    OCCLUSION_VISIBLE = 0,
+    OCCLUSION_FRUSTUM_CULLED,
+    OCCLUSION_OCCLUDED
+};
+
+struct OcclusionCullingStats
+{
+    uint32_t occluder_triangles   = 0; // Triangles submitted.
+    uint32_t rasterized_triangles = 0; // Triangles left after rejecting degenerate, off-screen and near plane crossing ones.
+    uint32_t bin_entries          = 0; // Sum over those triangles of the tiles they overlap.
+    uint32_t tested               = 0;
+    uint32_t frustum_culled       = 0;
+    uint32_t occluded             = 0;
+};
+
+// Screen space setup of an occluder triangle. Edge functions and depth are planes evaluated at pixel centres.
+struct OccluderTriangle
+{
+    float   edge_a[3];
+    float   edge_b[3];
+    float   edge_c[3];
+    float   z_a;
+    float   z_b;
+    float   z_c;
+    int32_t min_x; // Inclusive pixel bounds, clamped to the screen.
+    int32_t min_y;
+    int32_t max_x;
+    int32_t max_y;
+};
+
+// Picks the candidates that cover the largest area, skipping the ones with more than 'max_triangles' triangles.
+// Candidates must be opaque, holes in alpha tested geometry don't occlude anything.
+std::vector<uint32_t> select_occluders(const std::vector<SubmeshGeometry>& submeshes, const std::vector<uint32_t>& candidates, uint32_t max_occluders, uint32_t max_triangles);
+
+// Software occlusion culling: a handful of large occluders are rasterized on the CPU into a low resolution
+// depth buffer, and bounding boxes are tested against a max-depth hierarchy built from it. Triangles are binned
+// into screen tiles by several threads and the tiles are rasterized in parallel, eight pixels at a time when
+// compiled with AVX2. Anything that can't be resolved conservatively, such as geometry crossing the near
+// plane, is treated as visible.
+class OcclusionCuller
+{
+public:
+    OcclusionCuller(ThreadPool* pool, const OcclusionCullingSettings& settings = OcclusionCullingSettings());
+
+    // Merges the given submeshes into a single occluder triangle list.
+    void set_occluders(const std::vector<SubmeshGeometry>& submeshes, const std::vector<uint32_t>& occluders);
+
+    // Rasterizes the occluders and rebuilds the depth hierarchy.
+    void render(const glm::mat4& view_proj);
+
+    // Tests a world space box against the depth of the last render().
+    OcclusionResult test(const Aabb& box) const;
+
+    // Tests every box, 'visible' receives 1 for the ones that need to be drawn.
+    void cull(const std::vector<Aabb>& boxes, std::vector<uint8_t>& visible);
+
+    inline const std::vector<float>&       depth() const { return m_hiz[0]; }
+    inline const OcclusionCullingStats&    stats() const { return m_stats; }
+    inline const OcclusionCullingSettings& settings() const { return m_settings; }
+    inline uint32_t                        hiz_levels() const { return uint32_t(m_hiz.size()); }
+
+private:
+    void bin_triangles(uint32_t job, uint32_t job_count);
+    void rasterize_tile(uint32_t tile, uint32_t job_count);
+    void build_hiz();
+
+private:
+    ThreadPool*                        m_pool;
+    OcclusionCullingSettings           m_settings;
+    uint32_t                           m_tiles_x;
+    uint32_t                           m_tiles_y;
+    glm::mat4                          m_view_proj;
+    std::vector<glm::vec3>             m_positions;
+    std::vector<uint32_t>              m_indices;
+    std::vector<glm::vec4>             m_clip_positions;
+    std::vector<OccluderTriangle>      m_triangles;
+    std::vector<std::vector<uint32_t>> m_bins; // Triangles per tile, one set of tiles per binning job.
+    std::vector<std::vector<float>>    m_hiz;  // Level 0 is the rasterized depth, every level after it keeps the max of 2x2 texels.
+    std::vector<OcclusionResult>       m_results;
+    OcclusionCullingStats              m_stats;
+};
+
+// Scalar reference of OcclusionCuller::render(): every triangle is rasterized over the whole buffer one pixel
+// at a time. Produces exactly the same depth.
+void rasterize_occluders_reference(const std::vector<glm::vec3>& positions, const std::vector<uint32_t>& indices, const glm::mat4& view_proj, uint32_t width, uint32_t height, std::vector<float>& depth);
+
+// Reference of OcclusionCuller::test(): compares the box against every pixel of its footprint instead of the
+// depth hierarchy. The hierarchy is coarser, so it may keep boxes this culls but never the other way around.
+OcclusionResult test_box_reference(const std::vector<float>& depth, uint32_t width, uint32_t height, const glm::mat4& view_proj, const Aabb& box);
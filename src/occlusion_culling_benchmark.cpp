@@ -0,0 +1,274 @@
+#include "occlusion_culling.h"
+#include "thread_pool.h"
+
+#include <gtc/matrix_transform.hpp>
+#include <chrono>
+#include <cmath>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+// Standalone benchmark of the software occlusion culler. Renders a procedural interior from a set of views
+// with the tiled multithreaded rasterizer and the scalar reference, checks that both agree and reports the
+// time taken by each along with how much the culler removed.
+//
+// Usage: OcclusionCullingBenchmark [--views N] [--threads N] [--occluders N] [--width N] [--height N]
+
+// Rooms along each axis of the generated floor, and their size.
+static const uint32_t kRoomCount = 8;
+static const float    kRoomSize  = 400.0f;
+static const float    kRoomWall  = 10.0f;
+static const float    kRoomDoor  = 80.0f;
+static const float    kCeiling   = 300.0f;
+
+// Furniture boxes per room.
+static const uint32_t kPropsPerRoom = 24;
+
+typedef std::chrono::high_resolution_clock Clock;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static double elapsed_ms(const Clock::time_point& start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float next_random(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return float(seed >> 8) / 16777216.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static SubmeshGeometry make_box(const glm::vec3& min_extents, const glm::vec3& max_extents)
+{
+    static const uint32_t kFaces[36] = { 0, 1, 3, 0, 3, 2, 4, 6, 7, 4, 7, 5, 0, 4, 5, 0, 5, 1, 2, 3, 7, 2, 7, 6, 0, 2, 6, 0, 6, 4, 1, 5, 7, 1, 7, 3 };
+
+    SubmeshGeometry box;
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        box.positions.push_back(glm::vec3(i & 1 ? max_extents.x : min_extents.x,
+                                          i & 2 ? max_extents.y : min_extents.y,
+                                          i & 4 ? max_extents.z : min_extents.z));
+    }
+
+    box.indices.assign(kFaces, kFaces + 36);
+
+    box.bounds.min_extents = min_extents;
+    box.bounds.max_extents = max_extents;
+
+    return box;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A grid of rooms connected by doorways in the middle of every wall, each room filled with furniture. Walls,
+// floors and ceilings are the occluder candidates.
+static void generate_interior(std::vector<SubmeshGeometry>& submeshes, std::vector<uint32_t>& candidates)
+{
+    uint32_t seed = 1337;
+
+    const float extent = kRoomSize * float(kRoomCount);
+
+    submeshes.push_back(make_box(glm::vec3(0.0f, -kRoomWall, 0.0f), glm::vec3(extent, 0.0f, extent)));
+    submeshes.push_back(make_box(glm::vec3(0.0f, kCeiling, 0.0f), glm::vec3(extent, kCeiling + kRoomWall, extent)));
+
+    for (uint32_t i = 0; i <= kRoomCount; i++)
+    {
+        const float p = float(i) * kRoomSize;
+
+        for (uint32_t j = 0; j < kRoomCount; j++)
+        {
+            const float start  = float(j) * kRoomSize;
+            const float centre = start + kRoomSize * 0.5f;
+
+            // Two wall segments on either side of a doorway, the outer walls are closed.
+            if (i == 0 || i == kRoomCount)
+            {
+                submeshes.push_back(make_box(glm::vec3(p - kRoomWall, 0.0f, start), glm::vec3(p + kRoomWall, kCeiling, start + kRoomSize)));
+                submeshes.push_back(make_box(glm::vec3(start, 0.0f, p - kRoomWall), glm::vec3(start + kRoomSize, kCeiling, p + kRoomWall)));
+            }
+            else
+            {
+                submeshes.push_back(make_box(glm::vec3(p - kRoomWall, 0.0f, start), glm::vec3(p + kRoomWall, kCeiling, centre - kRoomDoor * 0.5f)));
+                submeshes.push_back(make_box(glm::vec3(p - kRoomWall, 0.0f, centre + kRoomDoor * 0.5f), glm::vec3(p + kRoomWall, kCeiling, start + kRoomSize)));
+                submeshes.push_back(make_box(glm::vec3(start, 0.0f, p - kRoomWall), glm::vec3(centre - kRoomDoor * 0.5f, kCeiling, p + kRoomWall)));
+                submeshes.push_back(make_box(glm::vec3(centre + kRoomDoor * 0.5f, 0.0f, p - kRoomWall), glm::vec3(start + kRoomSize, kCeiling, p + kRoomWall)));
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < uint32_t(submeshes.size()); i++)
+        candidates.push_back(i);
+
+    for (uint32_t z = 0; z < kRoomCount; z++)
+    {
+        for (uint32_t x = 0; x < kRoomCount; x++)
+        {
+            for (uint32_t i = 0; i < kPropsPerRoom; i++)
+            {
+                const glm::vec3 size   = glm::vec3(10.0f + 40.0f * next_random(seed), 10.0f + 80.0f * next_random(seed), 10.0f + 40.0f * next_random(seed));
+                const glm::vec3 corner = glm::vec3(float(x) * kRoomSize + kRoomWall + (kRoomSize - 2.0f * kRoomWall - size.x) * next_random(seed),
+                                                   0.0f,
+                                                   float(z) * kRoomSize + kRoomWall + (kRoomSize - 2.0f * kRoomWall - size.z) * next_random(seed));
+
+                submeshes.push_back(make_box(corner, corner + size));
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+    uint32_t                 view_count = 64;
+    uint32_t                 threads    = 0;
+    OcclusionCullingSettings settings;
+
+    // Every wall of the generated floor is a cheap box, so afford more occluders than a scanned mesh would.
+    settings.max_occluders = 512;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--views") == 0 && i + 1 < argc)
+            view_count = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--occluders") == 0 && i + 1 < argc)
+            settings.max_occluders = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+            settings.width = uint32_t(atoi(argv[++i]));
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+            settings.height = uint32_t(atoi(argv[++i]));
+    }
+
+    std::vector<SubmeshGeometry> submeshes;
+    std::vector<uint32_t>        candidates;
+
+    generate_interior(submeshes, candidates);
+
+    std::vector<Aabb> boxes;
+
+    for (const auto& submesh : submeshes)
+        boxes.push_back(submesh.bounds);
+
+    ThreadPool      pool(threads);
+    OcclusionCuller culler(&pool, settings);
+
+    const std::vector<uint32_t> occluders = select_occluders(submeshes, candidates, settings.max_occluders, settings.max_occluder_triangles);
+
+    culler.set_occluders(submeshes, occluders);
+
+    // The reference rasterizes the same merged triangle list.
+    std::vector<glm::vec3> occluder_positions;
+    std::vector<uint32_t>  occluder_indices;
+
+    for (uint32_t idx : occluders)
+    {
+        const uint32_t base_vertex = uint32_t(occluder_positions.size());
+
+        occluder_positions.insert(occluder_positions.end(), submeshes[idx].positions.begin(), submeshes[idx].positions.end());
+
+        for (uint32_t index : submeshes[idx].indices)
+            occluder_indices.push_back(base_vertex + index);
+    }
+
+    const uint32_t  width      = culler.settings().width;
+    const uint32_t  height     = culler.settings().height;
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), float(width) / float(height), 1.0f, 10000.0f);
+
+    std::vector<float>   reference_depth;
+    std::vector<uint8_t> visible;
+
+    double   culler_ms         = 0.0;
+    double   reference_ms      = 0.0;
+    uint64_t depth_mismatches  = 0;
+    uint64_t false_culls       = 0; // Boxes the culler removed that the reference keeps, must be zero.
+    uint64_t conservative_keep = 0; // Boxes only the reference removed, the cost of testing against the hierarchy.
+    uint64_t frustum_culled    = 0;
+    uint64_t occluded          = 0;
+    uint64_t reference_culled  = 0;
+
+    // Walk around the middle of the floor at eye height, looking in a slowly turning direction.
+    for (uint32_t v = 0; v < view_count; v++)
+    {
+        const float     t      = float(v) / float(view_count) * 6.2831853f;
+        const float     centre = kRoomSize * float(kRoomCount) * 0.5f;
+        const glm::vec3 eye    = glm::vec3(centre + std::cos(t) * kRoomSize * 2.5f, 160.0f, centre + std::sin(t) * kRoomSize * 2.5f);
+        const glm::vec3 dir    = glm::vec3(std::cos(t * 3.0f), -0.1f, std::sin(t * 3.0f));
+
+        const glm::mat4 view_proj = projection * glm::lookAt(eye, eye + dir, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        Clock::time_point start = Clock::now();
+
+        culler.render(view_proj);
+        culler.cull(boxes, visible);
+
+        culler_ms += elapsed_ms(start);
+
+        frustum_culled += culler.stats().frustum_culled;
+        occluded += culler.stats().occluded;
+
+        start = Clock::now();
+
+        rasterize_occluders_reference(occluder_positions, occluder_indices, view_proj, width, height, reference_depth);
+
+        std::vector<OcclusionResult> reference_results(boxes.size());
+
+        for (size_t i = 0; i < boxes.size(); i++)
+            reference_results[i] = test_box_reference(reference_depth, width, height, view_proj, boxes[i]);
+
+        reference_ms += elapsed_ms(start);
+
+        const std::vector<float>& depth = culler.depth();
+
+        for (size_t i = 0; i < depth.size(); i++)
+            depth_mismatches += depth[i] != reference_depth[i];
+
+        for (size_t i = 0; i < boxes.size(); i++)
+        {
+            const bool reference_visible = reference_results[i] == OCCLUSION_VISIBLE;
+
+            reference_culled += !reference_visible;
+
+            if (visible[i] && !reference_visible)
+                conservative_keep++;
+            else if (!visible[i] && reference_visible)
+                false_culls++;
+        }
+    }
+
+    const double box_tests = double(boxes.size()) * double(view_count);
+
+    printf("Occluders           : %u submeshes, %u triangles\n", uint32_t(occluders.size()), culler.stats().occluder_triangles);
+    printf("Boxes               : %u per view, %u views\n", uint32_t(boxes.size()), view_count);
+    printf("Depth buffer        : %ux%u, %u hierarchy levels\n", width, height, culler.hiz_levels());
+#if defined(__AVX2__)
+    printf("Rasterizer          : AVX2, %u threads\n", pool.thread_count());
+#else
+    printf("Rasterizer          : scalar, %u threads\n", pool.thread_count());
+#endif
+    printf("Culler              : %.3f ms per view\n", culler_ms / double(view_count));
+    printf("Scalar reference    : %.3f ms per view (%.2fx)\n", reference_ms / double(view_count), culler_ms > 0.0 ? reference_ms / culler_ms : 0.0);
+    printf("Frustum culled      : %.1f%%\n", 100.0 * double(frustum_culled) / box_tests);
+    printf("Occluded            : %.1f%% (reference %.1f%% including frustum)\n", 100.0 * double(occluded) / box_tests, 100.0 * double(reference_culled) / box_tests);
+    printf("Hierarchy keeps     : %llu boxes the reference culls\n", (unsigned long long)conservative_keep);
+    printf("Depth mismatches    : %llu pixels\n", (unsigned long long)depth_mismatches);
+    printf("False culls         : %llu boxes\n", (unsigned long long)false_culls);
+
+    if (depth_mismatches != 0 || false_culls != 0)
+    {
+        printf("FAILED: the culler disagrees with the scalar reference\n");
+        return 1;
+    }
+
+    printf("PASSED\n");
+
+    return 0;
+}
@@ -0,0 +1,371 @@
+#include "opacity_baker.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#endif
+
+// Triangles classified per parallel job.
+static const uint32_t kBakeBatchSize = 256;
+
+// Footprints larger than this many texels, which only happen for UVs tiling the texture many times over, are
+// classified as mixed without looking at them.
+static const uint64_t kMaxFootprintTexels = 1 << 22;
+
+static const uint32_t kSawOpaque      = 1;
+static const uint32_t kSawTransparent = 2;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Edge functions of a triangle in texel space, offset so that they are non-negative wherever a texel centre is
+// within bilinear reach of the triangle.
+struct FootprintEdges
+{
+    float a[3];
+    float b[3];
+    float c[3];
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static inline int32_t floor_div(int32_t value, int32_t divisor)
+{
+    return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Texels [x0, x1] of one row, all inside the same repetition of the texture so that 'row' can be indexed with
+// 'x - base'.
+static uint32_t classify_span_scalar(const FootprintEdges& edges, const uint8_t* row, int32_t base, int32_t x0, int32_t x1, float cy, uint8_t cutoff, uint64_t& tested)
+{
+    uint32_t seen = 0;
+
+    for (int32_t x = x0; x <= x1; x++)
+    {
+        const float cx = float(x) + 0.5f;
+
+        const float e0 = edges.a[0] * cx + edges.b[0] * cy + edges.c[0];
+        const float e1 = edges.a[1] * cx + edges.b[1] * cy + edges.c[1];
+        const float e2 = edges.a[2] * cx + edges.b[2] * cy + edges.c[2];
+
+        if (e0 >= 0.0f && e1 >= 0.0f && e2 >= 0.0f)
+        {
+            tested++;
+            seen |= row[x - base] < cutoff ? kSawTransparent : kSawOpaque;
+
+            if (seen == (kSawOpaque | kSawTransparent))
+                break;
+        }
+    }
+
+    return seen;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+#if defined(__AVX2__)
+
+static inline uint32_t count_bits(uint32_t value)
+{
+    value = value - ((value >> 1) & 0x55555555);
+    value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+
+    return (((value + (value >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Eight texels at a time, the remainder of the span goes through the scalar path.
+static uint32_t classify_span_avx2(const FootprintEdges& edges, const uint8_t* row, int32_t base, int32_t x0, int32_t x1, float cy, uint8_t cutoff, uint64_t& tested)
+{
+    const __m256  lane_offsets = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256  zero         = _mm256_setzero_ps();
+    const __m128i pass_min     = _mm_set1_epi8(char(cutoff));
+
+    __m256 edge_a[3];
+    __m256 edge_row[3];
+
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        edge_a[i]   = _mm256_set1_ps(edges.a[i]);
+        edge_row[i] = _mm256_set1_ps(edges.b[i] * cy + edges.c[i]);
+    }
+
+    uint32_t seen = 0;
+    int32_t  x    = x0;
+
+    for (; x + 7 <= x1; x += 8)
+    {
+        const __m256 cx = _mm256_add_ps(_mm256_set1_ps(float(x)), lane_offsets);
+
+        const __m256 e0 = _mm256_add_ps(_mm256_mul_ps(edge_a[0], cx), edge_row[0]);
+        const __m256 e1 = _mm256_add_ps(_mm256_mul_ps(edge_a[1], cx), edge_row[1]);
+        const __m256 e2 = _mm256_add_ps(_mm256_mul_ps(edge_a[2], cx), edge_row[2]);
+
+        const __m256   inside  = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(e0, zero, _CMP_GE_OQ), _mm256_cmp_ps(e1, zero, _CMP_GE_OQ)), _mm256_cmp_ps(e2, zero, _CMP_GE_OQ));
+        const uint32_t covered = uint32_t(_mm256_movemask_ps(inside));
+
+        if (covered == 0)
+            continue;
+
+        // Texels that pass are the ones equal to their maximum with the cutoff.
+        const __m128i  alpha  = _mm_loadl_epi64((const __m128i*)(row + x - base));
+        const uint32_t passed = uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(alpha, pass_min), alpha))) & 0xff;
+
+        tested += count_bits(covered);
+
+        if (covered & passed)
+            seen |= kSawOpaque;
+
+        if (covered & ~passed)
+            seen |= kSawTransparent;
+
+        if (seen == (kSawOpaque | kSawTransparent))
+            return seen;
+    }
+
+    if (x <= x1)
+        seen |= classify_span_scalar(edges, row, base, x, x1, cy, cutoff, tested);
+
+    return seen;
+}
+
+#endif
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static inline uint32_t classify_span(const FootprintEdges& edges, const uint8_t* row, int32_t base, int32_t x0, int32_t x1, float cy, uint8_t cutoff, uint64_t& tested)
+{
+#if defined(__AVX2__)
+    return classify_span_avx2(edges, row, base, x0, x1, cy, cutoff, tested);
+#else
+    return classify_span_scalar(edges, row, base, x0, x1, cy, cutoff, tested);
+#endif
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void analyze_opacity_texture(OpacityTexture& texture, uint8_t cutoff)
+{
+    texture.has_opaque      = false;
+    texture.has_transparent = false;
+
+    for (uint8_t alpha : texture.alpha)
+    {
+        if (alpha < cutoff)
+            texture.has_transparent = true;
+        else
+            texture.has_opaque = true;
+
+        if (texture.has_opaque && texture.has_transparent)
+            break;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TriangleOpacity classify_triangle_opacity(const OpacityTexture& texture, const glm::vec2& uv0, const glm::vec2& uv1, const glm::vec2& uv2, uint8_t cutoff, uint64_t* tested)
+{
+    // Textures that don't mix both kinds of texels decide for every triangle.
+    if (texture.alpha.empty())
+        return TRIANGLE_OPACITY_MIXED;
+
+    if (!texture.has_transparent)
+        return TRIANGLE_OPACITY_OPAQUE;
+
+    if (!texture.has_opaque)
+        return TRIANGLE_OPACITY_TRANSPARENT;
+
+    const glm::vec2 size = glm::vec2(float(texture.width), float(texture.height));
+    const glm::vec2 p[3] = { uv0 * size, uv1 * size, uv2 * size };
+
+    if (!std::isfinite(p[0].x + p[0].y + p[1].x + p[1].y + p[2].x + p[2].y))
+        return TRIANGLE_OPACITY_MIXED;
+
+    // Bilinear filtering reads the texels whose centre is less than a texel away from the sample on each axis.
+    const glm::vec2 min_p = glm::min(glm::min(p[0], p[1]), p[2]);
+    const glm::vec2 max_p = glm::max(glm::max(p[0], p[1]), p[2]);
+
+    if (double(max_p.x - min_p.x + 3.0f) * double(max_p.y - min_p.y + 3.0f) > double(kMaxFootprintTexels))
+        return TRIANGLE_OPACITY_MIXED;
+
+    const int32_t x0 = int32_t(std::floor(min_p.x - 1.5f));
+    const int32_t y0 = int32_t(std::floor(min_p.y - 1.5f));
+    const int32_t x1 = int32_t(std::ceil(max_p.x + 0.5f));
+    const int32_t y1 = int32_t(std::ceil(max_p.y + 0.5f));
+
+    FootprintEdges edges;
+
+    const float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[1].y - p[0].y) * (p[2].x - p[0].x);
+
+    if (std::abs(area) < 1e-6f)
+    {
+        // Degenerate in UV space: every texel of the bounds.
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            edges.a[i] = 0.0f;
+            edges.b[i] = 0.0f;
+            edges.c[i] = 0.0f;
+        }
+    }
+    else
+    {
+        const float sign = area > 0.0f ? 1.0f : -1.0f;
+
+        // Edge i runs from vertex i to the next one and is positive inside. Offsetting it by its gradient's L1
+        // norm keeps every texel centre within a texel of the triangle on both axes.
+        for (uint32_t i = 0; i < 3; i++)
+        {
+            const glm::vec2& from = p[i];
+            const glm::vec2& to   = p[(i + 1) % 3];
+
+            edges.a[i] = -sign * (to.y - from.y);
+            edges.b[i] = sign * (to.x - from.x);
+            edges.c[i] = -(edges.a[i] * from.x + edges.b[i] * from.y) + std::abs(edges.a[i]) + std::abs(edges.b[i]);
+        }
+    }
+
+    const int32_t width  = int32_t(texture.width);
+    const int32_t height = int32_t(texture.height);
+
+    uint64_t texels_tested = 0;
+    uint32_t seen          = 0;
+
+    for (int32_t y = y0; y <= y1 && seen != (kSawOpaque | kSawTransparent); y++)
+    {
+        const int32_t  wrapped_y = y - floor_div(y, height) * height;
+        const uint8_t* row       = &texture.alpha[size_t(wrapped_y) * texture.width];
+        const float    cy        = float(y) + 0.5f;
+
+        // Split the row where it wraps around the texture so that every span is contiguous in memory.
+        for (int32_t x = x0; x <= x1 && seen != (kSawOpaque | kSawTransparent);)
+        {
+            const int32_t base = floor_div(x, width) * width;
+            const int32_t end  = std::min(x1, base + width - 1);
+
+            seen |= classify_span(edges, row, base, x, end, cy, cutoff, texels_tested);
+
+            x = end + 1;
+        }
+    }
+
+    if (tested)
+        *tested += texels_tested;
+
+    if (seen == (kSawOpaque | kSawTransparent))
+        return TRIANGLE_OPACITY_MIXED;
+
+    // A footprint without any texel can't happen with the reach above, but stays safe if it does.
+    if (seen == kSawOpaque)
+        return TRIANGLE_OPACITY_OPAQUE;
+
+    if (seen == kSawTransparent)
+        return TRIANGLE_OPACITY_TRANSPARENT;
+
+    return TRIANGLE_OPACITY_MIXED;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+OpacityBakeStats bake_triangle_opacity(ThreadPool* pool, const std::vector<OpacitySubmesh>& submeshes, const std::vector<OpacityTexture>& textures, uint8_t cutoff, std::vector<uint8_t>& opacity)
+{
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    struct Job
+    {
+        uint32_t submesh;
+        uint32_t first;
+        uint32_t count;
+    };
+
+    std::vector<Job> jobs;
+
+    for (uint32_t i = 0; i < submeshes.size(); i++)
+    {
+        const uint32_t triangle_count = uint32_t(submeshes[i].indices.size() / 3);
+
+        for (uint32_t first = 0; first < triangle_count; first += kBakeBatchSize)
+            jobs.push_back({ i, first, std::min(kBakeBatchSize, triangle_count - first) });
+    }
+
+    std::vector<OpacityBakeStats> job_stats(jobs.size());
+
+    pool->parallel_for(uint32_t(jobs.size()), [&](uint32_t job_idx) {
+        const Job&            job     = jobs[job_idx];
+        const OpacitySubmesh& submesh = submeshes[job.submesh];
+        OpacityBakeStats&     stats   = job_stats[job_idx];
+
+        for (uint32_t i = job.first; i < job.first + job.count; i++)
+        {
+            TriangleOpacity result = TRIANGLE_OPACITY_MIXED;
+
+            if (submesh.texture < textures.size())
+            {
+                const glm::vec2& uv0 = submesh.tex_coords[submesh.indices[3 * i]];
+                const glm::vec2& uv1 = submesh.tex_coords[submesh.indices[3 * i + 1]];
+                const glm::vec2& uv2 = submesh.tex_coords[submesh.indices[3 * i + 2]];
+
+                result = classify_triangle_opacity(textures[submesh.texture], uv0, uv1, uv2, cutoff, &stats.texels_tested);
+            }
+
+            opacity[submesh.first_triangle + i] = uint8_t(result);
+
+            stats.triangles++;
+
+            if (result == TRIANGLE_OPACITY_OPAQUE)
+                stats.opaque++;
+            else if (result == TRIANGLE_OPACITY_TRANSPARENT)
+                stats.transparent++;
+            else
+                stats.mixed++;
+        }
+    });
+
+    OpacityBakeStats stats;
+
+    for (const OpacityBakeStats& job : job_stats)
+    {
+        stats.triangles += job.triangles;
+        stats.opaque += job.opaque;
+        stats.transparent += job.transparent;
+        stats.mixed += job.mixed;
+        stats.texels_tested += job.texels_tested;
+    }
+
+    stats.bake_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<uint32_t> pack_triangle_opacity(const std::vector<uint8_t>& opacity)
+{
+    std::vector<uint32_t> packed((opacity.size() + 15) / 16, 0);
+
+    for (size_t i = 0; i < opacity.size(); i++)
+        packed[i / 16] |= uint32_t(opacity[i] & 3) << ((i % 16) * 2);
+
+    return packed;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint8_t opacity_cutoff(float alpha_cutoff)
+{
+    // The first value the shaders' 'alpha < cutoff' test lets through.
+    for (uint32_t value = 0; value < 256; value++)
+    {
+        if (float(value) / 255.0f >= alpha_cutoff)
+            return uint8_t(value);
+    }
+
+    return 255;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
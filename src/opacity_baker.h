@@ -0,0 +1,62 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+class ThreadPool;
+
+// Must match alpha_test.rahit.
+enum TriangleOpacity
+{
+    TRIANGLE_OPACITY_OPAQUE      = 0, // No texel of the footprint fails the alpha test, hits are accepted as is.
+    TRIANGLE_OPACITY_TRANSPARENT = 1, // Every texel of the footprint fails the alpha test, hits are ignored.
+    TRIANGLE_OPACITY_MIXED       = 2, // Needs the alpha test at the hit point.
+    TRIANGLE_OPACITY_HIDDEN      = 3  // Never baked. Set over the bind pose copy of a skinned triangle, hits are always ignored.
+};
+
+// Alpha channel of an albedo map, top row first.
+struct OpacityTexture
+{
+    uint32_t             width           = 0;
+    uint32_t             height          = 0;
+    std::vector<uint8_t> alpha;
+    bool                 has_opaque      = false; // Any texel passes the alpha test.
+    bool                 has_transparent = false; // Any texel fails it.
+};
+
+struct OpacitySubmesh
+{
+    std::vector<glm::vec2> tex_coords;
+    std::vector<uint32_t>  indices;
+    uint32_t               texture        = UINT32_MAX; // UINT32_MAX: no texture, every triangle is mixed.
+    uint32_t               first_triangle = 0;          // Where the submesh's triangles start in the output.
+};
+
+struct OpacityBakeStats
+{
+    uint32_t triangles     = 0;
+    uint32_t opaque        = 0;
+    uint32_t transparent   = 0;
+    uint32_t mixed         = 0;
+    uint64_t texels_tested = 0;
+    float    bake_ms       = 0.0f;
+};
+
+// Fills in 'has_opaque' and 'has_transparent'. Alpha values below 'cutoff' fail the alpha test.
+void analyze_opacity_texture(OpacityTexture& texture, uint8_t cutoff);
+
+// Classifies a triangle from the texels its UV footprint can reach with bilinear filtering at the top mip, which
+// is what the any-hit shader samples. Texture coordinates wrap. Returns the number of texels tested in 'tested'.
+TriangleOpacity classify_triangle_opacity(const OpacityTexture& texture, const glm::vec2& uv0, const glm::vec2& uv1, const glm::vec2& uv2, uint8_t cutoff, uint64_t* tested = nullptr);
+
+// Classifies every triangle of 'submeshes' on the threads of 'pool', writing one TriangleOpacity per triangle to
+// 'opacity' at the submesh's 'first_triangle'. 'opacity' must already be large enough and is left untouched
+// where no submesh writes.
+OpacityBakeStats bake_triangle_opacity(ThreadPool* pool, const std::vector<OpacitySubmesh>& submeshes, const std::vector<OpacityTexture>& textures, uint8_t cutoff, std::vector<uint8_t>& opacity);
+
+// Two bits per triangle, sixteen triangles per word, as the any-hit shader reads them.
+std::vector<uint32_t> pack_triangle_opacity(const std::vector<uint8_t>& opacity);
+
+// Alpha cutoff of the shaders converted to the 8-bit texel values that fail it.
+uint8_t opacity_cutoff(float alpha_cutoff);
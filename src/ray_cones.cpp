@@ -0,0 +1,51 @@
+#include "ray_cones.h"
+
+#include <algorithm>
+#include <cmath>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float pixel_spread_angle(const glm::mat4& proj_inverse, float height)
+{
+    // The inverse projection scales NDC y by tan(fov_y / 2).
+    return std::atan(2.0f * std::abs(proj_inverse[1][1]) / height);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float surface_spread_angle(const glm::vec3& dp_dx, const glm::vec3& dp_dy, const glm::vec3& dn_dx, const glm::vec3& dn_dy)
+{
+    // A reflected direction turns twice as far as the normal it reflects off.
+    const float curvature = std::sqrt(glm::dot(dn_dx, dn_dx) + glm::dot(dn_dy, dn_dy));
+    const float sign      = glm::dot(dp_dx, dn_dx) + glm::dot(dp_dy, dn_dy) < 0.0f ? -1.0f : 1.0f;
+
+    return 2.0f * sign * curvature;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float ray_cone_width(float width, float spread, float t)
+{
+    return width + spread * t;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float triangle_lod_constant(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec2& uv0, const glm::vec2& uv1, const glm::vec2& uv2)
+{
+    // Both areas are doubled, which cancels out.
+    const float world_area = glm::length(glm::cross(p1 - p0, p2 - p0));
+    const float uv_area    = std::abs((uv1.x - uv0.x) * (uv2.y - uv0.y) - (uv2.x - uv0.x) * (uv1.y - uv0.y));
+
+    return 0.5f * std::log2(std::max(uv_area, 1e-12f) / std::max(world_area, 1e-12f));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+float ray_cone_lod(float lod_constant, const glm::vec2& texture_size, float width, float cos_incidence)
+{
+    // Grazing hits stretch the footprint along the surface.
+    return lod_constant + 0.5f * std::log2(texture_size.x * texture_size.y) + std::log2(std::max(std::abs(width), 1e-8f) / std::max(std::abs(cos_incidence), 1e-4f));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
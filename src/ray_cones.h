@@ -0,0 +1,22 @@
+#pragma once
+
+#include <glm.hpp>
+
+// Ray cone texture LOD selection for the reflection hits. Must match ray_cones.glsl, so that the LOD picked on the
+// GPU can be reproduced on the CPU.
+
+// Angle covered by one pixel of a render target 'height' pixels tall.
+float pixel_spread_angle(const glm::mat4& proj_inverse, float height);
+
+// Spread a mirror reflection adds to a cone from the position and normal differences to the neighbouring pixels.
+// Positive on convex surfaces, which widen the cone, negative on concave ones.
+float surface_spread_angle(const glm::vec3& dp_dx, const glm::vec3& dp_dy, const glm::vec3& dn_dx, const glm::vec3& dn_dy);
+
+// Width of a cone 't' along a ray that left a surface where the cone was 'width' wide.
+float ray_cone_width(float width, float spread, float t);
+
+// Texture independent part of the LOD of a triangle: half the log2 ratio of its UV area to its world space area.
+float triangle_lod_constant(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2, const glm::vec2& uv0, const glm::vec2& uv1, const glm::vec2& uv2);
+
+// Mip level of a 'texture_size' texture for a cone 'width' wide landing at 'cos_incidence' to the surface.
+float ray_cone_lod(float lod_constant, const glm::vec2& texture_size, float width, float cos_incidence);
@@ -0,0 +1,470 @@
+#include "ray_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Ray parameters used by the ray generation shaders.
+static const float kShadowRayBias = 0.1f;
+static const float kRayTMin       = 0.001f;
+static const float kRayTMax       = 10000.0f;
+
+static const float kPi = 3.14159265359f;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RayStats RayStats::unpack(const uint32_t* counters)
+{
+    RayStats stats;
+
+    stats.shadow.rays            = counters[RAY_STAT_SHADOW_RAYS];
+    stats.shadow.hits            = counters[RAY_STAT_SHADOW_HITS];
+    stats.shadow.misses          = counters[RAY_STAT_SHADOW_MISSES];
+    stats.reflection.rays        = counters[RAY_STAT_REFLECTION_RAYS];
+    stats.reflection.hits        = counters[RAY_STAT_REFLECTION_HITS];
+    stats.reflection.misses      = counters[RAY_STAT_REFLECTION_MISSES];
+    stats.light.rays             = counters[RAY_STAT_LIGHT_RAYS];
+    stats.light.hits             = counters[RAY_STAT_LIGHT_HITS];
+    stats.light.misses           = counters[RAY_STAT_LIGHT_MISSES];
+    stats.shadow_penumbra_pixels = counters[RAY_STAT_SHADOW_PENUMBRA_PIXELS];
+    stats.shadow_traced_pixels   = counters[RAY_STAT_SHADOW_TRACED_PIXELS];
+    stats.reflection_subgroups   = counters[RAY_STAT_REFLECTION_SHADE_SUBGROUPS];
+    stats.reflection_batches     = counters[RAY_STAT_REFLECTION_SHADE_BATCHES];
+    stats.ssr_pixels             = counters[RAY_STAT_SSR_PIXELS];
+    stats.ssr_hits               = counters[RAY_STAT_SSR_HITS];
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same hash as pcg_hash() in common.glsl.
+static uint32_t pcg_hash(uint32_t v)
+{
+    uint32_t state = v * 747796405u + 2891336453u;
+    uint32_t word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint32_t random_seed(uint32_t x, uint32_t y, uint32_t frame)
+{
+    return pcg_hash(x + pcg_hash(y + pcg_hash(frame)));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float next_random(uint32_t& seed)
+{
+    seed = pcg_hash(seed);
+    return float(seed) / 4294967296.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same as sample_cone() in common.glsl.
+static glm::vec3 sample_cone(const glm::vec3& dir, float cos_theta_max, float u0, float u1)
+{
+    const float cos_theta = glm::mix(1.0f, cos_theta_max, u0);
+    const float sin_theta = std::sqrt(std::max(1.0f - cos_theta * cos_theta, 0.0f));
+    const float phi       = 2.0f * kPi * u1;
+
+    const glm::vec3 up        = std::fabs(dir.y) < 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    const glm::vec3 tangent   = glm::normalize(glm::cross(up, dir));
+    const glm::vec3 bitangent = glm::cross(dir, tangent);
+
+    return glm::normalize(tangent * (std::cos(phi) * sin_theta) + bitangent * (std::sin(phi) * sin_theta) + dir * cos_theta);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// The shadow visibility image is RG16F, so the refinement pass reads blocker distances rounded to half precision.
+static float round_to_half(float value)
+{
+    int         exponent = 0;
+    const float mantissa = std::frexp(value, &exponent);
+
+    return std::ldexp(std::round(std::ldexp(mantissa, 11)), exponent - 11);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Same as shadow_map_visibility() in shadow.rgen: -1 where the pixel has to trace a ray.
+static float shadow_map_visibility(const RayTracingFrame& frame, const glm::vec3& position, const glm::vec3& normal)
+{
+    const float view_depth = -(frame.view * glm::vec4(position, 1.0f)).z;
+
+    uint32_t cascade = 0;
+
+    while (cascade < kShadowCascadeCount && view_depth > frame.cascades[cascade].split_far)
+        cascade++;
+
+    if (cascade == kShadowCascadeCount)
+        return -1.0f;
+
+    const ShadowCascade& c          = frame.cascades[cascade];
+    const float          split_near = cascade == 0 ? 0.0f : frame.cascades[cascade - 1].split_far;
+
+    if (c.split_far - view_depth < (c.split_far - split_near) * frame.cascade_boundary_band)
+        return -1.0f;
+
+    const glm::vec4 light_clip = c.view_proj * glm::vec4(position + normal * c.texel_size, 1.0f);
+    const glm::vec3 light_ndc  = glm::vec3(light_clip) / light_clip.w;
+
+    const int32_t size = int32_t(frame.shadow_map_resolution);
+    const int32_t tx   = int32_t((light_ndc.x * 0.5f + 0.5f) * float(size));
+    const int32_t ty   = int32_t((light_ndc.y * 0.5f + 0.5f) * float(size));
+
+    if (tx < 1 || ty < 1 || tx >= size - 1 || ty >= size - 1)
+        return -1.0f;
+
+    const float  bias      = 2.0f * c.texel_size / c.depth_range;
+    const float  ambiguity = frame.depth_ambiguity_texels * c.texel_size / c.depth_range;
+    const float  contact   = frame.contact_hardening_distance / c.depth_range;
+    const float* layer     = &frame.shadow_map[size_t(cascade) * size * size];
+
+    float lit = 0.0f;
+
+    for (int32_t y = -1; y <= 1; y++)
+    {
+        for (int32_t x = -1; x <= 1; x++)
+        {
+            const float occluder = layer[(ty + y) * size + tx + x];
+            const float delta    = light_ndc.z - bias - occluder;
+
+            if (std::fabs(delta) < ambiguity || (delta > 0.0f && delta < contact))
+                return -1.0f;
+
+            lit += delta > 0.0f ? 0.0f : 1.0f;
+        }
+    }
+
+    if (lit > 0.0f && lit < 9.0f)
+        return -1.0f;
+
+    return lit / 9.0f;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// shadow.rgen followed by shadow_refine.rgen.
+static void trace_shadow_rays(const CpuRayTracer& tracer, const RayTracingFrame& frame, RayStats& stats)
+{
+    const int32_t width  = int32_t(frame.width);
+    const int32_t height = int32_t(frame.height);
+
+    // The shadow visibility image: visibility and blocker distance.
+    std::vector<glm::vec2> visibility(frame.g_buffer.size());
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const size_t         idx    = size_t(y) * width + x;
+            const GBufferSample& sample = frame.g_buffer[idx];
+
+            if (frame.hybrid_shadows)
+            {
+                const float v = shadow_map_visibility(frame, sample.position, sample.normal);
+
+                if (v >= 0.0f)
+                {
+                    visibility[idx] = glm::vec2(v, 0.0f);
+                    continue;
+                }
+            }
+
+            stats.shadow_traced_pixels++;
+
+            glm::vec3 direction = frame.light_dir;
+
+            if (frame.light_angular_radius > 0.0f)
+            {
+                uint32_t    seed = random_seed(x, y, frame.frame);
+                const float u0   = next_random(seed);
+                const float u1   = next_random(seed);
+
+                direction = sample_cone(direction, std::cos(frame.light_angular_radius), u0, u1);
+            }
+
+            stats.shadow.rays++;
+
+            CpuRayTracer::Hit hit;
+
+            if (tracer.intersect(sample.position + frame.light_dir * kShadowRayBias, direction, kRayTMin, kRayTMax, hit))
+            {
+                stats.shadow.hits++;
+                visibility[idx] = glm::vec2(0.0f, round_to_half(hit.t));
+            }
+            else
+            {
+                stats.shadow.misses++;
+                visibility[idx] = glm::vec2(1.0f, 0.0f);
+            }
+        }
+    }
+
+    if (frame.light_angular_radius <= 0.0f)
+        return;
+
+    const float cos_theta_max = std::cos(frame.light_angular_radius);
+    const float tan_theta_max = std::tan(frame.light_angular_radius);
+
+    auto tap = [&](int32_t x, int32_t y) -> const glm::vec2& {
+        return visibility[size_t(glm::clamp(y, 0, height - 1)) * width + glm::clamp(x, 0, width - 1)];
+    };
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const GBufferSample& sample = frame.g_buffer[size_t(y) * width + x];
+
+            float blocker_dist = 0.0f;
+
+            for (int32_t dy = -1; dy <= 1; dy++)
+            {
+                for (int32_t dx = -1; dx <= 1; dx++)
+                {
+                    const glm::vec2& v = tap(x + dx, y + dy);
+
+                    if (v.x < 0.5f)
+                        blocker_dist = std::max(blocker_dist, v.y);
+                }
+            }
+
+            const float   view_depth  = std::fabs((frame.view * glm::vec4(sample.position, 1.0f)).z);
+            const float   pixel_size  = 2.0f * view_depth / (std::fabs(frame.projection[1][1]) * float(height));
+            const float   penumbra_px = 2.0f * blocker_dist * tan_theta_max / std::max(pixel_size, 1e-6f);
+            const int32_t radius      = int32_t(glm::clamp(penumbra_px, 1.0f, float(frame.max_penumbra_radius)));
+
+            float sum    = 0.0f;
+            float sum_sq = 0.0f;
+
+            for (int32_t dy = -1; dy <= 1; dy++)
+            {
+                for (int32_t dx = -1; dx <= 1; dx++)
+                {
+                    const float v = tap(x + dx * radius, y + dy * radius).x;
+
+                    sum += v;
+                    sum_sq += v * v;
+                }
+            }
+
+            const float mean     = sum / 9.0f;
+            const float variance = sum_sq / 9.0f - mean * mean;
+
+            if (variance <= frame.penumbra_variance_threshold)
+                continue;
+
+            stats.shadow_penumbra_pixels++;
+
+            const glm::vec3 origin = sample.position + frame.light_dir * kShadowRayBias;
+
+            uint32_t seed = random_seed(x, y, frame.frame + 0x9e3779b9u);
+
+            for (uint32_t i = 0; i < frame.penumbra_rays; i++)
+            {
+                const float     u0        = next_random(seed);
+                const float     u1        = next_random(seed);
+                const glm::vec3 direction = sample_cone(frame.light_dir, cos_theta_max, u0, u1);
+
+                stats.shadow.rays++;
+
+                if (tracer.occluded(origin, direction, kRayTMin, kRayTMax))
+                    stats.shadow.hits++;
+                else
+                    stats.shadow.misses++;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// reflection.rgen, and the mirror pixels ssr.comp marches before it.
+static void trace_reflection_rays(const CpuRayTracer& tracer, const RayTracingFrame& frame, RayStats& stats)
+{
+    auto trace = [&](uint32_t x, uint32_t y) {
+        const GBufferSample& sample = frame.g_buffer[size_t(y) * frame.width + x];
+
+        // Only perfectly smooth surfaces trace a reflection ray.
+        if (sample.roughness != 0.0f)
+            return;
+
+        const glm::vec3 view = glm::normalize(sample.position - frame.camera_pos);
+        const glm::vec3 dir  = glm::reflect(view, sample.normal);
+
+        stats.reflection.rays++;
+
+        CpuRayTracer::Hit hit;
+
+        if (tracer.intersect(sample.position, dir, kRayTMin, kRayTMax, hit))
+            stats.reflection.hits++;
+        else
+            stats.reflection.misses++;
+    };
+
+    if (!frame.ssr)
+    {
+        for (uint32_t y = 0; y < frame.height; y++)
+        {
+            for (uint32_t x = 0; x < frame.width; x++)
+                trace(x, y);
+        }
+
+        return;
+    }
+
+    for (const auto& sample : frame.g_buffer)
+    {
+        if (sample.roughness == 0.0f)
+            stats.ssr_pixels++;
+    }
+
+    // Every mirror pixel that didn't make it into the ray list was resolved in screen space.
+    stats.ssr_hits = stats.ssr_pixels - std::min(stats.ssr_pixels, uint64_t(frame.reflection_ray_list.size()));
+
+    for (uint32_t pixel : frame.reflection_ray_list)
+        trace(pixel & 0xffff, pixel >> 16);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// light_shade.rgen. The spatial reuse is replayed only for the random numbers it consumes, the reservoirs already
+// hold its result.
+static void trace_light_rays(const CpuRayTracer& tracer, const RayTracingFrame& frame, RayStats& stats)
+{
+    if (frame.reservoirs.empty())
+        return;
+
+    const int32_t width  = int32_t(frame.width);
+    const int32_t height = int32_t(frame.height);
+
+    for (int32_t y = 0; y < height; y++)
+    {
+        for (int32_t x = 0; x < width; x++)
+        {
+            const size_t         idx    = size_t(y) * width + x;
+            const GBufferSample& sample = frame.g_buffer[idx];
+
+            if (glm::dot(sample.normal, sample.normal) < 0.5f)
+                continue;
+
+            uint32_t seed = random_seed(x, y, frame.frame * 3u + 2u);
+
+            if (frame.spatial_radius > 0.0f)
+            {
+                const float view_dist = glm::distance(frame.camera_pos, sample.position);
+
+                for (uint32_t i = 0; i < frame.spatial_neighbours; i++)
+                {
+                    const float   u0 = next_random(seed);
+                    const float   u1 = next_random(seed);
+                    const int32_t nx = glm::clamp(int32_t(float(x) + 0.5f + (u0 * 2.0f - 1.0f) * frame.spatial_radius), 0, width - 1);
+                    const int32_t ny = glm::clamp(int32_t(float(y) + 0.5f + (u1 * 2.0f - 1.0f) * frame.spatial_radius), 0, height - 1);
+
+                    const GBufferSample& neighbor = frame.g_buffer[size_t(ny) * width + nx];
+
+                    if (glm::dot(sample.normal, neighbor.normal) < 0.9f || std::fabs(glm::distance(frame.camera_pos, neighbor.position) - view_dist) > 0.1f * view_dist)
+                        continue;
+
+                    // The random number combine_reservoirs() was passed.
+                    next_random(seed);
+                }
+            }
+
+            const LightReservoir& r = frame.reservoirs[idx];
+
+            if (r.light_idx >= frame.lights.size() || r.w <= 0.0f)
+                continue;
+
+            const Light& light  = frame.lights[r.light_idx];
+            glm::vec3    target = glm::vec3(light.position_range);
+
+            // Area lights are spheres, the ray aims at a random point on their surface.
+            if (uint32_t(light.color_type.w) == LIGHT_TYPE_AREA)
+            {
+                const float u0   = next_random(seed);
+                const float u1   = next_random(seed);
+                const float z    = 1.0f - 2.0f * u0;
+                const float r_xy = std::sqrt(std::max(1.0f - z * z, 0.0f));
+                const float phi  = 2.0f * kPi * u1;
+
+                target += glm::vec3(r_xy * std::cos(phi), r_xy * std::sin(phi), z) * light.direction_radius.w;
+            }
+
+            const glm::vec3 origin   = sample.position + sample.normal * kShadowRayBias;
+            const glm::vec3 to_light = target - origin;
+            const float     dist     = glm::length(to_light);
+
+            stats.light.rays++;
+
+            if (tracer.occluded(origin, to_light / dist, kRayTMin, std::max(dist - kShadowRayBias, kRayTMin)))
+                stats.light.hits++;
+            else
+                stats.light.misses++;
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+RayStats trace_frame_rays_cpu(const CpuRayTracer& tracer, const RayTracingFrame& frame)
+{
+    RayStats stats;
+
+    trace_shadow_rays(tracer, frame, stats);
+    trace_reflection_rays(tracer, frame, stats);
+    trace_light_rays(tracer, frame, stats);
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string compare_ray_stats(const RayStats& expected, const RayStats& actual, double tolerance)
+{
+    struct Counter
+    {
+        const char* name;
+        uint64_t    expected;
+        uint64_t    actual;
+    };
+
+    const Counter counters[] = {
+        { "shadow rays", expected.shadow.rays, actual.shadow.rays },
+        { "shadow hits", expected.shadow.hits, actual.shadow.hits },
+        { "shadow misses", expected.shadow.misses, actual.shadow.misses },
+        { "shadow traced pixels", expected.shadow_traced_pixels, actual.shadow_traced_pixels },
+        { "shadow penumbra pixels", expected.shadow_penumbra_pixels, actual.shadow_penumbra_pixels },
+        { "reflection rays", expected.reflection.rays, actual.reflection.rays },
+        { "reflection hits", expected.reflection.hits, actual.reflection.hits },
+        { "reflection misses", expected.reflection.misses, actual.reflection.misses },
+        { "ssr pixels", expected.ssr_pixels, actual.ssr_pixels },
+        { "ssr hits", expected.ssr_hits, actual.ssr_hits },
+        { "light rays", expected.light.rays, actual.light.rays },
+        { "light hits", expected.light.hits, actual.light.hits },
+        { "light misses", expected.light.misses, actual.light.misses }
+    };
+
+    std::string mismatches;
+
+    for (const auto& counter : counters)
+    {
+        const double difference = std::fabs(double(counter.actual) - double(counter.expected));
+
+        if (difference <= tolerance * double(std::max(counter.expected, counter.actual)))
+            continue;
+
+        if (!mismatches.empty())
+            mismatches += ", ";
+
+        mismatches += std::string(counter.name) + " " + std::to_string(counter.actual) + " (expected " + std::to_string(counter.expected) + ")";
+    }
+
+    return mismatches;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "cascaded_shadows.h"
+#include "cpu_ray_tracer.h"
+#include "light_sampling.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Layout of the per-frame ray counter block. Must match the RAY_STATS_* defines in common.glsl.
+enum RayStatCounter
+{
+    RAY_STAT_SHADOW_RAYS = 0,
+    RAY_STAT_SHADOW_HITS,
+    RAY_STAT_SHADOW_MISSES,
+    RAY_STAT_REFLECTION_RAYS,
+    RAY_STAT_REFLECTION_HITS,
+    RAY_STAT_REFLECTION_MISSES,
+    RAY_STAT_SHADOW_PENUMBRA_PIXELS,
+    RAY_STAT_LIGHT_RAYS,
+    RAY_STAT_LIGHT_HITS,
+    RAY_STAT_LIGHT_MISSES,
+    RAY_STAT_SHADOW_TRACED_PIXELS,
+    RAY_STAT_REFLECTION_SHADE_SUBGROUPS,
+    RAY_STAT_REFLECTION_SHADE_BATCHES,
+    RAY_STAT_SSR_PIXELS,
+    RAY_STAT_SSR_HITS,
+    RAY_STAT_COUNT = 16 // Size of the block, leaves room for more counters.
+};
+
+struct PassRayStats
+{
+    uint64_t rays   = 0;
+    uint64_t hits   = 0;
+    uint64_t misses = 0;
+
+    inline double rays_per_second(float pass_ms) const { return pass_ms > 0.0f ? double(rays) / (double(pass_ms) * 1e-3) : 0.0; }
+};
+
+struct RayStats
+{
+    PassRayStats shadow;
+    PassRayStats reflection;
+    PassRayStats light; // Shadow rays towards the lights picked by reservoir sampling.
+    uint64_t     shadow_penumbra_pixels = 0; // Pixels that traced extra soft shadow rays.
+    uint64_t     shadow_traced_pixels   = 0; // Pixels the shadow map couldn't resolve that traced a shadow ray.
+    uint64_t     reflection_subgroups   = 0; // Subgroups that shaded reflection hits.
+    uint64_t     reflection_batches     = 0; // Distinct materials summed over those subgroups.
+    uint64_t     ssr_pixels             = 0; // Mirror pixels the screen space pass marched first.
+    uint64_t     ssr_hits               = 0; // Of those, the ones it resolved without a reflection ray.
+
+    inline double shadow_rays_per_pixel(uint64_t pixels) const { return pixels > 0 ? double(shadow.rays) / double(pixels) : 0.0; }
+    inline double penumbra_fraction(uint64_t pixels) const { return pixels > 0 ? double(shadow_penumbra_pixels) / double(pixels) : 0.0; }
+    inline double shadow_traced_fraction(uint64_t pixels) const { return pixels > 0 ? double(shadow_traced_pixels) / double(pixels) : 0.0; }
+
+    // Average number of materials a subgroup had to shade, 1.0 when every subgroup is fully coherent.
+    inline double reflection_materials_per_subgroup() const { return reflection_subgroups > 0 ? double(reflection_batches) / double(reflection_subgroups) : 0.0; }
+
+    // Every screen space hit is a reflection ray that wasn't traced.
+    inline double ssr_hit_fraction() const { return ssr_pixels > 0 ? double(ssr_hits) / double(ssr_pixels) : 0.0; }
+
+    static RayStats unpack(const uint32_t* counters);
+};
+
+// The G-Buffer values the ray generation shaders read for a single pixel.
+struct GBufferSample
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+    float     roughness;
+};
+
+// Everything the ray tracing passes of a frame read to decide which rays they trace. The per-pixel vectors cover
+// the render area row by row, which is also the launch size of every pass.
+struct RayTracingFrame
+{
+    uint32_t                   width  = 0;
+    uint32_t                   height = 0;
+    std::vector<GBufferSample> g_buffer;
+    glm::mat4                  view;
+    glm::mat4                  projection;
+    glm::vec3                  camera_pos;
+    glm::vec3                  light_dir;   // Points towards the light.
+    uint32_t                   frame   = 0; // soft_shadow_samples.y, seeds the random numbers.
+
+    // Area light soft shadows, off when the angle is zero.
+    float    light_angular_radius        = 0.0f; // Radians
+    float    penumbra_variance_threshold = 0.0f;
+    uint32_t max_penumbra_radius         = 0;
+    uint32_t penumbra_rays               = 0;
+
+    // Hybrid shadows: the cascades and their depths, kShadowCascadeCount layers of resolution^2 texels.
+    bool               hybrid_shadows = false;
+    ShadowCascade      cascades[kShadowCascadeCount];
+    std::vector<float> shadow_map;
+    uint32_t           shadow_map_resolution      = 0;
+    float              cascade_boundary_band      = 0.0f;
+    float              depth_ambiguity_texels     = 0.0f;
+    float              contact_hardening_distance = 0.0f;
+
+    // Screen space reflections: the pixels they couldn't resolve, packed and ordered like ssr.comp's ray list.
+    bool                  ssr = false;
+    std::vector<uint32_t> reflection_ray_list;
+
+    // Many lights: the reservoir every pixel ended up with after spatial reuse, empty when the pass is off.
+    std::vector<LightReservoir> reservoirs;
+    std::vector<Light>          lights;
+    uint32_t                    spatial_neighbours = 0;
+    float                       spatial_radius     = 0.0f; // Zero when spatial reuse is off.
+};
+
+// CPU mirror of shadow.rgen, shadow_refine.rgen, reflection.rgen, the pixel counts of ssr.comp and light_shade.rgen.
+// Traces the same rays the shaders trace for the frame, so its counters are what the GPU should read back, up to
+// the geometry the CPU tracer doesn't share with the acceleration structure. The subgroup counters are left at zero.
+RayStats trace_frame_rays_cpu(const CpuRayTracer& tracer, const RayTracingFrame& frame);
+
+// Lists every counter where 'actual' differs from 'expected' by more than 'tolerance' of the larger of the two.
+// Returns an empty string when they agree.
+std::string compare_ray_stats(const RayStats& expected, const RayStats& actual, double tolerance);
@@ -0,0 +1,187 @@
+#include "screen_space_reflections.h"
+
+#include <algorithm>
+
+static const float kMaxDistance = 10000.0f; // The reflection rays' tmax.
+static const float kStepEpsilon = 0.01f;    // How far past a cell boundary a step lands, in pixels.
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void HiZBuffer::build(const std::vector<float>& depth, uint32_t width, uint32_t height)
+{
+    m_levels.resize(kHiZLevels);
+    m_sizes.resize(kHiZLevels);
+
+    m_levels[0] = depth;
+    m_sizes[0]  = glm::ivec2(width, height);
+
+    for (uint32_t level = 1; level < kHiZLevels; level++)
+    {
+        const glm::ivec2 src_size = m_sizes[level - 1];
+        const glm::ivec2 dst_size = (src_size + 1) / 2;
+
+        m_sizes[level] = dst_size;
+        m_levels[level].resize(dst_size.x * dst_size.y);
+
+        for (int32_t y = 0; y < dst_size.y; y++)
+        {
+            for (int32_t x = 0; x < dst_size.x; x++)
+            {
+                const glm::ivec2 src  = glm::ivec2(x, y) * 2;
+                const glm::ivec2 last = src_size - 1;
+
+                const float d0 = fetch(src, level - 1);
+                const float d1 = fetch(glm::min(src + glm::ivec2(1, 0), last), level - 1);
+                const float d2 = fetch(glm::min(src + glm::ivec2(0, 1), last), level - 1);
+                const float d3 = fetch(glm::min(src + glm::ivec2(1, 1), last), level - 1);
+
+                m_levels[level][y * dst_size.x + x] = std::min(std::min(d0, d1), std::min(d2, d3));
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float linear_depth(const glm::mat4& proj_inverse, float depth)
+{
+    const glm::vec4 view_pos = proj_inverse * glm::vec4(0.0f, 0.0f, depth, 1.0f);
+
+    return -view_pos.z / view_pos.w;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static glm::vec3 clip_to_screen(const glm::vec4& clip, const glm::vec2& jitter, const glm::vec2& render_size)
+{
+    const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+
+    return glm::vec3(((glm::vec2(ndc) + jitter) * 0.5f + 0.5f) * render_size, ndc.z);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static float cell_exit(const glm::vec3& start, const glm::vec3& dir, const glm::ivec2& cell, float cell_size)
+{
+    const float boundary_x = (float(cell.x) + (dir.x >= 0.0f ? 1.0f : 0.0f)) * cell_size;
+    const float boundary_y = (float(cell.y) + (dir.y >= 0.0f ? 1.0f : 0.0f)) * cell_size;
+
+    const float exit_x = dir.x != 0.0f ? (boundary_x - start.x) / dir.x : 1e30f;
+    const float exit_y = dir.y != 0.0f ? (boundary_y - start.y) / dir.y : 1e30f;
+
+    return std::min(exit_x, exit_y);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool march_screen_space_reflection(const HiZBuffer& hiz, const SsrGBuffer& g_buffer, const SsrView& view, const SsrSettings& settings, const glm::ivec2& pixel)
+{
+    const glm::vec2 render_size  = glm::vec2(float(g_buffer.width), float(g_buffer.height));
+    const glm::mat4 proj_inverse = glm::inverse(view.projection);
+    const uint32_t  idx          = pixel.y * g_buffer.width + pixel.x;
+    const float     depth        = g_buffer.depth[idx];
+
+    // world_position_from_depth() of common.glsl, the G-Buffer is the size of the render area here.
+    const glm::vec2 ndc      = (glm::vec2(pixel) + 0.5f) / render_size * 2.0f - 1.0f - view.jitter;
+    const glm::vec4 view_pos = proj_inverse * glm::vec4(ndc, depth, 1.0f);
+    const glm::vec3 P        = glm::vec3(glm::inverse(view.view) * glm::vec4(glm::vec3(view_pos) / view_pos.w, 1.0f));
+    const glm::vec3 R        = glm::reflect(glm::normalize(P - view.camera_pos), g_buffer.normal[idx]);
+
+    const glm::mat4 view_proj = view.projection * view.view;
+    const glm::vec4 c0        = view_proj * glm::vec4(P, 1.0f);
+    const glm::vec4 c1        = view_proj * glm::vec4(R, 0.0f);
+
+    float t = kMaxDistance;
+
+    if (c1.z < 0.0f)
+        t = std::min(t, -c0.z / c1.z);
+
+    if (c1.z > c1.w)
+        t = std::min(t, (c0.w - c0.z) / (c1.z - c1.w));
+
+    const glm::vec3 start = clip_to_screen(c0, view.jitter, render_size);
+    const glm::vec3 dir   = clip_to_screen(c0 + c1 * t, view.jitter, render_size) - start;
+    const float     span  = std::max(std::abs(dir.x), std::abs(dir.y));
+
+    if (span < 1.0f)
+        return false;
+
+    float end = 1.0f;
+
+    if (dir.x != 0.0f)
+        end = std::min(end, ((dir.x > 0.0f ? render_size.x : 0.0f) - start.x) / dir.x);
+
+    if (dir.y != 0.0f)
+        end = std::min(end, ((dir.y > 0.0f ? render_size.y : 0.0f) - start.y) / dir.y);
+
+    const float epsilon = kStepEpsilon / span;
+
+    float   u     = cell_exit(start, dir, pixel, 1.0f) + epsilon;
+    int32_t level = 0;
+
+    for (uint32_t i = 0; i < settings.max_iterations && u < end; i++)
+    {
+        const float      cell_size = float(1 << level);
+        const glm::vec3  pos       = start + dir * u;
+        const glm::ivec2 cell      = glm::min(glm::ivec2(glm::vec2(pos) / cell_size), hiz.size(level) - 1);
+        const float      exit      = std::min(cell_exit(start, dir, cell, cell_size), end);
+        const float      surface   = hiz.fetch(cell, level);
+        const float      ray_far   = start.z + dir.z * (dir.z > 0.0f ? exit : u);
+
+        if (ray_far < surface)
+        {
+            u     = exit + epsilon;
+            level = std::min(level + 1, int32_t(kHiZLevels) - 1);
+        }
+        else if (level > 0)
+            level--;
+        else
+        {
+            if (surface >= 1.0f)
+                return false;
+
+            const float ray_near = start.z + dir.z * (dir.z > 0.0f ? u : exit);
+
+            if (ray_near > surface && linear_depth(proj_inverse, ray_near) - linear_depth(proj_inverse, surface) > settings.thickness)
+                return false;
+
+            // The surface has to face the ray.
+            return glm::dot(g_buffer.normal[cell.y * g_buffer.width + cell.x], R) < 0.0f;
+        }
+    }
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SsrStats trace_screen_space_reflections_cpu(const SsrGBuffer& g_buffer, const SsrView& view, const SsrSettings& settings)
+{
+    HiZBuffer hiz;
+
+    hiz.build(g_buffer.depth, g_buffer.width, g_buffer.height);
+
+    SsrStats stats;
+
+    for (uint32_t y = 0; y < g_buffer.height; y++)
+    {
+        for (uint32_t x = 0; x < g_buffer.width; x++)
+        {
+            const uint32_t idx = y * g_buffer.width + x;
+
+            if (g_buffer.roughness[idx] != 0.0f)
+                continue;
+
+            stats.pixels++;
+
+            if (g_buffer.depth[idx] < 1.0f && march_screen_space_reflection(hiz, g_buffer, view, settings, glm::ivec2(x, y)))
+                stats.hits++;
+            else
+                stats.ray_list.push_back(x | (y << 16));
+        }
+    }
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
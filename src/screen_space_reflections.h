@@ -0,0 +1,73 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// Mip levels of the hierarchical depth buffer. Must match HIZ_LEVELS in common.glsl.
+static const uint32_t kHiZLevels = 8;
+
+// Size of the hierarchical depth buffer's first level for a render target dimension. Rounded up so that every level
+// halves exactly and still covers the render area at any render scale.
+inline uint32_t hiz_base_size(uint32_t size)
+{
+    const uint32_t alignment = 1u << (kHiZLevels - 1);
+
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Nearest depth of every 2^N x 2^N block of pixels, the CPU mirror of hiz_build.comp.
+class HiZBuffer
+{
+public:
+    void build(const std::vector<float>& depth, uint32_t width, uint32_t height);
+
+    // Texels of a level covering the render area, rounded up like the shader.
+    inline glm::ivec2 size(uint32_t level) const { return m_sizes[level]; }
+    inline float      fetch(const glm::ivec2& texel, uint32_t level) const { return m_levels[level][texel.y * m_sizes[level].x + texel.x]; }
+
+private:
+    std::vector<std::vector<float>> m_levels;
+    std::vector<glm::ivec2>         m_sizes;
+};
+
+// The G-Buffer targets the screen space pass reads, at the render resolution.
+struct SsrGBuffer
+{
+    uint32_t               width  = 0;
+    uint32_t               height = 0;
+    std::vector<float>     depth; // NDC depth, 1 is the background.
+    std::vector<glm::vec3> normal;
+    std::vector<float>     roughness;
+};
+
+struct SsrView
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 camera_pos;
+    glm::vec2 jitter = glm::vec2(0.0f); // NDC offset the raster pass added.
+};
+
+struct SsrSettings
+{
+    float    thickness      = 0.5f; // How far behind a surface the ray may pass and still hit it, in world units.
+    uint32_t max_iterations = 96;
+};
+
+struct SsrStats
+{
+    uint64_t              pixels = 0; // Mirror pixels, every one traced a ray before.
+    uint64_t              hits   = 0;
+    std::vector<uint32_t> ray_list; // Pixels left for the ray traced fallback, x | y << 16.
+
+    inline double hit_fraction() const { return pixels > 0 ? double(hits) / double(pixels) : 0.0; }
+};
+
+// CPU mirror of ssr.comp's march. Returns true if the pixel's reflection was resolved on screen.
+bool march_screen_space_reflection(const HiZBuffer& hiz, const SsrGBuffer& g_buffer, const SsrView& view, const SsrSettings& settings, const glm::ivec2& pixel);
+
+// Marches every mirror pixel of the G-Buffer like ssr.comp, the reference for the hit fraction its counters
+// report. The ray list holds the pixels left for the ray traced pass in row order, rather than the order the
+// shader's subgroups appended them in.
+SsrStats trace_screen_space_reflections_cpu(const SsrGBuffer& g_buffer, const SsrView& view, const SsrSettings& settings);
@@ -4,16 +4,130 @@
 
 #define PRIMARY_RAY_PAYLOAD_LOC 0
 
+// Ray statistics counters, must match RayStatCounter in ray_stats.h.
+#define RAY_STATS_SHADOW_RAYS 0
+#define RAY_STATS_SHADOW_HITS 1
+#define RAY_STATS_SHADOW_MISSES 2
+#define RAY_STATS_REFLECTION_RAYS 3
+#define RAY_STATS_REFLECTION_HITS 4
+#define RAY_STATS_REFLECTION_MISSES 5
+#define RAY_STATS_SHADOW_PENUMBRA_PIXELS 6
+#define RAY_STATS_LIGHT_RAYS 7
+#define RAY_STATS_LIGHT_HITS 8
+#define RAY_STATS_LIGHT_MISSES 9
+#define RAY_STATS_SHADOW_TRACED_PIXELS 10
+#define RAY_STATS_REFLECTION_SHADE_SUBGROUPS 11
+#define RAY_STATS_REFLECTION_SHADE_BATCHES 12
+#define RAY_STATS_SSR_PIXELS 13
+#define RAY_STATS_SSR_HITS 14
+
+// Increments a counter in the current frame's block when ray statistics are enabled. Expects the
+// per-frame UBO to be declared as 'ubo' and the counter buffer as 'RayStats'.
+#define INCREMENT_RAY_STAT(counter) if (ubo.ray_stats_params.x != 0) atomicAdd(RayStats.counters[ubo.ray_stats_params.y + (counter)], 1)
+
 #define kPI 3.14159265359
 
+// Visibility buffer encoding: the scene instance in the top bits and the triangle within the instance's
+// index buffer in the rest. Cleared to INVALID_VISIBILITY where nothing was rasterized.
+#define VISIBILITY_TRIANGLE_BITS 24
+#define VISIBILITY_TRIANGLE_MASK 0xffffff
+#define INVALID_VISIBILITY 0xffffffff
+
+// Reconstructs the world space position of a G-Buffer texel from the rasterized depth. 'tex_coord' addresses
+// the whole G-Buffer, of which only the top-left 'render_scale' portion is rendered, and 'jitter' is the
+// sub-pixel offset the raster pass added in NDC. Background texels return 0 like the cleared position target.
+vec3 world_position_from_depth(vec2 tex_coord, float depth, float render_scale, vec2 jitter, mat4 proj_inverse, mat4 view_inverse)
+{
+    if (depth >= 1.0)
+        return vec3(0.0);
+
+    vec2 ndc      = (tex_coord / render_scale) * 2.0 - 1.0 - jitter;
+    vec4 view_pos = proj_inverse * vec4(ndc, depth, 1.0);
+
+    return (view_inverse * vec4(view_pos.xyz / view_pos.w, 1.0)).xyz;
+}
+
+// PCG hash based random numbers, seeded per pixel and frame.
+uint pcg_hash(uint v)
+{
+    uint state = v * 747796405u + 2891336453u;
+    uint word  = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+uint random_seed(uvec2 pixel, uint frame)
+{
+    return pcg_hash(pixel.x + pcg_hash(pixel.y + pcg_hash(frame)));
+}
+
+float next_random(inout uint seed)
+{
+    seed = pcg_hash(seed);
+    return float(seed) / 4294967296.0;
+}
+
+// Uniformly samples a direction within the cone of half angle acos(cos_theta_max) around 'dir'.
+vec3 sample_cone(vec3 dir, float cos_theta_max, vec2 u)
+{
+    float cos_theta = mix(1.0, cos_theta_max, u.x);
+    float sin_theta = sqrt(max(1.0 - cos_theta * cos_theta, 0.0));
+    float phi       = 2.0 * kPI * u.y;
+
+    vec3 up        = abs(dir.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent   = normalize(cross(up, dir));
+    vec3 bitangent = cross(dir, tangent);
+
+    return normalize(tangent * (cos(phi) * sin_theta) + bitangent * (sin(phi) * sin_theta) + dir * cos_theta);
+}
+
 struct RayPayload
 {
     vec4 color_dist;
+    vec2 cone; // x: Width at the ray origin, y: Spread angle
 };
 
+// A reflection ray hit recorded for deferred shading. Must match kHitRecordSize in main.cpp.
+struct HitRecord
+{
+    uint  pixel;        // x | y << 16
+    uint  instance;     // Mesh index of the hit instance
+    uint  primitive;
+    uint  material;     // INVALID_MATERIAL if the ray didn't hit anything
+    vec2  barycentrics;
+    float distance;
+    float cone_width;   // Width of the ray cone at the hit
+};
+
+#define INVALID_MATERIAL 0xffffffff
+
+// Number of material bins used to sort recorded hits. Must match kMaxReflectionMaterials in main.cpp.
+#define MAX_REFLECTION_MATERIALS 1024
+
+// Mip levels of the hierarchical depth buffer the screen space reflections march through. Must match
+// kHiZLevels in main.cpp.
+#define HIZ_LEVELS 8
+
 struct ShadowRayPayload
 {
-    float dist;
+    float dist; // Distance to the blocker, negative if the light is visible.
+};
+
+// Must match Light in light_sampling.h.
+struct Light
+{
+    vec4 position_range;   // xyz: Position, w: Range
+    vec4 color_type;       // rgb: Color * intensity, a: Light type
+    vec4 direction_radius; // xyz: Spot direction, w: Area light radius
+    vec4 spot_params;      // x: Cosine of the inner cone angle, y: Cosine of the outer cone angle
+};
+
+// Must match LightReservoir in light_sampling.h.
+struct Reservoir
+{
+    uint  light_idx;
+    float w_sum;
+    float m;
+    float w;
 };
 
 struct IndirectionInfo
@@ -1,10 +1,16 @@
 #version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
 
 layout(set = 0, binding = 0) uniform sampler2D s_Shadow;
 layout(set = 0, binding = 1) uniform sampler2D s_Reflection;
-layout(set = 0, binding = 2) uniform sampler2D s_GBuffer1; // RGB: Albedo, A: Roughness
-layout(set = 0, binding = 3) uniform sampler2D s_GBuffer2; // RGB: Normal, A: Metallic
-layout(set = 0, binding = 4) uniform sampler2D s_GBuffer3; // RGB: Position, A: -
+layout(set = 0, binding = 2) uniform sampler2D s_GBuffer1; // RGB: Albedo, A: Roughness (unused here)
+layout(set = 0, binding = 3) uniform sampler2D s_GBuffer2; // RGB: Normal, A: Metallic (unused here)
+layout(set = 0, binding = 4) uniform sampler2D s_GBuffer3; // RGB: Position, A: - (not written in visibility buffer mode)
+layout(set = 0, binding = 5) uniform sampler2D s_History;
+layout(set = 0, binding = 6) uniform sampler2D s_Lighting; // RGB: Direct lighting from the light list
+layout(set = 0, binding = 7) uniform sampler2D s_Depth;
 
 layout(set = 1, binding = 0) uniform PerFrameUBO
 {
@@ -15,6 +21,23 @@ layout(set = 1, binding = 0) uniform PerFrameUBO
     mat4 projection;
     vec4 cam_pos;
     vec4 light_dir;
+    mat4 prev_view_proj;
+    vec4 upsample_params;
+    uvec4 ray_stats_params;
+    vec4 soft_shadow_params;
+    uvec4 soft_shadow_samples;
+    uvec4 light_params;
+    vec4 restir_params;
+    mat4 cascade_view_proj[4];
+    vec4 cascade_splits;
+    vec4 cascade_texel_sizes;
+    vec4 cascade_depth_ranges;
+    vec4 csm_params;
+    uvec4 visibility_params;
+    uvec4 alpha_test_params;
+    vec4 ray_cone_params;
+    vec4 ssr_params;
+    uvec4 vt_params;
 }
 ubo;
 
@@ -22,20 +45,61 @@ layout(location = 0) in vec2 inUV;
 
 layout(location = 0) out vec4 outFragColor;
 
-void main()
+vec3 shade(vec2 uv)
 {
-    vec3 albedo = texture(s_GBuffer1, inUV).rgb;
-    vec3 normal = texture(s_GBuffer2, inUV).rgb;
-    vec3 reflection = texture(s_Reflection, inUV).rgb;
-    float shadow = texture(s_Shadow, inUV).r;
+    vec3 albedo = texture(s_GBuffer1, uv).rgb;
+    vec3 normal = texture(s_GBuffer2, uv).rgb;
+    vec3 reflection = texture(s_Reflection, uv).rgb;
+    float shadow = texture(s_Shadow, uv).r;
 
     vec3 color = shadow * albedo * max(dot(normal, ubo.light_dir.xyz), 0.0) + albedo * 0.1 + reflection;
 
+    if (ubo.restir_params.z > 0.0)
+        color += texture(s_Lighting, uv).rgb;
+
     // Reinhard tone mapping
     color = color / (1.0 + color);
 
     // Gamma correction
     color = pow(color, vec3(1.0/2.2));
 
-    outFragColor = vec4(color, 1.0);
-}
\ No newline at end of file
+    return color;
+}
+
+void main()
+{
+    // The inputs only cover the scaled render area, so remap the output coordinate into it and undo the jitter.
+    float scale = ubo.upsample_params.x;
+    vec2 texel_size = 1.0 / vec2(textureSize(s_GBuffer1, 0));
+    vec2 uv = (inUV + ubo.upsample_params.zw * 0.5) * scale;
+
+    vec3 color = shade(uv);
+
+    // Clamp the history to the neighborhood of the current sample to reject stale data.
+    vec3 n0 = shade(uv + vec2(texel_size.x, 0.0));
+    vec3 n1 = shade(uv - vec2(texel_size.x, 0.0));
+    vec3 n2 = shade(uv + vec2(0.0, texel_size.y));
+    vec3 n3 = shade(uv - vec2(0.0, texel_size.y));
+
+    vec3 color_min = min(color, min(min(n0, n1), min(n2, n3)));
+    vec3 color_max = max(color, max(max(n0, n1), max(n2, n3)));
+
+    // Reproject into the previous frame using the world position.
+    vec3 position;
+
+    if (ubo.visibility_params.x != 0)
+        position = world_position_from_depth(uv, texture(s_Depth, uv).r, scale, ubo.upsample_params.zw, ubo.proj_inverse, ubo.view_inverse);
+    else
+        position = texture(s_GBuffer3, uv).rgb;
+    vec4 prev_clip = ubo.prev_view_proj * vec4(position, 1.0);
+    vec2 prev_uv = (prev_clip.xy / prev_clip.w) * 0.5 + 0.5;
+
+    float blend = ubo.upsample_params.y;
+
+    if (any(lessThan(prev_uv, vec2(0.0))) || any(greaterThan(prev_uv, vec2(1.0))))
+        blend = 1.0;
+
+    vec3 history = clamp(texture(s_History, prev_uv).rgb, color_min, color_max);
+
+    outFragColor = vec4(mix(history, color, blend), 1.0);
+}
@@ -0,0 +1,16 @@
+// G-Buffer inputs of the ray generation shaders, from the global set. Expects common.glsl and the per-frame
+// UBO (as 'ubo') to be declared before it is included.
+
+layout(set = 1, binding = 1) uniform sampler2D s_GBuffer1; // RGB: Albedo, A: Roughness
+layout(set = 1, binding = 2) uniform sampler2D s_GBuffer2; // RGB: Normal, A: Metallic
+layout(set = 1, binding = 3) uniform sampler2D s_GBuffer3; // RGB: Position, A: - (not written in visibility buffer mode)
+layout(set = 1, binding = 4) uniform sampler2D s_Depth;
+
+vec3 g_buffer_position(vec2 tex_coord)
+{
+    // The visibility buffer only keeps depth, so the position is rebuilt from it.
+    if (ubo.visibility_params.x != 0)
+        return world_position_from_depth(tex_coord, texture(s_Depth, tex_coord).r, ubo.upsample_params.x, ubo.upsample_params.zw, ubo.proj_inverse, ubo.view_inverse);
+
+    return texture(s_GBuffer3, tex_coord).rgb;
+}
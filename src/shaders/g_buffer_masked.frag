@@ -0,0 +1,6 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+// Alpha tested materials when there is no depth prepass.
+#define ALPHA_TEST
+#include "g_buffer_output.glsl"
\ No newline at end of file
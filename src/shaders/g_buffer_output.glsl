@@ -0,0 +1,123 @@
+// G-Buffer fragment shader shared by the opaque and alpha tested pipelines. Define ALPHA_TEST before
+// including it to discard the transparent texels of the albedo map. Expects GL_GOOGLE_include_directive.
+
+#ifndef ALPHA_TEST
+// The feedback writes would otherwise turn early depth testing off.
+layout(early_fragment_tests) in;
+#endif
+
+layout(location = 0) in vec3 FS_IN_FragPos;
+layout(location = 1) in vec2 FS_IN_Texcoord;
+layout(location = 2) in vec3 FS_IN_Normal;
+layout(location = 3) in vec3 FS_IN_Tangent;
+layout(location = 4) in vec3 FS_IN_Bitangent;
+
+layout(location = 0) out vec4 FS_OUT_GBuffer1; // RGB: Albedo, A: Roughness
+layout(location = 1) out vec4 FS_OUT_GBuffer2; // RGB: Normal, A: Metallic
+layout(location = 2) out vec4 FS_OUT_GBuffer3; // RGB: Position, A: -
+
+layout(set = 1, binding = 0) uniform sampler2D s_Diffuse;
+layout(set = 1, binding = 1) uniform sampler2D s_Normal;
+layout(set = 1, binding = 2) uniform sampler2D s_Roughness;
+layout(set = 1, binding = 3) uniform sampler2D s_Metallic;
+
+layout(set = 0, binding = 0) uniform PerFrameUBO
+{
+    mat4 view_inverse;
+    mat4 proj_inverse;
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+    vec4 cam_pos;
+    vec4 light_dir;
+    mat4 prev_view_proj;
+    vec4 upsample_params;
+    uvec4 ray_stats_params;
+    vec4 soft_shadow_params;
+    uvec4 soft_shadow_samples;
+    uvec4 light_params;
+    vec4 restir_params;
+    mat4 cascade_view_proj[4];
+    vec4 cascade_splits;
+    vec4 cascade_texel_sizes;
+    vec4 cascade_depth_ranges;
+    vec4 csm_params;
+    uvec4 visibility_params;
+    uvec4 alpha_test_params;
+    vec4 ray_cone_params;
+    vec4 ssr_params;
+    uvec4 vt_params;
+}
+ubo;
+
+#define VT_SET 2
+#define VT_BINDING 0
+#include "virtual_texture.glsl"
+
+layout(push_constant) uniform MaterialConstants
+{
+    uint material; // Of the draw, indexes the virtual textures
+}
+u_Material;
+
+vec3 get_normal_from_map(vec3 tangent, vec3 bitangent, vec3 normal, vec3 normal_sample)
+{
+    // Create TBN matrix.
+    mat3 TBN = mat3(normalize(tangent), normalize(bitangent), normalize(normal));
+
+    // Remap the tangent space normal vector sampled from the normal map from [0, 1] to [-1, 1] range.
+    vec3 n = normalize(normal_sample * 2.0 - 1.0);
+
+    // Multiple vector by the TBN matrix to transform the normal from tangent space to world space.
+    n = normalize(TBN * n);
+
+    return n;
+}
+
+void main()
+{
+    vec4  albedo;
+    vec3  normal_sample;
+    float roughness;
+    float metallic;
+
+    if (vt_enabled())
+    {
+        const float lod = vt_lod(u_Material.material, dFdx(FS_IN_Texcoord), dFdy(FS_IN_Texcoord));
+
+        albedo        = vt_sample(u_Material.material, VT_MAP_ALBEDO, FS_IN_Texcoord, lod);
+        normal_sample = vt_sample(u_Material.material, VT_MAP_NORMAL, FS_IN_Texcoord, lod).xyz;
+        roughness     = vt_sample(u_Material.material, VT_MAP_ROUGHNESS, FS_IN_Texcoord, lod).r;
+        metallic      = vt_sample(u_Material.material, VT_MAP_METALLIC, FS_IN_Texcoord, lod).r;
+
+        // Before the alpha test, the holes are only known once the page that has them is resident.
+        vt_write_feedback(uvec2(gl_FragCoord.xy), vt_request(u_Material.material, FS_IN_Texcoord, lod));
+    }
+    else
+    {
+        albedo        = texture(s_Diffuse, FS_IN_Texcoord);
+        normal_sample = texture(s_Normal, FS_IN_Texcoord).xyz;
+        roughness     = texture(s_Roughness, FS_IN_Texcoord).r;
+        metallic      = texture(s_Metallic, FS_IN_Texcoord).r;
+    }
+
+#ifdef ALPHA_TEST
+    if (albedo.a < 0.1)
+        discard;
+#endif
+
+    // Albedo
+    FS_OUT_GBuffer1.rgb = albedo.rgb;
+
+    // Normal.
+    FS_OUT_GBuffer2.rgb = get_normal_from_map(FS_IN_Tangent, FS_IN_Bitangent, FS_IN_Normal, normal_sample);
+
+    // Roughness
+    FS_OUT_GBuffer1.a = roughness;
+
+    // Metallic
+    FS_OUT_GBuffer2.a = metallic;
+
+    // World Pos
+    FS_OUT_GBuffer3.rgb = FS_IN_FragPos;
+}
\ No newline at end of file
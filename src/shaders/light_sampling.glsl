@@ -0,0 +1,96 @@
+// Reservoir based light sampling shared by light_resample.rgen and light_shade.rgen. Mirrors light_sampling.cpp.
+// Expects common.glsl to be included first, the light buffer to be declared as 'Lights' and the per-frame UBO as 'ubo'.
+
+#define LIGHT_TYPE_POINT 0
+#define LIGHT_TYPE_SPOT 1
+#define LIGHT_TYPE_AREA 2
+
+#define INVALID_LIGHT 0xffffffffu
+
+float luminance(vec3 color)
+{
+    return dot(color, vec3(0.2126, 0.7152, 0.0722));
+}
+
+Light fetch_light(uint idx)
+{
+    return Lights.lights[ubo.light_params.y + idx];
+}
+
+// Unshadowed radiance reaching a Lambertian surface from the light, including the cosine term.
+vec3 light_contribution(Light light, vec3 position, vec3 normal)
+{
+    vec3  to_light = light.position_range.xyz - position;
+    float dist_sq  = dot(to_light, to_light);
+    float range    = light.position_range.w;
+
+    if (dist_sq >= range * range)
+        return vec3(0.0);
+
+    vec3  l         = to_light * inversesqrt(dist_sq);
+    float n_dot_l   = max(dot(normal, l), 0.0);
+    float radius    = light.direction_radius.w;
+    float falloff   = dist_sq / (range * range);
+    float window    = pow(clamp(1.0 - falloff * falloff, 0.0, 1.0), 2.0);
+    float intensity = window / max(dist_sq, max(radius * radius, 1e-4));
+
+    if (uint(light.color_type.a) == LIGHT_TYPE_SPOT)
+        intensity *= smoothstep(light.spot_params.y, light.spot_params.x, dot(-l, light.direction_radius.xyz));
+
+    return light.color_type.rgb * intensity * n_dot_l;
+}
+
+float light_target_pdf(uint idx, vec3 position, vec3 normal)
+{
+    return luminance(light_contribution(fetch_light(idx), position, normal));
+}
+
+Reservoir empty_reservoir()
+{
+    Reservoir r;
+
+    r.light_idx = INVALID_LIGHT;
+    r.w_sum     = 0.0;
+    r.m         = 0.0;
+    r.w         = 0.0;
+
+    return r;
+}
+
+bool update_reservoir(inout Reservoir r, uint candidate, float weight, float u)
+{
+    r.w_sum += weight;
+    r.m += 1.0;
+
+    if (weight > 0.0 && u * r.w_sum < weight)
+    {
+        r.light_idx = candidate;
+        return true;
+    }
+
+    return false;
+}
+
+void finalize_reservoir(inout Reservoir r, vec3 position, vec3 normal)
+{
+    float target_pdf = r.light_idx < ubo.light_params.x ? light_target_pdf(r.light_idx, position, normal) : 0.0;
+
+    r.w = target_pdf > 0.0 ? r.w_sum / (r.m * target_pdf) : 0.0;
+}
+
+// Merges another reservoir by re-evaluating its light at the current surface. Reservoirs that found no
+// light still count their candidates, otherwise W would be overestimated.
+void combine_reservoirs(inout Reservoir r, Reservoir other, vec3 position, vec3 normal, float u)
+{
+    if (other.m <= 0.0)
+        return;
+
+    float m = r.m;
+
+    if (other.light_idx < ubo.light_params.x)
+        update_reservoir(r, other.light_idx, light_target_pdf(other.light_idx, position, normal) * other.w * other.m, u);
+
+    r.m = m + other.m;
+
+    finalize_reservoir(r, position, normal);
+}
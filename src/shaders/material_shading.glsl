@@ -0,0 +1,166 @@
+// Scene geometry and bindless material textures of the global set, used to shade reflection ray hits. Shared
+// by the inline closest hit shader, the deferred, material sorted shading pass and the visibility buffer
+// resolve. Expects common.glsl and the per-frame UBO (as 'ubo') to be declared before it is included, and the
+// ray counter buffer (as 'RayStats') unless MATERIAL_SHADING_NO_RAY_STATS is defined. The maps are sampled
+// through the virtual texture when it is enabled.
+
+#include "ray_cones.glsl"
+
+#define VT_SET 1
+#define VT_BINDING 13
+#include "virtual_texture.glsl"
+
+layout (set = 1, binding = 5) readonly buffer MaterialBuffer 
+{
+    uint id[];
+} Material[];
+
+layout (set = 1, binding = 6, std430) readonly buffer VertexBuffer 
+{
+    Vertex vertices[];
+} VertexArray[];
+
+layout (set = 1, binding = 7) readonly buffer IndexBuffer 
+{
+    uint indices[];
+} IndexArray[];
+
+layout(set = 1, binding = 8) uniform sampler2D s_Albedo[];
+
+layout(set = 1, binding = 9) uniform sampler2D s_Normal[];
+
+layout(set = 1, binding = 10) uniform sampler2D s_Roughness[];
+
+layout(set = 1, binding = 11) uniform sampler2D s_Metallic[];
+
+Vertex get_vertex(uint mesh_idx, uint vertex_idx)
+{
+    return VertexArray[nonuniformEXT(mesh_idx)].vertices[vertex_idx];
+}
+
+// Only reads what is needed to find the material: the first index and the position of the first vertex.
+uint fetch_material(uint mesh_idx, uint primitive_idx)
+{
+    uint idx = IndexArray[nonuniformEXT(mesh_idx)].indices[3 * primitive_idx];
+
+    return Material[nonuniformEXT(mesh_idx)].id[uint(VertexArray[nonuniformEXT(mesh_idx)].vertices[idx].position.w)];
+}
+
+Triangle fetch_triangle(uint mesh_idx, uint primitive_idx)
+{
+    Triangle tri;
+
+    uvec3 idx = uvec3(IndexArray[nonuniformEXT(mesh_idx)].indices[3 * primitive_idx], 
+                      IndexArray[nonuniformEXT(mesh_idx)].indices[3 * primitive_idx + 1],
+                      IndexArray[nonuniformEXT(mesh_idx)].indices[3 * primitive_idx + 2]);
+
+    tri.v0 = get_vertex(mesh_idx, idx.x);
+    tri.v1 = get_vertex(mesh_idx, idx.y);
+    tri.v2 = get_vertex(mesh_idx, idx.z);
+
+    tri.mat_idx = Material[nonuniformEXT(mesh_idx)].id[uint(tri.v0.position.w)];
+
+    return tri;
+}
+
+Vertex interpolated_vertex(in Triangle tri, vec2 hit_barycentrics)
+{
+    const vec3 barycentrics = vec3(1.0 - hit_barycentrics.x - hit_barycentrics.y, hit_barycentrics.x, hit_barycentrics.y);
+
+    Vertex o;
+
+    o.position.xyz = tri.v0.position.xyz * barycentrics.x + tri.v1.position.xyz * barycentrics.y + tri.v2.position.xyz * barycentrics.z;
+    o.tex_coord.xy = tri.v0.tex_coord.xy * barycentrics.x + tri.v1.tex_coord.xy * barycentrics.y + tri.v2.tex_coord.xy * barycentrics.z;
+    o.normal.xyz = normalize(tri.v0.normal.xyz * barycentrics.x + tri.v1.normal.xyz * barycentrics.y + tri.v2.normal.xyz * barycentrics.z);
+    o.tangent.xyz = normalize(tri.v0.tangent.xyz * barycentrics.x + tri.v1.tangent.xyz * barycentrics.y + tri.v2.tangent.xyz * barycentrics.z);
+    o.bitangent.xyz = normalize(tri.v0.bitangent.xyz * barycentrics.x + tri.v1.bitangent.xyz * barycentrics.y + tri.v2.bitangent.xyz * barycentrics.z);
+
+    return o;
+}
+
+vec3 get_normal_from_map(vec3 tangent, vec3 bitangent, vec3 normal, vec2 tex_coord, uint mat_idx, float lod)
+{
+    // Create TBN matrix.
+    mat3 TBN = mat3(normalize(tangent), normalize(bitangent), normalize(normal));
+
+    // Sample tangent space normal vector from normal map and remap it from [0, 1] to [-1, 1] range.
+    vec3 n = vt_enabled() ? vt_sample(mat_idx, VT_MAP_NORMAL, tex_coord, lod).rgb : textureLod(s_Normal[nonuniformEXT(mat_idx)], tex_coord, lod).rgb;
+
+    n = normalize(n * 2.0 - 1.0);
+
+    // Multiple vector by the TBN matrix to transform the normal from tangent space to world space.
+    n = normalize(TBN * n);
+
+    return n;
+}
+
+// Returns the reflected color in rgb and the hit distance in a (0 for alpha tested holes). The textures are
+// sampled at the mip level the ray cone picks, 'cone_width' wide where 'ray_dir' hits, or at the top level
+// when ray cones are off.
+vec4 shade_hit(uint mesh_idx, uint primitive_idx, vec2 hit_barycentrics, float hit_distance, vec3 ray_dir, float cone_width)
+{
+    const Triangle tri = fetch_triangle(mesh_idx, primitive_idx);
+    const Vertex v = interpolated_vertex(tri, hit_barycentrics);
+
+    mat3 normal_mat = mat3(ubo.model);
+
+    vec3 N = normal_mat * v.normal.xyz;
+    vec3 T = normal_mat * v.tangent.xyz;
+    vec3 B = normal_mat * v.bitangent.xyz;
+
+    float albedo_lod = 0.0;
+    float normal_lod = 0.0;
+
+    if (ubo.ray_cone_params.x != 0.0)
+    {
+        const vec3 p0 = (ubo.model * vec4(tri.v0.position.xyz, 1.0)).xyz;
+        const vec3 p1 = (ubo.model * vec4(tri.v1.position.xyz, 1.0)).xyz;
+        const vec3 p2 = (ubo.model * vec4(tri.v2.position.xyz, 1.0)).xyz;
+
+        const float lod_constant  = triangle_lod_constant(p0, p1, p2, tri.v0.tex_coord.xy, tri.v1.tex_coord.xy, tri.v2.tex_coord.xy);
+        const float cos_incidence = dot(ray_dir, normalize(cross(p1 - p0, p2 - p0)));
+
+        // Every map of a virtual texture has the same size.
+        const vec2 albedo_size = vt_enabled() ? vt_size(tri.mat_idx) : vec2(textureSize(s_Albedo[nonuniformEXT(tri.mat_idx)], 0));
+        const vec2 normal_size = vt_enabled() ? vt_size(tri.mat_idx) : vec2(textureSize(s_Normal[nonuniformEXT(tri.mat_idx)], 0));
+
+        albedo_lod = max(ray_cone_lod(lod_constant, albedo_size, cone_width, cos_incidence) + ubo.ray_cone_params.y, 0.0);
+        normal_lod = max(ray_cone_lod(lod_constant, normal_size, cone_width, cos_incidence) + ubo.ray_cone_params.y, 0.0);
+    }
+
+    vec4 albedo = vt_enabled() ? vt_sample(tri.mat_idx, VT_MAP_ALBEDO, v.tex_coord.xy, albedo_lod) : textureLod(s_Albedo[nonuniformEXT(tri.mat_idx)], v.tex_coord.xy, albedo_lod);
+    vec3 normal = get_normal_from_map(T, B, N, v.tex_coord.xy, tri.mat_idx, normal_lod);
+
+    vec3 color = albedo.rgb * max(dot(normal, ubo.light_dir.xyz), 0.0) + albedo.rgb * 0.1;
+
+    if (albedo.a < 0.1)
+    {
+        color = vec3(0.0);
+        hit_distance = 0;
+    }
+
+    return vec4(color, hit_distance);
+}
+
+#ifndef MATERIAL_SHADING_NO_RAY_STATS
+
+// Counts the subgroups executing this call and the distinct materials each of them touches, which is
+// how many times the divergent texture fetches get serialized.
+void count_material_divergence(uint mat_idx)
+{
+    if (subgroupElect())
+        INCREMENT_RAY_STAT(RAY_STATS_REFLECTION_SHADE_SUBGROUPS);
+
+    for (;;)
+    {
+        if (subgroupBroadcastFirst(mat_idx) == mat_idx)
+        {
+            if (subgroupElect())
+                INCREMENT_RAY_STAT(RAY_STATS_REFLECTION_SHADE_BATCHES);
+
+            break;
+        }
+    }
+}
+
+#endif
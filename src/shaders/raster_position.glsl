@@ -0,0 +1,23 @@
+// Clip space position of the raster passes that share the G-Buffer depth: the depth prepass, the G-Buffer and the
+// visibility buffer. The G-Buffer tests EQUAL against the prepass depth, which only holds if every pass computes
+// gl_Position with the same operations in the same order, so they all go through here. Needs the PerFrameUBO.
+
+// Invariant so that the compiler can't reorder the math differently between the passes.
+out gl_PerVertex
+{
+    invariant vec4 gl_Position;
+};
+
+// Writes the jittered clip space position of a model space vertex and returns its world space position.
+vec4 raster_position(vec3 position)
+{
+    vec4 world_pos = ubo.model * vec4(position, 1.0);
+
+    // Transform world position into clip space
+    gl_Position = ubo.projection * ubo.view * world_pos;
+
+    // Apply the sub-pixel jitter used by the temporal upsample.
+    gl_Position.xy += ubo.upsample_params.zw * gl_Position.w;
+
+    return world_pos;
+}
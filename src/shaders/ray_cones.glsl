@@ -0,0 +1,46 @@
+// Ray cone texture LOD selection for the reflection hits (Akenine-Moller et al., "Texture Level of Detail
+// Strategies for Real-Time Ray Tracing"). A cone starts at the camera with the spread of one pixel, widens to the
+// G-Buffer surface, is bent by that surface's curvature and picks the mip level where it lands from its width.
+// Must match ray_cones.h. CpuBenchmark compiles this file as C++ to check that it does, so only call the builtins
+// its glsl namespace maps.
+
+// Angle covered by one pixel of a render target 'height' pixels tall.
+float pixel_spread_angle(mat4 proj_inverse, float height)
+{
+    // The inverse projection scales NDC y by tan(fov_y / 2).
+    return atan(2.0 * abs(proj_inverse[1][1]) / height);
+}
+
+// Spread a mirror reflection adds to a cone from the position and normal differences to the neighbouring pixels.
+// Positive on convex surfaces, which widen the cone, negative on concave ones.
+float surface_spread_angle(vec3 dp_dx, vec3 dp_dy, vec3 dn_dx, vec3 dn_dy)
+{
+    // A reflected direction turns twice as far as the normal it reflects off.
+    const float curvature = sqrt(dot(dn_dx, dn_dx) + dot(dn_dy, dn_dy));
+    const float sign      = dot(dp_dx, dn_dx) + dot(dp_dy, dn_dy) < 0.0 ? -1.0 : 1.0;
+
+    return 2.0 * sign * curvature;
+}
+
+// Width of a cone 't' along a ray that left a surface where the cone was 'width' wide.
+float ray_cone_width(float width, float spread, float t)
+{
+    return width + spread * t;
+}
+
+// Texture independent part of the LOD of a triangle: half the log2 ratio of its UV area to its world space area.
+float triangle_lod_constant(vec3 p0, vec3 p1, vec3 p2, vec2 uv0, vec2 uv1, vec2 uv2)
+{
+    // Both areas are doubled, which cancels out.
+    const float world_area = length(cross(p1 - p0, p2 - p0));
+    const float uv_area    = abs((uv1.x - uv0.x) * (uv2.y - uv0.y) - (uv2.x - uv0.x) * (uv1.y - uv0.y));
+
+    return 0.5 * log2(max(uv_area, 1e-12) / max(world_area, 1e-12));
+}
+
+// Mip level of a 'texture_size' texture for a cone 'width' wide landing at 'cos_incidence' to the surface.
+float ray_cone_lod(float lod_constant, vec2 texture_size, float width, float cos_incidence)
+{
+    // Grazing hits stretch the footprint along the surface.
+    return lod_constant + 0.5 * log2(texture_size.x * texture_size.y) + log2(max(abs(width), 1e-8) / max(abs(cos_incidence), 1e-4));
+}
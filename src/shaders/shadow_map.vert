@@ -0,0 +1,52 @@
+#version 460
+
+layout(location = 0) in vec3 VS_IN_Position;
+layout(location = 1) in vec2 VS_IN_Texcoord;
+layout(location = 2) in vec3 VS_IN_Normal;
+layout(location = 3) in vec3 VS_IN_Tangent;
+layout(location = 4) in vec3 VS_IN_Bitangent;
+
+layout(set = 0, binding = 0) uniform PerFrameUBO
+{
+    mat4 view_inverse;
+    mat4 proj_inverse;
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+    vec4 cam_pos;
+    vec4 light_dir;
+    mat4 prev_view_proj;
+    vec4 upsample_params;
+    uvec4 ray_stats_params;
+    vec4 soft_shadow_params;
+    uvec4 soft_shadow_samples;
+    uvec4 light_params;
+    vec4 restir_params;
+    mat4 cascade_view_proj[4];
+    vec4 cascade_splits;
+    vec4 cascade_texel_sizes;
+    vec4 cascade_depth_ranges;
+    vec4 csm_params;
+    uvec4 visibility_params;
+    uvec4 alpha_test_params;
+    vec4 ray_cone_params;
+    vec4 ssr_params;
+    uvec4 vt_params;
+}
+ubo;
+
+layout(push_constant) uniform PushConstants
+{
+    uint cascade;
+}
+u_PushConstants;
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+void main()
+{
+    gl_Position = ubo.cascade_view_proj[u_PushConstants.cascade] * ubo.model * vec4(VS_IN_Position, 1.0);
+}
@@ -0,0 +1,108 @@
+// Virtual texturing of the material maps, see virtual_texturing.h. Every material is a virtual texture cut into
+// pages, of which only those the feedback asks for are resident in the physical caches, one per map. The
+// indirection texture has a layer per material and a mip per virtual mip, whose texels point at the resident
+// page that serves the virtual page, itself or its closest resident ancestor. Define VT_SET and VT_BINDING, the
+// first of four bindings, before including it. Expects the per-frame UBO (as 'ubo') to be declared before it.
+
+#define VT_PAGE_PAYLOAD 128.0
+#define VT_PAGE_BORDER 4.0
+#define VT_PAGE_SIZE 136.0
+#define VT_FEEDBACK_SCALE 16
+
+#define VT_MAP_ALBEDO 0
+#define VT_MAP_NORMAL 1
+#define VT_MAP_ROUGHNESS 2
+#define VT_MAP_METALLIC 3
+
+layout(set = VT_SET, binding = VT_BINDING) uniform usampler2DArray s_VtIndirection;
+
+layout(set = VT_SET, binding = VT_BINDING + 1) uniform sampler2D s_VtPhysical[4];
+
+// Pages per side of mip 0 and mip count of every material.
+layout(set = VT_SET, binding = VT_BINDING + 2, std430) readonly buffer VtTextureBuffer
+{
+    uvec4 textures[];
+}
+VtTextures;
+
+// Page requests, packed like pack_vt_page(), one per kVtFeedbackScale pixels square.
+layout(set = VT_SET, binding = VT_BINDING + 3, std430) writeonly buffer VtFeedbackBuffer
+{
+    uint requests[];
+}
+VtFeedback;
+
+bool vt_enabled()
+{
+    return (ubo.vt_params.x & 1) != 0;
+}
+
+// Texels of mip 0.
+vec2 vt_size(uint texture_idx)
+{
+    return vec2(VtTextures.textures[texture_idx].xy) * VT_PAGE_PAYLOAD;
+}
+
+float vt_lod(uint texture_idx, vec2 dx, vec2 dy)
+{
+    const vec2 size = vt_size(texture_idx);
+
+    return max(log2(max(length(dx * size), length(dy * size))), 0.0);
+}
+
+uint vt_mip(uint texture_idx, float lod)
+{
+    return min(uint(lod), VtTextures.textures[texture_idx].z - 1);
+}
+
+uvec2 vt_pages(uint texture_idx, uint mip)
+{
+    return max(VtTextures.textures[texture_idx].xy >> mip, uvec2(1));
+}
+
+uint vt_request(uint texture_idx, vec2 uv, float lod)
+{
+    const uint  mip   = vt_mip(texture_idx, lod);
+    const uvec2 pages = vt_pages(texture_idx, mip);
+    const uvec2 page  = min(uvec2(fract(uv) * vec2(pages)), pages - 1);
+
+    return (texture_idx << 20) | (mip << 16) | (page.x << 8) | page.y;
+}
+
+// Bilinear within the best resident page, there is no filtering across mips.
+vec4 vt_sample(uint texture_idx, uint map, vec2 uv, float lod)
+{
+    const uint  mip     = vt_mip(texture_idx, lod);
+    const uvec2 pages   = vt_pages(texture_idx, mip);
+    const vec2  wrapped = fract(uv);
+    const uvec2 page    = min(uvec2(wrapped * vec2(pages)), pages - 1);
+    const uint  entry   = texelFetch(s_VtIndirection, ivec3(page, texture_idx), int(mip)).r;
+
+    // The last mip of every material is always resident, so this only happens to materials the page file lacks.
+    if ((entry >> 24) == 0)
+        return vec4(1.0);
+
+    const uvec2 slot          = uvec2(entry & 0xff, (entry >> 8) & 0xff);
+    const uint  resident_mip  = (entry >> 16) & 0xff;
+    const vec2  in_page       = fract(wrapped * vec2(vt_pages(texture_idx, resident_mip)));
+    const vec2  physical_size = vec2(textureSize(s_VtPhysical[map], 0));
+
+    return textureLod(s_VtPhysical[map], (vec2(slot) * VT_PAGE_SIZE + VT_PAGE_BORDER + in_page * VT_PAGE_PAYLOAD) / physical_size, 0.0);
+}
+
+// Only one pixel of every kVtFeedbackScale square writes, which one moves every frame so that over a few frames
+// the feedback covers the whole square.
+void vt_write_feedback(uvec2 pixel, uint request)
+{
+    const uvec2 offset = uvec2((ubo.vt_params.x >> 8) & 0xff, (ubo.vt_params.x >> 16) & 0xff);
+
+    if (any(notEqual(pixel % VT_FEEDBACK_SCALE, offset)))
+        return;
+
+    const uvec2 texel = pixel / VT_FEEDBACK_SCALE;
+
+    if (texel.x >= ubo.vt_params.y || texel.y >= ubo.vt_params.z)
+        return;
+
+    VtFeedback.requests[ubo.vt_params.w + texel.y * ubo.vt_params.y + texel.x] = request;
+}
@@ -0,0 +1,67 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+#include "common.glsl"
+
+layout(location = 0) in vec2 FS_IN_Texcoord;
+
+layout(location = 0) out uint FS_OUT_Visibility;
+
+layout(set = 1, binding = 0) uniform sampler2D s_Diffuse;
+
+layout(set = 0, binding = 0) uniform PerFrameUBO
+{
+    mat4 view_inverse;
+    mat4 proj_inverse;
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+    vec4 cam_pos;
+    vec4 light_dir;
+    mat4 prev_view_proj;
+    vec4 upsample_params;
+    uvec4 ray_stats_params;
+    vec4 soft_shadow_params;
+    uvec4 soft_shadow_samples;
+    uvec4 light_params;
+    vec4 restir_params;
+    mat4 cascade_view_proj[4];
+    vec4 cascade_splits;
+    vec4 cascade_texel_sizes;
+    vec4 cascade_depth_ranges;
+    vec4 csm_params;
+    uvec4 visibility_params;
+    uvec4 alpha_test_params;
+    vec4 ray_cone_params;
+    vec4 ssr_params;
+    uvec4 vt_params;
+}
+ubo;
+
+#define VT_SET 2
+#define VT_BINDING 0
+#include "virtual_texture.glsl"
+
+layout(push_constant) uniform DrawConstants
+{
+    uint instance;
+    uint base_triangle; // First triangle of the draw within the instance's index buffer
+    uint material;      // Indexes the virtual textures
+}
+draw;
+
+void main()
+{
+    // Alpha testing is the only material access left in the raster pass, visibility_resolve.rgen writes the feedback.
+    float alpha;
+
+    if (vt_enabled())
+        alpha = vt_sample(draw.material, VT_MAP_ALBEDO, FS_IN_Texcoord, vt_lod(draw.material, dFdx(FS_IN_Texcoord), dFdy(FS_IN_Texcoord))).a;
+    else
+        alpha = texture(s_Diffuse, FS_IN_Texcoord).a;
+
+    if (alpha < 0.1)
+        discard;
+
+    FS_OUT_Visibility = (draw.instance << VISIBILITY_TRIANGLE_BITS) | (draw.base_triangle + uint(gl_PrimitiveID));
+}
\ No newline at end of file
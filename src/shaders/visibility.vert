@@ -0,0 +1,45 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+
+layout(location = 0) in vec3 VS_IN_Position;
+layout(location = 1) in vec2 VS_IN_Texcoord;
+
+layout(location = 0) out vec2 FS_IN_Texcoord;
+
+layout(set = 0, binding = 0) uniform PerFrameUBO
+{
+    mat4 view_inverse;
+    mat4 proj_inverse;
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+    vec4 cam_pos;
+    vec4 light_dir;
+    mat4 prev_view_proj;
+    vec4 upsample_params;
+    uvec4 ray_stats_params;
+    vec4 soft_shadow_params;
+    uvec4 soft_shadow_samples;
+    uvec4 light_params;
+    vec4 restir_params;
+    mat4 cascade_view_proj[4];
+    vec4 cascade_splits;
+    vec4 cascade_texel_sizes;
+    vec4 cascade_depth_ranges;
+    vec4 csm_params;
+    uvec4 visibility_params;
+    uvec4 alpha_test_params;
+    vec4 ray_cone_params;
+    vec4 ssr_params;
+    uvec4 vt_params;
+}
+ubo;
+
+#include "raster_position.glsl"
+
+void main()
+{
+    FS_IN_Texcoord = VS_IN_Texcoord;
+
+    raster_position(VS_IN_Position);
+}
\ No newline at end of file
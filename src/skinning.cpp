@@ -0,0 +1,215 @@
+#include "skinning.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <gtc/matrix_transform.hpp>
+
+static const float kPi = 3.14159265358979f;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+Skin build_hanging_skin(const std::vector<glm::vec3>& positions, uint32_t first_vertex, uint32_t joint_count, float phase)
+{
+    Skin skin;
+
+    skin.first_vertex = first_vertex;
+    skin.phase        = phase;
+
+    glm::vec3 min_extents = glm::vec3(FLT_MAX);
+    glm::vec3 max_extents = glm::vec3(-FLT_MAX);
+
+    for (const auto& position : positions)
+    {
+        min_extents = glm::min(min_extents, position);
+        max_extents = glm::max(max_extents, position);
+    }
+
+    if (positions.empty())
+        min_extents = max_extents = glm::vec3(0.0f);
+
+    const glm::vec3 size   = max_extents - min_extents;
+    const glm::vec3 center = (min_extents + max_extents) * 0.5f;
+
+    joint_count = std::max(joint_count, 2u);
+
+    // Cloth swings out of its plane, around the horizontal axis that lies in it.
+    skin.sway_axis = size.x < size.z ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+    skin.extent    = glm::length(size);
+
+    const float segment = size.y / float(joint_count - 1);
+
+    skin.joints.resize(joint_count);
+
+    for (uint32_t i = 0; i < joint_count; i++)
+    {
+        Joint&          joint    = skin.joints[i];
+        const glm::vec3 position = glm::vec3(center.x, max_extents.y - segment * float(i), center.z);
+
+        joint.parent       = int32_t(i) - 1;
+        joint.local_rest   = glm::translate(glm::mat4(1.0f), i == 0 ? position : glm::vec3(0.0f, -segment, 0.0f));
+        joint.inverse_bind = glm::translate(glm::mat4(1.0f), -position);
+        joint.bounds_min   = glm::vec3(FLT_MAX);
+        joint.bounds_max   = glm::vec3(-FLT_MAX);
+    }
+
+    skin.influences.resize(positions.size());
+
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        // Distance down the chain in joints, a flat skin hangs entirely from the root.
+        const float    t  = segment > 0.0f ? glm::clamp((max_extents.y - positions[i].y) / segment, 0.0f, float(joint_count - 1)) : 0.0f;
+        const uint32_t j0 = std::min(uint32_t(t), joint_count - 1);
+        const uint32_t j1 = std::min(j0 + 1, joint_count - 1);
+        const float    w1 = t - float(j0);
+
+        JointInfluence& influence = skin.influences[i];
+
+        influence.joints  = glm::uvec4(j0, j1, 0, 0);
+        influence.weights = glm::vec4(1.0f - w1, w1, 0.0f, 0.0f);
+
+        Joint& joint = skin.joints[w1 < 0.5f ? j0 : j1];
+
+        joint.bounds_min = glm::min(joint.bounds_min, positions[i]);
+        joint.bounds_max = glm::max(joint.bounds_max, positions[i]);
+    }
+
+    // Joints that influence no vertex most keep an empty box at their position.
+    for (auto& joint : skin.joints)
+    {
+        if (joint.bounds_min.x > joint.bounds_max.x)
+            joint.bounds_min = joint.bounds_max = glm::vec3(glm::inverse(joint.inverse_bind)[3]);
+    }
+
+    return skin;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void pose_skin(const Skin& skin, const SwaySettings& settings, float time, glm::mat4* palette)
+{
+    std::vector<glm::mat4> world(skin.joints.size());
+
+    for (size_t i = 0; i < skin.joints.size(); i++)
+    {
+        const Joint& joint = skin.joints[i];
+
+        // A wave running down the chain.
+        const float     angle = settings.amplitude * std::sin(2.0f * kPi * settings.frequency * time + skin.phase - 0.6f * float(i));
+        const glm::mat4 local = glm::rotate(joint.local_rest, angle, skin.sway_axis);
+
+        world[i]   = joint.parent >= 0 ? world[joint.parent] * local : local;
+        palette[i] = world[i] * joint.inverse_bind;
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void skin_vertices_cpu(const std::vector<SkinVertex>& rest, const Skin& skin, const glm::mat4* palette, std::vector<SkinVertex>& skinned)
+{
+    skinned.resize(rest.size());
+
+    for (size_t i = 0; i < rest.size(); i++)
+    {
+        const JointInfluence& influence = skin.influences[i];
+        const SkinVertex&     vertex    = rest[i];
+
+        glm::mat4 m = glm::mat4(0.0f);
+
+        for (uint32_t j = 0; j < 4; j++)
+            m += palette[influence.joints[j]] * influence.weights[j];
+
+        // The joints only rotate and translate, so the blended matrix also transforms the tangent frame.
+        const glm::mat3 r = glm::mat3(m);
+
+        SkinVertex& out = skinned[i];
+
+        out.position  = glm::vec4(glm::vec3(m * glm::vec4(glm::vec3(vertex.position), 1.0f)), vertex.position.w);
+        out.tex_coord = vertex.tex_coord;
+        out.normal    = glm::vec4(glm::normalize(r * glm::vec3(vertex.normal)), vertex.normal.w);
+        out.tangent   = glm::vec4(glm::normalize(r * glm::vec3(vertex.tangent)), vertex.tangent.w);
+        out.bitangent = glm::vec4(glm::normalize(r * glm::vec3(vertex.bitangent)), vertex.bitangent.w);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+SkinningError compare_skinned_vertices(const std::vector<SkinVertex>& reference, const std::vector<SkinVertex>& skinned)
+{
+    SkinningError error;
+
+    error.vertices = uint32_t(std::min(reference.size(), skinned.size()));
+
+    for (uint32_t i = 0; i < error.vertices; i++)
+    {
+        const SkinVertex& a = reference[i];
+        const SkinVertex& b = skinned[i];
+
+        error.max_position = std::max(error.max_position, glm::length(glm::vec3(a.position) - glm::vec3(b.position)));
+        error.max_normal   = std::max(error.max_normal, glm::length(glm::vec3(a.normal) - glm::vec3(b.normal)));
+
+        if (a.position.w != b.position.w || a.tex_coord.x != b.tex_coord.x || a.tex_coord.y != b.tex_coord.y)
+            error.mismatched++;
+    }
+
+    return error;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void BlasRebuildHeuristic::built(const std::vector<glm::mat4>& palette)
+{
+    m_build_palette = palette;
+    m_deformation   = 0.0f;
+    m_refits        = 0;
+    m_builds++;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool BlasRebuildHeuristic::should_rebuild(const std::vector<Skin>& skins, const std::vector<glm::mat4>& palette)
+{
+    if (m_build_palette.size() != palette.size())
+        return true;
+
+    m_deformation = 0.0f;
+
+    for (const auto& skin : skins)
+    {
+        if (skin.joints.empty() || skin.extent <= 0.0f)
+            continue;
+
+        // Motion of the whole skin since the build, which a refit handles as well as a build.
+        const uint32_t  root       = skin.first_joint;
+        const glm::mat4 root_delta = palette[root] * glm::inverse(m_build_palette[root]);
+
+        for (uint32_t i = 0; i < skin.joints.size(); i++)
+        {
+            const Joint&    joint = skin.joints[i];
+            const uint32_t  idx   = skin.first_joint + i;
+            const glm::mat4 delta = palette[idx] * glm::inverse(m_build_palette[idx]);
+
+            for (uint32_t corner = 0; corner < 8; corner++)
+            {
+                const glm::vec3 rest = glm::vec3((corner & 1) ? joint.bounds_max.x : joint.bounds_min.x,
+                                                 (corner & 2) ? joint.bounds_max.y : joint.bounds_min.y,
+                                                 (corner & 4) ? joint.bounds_max.z : joint.bounds_min.z);
+
+                // Where the corner was at the build and how far it moved relative to the root since.
+                const glm::vec4 built = m_build_palette[idx] * glm::vec4(rest, 1.0f);
+                const float     moved = glm::length(glm::vec3(delta * built) - glm::vec3(root_delta * built));
+
+                m_deformation = std::max(m_deformation, moved / skin.extent);
+            }
+        }
+    }
+
+    if (m_deformation > m_settings.max_deformation || m_refits >= m_settings.max_refits)
+        return true;
+
+    m_refits++;
+
+    return false;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+// Vertex of the scene's vertex buffer, Vertex in common.glsl. position.w holds the submesh index.
+struct SkinVertex
+{
+    glm::vec4 position;
+    glm::vec4 tex_coord;
+    glm::vec4 normal;
+    glm::vec4 tangent;
+    glm::vec4 bitangent;
+};
+
+// Up to four joints of the vertex's skin and their weights, which sum to one. Matches JointInfluence in
+// skinning.comp.
+struct JointInfluence
+{
+    glm::uvec4 joints  = glm::uvec4(0);
+    glm::vec4  weights = glm::vec4(0.0f);
+};
+
+struct Joint
+{
+    int32_t   parent = -1; // Parents come before their children, the root has none.
+    glm::mat4 local_rest;  // Relative to the parent in the bind pose.
+    glm::mat4 inverse_bind;
+    glm::vec3 bounds_min; // Bind pose box of the vertices the joint influences most.
+    glm::vec3 bounds_max;
+};
+
+// A contiguous range of the scene's vertices deformed by a chain of joints.
+struct Skin
+{
+    uint32_t                    first_vertex = 0;
+    uint32_t                    first_joint  = 0; // Of the skin's joints in the scene's palette.
+    std::vector<JointInfluence> influences;       // One per vertex of the range.
+    std::vector<Joint>          joints;
+    glm::vec3                   sway_axis = glm::vec3(1.0f, 0.0f, 0.0f);
+    float                       phase     = 0.0f; // Of the sway, so that neighbouring skins don't move in step.
+    float                       extent    = 0.0f; // Diagonal of the bind pose bounds.
+
+    inline uint32_t vertex_count() const { return uint32_t(influences.size()); }
+};
+
+struct SwaySettings
+{
+    float amplitude = 0.05f; // Radians per joint, the bends add up along the chain.
+    float frequency = 0.4f;  // Hertz.
+};
+
+// The scene is imported without skeletons, so deforming submeshes get a procedural rig: a chain of
+// 'joint_count' joints hanging down the vertical extent of the vertices from their top, every vertex bound
+// to the two joints it lies between. Made for hanging cloth such as curtains and banners.
+Skin build_hanging_skin(const std::vector<glm::vec3>& positions, uint32_t first_vertex, uint32_t joint_count, float phase);
+
+// Palette of the skin at 'time': every joint swings around the skin's sway axis and carries its children.
+// Writes one skinning matrix, joint transform times inverse bind matrix, per joint.
+void pose_skin(const Skin& skin, const SwaySettings& settings, float time, glm::mat4* palette);
+
+// CPU reference of skinning.comp: linear blend skinning of the positions and the tangent frame. 'palette'
+// holds the skin's own joints, the rest of the vertex is copied.
+void skin_vertices_cpu(const std::vector<SkinVertex>& rest, const Skin& skin, const glm::mat4* palette, std::vector<SkinVertex>& skinned);
+
+struct SkinningError
+{
+    float    max_position = 0.0f; // World units.
+    float    max_normal   = 0.0f; // Length of the difference of the unit normals.
+    uint32_t vertices     = 0;
+    uint32_t mismatched   = 0; // Different submesh index or texture coordinates.
+};
+
+// Compares the GPU's output with the CPU reference, vertex by vertex.
+SkinningError compare_skinned_vertices(const std::vector<SkinVertex>& reference, const std::vector<SkinVertex>& skinned);
+
+struct BlasRebuildSettings
+{
+    float    max_deformation = 0.1f; // Fraction of a skin's extent.
+    uint32_t max_refits      = 300;
+};
+
+// Chooses between refitting the skinned BLAS and building it again. A refit keeps the tree built for the pose
+// of the last build, whose nodes group vertices that were close then, and only grows the nodes' boxes. It is as
+// good as a build as long as the skins move rigidly, and degrades as parts of a skin move apart. The estimate of
+// that is the largest distance a joint's box moved relative to its skin's root since the build, as a fraction
+// of the skin's size. The refit count is capped as well, the estimate misses what the joints' boxes don't show.
+class BlasRebuildHeuristic
+{
+public:
+    inline void                       set_settings(const BlasRebuildSettings& settings) { m_settings = settings; }
+    inline const BlasRebuildSettings& settings() const { return m_settings; }
+
+    // The palette the BLAS was just built with.
+    void built(const std::vector<glm::mat4>& palette);
+
+    // Whether this frame's palette is better served by a build than a refit. Counts a refit if it isn't.
+    bool should_rebuild(const std::vector<Skin>& skins, const std::vector<glm::mat4>& palette);
+
+    inline float    deformation() const { return m_deformation; }
+    inline uint32_t refits() const { return m_refits; }
+    inline uint32_t builds() const { return m_builds; }
+
+private:
+    BlasRebuildSettings    m_settings;
+    std::vector<glm::mat4> m_build_palette;
+    float                  m_deformation = 0.0f;
+    uint32_t               m_refits      = 0;
+    uint32_t               m_builds      = 0;
+};
@@ -0,0 +1,348 @@
+#include "startup_graph.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+static const uint32_t kTimelineWidth = 48;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::string escape_json(const std::string& str)
+{
+    std::string result;
+
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+
+        result += c;
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::string lane_name(uint32_t lane)
+{
+    return lane == 0 ? "main" : "worker " + std::to_string(lane);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t StartupGraph::add(const std::string& name, const std::vector<uint32_t>& dependencies, StartupThread thread, const std::function<bool()>& fn)
+{
+    StartupPhase phase;
+
+    phase.name         = name;
+    phase.dependencies = dependencies;
+    phase.thread       = thread;
+    phase.fn           = fn;
+
+    for (uint32_t dependency : dependencies)
+        assert(dependency < m_phases.size());
+
+    m_phases.push_back(phase);
+
+    return uint32_t(m_phases.size() - 1);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool StartupGraph::run(uint32_t worker_count)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const Clock::time_point start = Clock::now();
+    const uint32_t          count = uint32_t(m_phases.size());
+
+    std::vector<uint32_t>              waiting(count); // Dependencies that haven't finished.
+    std::vector<std::vector<uint32_t>> dependents(count);
+    std::vector<bool>                  started(count, false);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        m_phases[i].ran = false;
+        waiting[i]      = uint32_t(m_phases[i].dependencies.size());
+
+        for (uint32_t dependency : m_phases[i].dependencies)
+            dependents[dependency].push_back(i);
+    }
+
+    std::mutex              mutex;
+    std::condition_variable wake;
+    uint32_t                finished = 0;
+    uint32_t                running  = 0;
+    bool                    failed   = false;
+
+    m_failed_phase.clear();
+
+    // Lowest ready phase the thread may run, in the order they were added.
+    auto next_phase = [&](uint32_t lane) {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (started[i] || waiting[i] > 0)
+                continue;
+
+            if (lane == 0 ? (m_phases[i].thread == STARTUP_THREAD_MAIN || worker_count == 0) : m_phases[i].thread == STARTUP_THREAD_ANY)
+                return i;
+        }
+
+        return UINT32_MAX;
+    };
+
+    auto run_lane = [&](uint32_t lane) {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while (true)
+        {
+            const uint32_t idx = failed ? UINT32_MAX : next_phase(lane);
+
+            if (idx == UINT32_MAX)
+            {
+                // After a failure the running phases still have to finish, they may use what the others created.
+                if (finished == count || (failed && running == 0))
+                    break;
+
+                wake.wait(lock);
+                continue;
+            }
+
+            started[idx] = true;
+            running++;
+
+            StartupPhase& phase = m_phases[idx];
+
+            lock.unlock();
+
+            phase.start_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+            const bool success = phase.fn();
+
+            phase.end_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            phase.lane   = lane;
+            phase.ran    = true;
+
+            lock.lock();
+
+            running--;
+            finished++;
+
+            if (!success && !failed)
+            {
+                failed         = true;
+                m_failed_phase = phase.name;
+            }
+
+            for (uint32_t dependent : dependents[idx])
+                waiting[dependent]--;
+
+            wake.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (uint32_t i = 0; i < worker_count; i++)
+        workers.push_back(std::thread(run_lane, i + 1));
+
+    run_lane(0);
+
+    for (auto& worker : workers)
+        worker.join();
+
+    m_thread_count = worker_count + 1;
+    m_wall_ms      = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    return !failed;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<uint32_t> StartupGraph::critical_path() const
+{
+    uint32_t current = UINT32_MAX;
+
+    for (uint32_t i = 0; i < m_phases.size(); i++)
+    {
+        if (m_phases[i].ran && (current == UINT32_MAX || m_phases[i].end_ms > m_phases[current].end_ms))
+            current = i;
+    }
+
+    std::vector<uint32_t> path;
+
+    while (current != UINT32_MAX)
+    {
+        path.push_back(current);
+
+        const StartupPhase& phase    = m_phases[current];
+        uint32_t            previous = UINT32_MAX;
+
+        // Whichever finished last held the phase up, be it a dependency or the thread being busy.
+        for (uint32_t i = 0; i < m_phases.size(); i++)
+        {
+            const StartupPhase& other = m_phases[i];
+
+            if (!other.ran || i == current)
+                continue;
+
+            const bool dependency = std::find(phase.dependencies.begin(), phase.dependencies.end(), i) != phase.dependencies.end();
+            const bool same_lane  = other.lane == phase.lane && other.end_ms <= phase.start_ms;
+
+            if ((dependency || same_lane) && (previous == UINT32_MAX || other.end_ms > m_phases[previous].end_ms))
+                previous = i;
+        }
+
+        current = previous;
+    }
+
+    std::reverse(path.begin(), path.end());
+
+    return path;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+double StartupGraph::work_ms() const
+{
+    double total = 0.0;
+
+    for (const auto& phase : m_phases)
+    {
+        if (phase.ran)
+            total += phase.end_ms - phase.start_ms;
+    }
+
+    return total;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<std::string> StartupGraph::report() const
+{
+    const std::vector<uint32_t> path = critical_path();
+
+    std::vector<uint32_t> order;
+
+    for (uint32_t i = 0; i < m_phases.size(); i++)
+        order.push_back(i);
+
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return m_phases[a].start_ms < m_phases[b].start_ms; });
+
+    std::vector<std::string> lines;
+    char                     line[256];
+
+    const double work = work_ms();
+
+    snprintf(line, sizeof(line), "Startup: %.1f ms on %u threads, %.1f ms of work (%.2fx)", m_wall_ms, m_thread_count, work, m_wall_ms > 0.0 ? work / m_wall_ms : 1.0);
+    lines.push_back(line);
+
+    for (uint32_t idx : order)
+    {
+        const StartupPhase& phase = m_phases[idx];
+
+        if (!phase.ran)
+        {
+            snprintf(line, sizeof(line), "  %-32s not run", phase.name.c_str());
+            lines.push_back(line);
+            continue;
+        }
+
+        // Every phase gets at least one column, so that short ones still show where they ran.
+        const uint32_t first = m_wall_ms > 0.0 ? std::min(uint32_t(phase.start_ms / m_wall_ms * kTimelineWidth), kTimelineWidth - 1) : 0;
+        const uint32_t last  = m_wall_ms > 0.0 ? std::min(uint32_t(phase.end_ms / m_wall_ms * kTimelineWidth), kTimelineWidth - 1) : 0;
+
+        std::string bar(kTimelineWidth, ' ');
+
+        for (uint32_t i = first; i <= last; i++)
+            bar[i] = '#';
+
+        const bool critical = std::find(path.begin(), path.end(), idx) != path.end();
+
+        snprintf(line, sizeof(line), "  %-32s %-9s %8.1f %8.1f ms |%s|%s", phase.name.c_str(), lane_name(phase.lane).c_str(), phase.start_ms, phase.end_ms, bar.c_str(), critical ? " *" : "");
+        lines.push_back(line);
+    }
+
+    double      path_ms = 0.0;
+    std::string chain;
+
+    for (uint32_t idx : path)
+    {
+        const double duration = m_phases[idx].end_ms - m_phases[idx].start_ms;
+
+        snprintf(line, sizeof(line), "%s%s (%.1f)", chain.empty() ? "" : " > ", m_phases[idx].name.c_str(), duration);
+
+        path_ms += duration;
+        chain += line;
+    }
+
+    // What's left of the wall time went to waking threads up, or to a thread idling while its next phase waited.
+    snprintf(line, sizeof(line), "Critical path (*): %.1f ms, %.1f ms idle", path_ms, std::max(m_wall_ms - path_ms, 0.0));
+    lines.push_back(line);
+    lines.push_back("  " + chain);
+
+    return lines;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool StartupGraph::write_json(const std::string& path, double first_frame_ms) const
+{
+    FILE* file = fopen(path.c_str(), "w");
+
+    if (!file)
+        return false;
+
+    const std::vector<uint32_t> critical = critical_path();
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"wall_ms\": %.3f,\n", m_wall_ms);
+    fprintf(file, "  \"work_ms\": %.3f,\n", work_ms());
+    fprintf(file, "  \"first_frame_ms\": %.3f,\n", first_frame_ms);
+    fprintf(file, "  \"threads\": %u,\n", m_thread_count);
+    fprintf(file, "  \"failed_phase\": \"%s\",\n", escape_json(m_failed_phase).c_str());
+
+    fprintf(file, "  \"phases\": [\n");
+
+    for (size_t i = 0; i < m_phases.size(); i++)
+    {
+        const StartupPhase& phase = m_phases[i];
+
+        std::string dependencies;
+
+        for (uint32_t dependency : phase.dependencies)
+            dependencies += (dependencies.empty() ? "\"" : ", \"") + escape_json(m_phases[dependency].name) + "\"";
+
+        fprintf(file, "    { \"name\": \"%s\", \"thread\": \"%s\", \"ran\": %s, \"start_ms\": %.3f, \"end_ms\": %.3f, \"critical\": %s, \"dependencies\": [%s] }%s\n",
+                escape_json(phase.name).c_str(),
+                phase.ran ? lane_name(phase.lane).c_str() : "",
+                phase.ran ? "true" : "false",
+                phase.start_ms,
+                phase.end_ms,
+                std::find(critical.begin(), critical.end(), uint32_t(i)) != critical.end() ? "true" : "false",
+                dependencies.c_str(),
+                i + 1 < m_phases.size() ? "," : "");
+    }
+
+    fprintf(file, "  ],\n");
+
+    fprintf(file, "  \"critical_path\": [");
+
+    for (size_t i = 0; i < critical.size(); i++)
+        fprintf(file, "%s\"%s\"", i == 0 ? "" : ", ", escape_json(m_phases[critical[i]].name).c_str());
+
+    fprintf(file, "]\n");
+    fprintf(file, "}\n");
+
+    fclose(file);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
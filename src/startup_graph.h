@@ -0,0 +1,65 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum StartupThread
+{
+    STARTUP_THREAD_ANY,
+    STARTUP_THREAD_MAIN // Records or submits command buffers, or touches state only the main thread may.
+};
+
+struct StartupPhase
+{
+    std::string           name;
+    std::vector<uint32_t> dependencies;
+    StartupThread         thread = STARTUP_THREAD_ANY;
+    std::function<bool()> fn;
+    double                start_ms = 0.0; // Relative to the start of run().
+    double                end_ms   = 0.0;
+    uint32_t              lane     = 0; // Thread it ran on, 0 is the main thread.
+    bool                  ran      = false;
+};
+
+// Startup work as a graph of phases, each started as soon as the phases it depends on finished. Phases that
+// only create objects run on worker threads so that pipelines compile while the main thread loads and uploads
+// the scene. Also profiles the phases: the timeline shows what overlapped, and the critical path is the chain
+// of phases that held up the end of startup.
+class StartupGraph
+{
+public:
+    // Returns the index other phases depend on. Dependencies have to be added before their dependents, which
+    // keeps the graph free of cycles.
+    uint32_t add(const std::string& name, const std::vector<uint32_t>& dependencies, StartupThread thread, const std::function<bool()>& fn);
+
+    // Runs every phase on the calling thread and 'worker_count' workers, zero runs them in the order they were
+    // added. Main thread phases run in that order too. After a phase fails no more are started, and false is
+    // returned once the running ones finished.
+    bool run(uint32_t worker_count);
+
+    // Ends with the last phase to finish, every phase before is the one that kept the next from starting earlier:
+    // a dependency, or the phase before it on the same thread.
+    std::vector<uint32_t> critical_path() const;
+
+    // Timeline of the phases with their threads and the critical path, one line each.
+    std::vector<std::string> report() const;
+
+    // 'first_frame_ms' is the time until the first frame was submitted, from wherever the caller's startup began.
+    bool write_json(const std::string& path, double first_frame_ms) const;
+
+    inline const std::vector<StartupPhase>& phases() const { return m_phases; }
+    inline double                           wall_ms() const { return m_wall_ms; }
+    inline uint32_t                         thread_count() const { return m_thread_count; }
+    inline const std::string&               failed_phase() const { return m_failed_phase; }
+
+    // Sum of the phase durations, what startup would take on a single thread.
+    double work_ms() const;
+
+private:
+    std::vector<StartupPhase> m_phases;
+    double                    m_wall_ms      = 0.0;
+    uint32_t                  m_thread_count = 1;
+    std::string               m_failed_phase;
+};
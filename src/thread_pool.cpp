@@ -0,0 +1,112 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ThreadPool::ThreadPool(uint32_t thread_count) :
+    m_next_item(0)
+{
+    if (thread_count == 0)
+        thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    for (uint32_t i = 1; i < thread_count; i++)
+        m_workers.push_back(std::thread(&ThreadPool::worker_thread, this));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ThreadPool::parallel_for(uint32_t count, const std::function<void(uint32_t)>& fn)
+{
+    if (count == 0)
+        return;
+
+    if (m_workers.empty() || count == 1)
+    {
+        for (uint32_t i = 0; i < count; i++)
+            fn(i);
+
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_job       = &fn;
+        m_job_count = count;
+        m_active    = uint32_t(m_workers.size());
+        m_next_item.store(0);
+        m_generation++;
+    }
+
+    m_wake.notify_all();
+
+    run_items(fn, count);
+
+    // Every worker checks in once per job, even if the caller already took all the items.
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_active == 0; });
+
+    m_job = nullptr;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ThreadPool::worker_thread()
+{
+    uint64_t generation = 0;
+
+    while (true)
+    {
+        const std::function<void(uint32_t)>* job   = nullptr;
+        uint32_t                             count = 0;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this, generation]() { return m_quit || m_generation != generation; });
+
+            if (m_quit)
+                return;
+
+            generation = m_generation;
+            job        = m_job;
+            count      = m_job_count;
+        }
+
+        run_items(*job, count);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (--m_active == 0)
+                m_done.notify_one();
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void ThreadPool::run_items(const std::function<void(uint32_t)>& fn, uint32_t count)
+{
+    uint32_t item;
+
+    while ((item = m_next_item.fetch_add(1)) < count)
+        fn(item);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that split index ranges between them. The calling thread takes part in
+// every job, so a pool with zero workers simply runs everything inline.
+class ThreadPool
+{
+public:
+    // 'thread_count' includes the caller, zero uses every hardware thread.
+    ThreadPool(uint32_t thread_count = 0);
+    ~ThreadPool();
+
+    // Calls 'fn' once for every index in [0, count) and returns when all of them finished. Not reentrant,
+    // 'fn' must not call back into the pool.
+    void parallel_for(uint32_t count, const std::function<void(uint32_t)>& fn);
+
+    inline uint32_t thread_count() const { return uint32_t(m_workers.size()) + 1; }
+
+private:
+    void worker_thread();
+    void run_items(const std::function<void(uint32_t)>& fn, uint32_t count);
+
+private:
+    std::vector<std::thread>             m_workers;
+    std::mutex                           m_mutex;
+    std::condition_variable              m_wake;
+    std::condition_variable              m_done;
+    const std::function<void(uint32_t)>* m_job        = nullptr;
+    uint32_t                             m_job_count  = 0;
+    std::atomic<uint32_t>                m_next_item;
+    uint32_t                             m_active     = 0;
+    uint64_t                             m_generation = 0;
+    bool                                 m_quit       = false;
+};
@@ -0,0 +1,272 @@
+#include "timing_report.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Whole cell or nothing, so that a truncated or hand edited baseline can't throw or half parse.
+static bool parse_cell(const std::string& cell, uint64_t& value)
+{
+    char* end = nullptr;
+
+    value = strtoull(cell.c_str(), &end, 10);
+
+    return end != cell.c_str() && *end == '\0' && cell[0] != '-';
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static bool parse_cell(const std::string& cell, float& value)
+{
+    char* end = nullptr;
+
+    value = strtof(cell.c_str(), &end);
+
+    return end != cell.c_str() && *end == '\0';
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameTimingLog::record(uint64_t frame, const std::string& column, float value_ms)
+{
+    auto     it    = std::find(m_columns.begin(), m_columns.end(), column);
+    uint32_t index = uint32_t(it - m_columns.begin());
+
+    if (it == m_columns.end())
+        m_columns.push_back(column);
+
+    m_rows[frame][index] = value_ms;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void FrameTimingLog::clear()
+{
+    m_columns.clear();
+    m_rows.clear();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<float> FrameTimingLog::column_values(const std::string& column, uint32_t skip_frames) const
+{
+    std::vector<float> values;
+
+    auto it = std::find(m_columns.begin(), m_columns.end(), column);
+
+    if (it == m_columns.end())
+        return values;
+
+    const uint32_t index = uint32_t(it - m_columns.begin());
+    uint32_t       row   = 0;
+
+    for (const auto& frame : m_rows)
+    {
+        if (row++ < skip_frames)
+            continue;
+
+        auto value = frame.second.find(index);
+
+        if (value != frame.second.end())
+            values.push_back(value->second);
+    }
+
+    return values;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool FrameTimingLog::write_csv(const std::string& path) const
+{
+    std::ofstream file(path);
+
+    if (!file.is_open())
+        return false;
+
+    file << "frame";
+
+    for (const auto& column : m_columns)
+        file << "," << column;
+
+    file << "\n";
+
+    for (const auto& frame : m_rows)
+    {
+        file << frame.first;
+
+        for (uint32_t i = 0; i < m_columns.size(); i++)
+        {
+            file << ",";
+
+            auto value = frame.second.find(i);
+
+            if (value != frame.second.end())
+                file << value->second;
+        }
+
+        file << "\n";
+    }
+
+    return file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool FrameTimingLog::load_csv(const std::string& path)
+{
+    clear();
+
+    std::ifstream file(path);
+
+    if (!file.is_open())
+        return false;
+
+    std::string line;
+
+    if (!std::getline(file, line))
+        return false;
+
+    // Header: the first column holds the frame number.
+    std::istringstream header(line);
+    std::string        cell;
+
+    std::getline(header, cell, ',');
+
+    while (std::getline(header, cell, ','))
+        m_columns.push_back(cell);
+
+    while (std::getline(file, line))
+    {
+        std::istringstream row(line);
+
+        if (!std::getline(row, cell, ',') || cell.empty())
+            continue;
+
+        uint64_t frame;
+
+        if (!parse_cell(cell, frame))
+            continue;
+
+        // Rows with a value that doesn't parse are skipped whole, rather than compared with a partial row.
+        std::map<uint32_t, float> data;
+        bool                      valid = true;
+
+        for (uint32_t i = 0; i < m_columns.size() && std::getline(row, cell, ','); i++)
+        {
+            if (!cell.empty() && !parse_cell(cell, data[i]))
+            {
+                valid = false;
+                break;
+            }
+        }
+
+        if (valid)
+            m_rows[frame] = data;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TimingStatistics compute_timing_statistics(std::vector<float> values)
+{
+    TimingStatistics stats;
+
+    if (values.empty())
+        return stats;
+
+    std::sort(values.begin(), values.end());
+
+    double sum = 0.0;
+
+    for (float value : values)
+        sum += value;
+
+    auto percentile = [&values](float p) {
+        return values[std::min(size_t(p * float(values.size() - 1) + 0.5f), values.size() - 1)];
+    };
+
+    stats.count = values.size();
+    stats.mean  = float(sum / double(values.size()));
+    stats.p50   = percentile(0.5f);
+    stats.p95   = percentile(0.95f);
+    stats.p99   = percentile(0.99f);
+    stats.max   = values.back();
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::vector<TimingComparison> compare_timings(const FrameTimingLog& current, const FrameTimingLog& baseline, const RegressionThresholds& thresholds)
+{
+    std::vector<TimingComparison> comparisons;
+
+    for (const auto& column : current.columns())
+    {
+        const auto& baseline_columns = baseline.columns();
+
+        if (std::find(baseline_columns.begin(), baseline_columns.end(), column) == baseline_columns.end())
+            continue;
+
+        TimingComparison comparison;
+
+        comparison.column   = column;
+        comparison.current  = compute_timing_statistics(current.column_values(column, thresholds.warmup_frames));
+        comparison.baseline = compute_timing_statistics(baseline.column_values(column, thresholds.warmup_frames));
+
+        if (comparison.current.count == 0 || comparison.baseline.count == 0)
+            continue;
+
+        if (comparison.baseline.mean > 0.0f)
+            comparison.mean_delta_pct = (comparison.current.mean / comparison.baseline.mean - 1.0f) * 100.0f;
+
+        if (comparison.baseline.p95 > 0.0f)
+            comparison.p95_delta_pct = (comparison.current.p95 / comparison.baseline.p95 - 1.0f) * 100.0f;
+
+        comparison.regressed = comparison.mean_delta_pct > thresholds.mean_pct || comparison.p95_delta_pct > thresholds.p95_pct;
+
+        comparisons.push_back(comparison);
+    }
+
+    return comparisons;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+std::string write_comparison_report(const std::string& path, const std::vector<TimingComparison>& comparisons)
+{
+    std::stringstream summary;
+    std::ofstream     file(path);
+
+    if (file.is_open())
+        file << "column,baseline_mean,current_mean,mean_delta_pct,baseline_p95,current_p95,p95_delta_pct,regressed\n";
+
+    uint32_t regressions = 0;
+
+    for (const auto& comparison : comparisons)
+    {
+        if (file.is_open())
+        {
+            file << comparison.column << "," << comparison.baseline.mean << "," << comparison.current.mean << "," << comparison.mean_delta_pct << ","
+                 << comparison.baseline.p95 << "," << comparison.current.p95 << "," << comparison.p95_delta_pct << "," << (comparison.regressed ? 1 : 0) << "\n";
+        }
+
+        summary << (comparison.regressed ? "REGRESSION " : "ok         ") << comparison.column << ": mean " << comparison.baseline.mean << " -> "
+                << comparison.current.mean << " ms (" << comparison.mean_delta_pct << "%), p95 " << comparison.baseline.p95 << " -> "
+                << comparison.current.p95 << " ms (" << comparison.p95_delta_pct << "%)\n";
+
+        if (comparison.regressed)
+            regressions++;
+    }
+
+    summary << regressions << " of " << comparisons.size() << " timings regressed";
+
+    return summary.str();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Summary of one timing column. All values are in milliseconds.
+struct TimingStatistics
+{
+    size_t count = 0;
+    float  mean  = 0.0f;
+    float  p50   = 0.0f;
+    float  p95   = 0.0f;
+    float  p99   = 0.0f;
+    float  max   = 0.0f;
+};
+
+// Relative slowdowns tolerated before a column is flagged as a regression.
+struct RegressionThresholds
+{
+    float    mean_pct      = 5.0f;  // Allowed increase of the mean in percent.
+    float    p95_pct       = 10.0f; // Allowed increase of the 95th percentile in percent.
+    uint32_t warmup_frames = 30;    // Leading frames ignored by both runs (pipeline and cache warm-up).
+};
+
+struct TimingComparison
+{
+    std::string      column;
+    TimingStatistics current;
+    TimingStatistics baseline;
+    float            mean_delta_pct = 0.0f;
+    float            p95_delta_pct  = 0.0f;
+    bool             regressed      = false;
+};
+
+// Per-frame timings keyed by frame number. CPU and GPU values for the same frame arrive at different times
+// (GPU timestamps resolve a few frames late), so values are stored by column and rows are assembled on write.
+// Values that were never recorded, e.g. GPU timings dropped because the results weren't ready, are left empty.
+class FrameTimingLog
+{
+public:
+    void record(uint64_t frame, const std::string& column, float value_ms);
+    void clear();
+
+    // Values of a column in frame order, skipping the first 'skip_frames' rows and missing entries.
+    std::vector<float> column_values(const std::string& column, uint32_t skip_frames = 0) const;
+
+    bool write_csv(const std::string& path) const;
+    bool load_csv(const std::string& path);
+
+    inline const std::vector<std::string>& columns() const { return m_columns; }
+    inline size_t                          frame_count() const { return m_rows.size(); }
+
+private:
+    std::vector<std::string>                      m_columns;
+    std::map<uint64_t, std::map<uint32_t, float>> m_rows;
+};
+
+TimingStatistics compute_timing_statistics(std::vector<float> values);
+
+// Compares every column present in both logs.
+std::vector<TimingComparison> compare_timings(const FrameTimingLog& current, const FrameTimingLog& baseline, const RegressionThresholds& thresholds);
+
+// Writes the comparison as CSV and returns a human readable summary.
+std::string write_comparison_report(const std::string& path, const std::vector<TimingComparison>& comparisons);
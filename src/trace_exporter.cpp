@@ -0,0 +1,302 @@
+#include "trace_exporter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <string.h>
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static std::string escape_json(const char* str)
+{
+    std::string result;
+
+    for (const char* c = str; *c; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            result += '\\';
+
+        result += *c;
+    }
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// Buckets of either sign, past which magnitudes are clamped: up to 1e-6 * 1.01^4096, around 1e12.
+static const int32_t kMaxHistogramBucket = 4096;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void SampleHistogram::add(double value)
+{
+    const double magnitude = std::fabs(value);
+
+    int32_t bucket = 0;
+
+    if (magnitude >= kMinMagnitude)
+    {
+        bucket = 1 + int32_t(std::min(std::floor(std::log(magnitude / kMinMagnitude) / std::log1p(kRelativeError)), double(kMaxHistogramBucket - 1)));
+
+        if (value < 0.0)
+            bucket = -bucket;
+    }
+
+    m_buckets[bucket]++;
+
+    m_min = m_count == 0 ? value : std::min(m_min, value);
+    m_max = m_count == 0 ? value : std::max(m_max, value);
+    m_sum += value;
+    m_count++;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+double SampleHistogram::percentile(double p) const
+{
+    if (m_count == 0)
+        return 0.0;
+
+    const uint64_t rank = std::min(std::max(uint64_t(std::ceil(p * double(m_count))), uint64_t(1)), m_count);
+
+    uint64_t seen = 0;
+
+    for (const auto& pair : m_buckets)
+    {
+        seen += pair.second;
+
+        if (seen < rank)
+            continue;
+
+        if (pair.first == 0)
+            return std::min(std::max(0.0, m_min), m_max);
+
+        // The geometric middle of the bucket, which is within kRelativeError of everything in it.
+        const double magnitude = kMinMagnitude * std::pow(1.0 + kRelativeError, double(std::abs(pair.first)) - 0.5);
+
+        return std::min(std::max(pair.first < 0 ? -magnitude : magnitude, m_min), m_max);
+    }
+
+    return m_max;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TraceExporter::TraceExporter()
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+TraceExporter::~TraceExporter()
+{
+    close();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TraceExporter::open(const std::string& path)
+{
+    close();
+
+    m_file = fopen(path.c_str(), "w");
+
+    if (!m_file)
+        return false;
+
+    m_path        = path;
+    m_first_event = true;
+    m_summary.clear();
+    m_samples.clear();
+
+    fprintf(m_file, "[\n");
+
+    m_running = true;
+    m_thread  = std::thread(&TraceExporter::flush_thread, this);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TraceExporter::close()
+{
+    if (!m_file)
+        return;
+
+    m_running = false;
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // Pick up anything pushed after the thread's last pass.
+    while (drain())
+        ;
+
+    fprintf(m_file, "\n]\n");
+    fclose(m_file);
+    m_file = nullptr;
+
+    write_summary();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t TraceExporter::register_track(const std::string& name)
+{
+    const uint32_t idx = m_track_count.load(std::memory_order_relaxed);
+
+    if (idx == kMaxTracks)
+        return kInvalidTrack;
+
+    m_tracks[idx].name = name;
+    m_tracks[idx].ring = std::unique_ptr<SpscRing<Event, kRingCapacity>>(new SpscRing<Event, kRingCapacity>());
+
+    m_track_count.store(idx + 1, std::memory_order_release);
+
+    return idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TraceExporter::record_scope(uint32_t track, const std::string& name, uint64_t frame, double start_ms, double duration_ms)
+{
+    return push(track, name, EVENT_SCOPE, frame, start_ms, duration_ms);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TraceExporter::record_counter(uint32_t track, const std::string& name, uint64_t frame, double time_ms, double value)
+{
+    return push(track, name, EVENT_COUNTER, frame, time_ms, value);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TraceExporter::push(uint32_t track, const std::string& name, uint32_t type, uint64_t frame, double time_ms, double value)
+{
+    if (!m_running.load(std::memory_order_relaxed) || track >= m_track_count.load(std::memory_order_acquire))
+        return false;
+
+    Event event;
+
+    strncpy(event.name, name.c_str(), sizeof(event.name) - 1);
+    event.name[sizeof(event.name) - 1] = '\0';
+    event.type                         = type;
+    event.frame                        = frame;
+    event.time_ms                      = time_ms;
+    event.value                        = value;
+
+    if (!m_tracks[track].ring->push(event))
+    {
+        // Never stall the render thread on a slow disk, drop the event instead.
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TraceExporter::flush_thread()
+{
+    const uint32_t track_count = m_track_count.load(std::memory_order_acquire);
+
+    for (uint32_t i = 0; i < track_count; i++)
+        fprintf(m_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}", i == 0 ? "" : ",\n", i, escape_json(m_tracks[i].name.c_str()).c_str());
+
+    m_first_event = track_count == 0;
+
+    while (m_running.load(std::memory_order_relaxed))
+    {
+        if (!drain())
+        {
+            fflush(m_file);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool TraceExporter::drain()
+{
+    const uint32_t track_count = m_track_count.load(std::memory_order_acquire);
+    bool           drained     = false;
+    Event          event;
+
+    for (uint32_t i = 0; i < track_count; i++)
+    {
+        while (m_tracks[i].ring->pop(event))
+        {
+            const std::string name = escape_json(event.name);
+
+            if (event.type == EVENT_SCOPE)
+            {
+                fprintf(m_file,
+                        "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"frame\":%llu}}",
+                        m_first_event ? "" : ",\n",
+                        name.c_str(),
+                        escape_json(m_tracks[i].name.c_str()).c_str(),
+                        event.time_ms * 1000.0,
+                        event.value * 1000.0,
+                        i,
+                        (unsigned long long)event.frame);
+            }
+            else
+            {
+                fprintf(m_file,
+                        "%s{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":0,\"tid\":%u,\"args\":{\"value\":%f}}",
+                        m_first_event ? "" : ",\n",
+                        name.c_str(),
+                        event.time_ms * 1000.0,
+                        i,
+                        event.value);
+            }
+
+            m_first_event = false;
+            m_samples[m_tracks[i].name + "/" + event.name].add(event.value);
+            drained = true;
+        }
+    }
+
+    return drained;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void TraceExporter::write_summary()
+{
+    // Sort by name so that summaries of different runs can be diffed.
+    std::map<std::string, SampleHistogram> sorted_samples(m_samples.begin(), m_samples.end());
+    std::stringstream                      stream;
+
+    stream << "scope,count,mean,p50,p95,p99,max" << std::endl;
+
+    for (const auto& pair : sorted_samples)
+    {
+        const SampleHistogram& samples = pair.second;
+
+        stream << pair.first << "," << samples.count() << "," << samples.mean() << "," << samples.percentile(0.5) << "," << samples.percentile(0.95) << "," << samples.percentile(0.99) << "," << samples.max() << std::endl;
+    }
+
+    if (m_dropped > 0)
+        stream << "# dropped events: " << m_dropped << std::endl;
+
+    m_summary = stream.str();
+    m_samples.clear();
+
+    FILE* file = fopen((m_path + ".summary.csv").c_str(), "w");
+
+    if (file)
+    {
+        fputs(m_summary.c_str(), file);
+        fclose(file);
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
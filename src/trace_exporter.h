@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Fixed capacity single-producer/single-consumer queue. push() and pop() never block or allocate.
+template <typename T, size_t N>
+class SpscRing
+{
+public:
+    bool push(const T& item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) % N;
+
+        if (next == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        m_items[head] = item;
+        m_head.store(next, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+        if (tail == m_head.load(std::memory_order_acquire))
+            return false;
+
+        item = m_items[tail];
+        m_tail.store((tail + 1) % N, std::memory_order_release);
+
+        return true;
+    }
+
+private:
+    T                   m_items[N];
+    std::atomic<size_t> m_head { 0 };
+    std::atomic<size_t> m_tail { 0 };
+};
+
+// Summary of a stream of samples in bounded memory: exact count, mean, min and max, and percentiles within
+// kRelativeError of the samples', from logarithmic buckets. The buckets span kMinMagnitude to far beyond any
+// timing or counter, so however many samples are added there are at most a few thousand of them.
+class SampleHistogram
+{
+public:
+    static constexpr double kRelativeError = 0.01;
+    static constexpr double kMinMagnitude  = 1e-6; // Smaller magnitudes count as zero.
+
+    void   add(double value);
+    double percentile(double p) const; // Nearest rank.
+
+    inline uint64_t count() const { return m_count; }
+    inline double   mean() const { return m_count > 0 ? m_sum / double(m_count) : 0.0; }
+    inline double   min() const { return m_min; }
+    inline double   max() const { return m_max; }
+
+private:
+    std::map<int32_t, uint64_t> m_buckets; // Signed, in the order of the values.
+    uint64_t                    m_count = 0;
+    double                      m_sum   = 0.0;
+    double                      m_min   = 0.0;
+    double                      m_max   = 0.0;
+};
+
+// Streams timing scopes and counters to a Chrome trace JSON file (readable by chrome://tracing and Perfetto).
+// Every track is written by a single thread through its own lock-free ring, and a background thread drains
+// the rings into the file. The event array is left unterminated until close() so that a trace cut short by a
+// crash still loads. close() also writes '<path>.summary.csv' with p50/p95/p99 for every scope and counter, from a
+// SampleHistogram per name so that long sessions summarize in constant memory.
+class TraceExporter
+{
+public:
+    static const size_t   kRingCapacity = 8192;
+    static const uint32_t kMaxTracks    = 8;
+    static const uint32_t kInvalidTrack = UINT32_MAX; // Returned once kMaxTracks are registered.
+
+    TraceExporter();
+    ~TraceExporter();
+
+    bool open(const std::string& path);
+    void close();
+
+    // Registers a track and returns its id. Tracks must be registered before open() and each track
+    // must only be written from one thread at a time. Past kMaxTracks the id is kInvalidTrack, whose events are
+    // dropped: sharing a ring with another track would give it a second producer.
+    uint32_t register_track(const std::string& name);
+
+    // Timestamps and durations are in milliseconds. Returns false if the event had to be dropped.
+    bool record_scope(uint32_t track, const std::string& name, uint64_t frame, double start_ms, double duration_ms);
+    bool record_counter(uint32_t track, const std::string& name, uint64_t frame, double time_ms, double value);
+
+    inline bool        is_open() const { return m_file != nullptr; }
+    inline uint64_t    dropped_events() const { return m_dropped.load(std::memory_order_relaxed); }
+    inline std::string summary() const { return m_summary; }
+
+private:
+    enum EventType
+    {
+        EVENT_SCOPE,
+        EVENT_COUNTER
+    };
+
+    struct Event
+    {
+        char     name[48];
+        uint32_t type;
+        uint64_t frame;
+        double   time_ms;
+        double   value; // Duration for scopes.
+    };
+
+    struct Track
+    {
+        std::string                                     name;
+        std::unique_ptr<SpscRing<Event, kRingCapacity>> ring;
+    };
+
+    bool push(uint32_t track, const std::string& name, uint32_t type, uint64_t frame, double time_ms, double value);
+    void flush_thread();
+    bool drain();
+    void write_summary();
+
+private:
+    FILE*                                               m_file = nullptr;
+    std::string                                         m_path;
+    Track                                               m_tracks[kMaxTracks];
+    std::atomic<uint32_t>                               m_track_count { 0 };
+    std::atomic<bool>                                   m_running { false };
+    std::atomic<uint64_t>                               m_dropped { 0 };
+    std::thread                                         m_thread;
+    bool                                                m_first_event = true;
+    std::unordered_map<std::string, SampleHistogram>    m_samples;
+    std::string                                         m_summary;
+};
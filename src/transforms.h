@@ -0,0 +1,67 @@
+#pragma once
+
+#include "cascaded_shadows.h"
+
+#include <glm.hpp>
+
+// Normally provided by the framework, defined here for the tools that build without it.
+#ifndef DW_ALIGNED
+#    if defined(_MSC_VER)
+#        define DW_ALIGNED(x) __declspec(align(x))
+#    else
+#        define DW_ALIGNED(x) __attribute__((aligned(x)))
+#    endif
+#endif
+
+// Uniform buffer data structure. Must match the PerFrameUBO block of the shaders.
+struct Transforms
+{
+    DW_ALIGNED(16)
+    glm::mat4 view_inverse;
+    DW_ALIGNED(16)
+    glm::mat4 proj_inverse;
+    DW_ALIGNED(16)
+    glm::mat4 model;
+    DW_ALIGNED(16)
+    glm::mat4 view;
+    DW_ALIGNED(16)
+    glm::mat4 proj;
+    DW_ALIGNED(16)
+    glm::vec4 cam_pos;
+    DW_ALIGNED(16)
+    glm::vec4 light_dir;
+    DW_ALIGNED(16)
+    glm::mat4 prev_view_proj;
+    DW_ALIGNED(16)
+    glm::vec4 upsample_params; // x: Render scale, y: History blend factor, zw: Sub-pixel jitter in NDC
+    DW_ALIGNED(16)
+    glm::uvec4 ray_stats_params; // x: Counters enabled, y: First counter of this frame's block
+    DW_ALIGNED(16)
+    glm::vec4 soft_shadow_params; // x: Light angular radius in radians (0: Hard shadows), y: Penumbra variance threshold, z: Max penumbra search radius in pixels
+    DW_ALIGNED(16)
+    glm::uvec4 soft_shadow_samples; // x: Extra rays per penumbra pixel, y: Random seed
+    DW_ALIGNED(16)
+    glm::uvec4 light_params; // x: Light count (0: Many lights off), y: First light of this frame's block, z: Initial candidates, w: Spatial neighbours
+    DW_ALIGNED(16)
+    glm::vec4 restir_params; // x: Temporal history cap (0: Off), y: Spatial reuse radius in pixels (0: Off), z: Many lights enabled
+    DW_ALIGNED(16)
+    glm::mat4 cascade_view_proj[kShadowCascadeCount];
+    DW_ALIGNED(16)
+    glm::vec4 cascade_splits; // View space far distance of every cascade
+    DW_ALIGNED(16)
+    glm::vec4 cascade_texel_sizes; // World space size of a shadow map texel in every cascade
+    DW_ALIGNED(16)
+    glm::vec4 cascade_depth_ranges; // World space depth covered by every cascade's projection
+    DW_ALIGNED(16)
+    glm::vec4 csm_params; // x: Hybrid shadows enabled, y: Cascade boundary band, z: Depth ambiguity threshold in texels, w: Contact hardening distance
+    DW_ALIGNED(16)
+    glm::uvec4 visibility_params; // x: Visibility buffer mode, the position G-Buffer target isn't written and is rebuilt from depth
+    DW_ALIGNED(16)
+    glm::uvec4 alpha_test_params; // x: Rays are traced without the opaque flag, y: Alpha tested ray tracing
+    DW_ALIGNED(16)
+    glm::vec4 ray_cone_params; // x: Ray cone texture LOD for reflection hits, y: LOD bias
+    DW_ALIGNED(16)
+    glm::vec4 ssr_params; // x: Screen space reflections first, only their misses trace rays, y: Thickness of the depth buffer in world units, z: Max march iterations
+    DW_ALIGNED(16)
+    glm::uvec4 vt_params; // x: Virtual texturing (bit 0), feedback pixel of the frame (bits 8-15 and 16-23), y, z: Feedback buffer size, w: First element of the frame's feedback
+};
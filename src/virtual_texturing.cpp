@@ -0,0 +1,959 @@
+#include "virtual_texturing.h"
+
+#include <cmath>
+#include <string.h>
+
+static const uint32_t kVtPageFileMagic   = 0x46505456; // 'VTPF'
+static const uint32_t kVtPageFileVersion = 1;
+
+// Frames after an eviction within which uploading the page again counts as thrashing.
+static const uint32_t kVtRefetchWindow = 60;
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+size_t vt_page_bytes()
+{
+    return vt_map_offset(VT_MAP_COUNT);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+size_t vt_map_offset(uint32_t map)
+{
+    size_t offset = 0;
+
+    for (uint32_t i = 0; i < map; i++)
+        offset += size_t(kVtPageSize) * kVtPageSize * kVtMapTexelSize[i];
+
+    return offset;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t VirtualTextureDesc::page_count() const
+{
+    uint32_t count = 0;
+
+    for (uint32_t mip = 0; mip < mip_count; mip++)
+        count += pages_x_at(mip) * pages_y_at(mip);
+
+    return count;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t VirtualTextureDesc::page_index(uint32_t mip, uint32_t x, uint32_t y) const
+{
+    uint32_t index = 0;
+
+    for (uint32_t i = 0; i < mip; i++)
+        index += pages_x_at(i) * pages_y_at(i);
+
+    return index + y * pages_x_at(mip) + x;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static uint32_t page_grid_size(uint32_t texels)
+{
+    uint32_t pages = 1;
+
+    while (pages < kVtMaxPages && pages * kVtPagePayload < texels)
+        pages *= 2;
+
+    return pages;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VirtualTextureDesc describe_virtual_texture(uint32_t width, uint32_t height)
+{
+    VirtualTextureDesc desc;
+
+    desc.pages_x   = page_grid_size(width);
+    desc.pages_y   = page_grid_size(height);
+    desc.mip_count = 1;
+
+    while ((desc.pages_x_at(desc.mip_count - 1) > 1 || desc.pages_y_at(desc.mip_count - 1) > 1) && desc.mip_count < kVtMaxMips)
+        desc.mip_count++;
+
+    return desc;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+// A map with the texel size it has in the pages.
+struct VtMapLevel
+{
+    uint32_t             width;
+    uint32_t             height;
+    uint32_t             channels;
+    std::vector<uint8_t> texels;
+};
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void resample_source(const VtSourceImage& source, uint32_t map, uint32_t width, uint32_t height, VtMapLevel& level)
+{
+    static const uint8_t kDefaults[VT_MAP_COUNT][4] = { { 255, 255, 255, 255 }, { 128, 128, 255, 255 }, { 255, 0, 0, 0 }, { 0, 0, 0, 0 } };
+
+    level.width    = width;
+    level.height   = height;
+    level.channels = kVtMapTexelSize[map];
+    level.texels.resize(size_t(width) * height * level.channels);
+
+    if (source.texels.empty() || source.width == 0 || source.height == 0)
+    {
+        for (size_t i = 0; i < level.texels.size(); i++)
+            level.texels[i] = kDefaults[map][i % level.channels];
+
+        return;
+    }
+
+    // Bilinear, wrapping around like the texture coordinates. A grey source fills every channel, a source
+    // without alpha is opaque.
+    for (uint32_t y = 0; y < height; y++)
+    {
+        const float    sy = (float(y) + 0.5f) * float(source.height) / float(height) - 0.5f;
+        const float    fy = sy - std::floor(sy);
+        const uint32_t y0 = uint32_t(int32_t(std::floor(sy)) + int32_t(source.height)) % source.height;
+        const uint32_t y1 = (y0 + 1) % source.height;
+
+        for (uint32_t x = 0; x < width; x++)
+        {
+            const float    sx = (float(x) + 0.5f) * float(source.width) / float(width) - 0.5f;
+            const float    fx = sx - std::floor(sx);
+            const uint32_t x0 = uint32_t(int32_t(std::floor(sx)) + int32_t(source.width)) % source.width;
+            const uint32_t x1 = (x0 + 1) % source.width;
+
+            for (uint32_t c = 0; c < level.channels; c++)
+            {
+                const uint32_t src_c = std::min(c, source.channels - 1);
+
+                auto fetch = [&](uint32_t tx, uint32_t ty) {
+                    if (c == 3 && source.channels < 4)
+                        return 255.0f;
+
+                    return float(source.texels[(size_t(ty) * source.width + tx) * source.channels + src_c]);
+                };
+
+                const float top    = fetch(x0, y0) + (fetch(x1, y0) - fetch(x0, y0)) * fx;
+                const float bottom = fetch(x0, y1) + (fetch(x1, y1) - fetch(x0, y1)) * fx;
+
+                level.texels[(size_t(y) * width + x) * level.channels + c] = uint8_t(std::min(top + (bottom - top) * fy + 0.5f, 255.0f));
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+static void downsample_level(const VtMapLevel& src, uint32_t width, uint32_t height, VtMapLevel& dst)
+{
+    dst.width    = width;
+    dst.height   = height;
+    dst.channels = src.channels;
+    dst.texels.resize(size_t(width) * height * dst.channels);
+
+    // A dimension that stopped at a single page isn't halved any more.
+    const uint32_t step_x = src.width / width;
+    const uint32_t step_y = src.height / height;
+
+    for (uint32_t y = 0; y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+        {
+            for (uint32_t c = 0; c < dst.channels; c++)
+            {
+                uint32_t sum = 0;
+
+                for (uint32_t j = 0; j < step_y; j++)
+                {
+                    for (uint32_t i = 0; i < step_x; i++)
+                        sum += src.texels[(size_t(y * step_y + j) * src.width + x * step_x + i) * src.channels + c];
+                }
+
+                dst.texels[(size_t(y) * width + x) * dst.channels + c] = uint8_t((sum + step_x * step_y / 2) / (step_x * step_y));
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void build_virtual_texture_pages(const VtSourceImage* maps, const VirtualTextureDesc& desc, std::vector<uint8_t>& pages)
+{
+    const size_t page_bytes = vt_page_bytes();
+
+    pages.resize(size_t(desc.page_count()) * page_bytes);
+
+    for (uint32_t map = 0; map < VT_MAP_COUNT; map++)
+    {
+        const uint32_t texel_size = kVtMapTexelSize[map];
+        const size_t   map_offset = vt_map_offset(map);
+
+        VtMapLevel level;
+
+        resample_source(maps[map], map, desc.pages_x * kVtPagePayload, desc.pages_y * kVtPagePayload, level);
+
+        for (uint32_t mip = 0; mip < desc.mip_count; mip++)
+        {
+            if (mip > 0)
+            {
+                VtMapLevel next;
+                downsample_level(level, desc.pages_x_at(mip) * kVtPagePayload, desc.pages_y_at(mip) * kVtPagePayload, next);
+                level = std::move(next);
+            }
+
+            for (uint32_t page_y = 0; page_y < desc.pages_y_at(mip); page_y++)
+            {
+                for (uint32_t page_x = 0; page_x < desc.pages_x_at(mip); page_x++)
+                {
+                    uint8_t* dst = &pages[size_t(desc.page_index(mip, page_x, page_y)) * page_bytes + map_offset];
+
+                    // The border wraps around the level, like the repeating texture coordinates.
+                    for (uint32_t y = 0; y < kVtPageSize; y++)
+                    {
+                        const uint32_t src_y = (page_y * kVtPagePayload + y + level.height - kVtPageBorder) % level.height;
+
+                        for (uint32_t x = 0; x < kVtPageSize; x++)
+                        {
+                            const uint32_t src_x = (page_x * kVtPagePayload + x + level.width - kVtPageBorder) % level.width;
+
+                            memcpy(&dst[(size_t(y) * kVtPageSize + x) * texel_size], &level.texels[(size_t(src_y) * level.width + src_x) * texel_size], texel_size);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+static void write_value(std::fstream& file, T value)
+{
+    file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+template <typename T>
+static T read_value(std::fstream& file)
+{
+    T value = T(0);
+    file.read(reinterpret_cast<char*>(&value), sizeof(T));
+    return value;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTexturePageFile::create(const std::string& path, std::vector<VirtualTextureDesc>& textures)
+{
+    close();
+
+    m_file.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+
+    if (!m_file.is_open())
+        return false;
+
+    uint64_t first_page = 0;
+
+    for (auto& desc : textures)
+    {
+        desc.first_page = first_page;
+        first_page += desc.page_count();
+    }
+
+    write_value(m_file, kVtPageFileMagic);
+    write_value(m_file, kVtPageFileVersion);
+    write_value(m_file, kVtPagePayload);
+    write_value(m_file, kVtPageBorder);
+    write_value(m_file, uint32_t(textures.size()));
+
+    for (const auto& desc : textures)
+    {
+        write_value(m_file, desc.pages_x);
+        write_value(m_file, desc.pages_y);
+        write_value(m_file, desc.mip_count);
+        write_value(m_file, desc.first_page);
+    }
+
+    m_textures = textures;
+
+    return m_file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTexturePageFile::append(const std::vector<uint8_t>& pages)
+{
+    m_file.write(reinterpret_cast<const char*>(pages.data()), pages.size());
+
+    return m_file.good();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTexturePageFile::open(const std::string& path, uint32_t texture_count)
+{
+    close();
+
+    m_file.open(path, std::ios::in | std::ios::binary);
+
+    if (!m_file.is_open())
+        return false;
+
+    const uint32_t magic   = read_value<uint32_t>(m_file);
+    const uint32_t version = read_value<uint32_t>(m_file);
+    const uint32_t payload = read_value<uint32_t>(m_file);
+    const uint32_t border  = read_value<uint32_t>(m_file);
+    const uint32_t count   = read_value<uint32_t>(m_file);
+
+    if (!m_file.good() || magic != kVtPageFileMagic || version != kVtPageFileVersion || payload != kVtPagePayload || border != kVtPageBorder || count != texture_count)
+    {
+        close();
+        return false;
+    }
+
+    uint64_t page_count = 0;
+
+    m_textures.resize(count);
+
+    for (auto& desc : m_textures)
+    {
+        desc.pages_x    = read_value<uint32_t>(m_file);
+        desc.pages_y    = read_value<uint32_t>(m_file);
+        desc.mip_count  = read_value<uint32_t>(m_file);
+        desc.first_page = read_value<uint64_t>(m_file);
+
+        page_count += desc.page_count();
+    }
+
+    m_data_offset = uint64_t(m_file.tellg());
+
+    // A build that was interrupted leaves the file short.
+    m_file.seekg(0, std::ios::end);
+
+    if (!m_file.good() || uint64_t(m_file.tellg()) != m_data_offset + page_count * vt_page_bytes())
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTexturePageFile::read_page(uint64_t page, uint8_t* dst)
+{
+    const size_t page_bytes = vt_page_bytes();
+
+    m_file.seekg(std::streamoff(m_data_offset + page * page_bytes));
+    m_file.read(reinterpret_cast<char*>(dst), page_bytes);
+
+    if (!m_file.good())
+    {
+        m_file.clear();
+        return false;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTexturePageFile::close()
+{
+    if (m_file.is_open())
+        m_file.close();
+
+    m_file.clear();
+    m_textures.clear();
+    m_data_offset = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureCache::initialize(const std::vector<VirtualTextureDesc>& textures, uint32_t slot_count)
+{
+    m_textures = textures;
+
+    m_slots.clear();
+    m_slots.resize(slot_count);
+    m_free.resize(slot_count);
+    m_lru.clear();
+    m_resident.clear();
+    m_requests.clear();
+    m_stats = VtCacheStats();
+
+    // Hand out the first slots first.
+    for (uint32_t i = 0; i < slot_count; i++)
+        m_free[i] = slot_count - 1 - i;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureCache::analyze(const uint32_t* requests, size_t count, uint64_t frame, std::vector<uint32_t>& missing)
+{
+    m_requests.clear();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint32_t request = requests[i];
+
+        if (request == kVtInvalidPage)
+            continue;
+
+        const VtPage page = unpack_vt_page(request);
+
+        // Texels of a texture that isn't virtual, or cut short by a resize.
+        if (page.texture >= m_textures.size())
+            continue;
+
+        const VirtualTextureDesc& desc = m_textures[page.texture];
+
+        if (page.mip >= desc.mip_count || page.x >= desc.pages_x_at(page.mip) || page.y >= desc.pages_y_at(page.mip))
+            continue;
+
+        m_requests[request]++;
+    }
+
+    m_stats.requested = uint32_t(m_requests.size());
+    m_stats.resident  = 0;
+
+    // Request count of every missing page, ancestors get their descendants' requests as well.
+    std::unordered_map<uint32_t, uint32_t> missing_counts;
+
+    for (const auto& request : m_requests)
+    {
+        uint32_t page = request.first;
+
+        if (m_resident.find(page) != m_resident.end())
+            m_stats.resident++;
+
+        // Up to the page that serves the request, which is used this frame.
+        while (page != kVtInvalidPage)
+        {
+            auto resident = m_resident.find(page);
+
+            if (resident != m_resident.end())
+            {
+                Slot& slot = m_slots[resident->second];
+
+                slot.last_used = frame;
+
+                if (!slot.pinned)
+                    m_lru.splice(m_lru.begin(), m_lru, slot.lru);
+
+                break;
+            }
+
+            missing_counts[page] += request.second;
+            page = parent(page);
+        }
+    }
+
+    missing.clear();
+    missing.reserve(missing_counts.size());
+
+    for (const auto& page : missing_counts)
+        missing.push_back(page.first);
+
+    // An ancestor before its descendants, it serves them all until they arrive.
+    std::sort(missing.begin(), missing.end(), [&](uint32_t a, uint32_t b) {
+        const uint32_t mip_a = unpack_vt_page(a).mip;
+        const uint32_t mip_b = unpack_vt_page(b).mip;
+
+        if (mip_a != mip_b)
+            return mip_a > mip_b;
+
+        const uint32_t count_a = missing_counts[a];
+        const uint32_t count_b = missing_counts[b];
+
+        if (count_a != count_b)
+            return count_a > count_b;
+
+        return a < b;
+    });
+
+    m_stats.missing  = uint32_t(missing.size());
+    m_stats.deferred = 0;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t VirtualTextureCache::insert(uint32_t page, uint64_t frame, bool pinned, uint32_t& evicted)
+{
+    evicted = kVtInvalidPage;
+
+    auto resident = m_resident.find(page);
+
+    if (resident != m_resident.end())
+        return resident->second;
+
+    uint32_t slot_idx = kVtInvalidPage;
+
+    if (!m_free.empty())
+    {
+        slot_idx = m_free.back();
+        m_free.pop_back();
+    }
+    else
+    {
+        // Evicting a page the frame uses would only make it the next request.
+        if (m_lru.empty() || m_slots[m_lru.back()].last_used >= frame)
+        {
+            m_stats.deferred++;
+            return kVtInvalidPage;
+        }
+
+        slot_idx = m_lru.back();
+        m_lru.pop_back();
+
+        evicted = m_slots[slot_idx].page;
+        m_resident.erase(evicted);
+
+        m_stats.evictions++;
+    }
+
+    Slot& slot = m_slots[slot_idx];
+
+    slot.page      = page;
+    slot.last_used = frame;
+    slot.pinned    = pinned;
+
+    if (!pinned)
+    {
+        m_lru.push_front(slot_idx);
+        slot.lru = m_lru.begin();
+    }
+
+    m_resident[page] = slot_idx;
+    m_stats.uploads++;
+
+    return slot_idx;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTextureCache::is_resident(uint32_t page) const
+{
+    return m_resident.find(page) != m_resident.end();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t VirtualTextureCache::serving_mip(uint32_t page) const
+{
+    while (page != kVtInvalidPage)
+    {
+        if (is_resident(page))
+            return unpack_vt_page(page).mip;
+
+        page = parent(page);
+    }
+
+    return kVtInvalidPage;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureCache::indirection(uint32_t texture, uint32_t slots_per_side, std::vector<uint32_t>& entries) const
+{
+    const VirtualTextureDesc& desc = m_textures[texture];
+
+    entries.resize(desc.page_count());
+
+    // Coarse to fine, a page that isn't resident takes the entry of its parent.
+    for (int32_t mip = int32_t(desc.mip_count) - 1; mip >= 0; mip--)
+    {
+        for (uint32_t y = 0; y < desc.pages_y_at(mip); y++)
+        {
+            for (uint32_t x = 0; x < desc.pages_x_at(mip); x++)
+            {
+                auto     resident = m_resident.find(pack_vt_page(texture, mip, x, y));
+                uint32_t entry    = 0;
+
+                if (resident != m_resident.end())
+                    entry = pack_vt_indirection(resident->second % slots_per_side, resident->second / slots_per_side, mip);
+                else if (uint32_t(mip) + 1 < desc.mip_count)
+                    entry = entries[desc.page_index(mip + 1, x / 2, y / 2)];
+
+                entries[desc.page_index(mip, x, y)] = entry;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t VirtualTextureCache::parent(uint32_t page) const
+{
+    const VtPage p = unpack_vt_page(page);
+
+    if (p.mip + 1 >= m_textures[p.texture].mip_count)
+        return kVtInvalidPage;
+
+    return pack_vt_page(p.texture, p.mip + 1, p.x / 2, p.y / 2);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VirtualTextureStreamer::VirtualTextureStreamer(VirtualTexturePageFile* file, uint32_t slots_per_side) :
+    m_file(file), m_slots_per_side(slots_per_side)
+{
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VirtualTextureStreamer::~VirtualTextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_wake.notify_all();
+
+    if (m_thread.joinable())
+        m_thread.join();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTextureStreamer::initialize(VtStreamingBatch& batch)
+{
+    const std::vector<VirtualTextureDesc>& textures = m_file->textures();
+
+    if (textures.size() > slot_count())
+        return false;
+
+    m_cache.initialize(textures, slot_count());
+
+    batch.pages.clear();
+    batch.indirection.clear();
+
+    std::vector<uint32_t> all_textures;
+
+    for (uint32_t texture = 0; texture < textures.size(); texture++)
+    {
+        const VirtualTextureDesc& desc = textures[texture];
+        const uint32_t            mip  = desc.mip_count - 1;
+
+        VtPageUpload upload;
+
+        upload.page = pack_vt_page(texture, mip, 0, 0);
+        upload.texels.resize(vt_page_bytes());
+
+        if (!m_file->read_page(desc.first_page + desc.page_index(mip, 0, 0), upload.texels.data()))
+            return false;
+
+        uint32_t evicted = kVtInvalidPage;
+
+        upload.slot = m_cache.insert(upload.page, 0, true, evicted);
+
+        batch.pages.push_back(std::move(upload));
+        all_textures.push_back(texture);
+    }
+
+    update_indirection(all_textures, batch);
+
+    m_stats          = m_cache.stats();
+    m_resident_count = m_cache.resident_count();
+    m_thread         = std::thread(&VirtualTextureStreamer::thread_main, this);
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureStreamer::submit_feedback(const uint32_t* requests, size_t count, uint64_t frame)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_feedback.assign(requests, requests + count);
+        m_feedback_frame = frame;
+        m_has_feedback   = true;
+    }
+
+    m_wake.notify_one();
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+bool VirtualTextureStreamer::take_batch(VtStreamingBatch& batch)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (!m_has_batch)
+            return false;
+
+        batch       = std::move(m_batch);
+        m_has_batch = false;
+    }
+
+    m_wake.notify_one();
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureStreamer::set_settings(const VirtualTextureSettings& settings)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_settings = settings;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VirtualTextureSettings VirtualTextureStreamer::settings()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_settings;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VtCacheStats VirtualTextureStreamer::stats()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+uint32_t VirtualTextureStreamer::resident_count()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_resident_count;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureStreamer::thread_main()
+{
+    std::vector<uint32_t> feedback;
+    VtStreamingBatch      batch;
+
+    while (true)
+    {
+        uint64_t frame       = 0;
+        uint32_t max_uploads = 0;
+
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+
+            m_wake.wait(lock, [this]() { return m_quit || (m_has_feedback && !m_has_batch); });
+
+            if (m_quit)
+                break;
+
+            feedback.swap(m_feedback);
+            frame          = m_feedback_frame;
+            max_uploads    = m_settings.max_uploads;
+            m_has_feedback = false;
+        }
+
+        batch.pages.clear();
+        batch.indirection.clear();
+
+        stream(feedback, frame, max_uploads, batch);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            m_stats          = m_cache.stats();
+            m_resident_count = m_cache.resident_count();
+
+            if (!batch.pages.empty())
+            {
+                m_batch     = std::move(batch);
+                m_has_batch = true;
+            }
+        }
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureStreamer::stream(const std::vector<uint32_t>& feedback, uint64_t frame, uint32_t max_uploads, VtStreamingBatch& batch)
+{
+    std::vector<uint32_t> missing;
+
+    m_cache.analyze(feedback.data(), feedback.size(), frame, missing);
+
+    std::vector<uint32_t> dirty;
+
+    for (uint32_t page : missing)
+    {
+        if (batch.pages.size() >= max_uploads)
+            break;
+
+        const VtPage              p    = unpack_vt_page(page);
+        const VirtualTextureDesc& desc = m_file->textures()[p.texture];
+
+        VtPageUpload upload;
+
+        upload.page = page;
+        upload.texels.resize(vt_page_bytes());
+
+        if (!m_file->read_page(desc.first_page + desc.page_index(p.mip, p.x, p.y), upload.texels.data()))
+            continue;
+
+        uint32_t evicted = kVtInvalidPage;
+
+        upload.slot = m_cache.insert(page, frame, false, evicted);
+
+        // Every slot is used this frame, the rest of the pages wait.
+        if (upload.slot == kVtInvalidPage)
+            break;
+
+        dirty.push_back(p.texture);
+
+        if (evicted != kVtInvalidPage)
+            dirty.push_back(unpack_vt_page(evicted).texture);
+
+        batch.pages.push_back(std::move(upload));
+    }
+
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+
+    update_indirection(dirty, batch);
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+void VirtualTextureStreamer::update_indirection(const std::vector<uint32_t>& textures, VtStreamingBatch& batch)
+{
+    for (uint32_t texture : textures)
+    {
+        VtIndirectionUpdate update;
+
+        update.texture = texture;
+        m_cache.indirection(texture, m_slots_per_side, update.entries);
+
+        batch.indirection.push_back(std::move(update));
+    }
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
+
+VtSimulationStats simulate_virtual_texturing(const VtSimulationSettings& settings)
+{
+    VtSimulationStats stats;
+
+    const VirtualTextureDesc        desc = describe_virtual_texture(settings.pages * kVtPagePayload, settings.pages * kVtPagePayload);
+    std::vector<VirtualTextureDesc> textures(settings.textures, desc);
+
+    VirtualTextureCache cache;
+
+    cache.initialize(textures, settings.slots);
+
+    // The pinned last mips, like VirtualTextureStreamer::initialize().
+    for (uint32_t texture = 0; texture < settings.textures; texture++)
+    {
+        uint32_t evicted = kVtInvalidPage;
+        cache.insert(pack_vt_page(texture, desc.mip_count - 1, 0, 0), 0, true, evicted);
+    }
+
+    // The textures tile a square wall, one unit per texture.
+    const uint32_t columns = uint32_t(std::ceil(std::sqrt(float(settings.textures))));
+    const float    aspect  = float(settings.feedback_width) / float(settings.feedback_height);
+    const float    texels  = float(desc.pages_x * kVtPagePayload);
+
+    std::vector<uint32_t>                  requests(size_t(settings.feedback_width) * settings.feedback_height);
+    std::vector<uint32_t>                  missing;
+    std::unordered_map<uint32_t, uint64_t> evicted_at;
+
+    for (uint32_t frame = 1; frame <= settings.frames; frame++)
+    {
+        // Pans across the wall and zooms from a few textures to a fraction of one in view.
+        const float t        = float(frame) / 60.0f;
+        const float center_x = float(columns) * (0.5f + 0.4f * std::sin(t * 0.7f));
+        const float center_y = float(columns) * (0.5f + 0.4f * std::cos(t * 0.5f));
+        const float height   = 1.65f + 1.35f * std::sin(t * 0.23f);
+
+        // Texels of mip 0 a pixel covers.
+        const float    footprint = height * texels / float(settings.feedback_height * kVtFeedbackScale);
+        const uint32_t mip       = std::min(uint32_t(std::max(std::log2(footprint), 0.0f)), desc.mip_count - 1);
+
+        for (uint32_t y = 0; y < settings.feedback_height; y++)
+        {
+            for (uint32_t x = 0; x < settings.feedback_width; x++)
+            {
+                const float wx = center_x + ((float(x) + 0.5f) / float(settings.feedback_width) - 0.5f) * height * aspect;
+                const float wy = center_y + ((float(y) + 0.5f) / float(settings.feedback_height) - 0.5f) * height;
+
+                uint32_t& request = requests[size_t(y) * settings.feedback_width + x];
+
+                request = kVtInvalidPage;
+
+                if (wx < 0.0f || wy < 0.0f || wx >= float(columns) || wy >= float(columns))
+                    continue;
+
+                const uint32_t texture = uint32_t(wy) * columns + uint32_t(wx);
+
+                if (texture >= settings.textures)
+                    continue;
+
+                const uint32_t page_x = std::min(uint32_t((wx - std::floor(wx)) * float(desc.pages_x_at(mip))), desc.pages_x_at(mip) - 1);
+                const uint32_t page_y = std::min(uint32_t((wy - std::floor(wy)) * float(desc.pages_y_at(mip))), desc.pages_y_at(mip) - 1);
+
+                request = pack_vt_page(texture, mip, page_x, page_y);
+
+                // What the frame shows with the cache as the last frame left it.
+                const uint32_t served = cache.serving_mip(request);
+
+                stats.requests++;
+
+                if (served == mip)
+                    stats.exact++;
+                else
+                    stats.mip_error += served - mip;
+            }
+        }
+
+        // The streamer's part of the loop.
+        cache.analyze(requests.data(), requests.size(), frame, missing);
+
+        uint32_t uploads = 0;
+
+        for (uint32_t page : missing)
+        {
+            if (uploads >= settings.max_uploads)
+                break;
+
+            uint32_t evicted = kVtInvalidPage;
+
+            if (cache.insert(page, frame, false, evicted) == kVtInvalidPage)
+                break;
+
+            uploads++;
+
+            auto previous = evicted_at.find(page);
+
+            if (previous != evicted_at.end() && frame - previous->second <= kVtRefetchWindow)
+                stats.refetches++;
+
+            if (evicted != kVtInvalidPage)
+            {
+                evicted_at[evicted] = frame;
+                stats.evictions++;
+            }
+        }
+
+        stats.uploads += uploads;
+        stats.deferred += cache.stats().deferred;
+    }
+
+    return stats;
+}
+
+// -----------------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Virtual textures are cut into pages of kVtPagePayload texels per side, stored with a border of kVtPageBorder
+// texels taken from the neighbouring pages so that bilinear filtering never reads the next slot of the physical
+// cache.
+static const uint32_t kVtPagePayload = 128;
+static const uint32_t kVtPageBorder  = 4;
+static const uint32_t kVtPageSize    = kVtPagePayload + 2 * kVtPageBorder;
+
+// Pages per side of mip 0 of the largest virtual texture, 8192 texels, which sizes the indirection texture.
+static const uint32_t kVtMaxPages = 64;
+static const uint32_t kVtMaxMips  = 7;
+
+// Pixels per side of a texel of the feedback buffer.
+static const uint32_t kVtFeedbackScale = 16;
+
+static const uint32_t kVtInvalidPage = 0xffffffff;
+
+enum VirtualTextureMap
+{
+    VT_MAP_ALBEDO,
+    VT_MAP_NORMAL,
+    VT_MAP_ROUGHNESS,
+    VT_MAP_METALLIC,
+    VT_MAP_COUNT
+};
+
+// Bytes per texel of every map, in the page file and the physical caches: RGBA albedo and normal, single
+// channel roughness and metallic.
+static const uint32_t kVtMapTexelSize[VT_MAP_COUNT] = { 4, 4, 1, 1 };
+
+// A page of all four maps, one after the other.
+size_t vt_page_bytes();
+size_t vt_map_offset(uint32_t map);
+
+// Page address, packed like the requests of the feedback buffer in virtual_texture.glsl: the texture in the
+// top 12 bits, then the mip, x and y of the page in 4, 8 and 8 bits.
+struct VtPage
+{
+    uint32_t texture;
+    uint32_t mip;
+    uint32_t x;
+    uint32_t y;
+};
+
+inline uint32_t pack_vt_page(uint32_t texture, uint32_t mip, uint32_t x, uint32_t y) { return (texture << 20) | (mip << 16) | (x << 8) | y; }
+
+inline VtPage unpack_vt_page(uint32_t page) { return { page >> 20, (page >> 16) & 15, (page >> 8) & 255, page & 255 }; }
+
+// Entry of the indirection texture: the slot of the resident page that serves a virtual page, which is the page
+// itself or its closest resident ancestor, and that page's mip. Zero when nothing serves it.
+inline uint32_t pack_vt_indirection(uint32_t slot_x, uint32_t slot_y, uint32_t mip) { return slot_x | (slot_y << 8) | (mip << 16) | (1u << 24); }
+
+struct VirtualTextureDesc
+{
+    uint32_t pages_x    = 1; // Of mip 0, powers of two.
+    uint32_t pages_y    = 1;
+    uint32_t mip_count  = 1; // Down to the mip that fits a single page.
+    uint64_t first_page = 0; // Of the texture in the page file.
+
+    inline uint32_t pages_x_at(uint32_t mip) const { return std::max(pages_x >> mip, 1u); }
+    inline uint32_t pages_y_at(uint32_t mip) const { return std::max(pages_y >> mip, 1u); }
+
+    // Pages of every mip, one mip after the other starting at mip 0.
+    uint32_t page_count() const;
+    uint32_t page_index(uint32_t mip, uint32_t x, uint32_t y) const;
+};
+
+// The smallest power of two page grid that holds a 'width' x 'height' texture, at most kVtMaxPages per side.
+VirtualTextureDesc describe_virtual_texture(uint32_t width, uint32_t height);
+
+// A source map with 'channels' 8 bit channels per texel, empty if the material doesn't have it.
+struct VtSourceImage
+{
+    uint32_t             width    = 0;
+    uint32_t             height   = 0;
+    uint32_t             channels = 0;
+    std::vector<uint8_t> texels;
+};
+
+// Cuts the four maps of a material into the pages of 'desc', in page file order. The maps are resampled to the
+// size of mip 0 and box filtered down the mips, the borders wrap around like the repeating texture coordinates.
+// Missing maps are constant: white albedo, a flat normal, fully rough and not metallic.
+void build_virtual_texture_pages(const VtSourceImage* maps, const VirtualTextureDesc& desc, std::vector<uint8_t>& pages);
+
+// The pages of every virtual texture in one file, built once from the scene's textures: a header, the descs of
+// the textures, then the pages.
+class VirtualTexturePageFile
+{
+public:
+    // Writes the header and the descs, the pages of every texture follow through append() in order.
+    bool create(const std::string& path, std::vector<VirtualTextureDesc>& textures);
+    bool append(const std::vector<uint8_t>& pages);
+
+    // Fails on files written for other page sizes, another texture count or cut short.
+    bool open(const std::string& path, uint32_t texture_count);
+    bool read_page(uint64_t page, uint8_t* dst);
+    void close();
+
+    inline bool                                   is_open() const { return m_file.is_open(); }
+    inline const std::vector<VirtualTextureDesc>& textures() const { return m_textures; }
+
+private:
+    std::fstream                    m_file;
+    std::vector<VirtualTextureDesc> m_textures;
+    uint64_t                        m_data_offset = 0;
+};
+
+struct VtCacheStats
+{
+    uint32_t requested = 0; // Distinct pages of the last feedback.
+    uint32_t resident  = 0; // Of those, already resident.
+    uint32_t missing   = 0; // Including missing ancestors.
+    uint32_t deferred  = 0; // Missing pages left for later, every slot was used this frame.
+    uint64_t uploads   = 0;
+    uint64_t evictions = 0;
+};
+
+// Which pages the physical cache of 'slot_count' pages holds. Pages the feedback asks for count as used that
+// frame, along with their resident ancestors, which serve them until they arrive. When the cache is full the
+// page used least recently is evicted, unless it was used this frame: the working set then doesn't fit and
+// evicting would only trade one visible page for another, so the request waits and is served by its ancestor.
+class VirtualTextureCache
+{
+public:
+    void initialize(const std::vector<VirtualTextureDesc>& textures, uint32_t slot_count);
+
+    // The distinct pages of 'requests' that aren't resident and their missing ancestors, most urgent first:
+    // coarser mips, then the most requested.
+    void analyze(const uint32_t* requests, size_t count, uint64_t frame, std::vector<uint32_t>& missing);
+
+    // Makes 'page' resident and returns its slot, kVtInvalidPage if every slot was used this frame. 'evicted'
+    // is the page whose slot it took, kVtInvalidPage for a free one. Pinned pages are never evicted.
+    uint32_t insert(uint32_t page, uint64_t frame, bool pinned, uint32_t& evicted);
+
+    bool is_resident(uint32_t page) const;
+
+    // Mip of the page that serves 'page', its closest resident ancestor, or kVtInvalidPage.
+    uint32_t serving_mip(uint32_t page) const;
+
+    // Indirection of a texture with its physical cache 'slots_per_side' slots wide: every mip one after the other,
+    // pages_x_at(mip) * pages_y_at(mip) entries each.
+    void indirection(uint32_t texture, uint32_t slots_per_side, std::vector<uint32_t>& entries) const;
+
+    inline const VtCacheStats& stats() const { return m_stats; }
+    inline uint32_t            slot_count() const { return uint32_t(m_slots.size()); }
+    inline uint32_t            resident_count() const { return uint32_t(m_resident.size()); }
+
+private:
+    uint32_t parent(uint32_t page) const;
+
+private:
+    struct Slot
+    {
+        uint32_t                      page      = kVtInvalidPage;
+        uint64_t                      last_used = 0;
+        bool                          pinned    = false;
+        std::list<uint32_t>::iterator lru;
+    };
+
+    std::vector<VirtualTextureDesc>        m_textures;
+    std::vector<Slot>                      m_slots;
+    std::vector<uint32_t>                  m_free;
+    std::list<uint32_t>                    m_lru; // Unpinned occupied slots, most recently used first.
+    std::unordered_map<uint32_t, uint32_t> m_resident; // Page to slot.
+    std::unordered_map<uint32_t, uint32_t> m_requests; // Page to request count, of the last feedback.
+    VtCacheStats                           m_stats;
+};
+
+// A page read from the page file, to be copied into its slot of the physical caches.
+struct VtPageUpload
+{
+    uint32_t             page;
+    uint32_t             slot;
+    std::vector<uint8_t> texels;
+};
+
+struct VtIndirectionUpdate
+{
+    uint32_t              texture;
+    std::vector<uint32_t> entries;
+};
+
+// The pages and the new indirection of every texture whose residency changed. The indirection points at the new
+// pages' slots, so both have to reach the GPU in the same submission.
+struct VtStreamingBatch
+{
+    std::vector<VtPageUpload>        pages;
+    std::vector<VtIndirectionUpdate> indirection;
+};
+
+struct VirtualTextureSettings
+{
+    uint32_t max_uploads = 16; // Pages read and uploaded per frame.
+};
+
+// Analyzes the feedback and reads the missing pages from the page file on a thread of its own, so that neither
+// the analysis nor the disk stall the render thread. The render thread hands it the feedback of every completed
+// frame and applies the batches it produces. A batch waits until it is taken, which bounds it to max_uploads
+// pages.
+class VirtualTextureStreamer
+{
+public:
+    VirtualTextureStreamer(VirtualTexturePageFile* file, uint32_t slots_per_side);
+    ~VirtualTextureStreamer();
+
+    // Makes the last mip of every texture resident for good, so every lookup finds a page, and returns it as the
+    // first batch. Starts the thread.
+    bool initialize(VtStreamingBatch& batch);
+
+    // Replaces the feedback the thread hasn't picked up yet.
+    void submit_feedback(const uint32_t* requests, size_t count, uint64_t frame);
+
+    bool take_batch(VtStreamingBatch& batch);
+
+    void                   set_settings(const VirtualTextureSettings& settings);
+    VirtualTextureSettings settings();
+    VtCacheStats           stats();
+    uint32_t               resident_count();
+
+    inline uint32_t slot_count() const { return m_slots_per_side * m_slots_per_side; }
+
+private:
+    void thread_main();
+    void stream(const std::vector<uint32_t>& feedback, uint64_t frame, uint32_t max_uploads, VtStreamingBatch& batch);
+    void update_indirection(const std::vector<uint32_t>& textures, VtStreamingBatch& batch);
+
+private:
+    VirtualTexturePageFile* m_file;
+    uint32_t                m_slots_per_side;
+    VirtualTextureCache     m_cache;
+    VirtualTextureSettings  m_settings;
+    VtCacheStats            m_stats;
+    uint32_t                m_resident_count = 0;
+    std::vector<uint32_t>   m_feedback;
+    uint64_t                m_feedback_frame = 0;
+    bool                    m_has_feedback   = false;
+    VtStreamingBatch        m_batch;
+    bool                    m_has_batch = false;
+    bool                    m_quit      = false;
+    std::mutex              m_mutex;
+    std::condition_variable m_wake;
+    std::thread             m_thread;
+};
+
+struct VtSimulationSettings
+{
+    uint32_t textures        = 32;
+    uint32_t pages           = 32; // Per side of mip 0 of every texture.
+    uint32_t slots           = 1024;
+    uint32_t frames          = 600;
+    uint32_t max_uploads     = 16;
+    uint32_t feedback_width  = 120; // A 1920x1080 frame.
+    uint32_t feedback_height = 68;
+};
+
+struct VtSimulationStats
+{
+    uint64_t requests   = 0; // Feedback texels.
+    uint64_t exact      = 0; // Served at the requested mip.
+    uint64_t mip_error  = 0; // Sum over the requests of how many mips coarser they were served.
+    uint64_t uploads    = 0;
+    uint64_t evictions  = 0;
+    uint64_t refetches  = 0; // Uploads of pages evicted in the last 60 frames, the cache thrashing.
+    uint64_t deferred   = 0; // Missing pages left for a later frame because every slot was in use.
+};
+
+// The feedback, analysis and eviction loop of the streamer without a GPU or a page file. A camera pans across a
+// wall of 'textures' virtual textures and zooms in and out, every feedback texel requests the page under it at
+// the mip its footprint asks for, and up to 'max_uploads' missing pages are made resident after each frame.
+VtSimulationStats simulate_virtual_texturing(const VtSimulationSettings& settings);